@@ -1,17 +1,30 @@
 UNIT_TEST_OBJS := \
+	src/unit_test/ares/admin_service.o \
+	src/unit_test/ares/admission_control.o \
 	src/unit_test/ares/bin_util.o \
 	src/unit_test/ares/bytes.o \
+	src/unit_test/ares/command_queue.o \
+	src/unit_test/ares/command_timer.o \
 	src/unit_test/ares/date.o \
 	src/unit_test/ares/date_util.o \
+	src/unit_test/ares/dispatcher.o \
 	src/unit_test/ares/hashtable.o \
+	src/unit_test/ares/io_uring.o \
+	src/unit_test/ares/line_reader.o \
+	src/unit_test/ares/lz_codec.o \
 	src/unit_test/ares/main.o \
 	src/unit_test/ares/message_reader.o \
+	src/unit_test/ares/message_schema.o \
 	src/unit_test/ares/message_writer.o \
+	src/unit_test/ares/metrics.o \
+	src/unit_test/ares/processor_scaler.o \
 	src/unit_test/ares/queue_sink.o \
 	src/unit_test/ares/string_tokenizer.o \
 	src/unit_test/ares/string_util.o \
 	src/unit_test/ares/sync_queue.o \
-	src/unit_test/ares/test_sink.o
+	src/unit_test/ares/test_sink.o \
+	src/unit_test/ares/thread.o \
+	src/unit_test/ares/traffic_capture.o
 
 test: bin/run_unit_tests
 	./bin/run_unit_tests
@@ -0,0 +1,551 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/admin_service.hpp"
+#include "ares/buffer.hpp"
+#include "ares/error.hpp"
+#include "ares/http/error.hpp"
+#include "ares/http/request.hpp"
+#include "ares/http/request_parser.hpp"
+#include "ares/log.hpp"
+#include "ares/platform.hpp"
+#include "ares/server.hpp"
+#include "ares/socket.hpp"
+#include "ares/string_util.hpp"
+#include <memory>
+#include <poll.h>
+#include <set>
+
+using namespace std;
+using ares::Admin_strategy;
+using ares::Histogram_snapshot;
+using ares::Int64;
+using ares::Socket;
+using ares::http::Client_error;
+using ares::http::Codes;
+
+namespace
+{
+enum {
+    MAX_REQUEST_SIZE = 8192,    // bytes of request headers accepted
+    TIMEOUT = 2000              // milliseconds allowed to read or write
+};
+
+// Waits until a socket is ready for the events given, or until a deadline
+// (a reading of monotonic_micros) passes. Returns false on timeout.
+bool wait_for(Socket& socket, short events, Int64 deadline)
+{
+    int const millis = int((deadline - ares::monotonic_micros())/1000);
+    if (millis <= 0)
+        return false;
+    struct pollfd pfd;
+    pfd.fd = socket.handle();
+    pfd.events = events;
+    pfd.revents = 0;
+    return poll(&pfd, 1, millis) > 0;
+}
+
+// Reads a request from a socket. Returns null if the peer closes the
+// connection or does not send a complete request in time.
+ares::http::Request* read_request(Socket& socket)
+{
+    Int64 const deadline = ares::monotonic_micros() + TIMEOUT*1000;
+    ares::Buffer input(MAX_REQUEST_SIZE);
+    ares::http::Request_parser parser;
+    socket.set_blocking(false);
+
+    while (!parser.add_input(input)) {
+        if (input.free() == 0)
+            throw Client_error(Codes::REQUEST_ENTITY_TOO_LARGE);
+        if (!wait_for(socket, POLLIN, deadline) || socket.read(input) < 0)
+            return 0;
+    }
+    return parser.make_request();
+}
+
+// Writes a complete response to a socket, giving up if the peer does not
+// accept it in time.
+void write_response(Socket& socket, int status, string const& content_type,
+                    string const& body, bool is_head)
+{
+    Int64 const deadline = ares::monotonic_micros() + TIMEOUT*1000;
+    string response = ares::format(
+        "HTTP/1.0 %d %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+        "Connection: close\r\n\r\n", status,
+        ares::http::status_code_to_string(status).c_str(),
+        content_type.c_str(), int(body.size()));
+    if (!is_head)
+        response += body;
+
+    ares::Byte const* p = reinterpret_cast<ares::Byte const*>(
+        response.data());
+    int sent = 0;
+    while (sent < int(response.size())) {
+        int n = socket.try_write(p + sent, response.size() - sent);
+        if (n < 0)
+            return;
+        sent += n;
+        if (n == 0 && !wait_for(socket, POLLOUT, deadline)) {
+            ares::Log::writef(ares::Log::DEBUG, "admin: timed out writing "
+                              "to %s", socket.to_string().c_str());
+            return;
+        }
+    }
+}
+
+// Returns s as a quoted JSON string.
+string quote(string const& s)
+{
+    string q = "\"";
+    for (int i = 0; i < int(s.size()); i++) {
+        unsigned char const c = s[i];
+        if (c == '"' || c == '\\')
+            (q += '\\') += c;
+        else if (c < 0x20)
+            q += ares::format("\\u%04x", c);
+        else
+            q += c;
+    }
+    return q += '"';
+}
+
+string to_json(Int64 n)
+{
+    return ares::format("%lld", static_cast<long long>(n));
+}
+
+string to_json(bool b)
+{
+    return b ? "true" : "false";
+}
+
+string to_json(Histogram_snapshot const& h)
+{
+    return ares::format(
+        "{\"count\": %lld, \"mean\": %.1f, \"p50\": %lld, \"p90\": %lld, "
+        "\"p99\": %lld, \"p999\": %lld, \"max\": %lld}",
+        static_cast<long long>(h.count()), h.mean(),
+        static_cast<long long>(h.percentile(50)),
+        static_cast<long long>(h.percentile(90)),
+        static_cast<long long>(h.percentile(99)),
+        static_cast<long long>(h.percentile(99.9)),
+        static_cast<long long>(h.max()));
+}
+
+// Builds a JSON object one member at a time. The value passed to put must
+// already be in JSON form.
+class Json_object {
+  public:
+    Json_object(string& s, char const* indent = "")
+            : m_s(s)
+            , m_indent(indent)
+            , m_is_empty(true)
+    {
+        m_s += '{';
+    }
+
+    void put(char const* name, string const& value)
+    {
+        m_s += m_is_empty ? "\n" : ",\n";
+        m_s += m_indent;
+        m_s += ares::format("  \"%s\": ", name);
+        m_s += value;
+        m_is_empty = false;
+    }
+
+    void close()
+    {
+        m_s += '\n';
+        m_s += m_indent;
+        m_s += '}';
+    }
+
+  private:
+    string& m_s;
+    char const* m_indent;
+    bool m_is_empty;
+};
+
+// Appends the TYPE line of a Prometheus metric family.
+void put_type(string& s, char const* name, char const* type)
+{
+    s += ares::format("# TYPE ares_%s %s\n", name, type);
+}
+
+// Appends a Prometheus counter or gauge.
+void put_metric(string& s, char const* name, char const* type, Int64 n)
+{
+    put_type(s, name, type);
+    s += ares::format("ares_%s %lld\n", name, static_cast<long long>(n));
+}
+
+// Appends the samples of a Prometheus summary of a latency distribution, in
+// seconds. labels is empty, or holds labels (and a trailing comma) that
+// tell the summary apart from others of the same family.
+void put_quantiles(string& s, char const* name, string const& labels,
+                   Histogram_snapshot const& h)
+{
+    static double const QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    for (int i = 0; i < int(sizeof(QUANTILES)/sizeof(QUANTILES[0])); i++) {
+        s += ares::format("ares_%s{%squantile=\"%g\"} %.6f\n", name,
+                          labels.c_str(), QUANTILES[i],
+                          h.percentile(100*QUANTILES[i])/1e6);
+    }
+    string const braced = labels.empty()
+            ? labels : "{" + labels.substr(0, labels.size() - 1) + "}";
+    s += ares::format("ares_%s_sum%s %.6f\n", name, braced.c_str(),
+                      h.sum()/1e6);
+    s += ares::format("ares_%s_count%s %lld\n", name, braced.c_str(),
+                      static_cast<long long>(h.count()));
+}
+
+// Appends a latency distribution as a Prometheus summary.
+void put_summary(string& s, char const* name, Histogram_snapshot const& h)
+{
+    put_type(s, name, "summary");
+    put_quantiles(s, name, "", h);
+}
+
+// Appends a latency distribution for each type of command.
+void put_command_summaries(
+    string& s, char const* name,
+    vector<ares::Command_statistics> const& commands,
+    Histogram_snapshot ares::Command_statistics::*latency)
+{
+    put_type(s, name, "summary");
+    for (int i = 0; i < int(commands.size()); i++) {
+        string const labels = "command=" + quote(commands[i].m_name) + ",";
+        put_quantiles(s, name, labels, commands[i].*latency);
+    }
+}
+}
+
+Admin_strategy::Admin_strategy(Server& server)
+        : m_server(server)
+{}
+
+void Admin_strategy::handle_connection(Server_interface&, Socket* socket)
+{
+    auto_ptr<Socket> owner(socket);
+    int status = Codes::OK;
+    string content_type;
+    string body;
+    bool is_head = false;
+
+    try {
+        auto_ptr<http::Request> request(read_request(*socket));
+        if (!request.get())
+            return;
+        is_head = request->method() == http::METHOD_HEAD;
+        if (request->method() != http::METHOD_GET && !is_head)
+            throw Client_error(Codes::METHOD_NOT_ALLOWED);
+
+        string const& uri = request->uri();
+        body = render(uri.substr(0, uri.find('?')), content_type);
+    }
+    catch (http::Error& e) {
+        status = e.code();
+        content_type = "text/plain";
+        body = http::status_code_to_string(status) + "\n";
+    }
+    catch (Network_error& e) {
+        Log::writef(Log::DEBUG, "admin: error reading from %s: %s",
+                    socket->to_string().c_str(), e.to_string().c_str());
+        return;
+    }
+    catch (Exception& e) {
+        Log::writef(Log::WARNING, "admin: error serving %s: %s",
+                    socket->to_string().c_str(), e.to_string().c_str());
+        status = Codes::INTERNAL_SERVER_ERROR;
+        content_type = "text/plain";
+        body = http::status_code_to_string(status) + "\n";
+    }
+
+    try {
+        write_response(*socket, status, content_type, body, is_head);
+    }
+    catch (Network_error& e) {
+        Log::writef(Log::DEBUG, "admin: error writing to %s: %s",
+                    socket->to_string().c_str(), e.to_string().c_str());
+    }
+}
+
+string Admin_strategy::render(string const& path, string& content_type)
+{
+    content_type = "application/json";
+    if (path == "/metrics") {
+        content_type = "text/plain; version=0.0.4";
+        return statistics_to_prometheus(m_server.totals());
+    }
+    if (path == "/stats")
+        return statistics_to_json(m_server.totals());
+    if (path == "/jobs") {
+        vector<job::Job_info> jobs;
+        m_server.scheduler().jobs(jobs);
+        return jobs_to_json(jobs);
+    }
+    if (path == "/sessions") {
+        vector<Session> sessions;
+        m_server.sessions(sessions);
+        return sessions_to_json(sessions);
+    }
+    throw Client_error(Codes::NOT_FOUND);
+}
+
+string ares::statistics_to_prometheus(Server_statistics const& stats)
+{
+    string s;
+    put_metric(s, "uptime_seconds", "gauge", stats.m_elapsed_sec);
+
+    put_metric(s, "receiver_sessions", "gauge", stats.m_sessions_snap);
+    put_metric(s, "receiver_queued_updates", "gauge",
+               stats.m_queued_updates_snap);
+    put_metric(s, "receiver_events_total", "counter", stats.m_events);
+    put_metric(s, "receiver_reads_total", "counter", stats.m_reads);
+    put_metric(s, "receiver_read_bytes_total", "counter",
+               stats.m_bytes_read);
+    put_metric(s, "receiver_buffer_grows_total", "counter",
+               stats.m_buffer_grows);
+    put_metric(s, "receiver_buffer_shrinks_total", "counter",
+               stats.m_buffer_shrinks);
+    put_metric(s, "receiver_attached_buffers", "gauge",
+               stats.m_attached_buffers_snap);
+    put_metric(s, "receiver_pooled_buffers", "gauge",
+               stats.m_pooled_buffers_snap);
+    put_summary(s, "receiver_input_latency_seconds", stats.m_input_latency);
+
+    put_metric(s, "dispatcher_sessions", "gauge",
+               stats.m_output_sessions_snap);
+    put_metric(s, "dispatcher_queued_dispatches", "gauge",
+               stats.m_queued_dispatches_snap);
+    put_metric(s, "dispatcher_buffers", "gauge", stats.m_output_buffers_snap);
+    put_metric(s, "dispatcher_buffered_bytes", "gauge",
+               stats.m_output_bytes_snap);
+    put_metric(s, "dispatcher_writes_total", "counter", stats.m_writes);
+    put_metric(s, "dispatcher_zero_writes_total", "counter",
+               stats.m_zero_writes);
+    put_metric(s, "dispatcher_sent_bytes_total", "counter",
+               stats.m_bytes_sent);
+    put_metric(s, "dispatcher_buffers_added_total", "counter",
+               stats.m_buffers_added);
+    put_metric(s, "dispatcher_buffers_sent_total", "counter",
+               stats.m_buffers_sent);
+    put_metric(s, "dispatcher_blocked_sends_total", "counter",
+               stats.m_blocked_sends);
+    put_metric(s, "dispatcher_dropped_buffers_total", "counter",
+               stats.m_dropped_buffers);
+    put_metric(s, "dispatcher_disconnects_total", "counter",
+               stats.m_disconnects);
+    put_summary(s, "dispatcher_flush_latency_seconds", stats.m_flush_latency);
+
+    put_type(s, "processor_commands_executed_total", "counter");
+    for (int i = 0; i < int(stats.m_commands_executed.size()); i++) {
+        s += format("ares_processor_commands_executed_total"
+                    "{processor=\"%d\"} %lld\n", i,
+                    static_cast<long long>(stats.m_commands_executed[i]));
+    }
+    put_type(s, "processor_busy_seconds_total", "counter");
+    s += format("ares_processor_busy_seconds_total %.6f\n",
+                stats.m_busy_micros/1e6);
+    put_metric(s, "processor_queued_commands", "gauge",
+               stats.m_queued_commands_snap);
+    put_type(s, "processor_queued_commands_by_priority", "gauge");
+    for (int i = 0; i < int(stats.m_queued_by_priority_snap.size()); i++) {
+        s += format("ares_processor_queued_commands_by_priority"
+                    "{priority=\"%s\"} %d\n",
+                    Command::priority_name(Command::Priority(i)),
+                    stats.m_queued_by_priority_snap[i]);
+    }
+    put_metric(s, "processor_commands_aged_total", "counter",
+               stats.m_commands_aged);
+    put_metric(s, "processor_commands_expired_total", "counter",
+               stats.m_commands_expired);
+    put_metric(s, "processor_commands_dropped_total", "counter",
+               stats.m_commands_dropped);
+    put_metric(s, "processor_scaling_grows_total", "counter",
+               stats.m_processor_grows);
+    put_metric(s, "processor_scaling_shrinks_total", "counter",
+               stats.m_processor_shrinks);
+    put_summary(s, "processor_queue_latency_seconds", stats.m_queue_latency);
+
+    put_metric(s, "listener_overloaded", "gauge", stats.m_overloaded_snap);
+    put_metric(s, "listener_admission_closures_total", "counter",
+               stats.m_admission_closures);
+    put_metric(s, "listener_rejected_connections_total", "counter",
+               stats.m_rejected_connections);
+
+    put_command_summaries(s, "command_queue_latency_seconds",
+                          stats.m_commands,
+                          &Command_statistics::m_queue_latency);
+    put_command_summaries(s, "command_execution_latency_seconds",
+                          stats.m_commands,
+                          &Command_statistics::m_execution_latency);
+    return s;
+}
+
+string ares::statistics_to_json(Server_statistics const& stats)
+{
+    string s;
+    Json_object top(s);
+    top.put("elapsed_sec", to_json(Int64(stats.m_elapsed_sec)));
+
+    string r;
+    Json_object receiver(r, "  ");
+    receiver.put("sessions", to_json(Int64(stats.m_sessions_snap)));
+    receiver.put("queued_updates",
+                 to_json(Int64(stats.m_queued_updates_snap)));
+    receiver.put("events", to_json(stats.m_events));
+    receiver.put("reads", to_json(stats.m_reads));
+    receiver.put("bytes_read", to_json(stats.m_bytes_read));
+    receiver.put("buffer_grows", to_json(stats.m_buffer_grows));
+    receiver.put("buffer_shrinks", to_json(stats.m_buffer_shrinks));
+    receiver.put("attached_buffers",
+                 to_json(Int64(stats.m_attached_buffers_snap)));
+    receiver.put("pooled_buffers",
+                 to_json(Int64(stats.m_pooled_buffers_snap)));
+    receiver.put("input_latency", to_json(stats.m_input_latency));
+    receiver.close();
+    top.put("receiver", r);
+
+    string d;
+    Json_object dispatcher(d, "  ");
+    dispatcher.put("sessions", to_json(Int64(stats.m_output_sessions_snap)));
+    dispatcher.put("queued_dispatches",
+                   to_json(Int64(stats.m_queued_dispatches_snap)));
+    dispatcher.put("buffers", to_json(Int64(stats.m_output_buffers_snap)));
+    dispatcher.put("buffered_bytes",
+                   to_json(Int64(stats.m_output_bytes_snap)));
+    dispatcher.put("writes", to_json(stats.m_writes));
+    dispatcher.put("zero_writes", to_json(stats.m_zero_writes));
+    dispatcher.put("bytes_sent", to_json(stats.m_bytes_sent));
+    dispatcher.put("buffers_added", to_json(stats.m_buffers_added));
+    dispatcher.put("buffers_sent", to_json(stats.m_buffers_sent));
+    dispatcher.put("blocked_sends", to_json(stats.m_blocked_sends));
+    dispatcher.put("dropped_buffers", to_json(stats.m_dropped_buffers));
+    dispatcher.put("disconnects", to_json(stats.m_disconnects));
+    dispatcher.put("flush_latency", to_json(stats.m_flush_latency));
+    dispatcher.close();
+    top.put("dispatcher", d);
+
+    string p;
+    Json_object processors(p, "  ");
+    string executed = "[";
+    for (int i = 0; i < int(stats.m_commands_executed.size()); i++) {
+        if (i > 0)
+            executed += ", ";
+        executed += to_json(stats.m_commands_executed[i]);
+    }
+    processors.put("commands_executed", executed + "]");
+    processors.put("busy_micros", to_json(stats.m_busy_micros));
+    processors.put("queued_commands",
+                   to_json(Int64(stats.m_queued_commands_snap)));
+    processors.put("grows", to_json(stats.m_processor_grows));
+    processors.put("shrinks", to_json(stats.m_processor_shrinks));
+    string q;
+    Json_object queued(q, "    ");
+    for (int i = 0; i < int(stats.m_queued_by_priority_snap.size()); i++) {
+        queued.put(Command::priority_name(Command::Priority(i)),
+                   to_json(Int64(stats.m_queued_by_priority_snap[i])));
+    }
+    queued.close();
+    processors.put("queued_by_priority", q);
+    processors.put("commands_aged", to_json(stats.m_commands_aged));
+    processors.put("commands_expired", to_json(stats.m_commands_expired));
+    processors.put("commands_dropped", to_json(stats.m_commands_dropped));
+    processors.put("queue_latency", to_json(stats.m_queue_latency));
+    processors.close();
+    top.put("processors", p);
+
+    string l;
+    Json_object listeners(l, "  ");
+    listeners.put("overloaded", to_json(stats.m_overloaded_snap));
+    listeners.put("admission_closures",
+                  to_json(stats.m_admission_closures));
+    listeners.put("rejected_connections",
+                  to_json(stats.m_rejected_connections));
+    listeners.close();
+    top.put("listeners", l);
+
+    string c = "[";
+    for (int i = 0; i < int(stats.m_commands.size()); i++) {
+        Command_statistics const& command = stats.m_commands[i];
+        c += i > 0 ? ",\n    " : "\n    ";
+        Json_object object(c, "    ");
+        object.put("name", quote(command.m_name));
+        object.put("queue_latency", to_json(command.m_queue_latency));
+        object.put("execution_latency",
+                   to_json(command.m_execution_latency));
+        object.close();
+    }
+    top.put("commands", c + (stats.m_commands.empty() ? "]" : "\n  ]"));
+
+    string t = "[";
+    for (int i = 0; i < int(stats.m_placement.size()); i++) {
+        Thread_placement const& placement = stats.m_placement[i];
+        string nodes = "[";
+        for (set<int>::const_iterator j = placement.m_nodes.begin();
+             j != placement.m_nodes.end(); ++j)
+        {
+            if (nodes.size() > 1)
+                nodes += ", ";
+            nodes += to_json(Int64(*j));
+        }
+        t += i > 0 ? ",\n    " : "\n    ";
+        Json_object object(t, "    ");
+        object.put("thread", quote(placement.m_name));
+        object.put("cpus", quote(format_cpu_list(placement.m_cpus)));
+        object.put("nodes", nodes + "]");
+        object.close();
+    }
+    top.put("placement", t + (stats.m_placement.empty() ? "]" : "\n  ]"));
+
+    top.close();
+    return s += '\n';
+}
+
+string ares::jobs_to_json(vector<job::Job_info> const& jobs)
+{
+    string s = "[";
+    for (int i = 0; i < int(jobs.size()); i++) {
+        job::Job_info const& info = jobs[i];
+        s += i > 0 ? ",\n  " : "\n  ";
+        Json_object job(s, "  ");
+        job.put("id", to_json(Int64(info.m_id)));
+        job.put("running", to_json(info.m_is_running));
+        if (!info.m_is_running) {
+            job.put("next_date", quote(info.m_next_date.to_string()));
+            job.put("last_date", quote(info.m_last_date.to_string()));
+            job.put("broken", to_json(info.m_is_broken));
+            job.put("failures", to_json(Int64(info.m_num_failures)));
+            job.put("last_failure", quote(info.m_last_failure));
+        }
+        job.close();
+    }
+    return s += jobs.empty() ? "]\n" : "\n]\n";
+}
+
+string ares::sessions_to_json(vector<Session> const& sessions)
+{
+    string s = "[";
+    for (int i = 0; i < int(sessions.size()); i++) {
+        Session_info const info(*sessions[i]);
+        s += i > 0 ? ",\n  " : "\n  ";
+        Json_object session(s, "  ");
+        session.put("id", to_json(Int64(info.session_id())));
+        session.put("remote_address", quote(info.remote_address()));
+        session.put("remote_port", to_json(Int64(info.remote_port())));
+        session.put("created", quote(info.created().to_string()));
+        session.put("action", quote(info.action()));
+        session.put("bytes_received",
+                    to_json(Int64(info.num_bytes_received())));
+        session.put("bytes_sent", to_json(Int64(info.num_bytes_sent())));
+        session.close();
+    }
+    return s += sessions.empty() ? "]\n" : "\n]\n";
+}
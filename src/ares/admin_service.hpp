@@ -0,0 +1,79 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_admin_service
+#define included_ares_admin_service
+
+#include "ares/job/scheduler.hpp"
+#include "ares/listener_strategy.hpp"
+#include "ares/session.hpp"
+#include <string>
+#include <vector>
+
+namespace ares {
+
+class Server;
+struct Server_statistics;
+
+// Admin_strategy answers HTTP requests for a server's statistics, its jobs
+// and its sessions, so that the server may be monitored by ordinary tools.
+// To enable it, add a service that uses it to the server:
+//
+//  server.add_service(new Service("admin", "127.0.0.1", "8081",
+//                                 new Admin_strategy(server)));
+//
+// It serves the following documents (GET or HEAD only):
+//
+//  /metrics        the statistics of Server::totals, in the Prometheus text
+//                  exposition format
+//  /stats          the same statistics as a JSON object
+//  /jobs           the server's scheduled jobs, as a JSON array
+//  /sessions       the sessions the server is reading from, as a JSON array
+//
+// Each connection is served to completion by the listener that accepted it,
+// and then closed. Every service has a listener thread of its own, so a slow
+// scraper delays only other scrapers, never the receiver or the processors;
+// the data served is gathered without holding any server lock while it is
+// formatted. Connections that do not send a request within a few seconds
+// are dropped. They are not subject to admission control, since an
+// overloaded server is just the one its operators need to look at.
+class Admin_strategy : public Listener_strategy {
+  public:
+    // Constructs a strategy that reports on server. The server must outlive
+    // the strategy (it does if the strategy belongs to one of its services).
+    explicit Admin_strategy(Server& server);
+
+    void handle_connection(Server_interface& server, Socket* socket);
+    bool is_admission_controlled() const { return false; }
+
+    // Returns the document at path, and stores its content type in
+    // content_type. Raises a Client_error if there is no such document.
+    std::string render(std::string const& path, std::string& content_type);
+
+  private:
+    Server& m_server;
+};
+
+// Formats statistics in the Prometheus text exposition format. Counts are
+// reported as counters, snapshots as gauges and latencies as summaries, in
+// seconds; the latencies of each type of command are labelled with its
+// name.
+std::string statistics_to_prometheus(Server_statistics const& stats);
+
+// Formats statistics as a JSON object. Latencies are in microseconds.
+std::string statistics_to_json(Server_statistics const& stats);
+
+// Formats a list of jobs (see Scheduler::jobs) as a JSON array.
+std::string jobs_to_json(std::vector<job::Job_info> const& jobs);
+
+// Formats a list of sessions (see Server::sessions) as a JSON array.
+std::string sessions_to_json(std::vector<Session> const& sessions);
+
+} // namespace ares
+
+#endif
@@ -0,0 +1,68 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/admission_control.hpp"
+#include "ares/string_util.hpp"
+#include <algorithm>
+
+using namespace std;
+using ares::Admission_control;
+
+ares::Admission_limits::Admission_limits()
+        : m_max_queued_commands(0)
+        , m_max_pending_output(0)
+        , m_max_sessions(0)
+        , m_resume_fraction(0.8)
+        , m_policy(ADMISSION_PAUSE)
+{}
+
+ares::Server_load::Server_load()
+        : m_queued_commands(0)
+        , m_pending_output(0)
+        , m_sessions(0)
+{}
+
+string ares::Server_load::to_string() const
+{
+    return format("%d queued commands, %lld bytes of pending output, "
+                  "%d sessions", m_queued_commands,
+                  static_cast<long long>(m_pending_output), m_sessions);
+}
+
+Admission_control::Admission_control(Admission_limits const& limits)
+        : m_limits(limits)
+        , m_overloaded(false)
+{
+    m_limits.m_resume_fraction =
+        min(max(m_limits.m_resume_fraction, 0.0), 1.0);
+}
+
+bool Admission_control::admit(Server_load const& load)
+{
+    Admission_limits const& l = m_limits;
+    if (!m_overloaded) {
+        m_overloaded =
+            (l.m_max_queued_commands > 0
+             && load.m_queued_commands >= l.m_max_queued_commands)
+            || (l.m_max_pending_output > 0
+                && load.m_pending_output >= l.m_max_pending_output)
+            || (l.m_max_sessions > 0 && load.m_sessions >= l.m_max_sessions);
+    }
+    else {
+        // Once overloaded, the server stays so until the load falls to the
+        // resume fraction of every limit.
+        double const f = l.m_resume_fraction;
+        m_overloaded =
+            (l.m_max_queued_commands > 0
+             && load.m_queued_commands > l.m_max_queued_commands*f)
+            || (l.m_max_pending_output > 0
+                && load.m_pending_output > l.m_max_pending_output*f)
+            || (l.m_max_sessions > 0 && load.m_sessions > l.m_max_sessions*f);
+    }
+    return !m_overloaded;
+}
@@ -0,0 +1,87 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_admission_control
+#define included_ares_admission_control
+
+#include "ares/types.hpp"
+#include <string>
+
+namespace ares {
+
+// Specifies what a server's listeners do with new connections while the
+// server is overloaded (see Server::set_admission_limits).
+enum Admission_policy {
+    ADMISSION_PAUSE,        // connections are left waiting to be accepted
+    ADMISSION_REJECT,       // they are accepted, sent the reject message and
+                            // closed
+};
+
+// The limits that govern a server that sheds load by refusing new
+// connections (see Server::set_admission_limits and Admission_control). A
+// limit of zero or less is disabled. The defaults are given in parentheses.
+struct Admission_limits {
+    // The server is overloaded once any of these limits is reached, and
+    // stays overloaded until all of them have fallen to m_resume_fraction of
+    // their values.
+    int m_max_queued_commands;      // commands waiting for a processor (0)
+    Int64 m_max_pending_output;     // bytes dispatched but not yet sent (0)
+    int m_max_sessions;             // sessions being read from (0)
+    double m_resume_fraction;       // (0.8)
+
+    Admission_policy m_policy;      // (ADMISSION_PAUSE)
+    std::string m_reject_message;   // sent to rejected connections, if not
+                                    // empty, so that clients can tell they
+                                    // were refused ("")
+
+    Admission_limits();
+};
+
+// A sample of the load on a server.
+struct Server_load {
+    int m_queued_commands;          // commands waiting for a processor
+    Int64 m_pending_output;         // bytes dispatched but not yet sent
+    int m_sessions;                 // sessions being read from
+
+    Server_load();
+
+    // Returns the load as text, for logging.
+    std::string to_string() const;
+};
+
+// Admission_control decides, from samples of a server's load, whether the
+// server should take on new connections. It applies hysteresis: the server
+// becomes overloaded when a sample reaches any of the limits, and ceases to
+// be overloaded only when a sample falls well below all of them, so that
+// admission doesn't flap when the load is near a limit.
+//
+// This class is not synchronized.
+class Admission_control {
+  public:
+    // Constructs a controller governed by limits, whose resume fraction is
+    // made to lie between zero and one if it doesn't already.
+    explicit Admission_control(Admission_limits const& limits);
+
+    // Returns the limits the controller is governed by.
+    Admission_limits const& limits() const { return m_limits; }
+
+    // Records a sample of the load, and returns true if the server should
+    // admit new connections.
+    bool admit(Server_load const& load);
+
+    // Returns true if the most recent sample found the server overloaded.
+    bool is_overloaded() const { return m_overloaded; }
+
+  private:
+    Admission_limits m_limits;      // limits and policy
+    bool m_overloaded;              // the result of the previous sample
+};
+
+} // namespace ares
+
+#endif
@@ -7,6 +7,149 @@
 // DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ares/bin_util.hpp"
+#include <cassert>
+
+// The SSSE3 decoder is compiled with a per-function target attribute, so
+// the library can still be built for (and run on) any x86 processor. See
+// line_scan.cpp.
+#if defined(__GNUC__) && !defined(__clang__) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_X86_GROUP_VARINT
+#include <immintrin.h>
+#endif
+
+using ares::Byte;
+using ares::Int32;
+using ares::Uint32;
+
+namespace
+{
+// Returns the number of bytes (one to four) group varint uses for n.
+inline int uint32_length(Uint32 n)
+{
+    return n < (1U << 8) ? 1 : n < (1U << 16) ? 2 : n < (1U << 24) ? 3 : 4;
+}
+
+// Returns the number of data bytes that follow a group varint tag.
+inline int group_length(Byte tag)
+{
+    return (tag & 3) + ((tag >> 2) & 3) + ((tag >> 4) & 3) + (tag >> 6) + 4;
+}
+
+// Reads a little-endian integer of length bytes.
+inline Uint32 read_uint32(Byte const* p, int length)
+{
+    Uint32 n = p[0];
+    if (length > 1) n |= Uint32(p[1]) << 8;
+    if (length > 2) n |= Uint32(p[2]) << 16;
+    if (length > 3) n |= Uint32(p[3]) << 24;
+    return n;
+}
+
+// Decodes up to count integers, stopping at the first group that is not
+// entirely within [p, end). Returns a pointer to the first unread byte, and
+// adds the number of integers decoded to *decoded.
+Byte const* decode_groups_generic(Byte const* p, Byte const* end,
+                                  Uint32* values, int count, int* decoded)
+{
+    int i = 0;
+    while (i < count) {
+        if (p == end)
+            break;
+
+        Byte tag = *p;
+        int n = count - i < 4 ? count - i : 4;
+        int length = 1;
+        for (int j = 0; j < n; j++)
+            length += ((tag >> 2*j) & 3) + 1;
+        if (end - p < length)
+            break;
+
+        p++;
+        for (int j = 0; j < n; j++) {
+            int k = ((tag >> 2*j) & 3) + 1;
+            values[i++] = read_uint32(p, k);
+            p += k;
+        }
+    }
+    *decoded += i;
+    return p;
+}
+
+#if defined(USE_X86_GROUP_VARINT)
+
+// For each tag, the pshufb control that moves the data bytes of a group
+// into four 32-bit lanes. Built during static initialization.
+Byte s_shuffles[256][16];
+
+bool init_shuffles()
+{
+    for (int tag = 0; tag < 256; tag++) {
+        int offset = 0;
+        for (int i = 0; i < 4; i++) {
+            int length = ((tag >> 2*i) & 3) + 1;
+            for (int j = 0; j < 4; j++)
+                s_shuffles[tag][4*i + j] = j < length ? offset + j : 0x80;
+            offset += length;
+        }
+    }
+    return true;
+}
+
+bool const s_shuffles_ready = init_shuffles();
+
+// Decodes whole groups while at least 16 bytes follow the tag (so that the
+// unaligned load stays within the input), then finishes with the generic
+// decoder. Stores are little-endian, like x86 itself.
+__attribute__((target("ssse3")))
+Byte const* decode_groups_ssse3(Byte const* p, Byte const* end,
+                                Uint32* values, int count, int* decoded)
+{
+    int i = 0;
+    while (count - i >= 4 && end - p >= 17) {
+        Byte tag = *p;
+        __m128i data = _mm_loadu_si128(
+                reinterpret_cast<__m128i const*>(p + 1));
+        __m128i shuffle = _mm_loadu_si128(
+                reinterpret_cast<__m128i const*>(s_shuffles[tag]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i),
+                         _mm_shuffle_epi8(data, shuffle));
+        p += 1 + group_length(tag);
+        i += 4;
+    }
+    *decoded += i;
+    return decode_groups_generic(p, end, values + i, count - i, decoded);
+}
+
+#endif // USE_X86_GROUP_VARINT
+
+typedef Byte const* (*Decode_function)(Byte const*, Byte const*, Uint32*,
+                                       int, int*);
+
+// The selected decoder. Selection is idempotent, so a race between threads
+// that decode for the first time is harmless.
+Decode_function s_decode = 0;
+
+Decode_function select_decode_function()
+{
+#if defined(USE_X86_GROUP_VARINT)
+    if (ares::is_uint32_array_simd_supported())
+        return s_decode = decode_groups_ssse3;
+#endif
+    return s_decode = decode_groups_generic;
+}
+
+int decompress(Decode_function decode, Byte const* buf, int len,
+               Uint32* values, int count)
+{
+    assert(count >= 0);
+    int decoded = 0;
+    Byte const* p = decode(buf, buf + (len > 0 ? len : 0), values, count,
+                           &decoded);
+    return decoded == count ? int(p - buf) : 0;
+}
+}
 
 int ares::compress_uint32(Byte* buf, Uint32 n) {
     if (n < 254) {
@@ -61,3 +204,96 @@ int ares::decompress_uint32(Byte const* buf, int len, Uint32& n)
         return sizeof(Uint32)+1;
     }
 }
+
+void ares::pack_int32_array(Byte* buf, Int32 const* values, int count)
+{
+    for (int i = 0; i < count; i++)
+        pack_int32(buf + 4*i, values[i]);
+}
+
+void ares::unpack_int32_array(Byte const* buf, Int32* values, int count)
+{
+    for (int i = 0; i < count; i++)
+        values[i] = unpack_int32(buf + 4*i);
+}
+
+int ares::encode_varint32(Byte* buf, Uint32 n)
+{
+    int i = 0;
+    while (n >= 0x80) {
+        buf[i++] = Byte(n | 0x80);
+        n >>= 7;
+    }
+    buf[i++] = Byte(n);
+    return i;
+}
+
+int ares::decode_varint32(Byte const* buf, int len, Uint32& n)
+{
+    Uint32 result = 0;
+    for (int i = 0; i < 5; i++) {
+        if (i >= len)
+            return 0;
+        Byte b = buf[i];
+        if (i == 4 && b > 0x0F)
+            return -1;      // too long, or more than 32 bits
+        result |= Uint32(b & 0x7F) << 7*i;
+        if (b < 0x80) {
+            n = result;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+int ares::compress_uint32_array(Byte* buf, Uint32 const* values, int count)
+{
+    assert(count >= 0);
+    Byte* p = buf;
+    for (int i = 0; i < count; i += 4) {
+        Byte* tag = p++;
+        *tag = 0;
+        int n = count - i < 4 ? count - i : 4;
+        for (int j = 0; j < n; j++) {
+            Uint32 v = values[i + j];
+            int length = uint32_length(v);
+            *tag |= (length - 1) << 2*j;
+            for (int k = 0; k < length; k++) {
+                *p++ = Byte(v);
+                v >>= 8;
+            }
+        }
+    }
+    return p - buf;
+}
+
+int ares::decompress_uint32_array(Byte const* buf, int len, Uint32* values,
+                                  int count)
+{
+    Decode_function decode = s_decode ? s_decode : select_decode_function();
+    return decompress(decode, buf, len, values, count);
+}
+
+int ares::decompress_uint32_array_generic(Byte const* buf, int len,
+                                          Uint32* values, int count)
+{
+    return decompress(decode_groups_generic, buf, len, values, count);
+}
+
+bool ares::is_uint32_array_simd_supported()
+{
+#if defined(USE_X86_GROUP_VARINT)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#else
+    return false;
+#endif
+}
+
+int ares::compressed_uint32_array_size(Uint32 const* values, int count)
+{
+    int size = (count + 3)/4;
+    for (int i = 0; i < count; i++)
+        size += uint32_length(values[i]);
+    return size;
+}
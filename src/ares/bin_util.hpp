@@ -15,69 +15,185 @@
 // bit-manipulation on unsigned and signed values do not precisely correspond.
 // Specifically, right-shift on signed values is not portable (without
 // explicit bit masking), and sign-bits must be removed from signed byte
-// values before they can be combined into a target integer value.
+// values before they can be combined into a target integer value. The
+// signed versions therefore convert to and from the unsigned ones.
+//
+// Where the compiler reveals the byte order of the machine, the unsigned
+// versions copy whole integers with memcpy, which is safe for unaligned
+// buffers, and swap their bytes with __builtin_bswap; together these compile
+// to a single load or store and a BSWAP (or one MOVBE). Elsewhere, integers
+// are assembled a byte at a time.
 
 #include "ares/types.hpp"
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+#define ARES_BIN_UTIL_BSWAP
+#endif
 
 namespace ares {
 
-// Stores a signed 16-bit integer in a byte buffer. The integer is packed in
-// most to least significant byte order (also called network byte order).
-inline void pack_int16(Byte* buf, Int16 n) {
-    buf[0] = (n >> 8) & 0xFF;
-    buf[1] = n;
-}
+#if defined(ARES_BIN_UTIL_BSWAP)
 
-// Stores a signed 32-bit integer in a byte buffer. The integer is packed in
-// most to least significant byte order (also called network byte order).
-inline void pack_int32(Byte* buf, Int32 n) {
-    buf[0] = (n >> 24) & 0xFF;
-    buf[1] = (n >> 16) & 0xFF;
-    buf[2] = (n >> 8)  & 0xFF;
-    buf[3] = n;
+// Converts an integer between host and network byte order (in either
+// direction, since the conversion is its own inverse).
+inline Uint16 network_order16(Uint16 n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(n);
+#else
+    return n;
+#endif
 }
 
-// Reverses the operation performed by pack_int16.
-inline Int16 unpack_int16(Byte const* buf) {
-    Int16 n = buf[0] << 8;
-    return n | (buf[1] & 0xFF);
+// Similar to network_order16, this function operates on 32-bit values.
+inline Uint32 network_order32(Uint32 n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(n);
+#else
+    return n;
+#endif
 }
 
-// Reverses the operation performed by pack_int32.
-inline Int32 unpack_int32(Byte const* buf) {
-    Int32 n = (buf[0] << 24);
-    n |= (buf[1] << 16) & 0xFF0000;
-    n |= (buf[2] << 8)  & 0xFF00;
-    return n | (buf[3] & 0xFF);
+// Similar to network_order16, this function operates on 64-bit values.
+inline Uint64 network_order64(Uint64 n) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(n);
+#else
+    return n;
+#endif
 }
 
+#endif // ARES_BIN_UTIL_BSWAP
+
 // Stores an unsigned 16-bit integer in a byte buffer. The integer is packed
 // in most to least significant byte order (also called network byte order).
-inline void pack_uint16(Byte* buf, Uint16 n)
-{
+inline void pack_uint16(Byte* buf, Uint16 n) {
+#if defined(ARES_BIN_UTIL_BSWAP)
+    n = network_order16(n);
+    std::memcpy(buf, &n, sizeof(n));
+#else
     buf[0] = n >> 8;
     buf[1] = n;
+#endif
 }
 
 // Stores an unsigned 32-bit integer in a byte buffer. The integer is packed
 // in most to least significant byte order (also called network byte order).
 inline void pack_uint32(Byte* buf, Uint32 n) {
+#if defined(ARES_BIN_UTIL_BSWAP)
+    n = network_order32(n);
+    std::memcpy(buf, &n, sizeof(n));
+#else
     buf[0] = n >> 24;
     buf[1] = n >> 16;
     buf[2] = n >> 8;
     buf[3] = n;
+#endif
+}
+
+// Stores an unsigned 64-bit integer in a byte buffer. The integer is packed
+// in most to least significant byte order (also called network byte order).
+inline void pack_uint64(Byte* buf, Uint64 n) {
+#if defined(ARES_BIN_UTIL_BSWAP)
+    n = network_order64(n);
+    std::memcpy(buf, &n, sizeof(n));
+#else
+    pack_uint32(buf, Uint32(n >> 32));
+    pack_uint32(buf+4, Uint32(n));
+#endif
 }
 
 // Reverses the operation performed by pack_uint16.
 inline Uint16 unpack_uint16(Byte const* buf) {
-    return unpack_int16(buf);
+#if defined(ARES_BIN_UTIL_BSWAP)
+    Uint16 n;
+    std::memcpy(&n, buf, sizeof(n));
+    return network_order16(n);
+#else
+    return Uint16((buf[0] << 8) | buf[1]);
+#endif
 }
 
 // Reverses the operation performed by pack_uint32.
 inline Uint32 unpack_uint32(Byte const* buf) {
-    return unpack_int32(buf);
+#if defined(ARES_BIN_UTIL_BSWAP)
+    Uint32 n;
+    std::memcpy(&n, buf, sizeof(n));
+    return network_order32(n);
+#else
+    return (Uint32(buf[0]) << 24) | (Uint32(buf[1]) << 16) |
+           (Uint32(buf[2]) << 8)  |  Uint32(buf[3]);
+#endif
+}
+
+// Reverses the operation performed by pack_uint64.
+inline Uint64 unpack_uint64(Byte const* buf) {
+#if defined(ARES_BIN_UTIL_BSWAP)
+    Uint64 n;
+    std::memcpy(&n, buf, sizeof(n));
+    return network_order64(n);
+#else
+    return (Uint64(unpack_uint32(buf)) << 32) | unpack_uint32(buf+4);
+#endif
+}
+
+// Stores a signed 16-bit integer in a byte buffer. The integer is packed in
+// most to least significant byte order (also called network byte order).
+inline void pack_int16(Byte* buf, Int16 n) {
+    pack_uint16(buf, Uint16(n));
+}
+
+// Stores a signed 32-bit integer in a byte buffer. The integer is packed in
+// most to least significant byte order (also called network byte order).
+inline void pack_int32(Byte* buf, Int32 n) {
+    pack_uint32(buf, Uint32(n));
+}
+
+// Stores a signed 64-bit integer in a byte buffer. The integer is packed in
+// most to least significant byte order (also called network byte order).
+inline void pack_int64(Byte* buf, Int64 n) {
+    pack_uint64(buf, Uint64(n));
 }
 
+// Reverses the operation performed by pack_int16.
+inline Int16 unpack_int16(Byte const* buf) {
+    return Int16(unpack_uint16(buf));
+}
+
+// Reverses the operation performed by pack_int32.
+inline Int32 unpack_int32(Byte const* buf) {
+    return Int32(unpack_uint32(buf));
+}
+
+// Reverses the operation performed by pack_int64.
+inline Int64 unpack_int64(Byte const* buf) {
+    return Int64(unpack_uint64(buf));
+}
+
+// Stores a double in a byte buffer: its IEEE 754 bit pattern, packed like a
+// 64-bit integer. Assumes that the platform's doubles are IEEE 754 doubles.
+inline void pack_double(Byte* buf, double d) {
+    Uint64 n;
+    std::memcpy(&n, &d, sizeof(n));
+    pack_uint64(buf, n);
+}
+
+// Reverses the operation performed by pack_double.
+inline double unpack_double(Byte const* buf) {
+    Uint64 n = unpack_uint64(buf);
+    double d;
+    std::memcpy(&d, &n, sizeof(d));
+    return d;
+}
+
+// Stores count signed 32-bit integers in a byte buffer, each one packed as
+// pack_int32 would. buf must point to at least 4*count bytes.
+void pack_int32_array(Byte* buf, Int32 const* values, int count);
+
+// Reverses the operation performed by pack_int32_array.
+void unpack_int32_array(Byte const* buf, Int32* values, int count);
+
 // Packs n into buf, using as little space as possible. Specifically, n will
 // consume one byte in buf if it is less than 2^8-1, three bytes if less than
 // 2^16-1, and five bytes otherwise. Therefore, buf must point to at least
@@ -95,6 +211,62 @@ int decompress_uint32(Byte const* buf, Uint32& n);
 // small to read the entire integer value.
 int decompress_uint32(Byte const* buf, int len, Uint32& n);
 
+// Stores n in buf as a LEB128 variable-length integer: seven bits per byte,
+// least significant group first, with the high bit of each byte set if more
+// bytes follow. Values below 2^7 take one byte, below 2^14 two bytes, and so
+// on; buf must point to at least five bytes of contiguous memory. Returns
+// the number of bytes used.
+int encode_varint32(Byte* buf, Uint32 n);
+
+// Reverses the operation performed by encode_varint32, reading no more than
+// len bytes from buf. Returns the number of bytes used, 0 if len was too
+// small to read the entire integer value, or -1 if buf does not begin with a
+// valid encoding (one that is longer than five bytes, or that overflows 32
+// bits).
+int decode_varint32(Byte const* buf, int len, Uint32& n);
+
+// Packs an array of count integers into buf using the "group varint" format,
+// which stores each group of four integers as a tag byte followed by the
+// four values. Each value takes one to four bytes, in least to most
+// significant byte order, and the tag holds the byte counts (less one) of
+// the values in its group, two bits each, beginning with the lowest bits.
+// The final group may have fewer than four values; the unused tag bits are
+// zero. Small values therefore cost 1.25 bytes each, and no value costs more
+// than 4.25. buf must point to at least
+// max_compressed_uint32_array_size(count) bytes. Returns the number of bytes
+// used.
+int compress_uint32_array(Byte* buf, Uint32 const* values, int count);
+
+// Reverses the operation performed by compress_uint32_array, storing count
+// integers in values, and reading no more than len bytes from buf. The
+// count must be the one passed to compress_uint32_array; it is not recorded
+// in buf. Returns the number of bytes used, or 0 if len was too small to
+// read all of the integers (or count was zero).
+//
+// On x86 processors that support SSSE3, whole groups are decoded with a
+// single shuffle each.
+int decompress_uint32_array(Byte const* buf, int len, Uint32* values,
+                            int count);
+
+// Works like decompress_uint32_array, but never uses vector instructions.
+// Intended for testing and benchmarking.
+int decompress_uint32_array_generic(Byte const* buf, int len, Uint32* values,
+                                    int count);
+
+// Returns true if decompress_uint32_array uses vector instructions on this
+// processor.
+bool is_uint32_array_simd_supported();
+
+// Returns the number of bytes compress_uint32_array would use to pack the
+// given integers.
+int compressed_uint32_array_size(Uint32 const* values, int count);
+
+// Returns the largest number of bytes compress_uint32_array can use to pack
+// count integers.
+inline int max_compressed_uint32_array_size(int count) {
+    return (count + 3)/4 + count*int(sizeof(Uint32));
+}
+
 // Reverses the order of bytes in a signed 16-bit integer, returning the
 // resulting integer value. Note that the bytes are reversed in logical high
 // to low order regardless of the endianess of the machine.
@@ -21,7 +21,7 @@ namespace ares {
 // Buffer object, and output is typically written from a Buffer object. Data
 // are stored in and extracted from buffers using classes derived from
 // Buffer_formatter.
-class Buffer : public Reference_counted {
+class Buffer : public Thread_safe_reference_counted {
   public:
     // Constructs a buffer, optionally specifying its initial capacity. If the
     // capacity is left unspecified, a small default value is used. The
@@ -153,7 +153,10 @@ class Buffer : public Reference_counted {
 };
 
 // Buffers are reference-counted objects, and may therefore be wrapped in a
-// boost::intrusive_ptr to enable automatic garbage collection.
+// boost::intrusive_ptr to enable automatic garbage collection. The count is
+// thread-safe, so a buffer may be shared with the dispatcher (see
+// Gather_list); its contents, however, are not synchronized, and the bytes
+// it shares must not change while it is shared.
 typedef boost::intrusive_ptr<Buffer> Shared_buffer;
 
 // #########################################################################
@@ -7,15 +7,49 @@
 // DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ares/command.hpp"
+#include "ares/platform.hpp"
 #include "ares/server_interface.hpp"
 #include "ares/socket.hpp"
 #include "ares/trace.hpp"
+#include <cxxabi.h>
+#include <stdlib.h>
+#include <typeinfo>
 
 using namespace std;
 
 ares::Command::~Command()
 {}
 
+void ares::Command::discard(Server_interface&, int)
+{}
+
+void ares::Command::set_deadline_after(int millis)
+{
+    m_deadline = monotonic_micros() + Int64(millis)*1000;
+}
+
+char const* ares::Command::priority_name(Priority p)
+{
+    switch (p) {
+        case HIGH_PRIORITY:     return "high";
+        case NORMAL_PRIORITY:   return "normal";
+        case LOW_PRIORITY:      return "low";
+        default:                return "unknown";
+    }
+}
+
+string ares::Command::name() const
+{
+    char const* mangled = typeid(*this).name();
+    int status;
+    char* demangled = abi::__cxa_demangle(mangled, 0, 0, &status);
+    if (!demangled)
+        return mangled;
+    string s = demangled;
+    free(demangled);
+    return s;
+}
+
 
 ares::Session_command::Session_command(Session s)
         : m_session(s)
@@ -68,3 +102,14 @@ void ares::Process_session_command::execute(Server_interface&, int pid)
     ARES_TRACE(("executing Process_session_command"));
     session()->handle_processing(pid);
 }
+
+
+ares::Writable_session_command::Writable_session_command(Session s)
+        : Session_command(s)
+{}
+
+void ares::Writable_session_command::execute(Server_interface&, int)
+{
+    ARES_TRACE(("executing Writable_session_command"));
+    session()->handle_writable();
+}
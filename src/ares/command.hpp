@@ -10,7 +10,9 @@
 #define included_ares_command
 
 #include "ares/buffer.hpp"
+#include "ares/metrics.hpp"
 #include "ares/session.hpp"
+#include <string>
 
 namespace ares {
 
@@ -22,8 +24,82 @@ class Server_interface;
 // command's execute member function via the pid argument.
 class Command {
   public:
+    // The priority classes of commands. Waiting commands of a higher
+    // priority are executed before those of a lower one, though a command
+    // that has waited long enough is executed ahead of newer, higher
+    // priority ones (see Command_queue). Commands of the same priority are
+    // executed in the order they were enqueued, so commands that must be
+    // executed in order (such as those for one session) should have the
+    // same priority.
+    enum Priority {
+        HIGH_PRIORITY,
+        NORMAL_PRIORITY,            // (the default)
+        LOW_PRIORITY,               // housekeeping
+        NUM_PRIORITIES
+    };
+
+    Command()
+            : m_enqueued(0)
+            , m_deadline(0)
+            , m_priority(NORMAL_PRIORITY)
+            , m_expired(false)
+    {}
     virtual ~Command();
     virtual void execute(Server_interface& server, int pid) = 0;
+
+    // Called instead of execute when the command is discarded because its
+    // deadline passed before a processor could execute it (see
+    // set_deadline). Does nothing by default.
+    virtual void discard(Server_interface& server, int pid);
+
+    // Returns the name under which the server reports the timing of this
+    // type of command. By default, this is the name of the command's class.
+    virtual std::string name() const;
+
+    // The time at which the command was last enqueued for execution, as a
+    // reading of monotonic_micros, or zero if it has not been enqueued. Set
+    // by the command queue; the server measures how long commands wait to be
+    // executed from it.
+    Int64 enqueued() const { return m_enqueued; }
+    void set_enqueued(Int64 micros) { m_enqueued = micros; }
+
+    // The priority class of the command. Set it before the command is
+    // enqueued.
+    Priority priority() const { return m_priority; }
+    void set_priority(Priority p) { m_priority = p; }
+
+    // The time by which the command should begin executing, as a reading of
+    // monotonic_micros, or zero (the default) if it has no deadline. A
+    // command whose deadline has passed when a processor dequeues it is
+    // expired. An expired command is discarded if the server drops expired
+    // commands (see Server::drop_expired_commands), and is otherwise
+    // executed with is_expired returning true, so that it may shed work of
+    // its own.
+    Int64 deadline() const { return m_deadline; }
+    void set_deadline(Int64 micros) { m_deadline = micros; }
+
+    // Sets the deadline to the given number of milliseconds from now.
+    void set_deadline_after(int millis);
+
+    bool is_expired() const { return m_expired; }
+    void set_expired(bool b) { m_expired = b; }
+
+    // Returns the name of the priority class p ("high", "normal" or "low").
+    static char const* priority_name(Priority p);
+
+  private:
+    Int64 m_enqueued;
+    Int64 m_deadline;
+    Priority m_priority;
+    bool m_expired;
+};
+
+// How long the commands of one type waited to be executed, and how long
+// they took to execute, in microseconds (see Command::name).
+struct Command_statistics {
+    std::string m_name;                     // the type of command
+    Histogram_snapshot m_queue_latency;     // enqueue to start of execution
+    Histogram_snapshot m_execution_latency; // start to end of execution
 };
 
 // A command that requires a session on which it should operate. Any command
@@ -75,13 +151,22 @@ class Process_session_command : public Session_command {
     void execute(Server_interface& server, int pid);
 };
 
+class Writable_session_command : public Session_command {
+  public:
+    Writable_session_command(Session s);
+    void execute(Server_interface& server, int pid);
+};
+
 // Instructs the server to delete the specified object. If an object can be
 // expensive to delete (e.g. because it manages resources that are very
 // time-consuming to clean up), it should be deleted asynchronously in a
-// processor thread using this command.
+// processor thread using this command. Its priority is LOW_PRIORITY.
 template<typename T>
 struct Delete_object_command : public Command {
-    Delete_object_command(T* ptr) : m_ptr(ptr) {}
+    Delete_object_command(T* ptr) : m_ptr(ptr)
+    {
+        set_priority(LOW_PRIORITY);
+    }
     void execute(Server_interface&, int) { delete m_ptr; }
   private:
     T* m_ptr;
@@ -7,3 +7,127 @@
 // DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ares/command_queue.hpp"
+#include "ares/auto_inc_dec.hpp"
+#include "ares/guard.hpp"
+#include "ares/platform.hpp"
+#include <cassert>
+
+using namespace std;
+using ares::Command;
+using ares::Command_queue;
+
+Command_queue::Command_queue(int aging_millis)
+        : m_size(0)
+        , m_aging_micros(Int64(aging_millis)*1000)
+        , m_drop_expired(false)
+        , m_aged(0)
+        , m_empty_cond(m_mutex)
+        , m_num_dequeue_waiters(0)
+{}
+
+void Command_queue::enqueue(Command* c)
+{
+    int const priority = c->priority();
+    assert(priority >= 0 && priority < Command::NUM_PRIORITIES);
+    c->set_enqueued(monotonic_micros());
+
+    Guard guard(m_mutex);
+    m_queues[priority].push_back(c);
+    m_size++;
+
+    if (m_num_dequeue_waiters > 0)
+        m_empty_cond.signal();
+}
+
+bool Command_queue::dequeue(Command*& c, int max_wait_millis)
+{
+    Guard guard(m_mutex);
+
+    if (m_size == 0) {
+        if (max_wait_millis <= 0)
+            return false;
+
+        while (m_size == 0) {       // loop to avoid race condition
+            Auto_inc_dec<int> inc_dec(m_num_dequeue_waiters);
+            if (!m_empty_cond.wait(max_wait_millis))
+                return false;
+        }
+    }
+    // The queue is not empty, and we have the lock.
+    assert(m_size > 0);
+
+    int highest = 0;
+    while (m_queues[highest].empty())
+        highest++;
+
+    // Look for aged commands only if lower priority ones are waiting, so
+    // that the common case doesn't read the clock.
+    int chosen = highest;
+    if (m_aging_micros > 0 && int(m_queues[highest].size()) < m_size) {
+        Int64 const aged_before = monotonic_micros() - m_aging_micros;
+        Int64 oldest = aged_before;
+        for (int i = highest; i < Command::NUM_PRIORITIES; i++) {
+            if (!m_queues[i].empty()) {
+                Int64 const enqueued = m_queues[i].front()->enqueued();
+                if (enqueued <= oldest) {
+                    oldest = enqueued;
+                    chosen = i;
+                }
+            }
+        }
+        if (chosen != highest)
+            m_aged++;
+    }
+
+    c = m_queues[chosen].front();
+    m_queues[chosen].pop_front();
+    m_size--;
+
+    if (m_size > 0 && m_num_dequeue_waiters > 0)
+        m_empty_cond.signal();
+
+    return true;
+}
+
+void Command_queue::set_aging(int millis)
+{
+    Guard guard(m_mutex);
+    m_aging_micros = Int64(millis)*1000;
+}
+
+int Command_queue::aging() const
+{
+    Guard guard(m_mutex);
+    return m_aging_micros > 0 ? int(m_aging_micros/1000) : 0;
+}
+
+void Command_queue::set_drop_expired(bool b)
+{
+    Guard guard(m_mutex);
+    m_drop_expired = b;
+}
+
+bool Command_queue::drops_expired() const
+{
+    Guard guard(m_mutex);
+    return m_drop_expired;
+}
+
+int Command_queue::size() const
+{
+    Guard guard(m_mutex);
+    return m_size;
+}
+
+int Command_queue::size(Command::Priority p) const
+{
+    assert(p >= 0 && p < Command::NUM_PRIORITIES);
+    Guard guard(m_mutex);
+    return m_queues[p].size();
+}
+
+ares::Int64 Command_queue::aged() const
+{
+    Guard guard(m_mutex);
+    return m_aged;
+}
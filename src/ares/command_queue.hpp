@@ -9,14 +9,80 @@
 #ifndef included_ares_command_queue
 #define included_ares_command_queue
 
-#include "ares/shared_queue.hpp"
+#include "ares/command.hpp"
+#include "ares/condition.hpp"
+#include "ares/mutex.hpp"
+#include "ares/types.hpp"
+#include <boost/utility.hpp>
+#include <deque>
 
 namespace ares {
 
-// forward declaration
-class Command;
+// The queue of commands waiting for a server's processors. Commands are
+// kept in one FIFO queue per priority class (see Command::Priority), and
+// are dequeued from the highest priority queue that isn't empty, so that
+// housekeeping commands don't delay those that serve sessions. To keep a
+// steady stream of higher priority commands from starving the others, a
+// command that has waited for at least the aging time is dequeued ahead of
+// any higher priority command that has waited less; of several such
+// commands, the one that has waited longest is dequeued first. Commands of
+// the same priority are always dequeued in the order they were enqueued.
+//
+// The queue is unbounded, and does not own the commands it contains.
+class Command_queue : boost::noncopyable {
+  public:
+    typedef Command* Item_type;
+
+    // Creates an empty queue with the given aging time, in milliseconds.
+    // Zero or less disables aging, so that priority is strict.
+    explicit Command_queue(int aging_millis = 100);
+
+    // Enqueues c at the back of the queue for its priority, and records the
+    // time at which it was enqueued (see Command::enqueued).
+    void enqueue(Command* c);
+
+    // Dequeues a command as described above, storing it in c. If the queue
+    // is empty, waits up to max_wait_millis milliseconds for a command to be
+    // enqueued. Does not wait at all if max_wait_millis is zero or less.
+    // Returns true if a command was dequeued, false if the function timed
+    // out.
+    bool dequeue(Command*& c, int max_wait_millis = 0);
+
+    // Sets the aging time, in milliseconds, as described above.
+    void set_aging(int millis);
+    int aging() const;
+
+    // Sets whether processors discard commands whose deadlines have passed
+    // instead of executing them (see Command::set_deadline). False by
+    // default.
+    void set_drop_expired(bool b);
+    bool drops_expired() const;
+
+    // Returns the number of commands in the queue.
+    int size() const;
+
+    // Returns the number of commands of priority p in the queue.
+    int size(Command::Priority p) const;
+
+    // Tests if the queue is empty.
+    bool is_empty() const { return size() == 0; }
+
+    // Returns the number of commands that were dequeued ahead of a higher
+    // priority command because they had aged.
+    Int64 aged() const;
+
+  private:
+    typedef std::deque<Command*> Queue;
 
-typedef Shared_queue<Command*> Command_queue;
+    Queue m_queues[Command::NUM_PRIORITIES];    // one per priority
+    int m_size;                     // commands in all of m_queues
+    Int64 m_aging_micros;           // aging time (<=0 disables aging)
+    bool m_drop_expired;            // true to discard expired commands
+    Int64 m_aged;                   // commands dequeued because they aged
+    mutable Mutex m_mutex;          // make queue updates thread-safe
+    Condition m_empty_cond;         // to wait on empty status
+    int m_num_dequeue_waiters;      // # of blocked dequeue attempts
+};
 
 } // namespace ares
 
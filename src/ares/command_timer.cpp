@@ -0,0 +1,117 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/command_timer.hpp"
+#include "ares/guard.hpp"
+#include <algorithm>
+
+using namespace std;
+using ares::Command_statistics;
+using ares::Command_timer;
+
+namespace
+{
+// Orders command statistics slowest first: by the 99th percentile of their
+// execution latency, then by its mean.
+bool is_slower(Command_statistics const& a, Command_statistics const& b)
+{
+    ares::Int64 const a99 = a.m_execution_latency.percentile(99);
+    ares::Int64 const b99 = b.m_execution_latency.percentile(99);
+    if (a99 != b99)
+        return a99 > b99;
+    return a.m_execution_latency.mean() > b.m_execution_latency.mean();
+}
+}
+
+Command_timer::Command_timer()
+        : m_slow_threshold(0)
+{}
+
+Command_timer::~Command_timer()
+{
+    for (Cache::iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+        delete i->second;
+}
+
+void Command_timer::record(Command const& c, Int64 queue_latency,
+                           Int64 execution_latency, Cache& cache)
+{
+    type_info const* type = &typeid(c);
+    Cache::iterator it = cache.find(type);
+    if (it == cache.end()) {
+        Guard guard(m_lock);
+        Entry*& entry = m_entries[type];
+        if (!entry) {
+            entry = new Entry;
+            entry->m_name = c.name();
+        }
+        it = cache.insert(make_pair(type, entry)).first;
+    }
+
+    Entry* entry = it->second;
+    if (queue_latency >= 0)
+        entry->m_queue_latency.record(queue_latency);
+    entry->m_execution_latency.record(execution_latency);
+}
+
+void Command_timer::totals(vector<Command_statistics>& v) const
+{
+    // Entries are never removed, so they may be read without the lock once
+    // they have been found.
+    vector<Entry*> entries;
+    {
+        Guard guard(m_lock);
+        for (Cache::const_iterator i = m_entries.begin();
+             i != m_entries.end(); ++i)
+        {
+            entries.push_back(i->second);
+        }
+    }
+
+    // Distinct types that share a name are reported together.
+    Statistics_map by_name;
+    for (int i = 0; i < int(entries.size()); i++) {
+        Command_statistics& stats = by_name[entries[i]->m_name];
+        stats.m_name = entries[i]->m_name;
+        stats.m_queue_latency += entries[i]->m_queue_latency.snapshot();
+        stats.m_execution_latency +=
+            entries[i]->m_execution_latency.snapshot();
+    }
+
+    v.clear();
+    for (Statistics_map::iterator i = by_name.begin(); i != by_name.end();
+         ++i)
+    {
+        v.push_back(i->second);
+    }
+    sort(v.begin(), v.end(), is_slower);
+}
+
+void Command_timer::statistics(vector<Command_statistics>& v)
+{
+    vector<Command_statistics> totals;
+    this->totals(totals);
+    Guard guard(m_stats_lock);
+
+    v.clear();
+    for (int i = 0; i < int(totals.size()); i++) {
+        Command_statistics stats = totals[i];
+        Statistics_map::iterator it = m_previous.find(stats.m_name);
+        if (it != m_previous.end()) {
+            stats.m_queue_latency -= it->second.m_queue_latency;
+            stats.m_execution_latency -= it->second.m_execution_latency;
+            it->second = totals[i];
+        }
+        else {
+            m_previous[stats.m_name] = totals[i];
+        }
+        if (stats.m_execution_latency.count() > 0)
+            v.push_back(stats);
+    }
+    sort(v.begin(), v.end(), is_slower);
+}
@@ -0,0 +1,86 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_command_timer
+#define included_ares_command_timer
+
+// This is an implementation file; do not use directly.
+
+#include "ares/command.hpp"
+#include "ares/metrics.hpp"
+#include "ares/mutex.hpp"
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace ares {
+
+// Command_timer keeps a pair of latency histograms for each type of command
+// the server's processors execute: one for the time commands spent in the
+// command queue, and one for the time they took to execute. Types are told
+// apart by their dynamic type, and reported under Command::name.
+class Command_timer : boost::noncopyable {
+  private:
+    struct Entry;
+    struct Type_less {
+        bool operator()(std::type_info const* a,
+                        std::type_info const* b) const
+        {
+            return a->before(*b);
+        }
+    };
+
+  public:
+    // A table of the types a thread has already seen. Each thread that
+    // calls record should pass the same cache every time, so that record
+    // takes a lock only the first time the thread sees a type of command.
+    typedef std::map<std::type_info const*, Entry*, Type_less> Cache;
+
+    Command_timer();
+    ~Command_timer();
+
+    // Counts the latencies of command c, in microseconds. queue_latency is
+    // negative if it is not known.
+    void record(Command const& c, Int64 queue_latency,
+                Int64 execution_latency, Cache& cache);
+
+    // Stores the statistics of each type of command executed since the
+    // timer was created in v, slowest first (see Server_statistics).
+    void totals(std::vector<Command_statistics>& v) const;
+
+    // Like totals, but stores the activity since the previous call to this
+    // function, omitting the types that were not executed in that time.
+    void statistics(std::vector<Command_statistics>& v);
+
+    // The execution time, in milliseconds, at or above which a command is
+    // logged as slow by the processor that executed it; zero (the default)
+    // if no command is.
+    int slow_threshold() const { return m_slow_threshold; }
+    void set_slow_threshold(int millis) { m_slow_threshold = millis; }
+
+  private:
+    struct Entry {
+        std::string m_name;             // Command::name of the type
+        Histogram m_queue_latency;
+        Histogram m_execution_latency;
+    };
+
+    typedef std::map<std::string, Command_statistics> Statistics_map;
+
+    mutable Mutex m_lock;               // guards m_entries
+    Cache m_entries;                    // every type seen by any thread
+    int m_slow_threshold;               // see slow_threshold
+    Mutex m_stats_lock;                 // guards m_previous
+    Statistics_map m_previous;          // totals at the previous call to
+                                        // statistics, by name
+};
+
+} // namespace ares
+
+#endif
@@ -68,6 +68,20 @@ class Component : public Thread::Runnable {
     // successfully started. If the component is not active, returns zero.
     int uptime() const;
 
+    // Binds this component's thread to the given cpus (see
+    // Thread::set_affinity). An empty set, the default, unbinds it.
+    void set_cpu_affinity(Cpu_set const& cpus) { m_thread.set_affinity(cpus); }
+
+    // Returns the cpus passed to set_cpu_affinity.
+    Cpu_set const& cpu_affinity() const { return m_thread.affinity(); }
+
+    // Returns the cpus this component's thread may run on, as reported by
+    // the system, or an empty set if the thread isn't running.
+    Cpu_set current_cpu_affinity() const
+    {
+        return m_thread.current_affinity();
+    }
+
   protected:
     // Returns true if this component's internal thread has been stopped
     // (which doesn't imply that it has exited). Derived classes that
@@ -9,6 +9,7 @@
 #include "ares/data_reader.hpp"
 #include "ares/buffer.hpp"
 #include "ares/bin_util.hpp"
+#include <limits>
 
 using namespace std;
 
@@ -40,6 +41,95 @@ ares::Int32 ares::Data_reader::get_int32()
     return n;
 }
 
+ares::Int64 ares::Data_reader::get_int64()
+{
+    Int64 n = peek_int64();
+    if (*this) buffer().consume(sizeof(n));
+    return n;
+}
+
+double ares::Data_reader::get_double()
+{
+    if (!can_read(sizeof(double)))
+        return numeric_limits<double>::quiet_NaN();
+    double d = unpack_double(buffer().begin());
+    buffer().consume(sizeof(d));
+    return d;
+}
+
+bool ares::Data_reader::get_int32_array(vector<Int32>& values, int max_count)
+{
+    if (!can_read(sizeof(Int32)))
+        return false;
+
+    Int32 count = unpack_int32(buffer().begin());
+    if (count < 0 || (max_count > 0 && count > max_count) ||
+        count > (buffer().size() - int(sizeof(Int32)))/int(sizeof(Int32)))
+    {
+        fail();
+        return false;
+    }
+
+    values.resize(count);
+    if (count > 0)
+        unpack_int32_array(buffer().begin() + sizeof(Int32), &values[0],
+                           count);
+    buffer().consume(sizeof(Int32) + count*sizeof(Int32));
+    return true;
+}
+
+ares::Uint32 ares::Data_reader::get_varint()
+{
+    Uint32 n;
+    if (*this) {
+        int used = decode_varint32(buffer().begin(), buffer().size(), n);
+        if (used > 0) {
+            buffer().consume(used);
+            return n;
+        }
+        fail();
+    }
+    return 4294967295U;
+}
+
+bool ares::Data_reader::get_uint32_array(vector<Uint32>& values,
+                                         int max_count)
+{
+    if (!*this)
+        return false;
+
+    Uint32 count;
+    int header_size = decode_varint32(buffer().begin(), buffer().size(),
+                                      count);
+
+    // Every integer takes at least one byte, so a count larger than the
+    // buffer cannot be valid; checking it first keeps a corrupt count from
+    // allocating a huge vector.
+    if (header_size <= 0 ||
+        count > Uint32(buffer().size() - header_size) ||
+        (max_count > 0 && count > Uint32(max_count)))
+    {
+        fail();
+        return false;
+    }
+
+    values.resize(count);
+    if (count == 0) {
+        buffer().consume(header_size);
+        return true;
+    }
+
+    int size = decompress_uint32_array(buffer().begin() + header_size,
+                                       buffer().size() - header_size,
+                                       &values[0], count);
+    if (size == 0) {
+        fail();
+        return false;
+    }
+    buffer().consume(header_size + size);
+    return true;
+}
+
 ares::Int8 ares::Data_reader::peek_int8()
 {
     return can_read(sizeof(Int8))
@@ -61,6 +151,13 @@ ares::Int32 ares::Data_reader::peek_int32()
             : 2147483647;
 }
 
+ares::Int64 ares::Data_reader::peek_int64()
+{
+    return can_read(sizeof(Int64))
+            ? unpack_int64(buffer().begin())
+            : Int64(9223372036854775807LL);
+}
+
 bool ares::Data_reader::get_string(string& s, int)
 {
     if (can_read(sizeof(Int32))) {
@@ -94,6 +191,24 @@ bool ares::Data_reader::get_bytes(Bytes& bytes)
     return false;
 }
 
+ares::Byte const* ares::Data_reader::peek(int& size)
+{
+    if (!*this) {
+        size = 0;
+        return 0;
+    }
+    size = buffer().size();
+    return buffer().begin();
+}
+
+bool ares::Data_reader::skip(int count)
+{
+    if (count < 0 || !can_read(count))
+        return false;
+    buffer().consume(count);
+    return true;
+}
+
 bool ares::Data_reader::can_read(int n)
 {
     if (!*this) {
@@ -13,6 +13,7 @@
 #include "ares/bytes.hpp"
 #include "ares/types.hpp"
 #include <string>
+#include <vector>
 
 namespace ares {
 
@@ -37,6 +38,29 @@ class Data_reader : public Basic_reader {
     // Reads a 32-bit integer from the buffer. Returns 2147483647 on error.
     Int32 get_int32();
 
+    // Reads a 64-bit integer from the buffer. Returns 9223372036854775807 on
+    // error.
+    Int64 get_int64();
+
+    // Reads a double from the buffer. Returns NaN on error.
+    double get_double();
+
+    // Reads an array written by Data_writer::put_int32_array, storing its
+    // integers in values. If max_count is positive, arrays of more than
+    // max_count integers are treated as errors. Returns false on error, in
+    // which case the contents of values are undefined.
+    bool get_int32_array(std::vector<Int32>& values, int max_count = 0);
+
+    // Reads an unsigned integer written by Data_writer::put_varint. Returns
+    // 4294967295 on error.
+    Uint32 get_varint();
+
+    // Reads a packed array written by Data_writer::put_uint32_array, storing
+    // its integers in values. If max_count is positive, arrays of more than
+    // max_count integers are treated as errors. Returns false on error, in
+    // which case the contents of values are undefined.
+    bool get_uint32_array(std::vector<Uint32>& values, int max_count = 0);
+
     // Works like Data_reader::get_int8, except the buffer is not modified.
     Int8 peek_int8();
 
@@ -46,6 +70,9 @@ class Data_reader : public Basic_reader {
     // Works like Data_reader::get_int32, except the buffer is not modified.
     Int32 peek_int32();
 
+    // Works like Data_reader::get_int64, except the buffer is not modified.
+    Int64 peek_int64();
+
     // Reads a string from the buffer, storing it in s. In this context,
     // strings are not assumed to contain text. Instead, they are simply
     // treated as sequences of bytes. When written to the buffer, strings are
@@ -63,6 +90,20 @@ class Data_reader : public Basic_reader {
     // integer that contains the length of the array.
     bool get_bytes(Bytes& bytes);
 
+    // Returns a pointer to the unread bytes in the buffer, storing their
+    // number in size. Nothing is removed from the buffer. Returns 0 if this
+    // reader is in the error state.
+    Byte const* peek(int& size);
+
+    // Removes count bytes from the buffer. Returns false, and leaves the
+    // buffer unchanged, if fewer than count bytes are available.
+    bool skip(int count);
+
+    // Puts this reader in the error state, as if a read had failed. Intended
+    // for functions that parse data on this reader's behalf, such as
+    // read_message (see message_schema.hpp).
+    void fail() { Buffer_formatter::fail(); }
+
   private:
     bool can_read(int n);
 };
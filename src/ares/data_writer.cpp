@@ -46,6 +46,68 @@ bool Data_writer::put_int32(Int32 n)
     return write(buf, sizeof(buf));
 }
 
+bool Data_writer::put_int64(Int64 n)
+{
+    if (!*this)
+        return false;
+    Byte buf[sizeof(n)];
+    pack_int64(buf, n);
+    return write(buf, sizeof(buf));
+}
+
+bool Data_writer::put_double(double d)
+{
+    if (!*this)
+        return false;
+    Byte buf[sizeof(d)];
+    pack_double(buf, d);
+    return write(buf, sizeof(buf));
+}
+
+bool Data_writer::put_int32_array(Int32 const* values, int count)
+{
+    if (!*this)
+        return false;
+
+    int size = count*int(sizeof(Int32));
+    if (buffer().free() < int(sizeof(Int32)) + size) {
+        fail();
+        return false;
+    }
+
+    put_int32(count);
+    pack_int32_array(buffer().end(), values, count);
+    buffer().advance(size);
+    return true;
+}
+
+bool Data_writer::put_varint(Uint32 n)
+{
+    if (!*this)
+        return false;
+    Byte buf[5];
+    return write(buf, encode_varint32(buf, n));
+}
+
+bool Data_writer::put_uint32_array(Uint32 const* values, int count)
+{
+    if (!*this)
+        return false;
+
+    Byte header[5];
+    int header_size = encode_varint32(header, count);
+    int size = compressed_uint32_array_size(values, count);
+    if (buffer().free() < header_size + size) {
+        fail();
+        return false;
+    }
+
+    write(header, header_size);
+    compress_uint32_array(buffer().end(), values, count);
+    buffer().advance(size);
+    return true;
+}
+
 bool Data_writer::put_bytes(Byte const* data, Int32 len)
 {
     if (!*this)
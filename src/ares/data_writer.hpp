@@ -14,6 +14,7 @@
 #include "ares/types.hpp"
 #include <cstring>
 #include <string>
+#include <vector>
 
 namespace ares {
 
@@ -38,6 +39,38 @@ class Data_writer : public Buffer_formatter {
     // Writes a 32-bit integer to the buffer.
     bool put_int32(Int32 n);
 
+    // Writes a 64-bit integer to the buffer.
+    bool put_int64(Int64 n);
+
+    // Writes a double to the buffer, as its IEEE 754 bit pattern in the
+    // byte order of a 64-bit integer.
+    bool put_double(double d);
+
+    // Writes count 32-bit integers to the buffer: the count, written exactly
+    // as Data_writer::put_int32 would, followed by the integers. The space
+    // needed is checked once for the whole array.
+    bool put_int32_array(Int32 const* values, int count);
+
+    // Writes a vector of 32-bit integers to the buffer. This function is
+    // semantically equivalent to put_int32_array(&values[0],values.size()).
+    bool put_int32_array(std::vector<Int32> const& values);
+
+    // Writes an unsigned 32-bit integer to the buffer in one to five bytes,
+    // using fewer bytes for smaller values (see encode_varint32).
+    bool put_varint(Uint32 n);
+
+    // Writes count unsigned 32-bit integers to the buffer as a packed array:
+    // the count, written exactly as Data_writer::put_varint would, followed
+    // by the integers in the compact format produced by
+    // compress_uint32_array. Lists of small values, such as ids, take little
+    // more than a byte per value.
+    bool put_uint32_array(Uint32 const* values, int count);
+
+    // Writes a vector of integers to the buffer as a packed array. This
+    // function is semantically equivalent to
+    // put_uint32_array(&values[0],values.size()).
+    bool put_uint32_array(std::vector<Uint32> const& values);
+
     // Writes a null-terminated string to the buffer. This function is
     // semantically equivalent to put_string(s,strlen(s)).
     bool put_string(const char* s);
@@ -73,6 +106,16 @@ inline bool Data_writer::put_string(std::string const& s)
     return put_bytes((Byte const*) s.data(), s.length());
 }
 
+inline bool Data_writer::put_int32_array(std::vector<Int32> const& values)
+{
+    return put_int32_array(values.empty() ? 0 : &values[0], values.size());
+}
+
+inline bool Data_writer::put_uint32_array(std::vector<Uint32> const& values)
+{
+    return put_uint32_array(values.empty() ? 0 : &values[0], values.size());
+}
+
 inline bool Data_writer::put_bytes(Bytes const& bytes)
 {
     return put_bytes(bytes.begin(), bytes.size());
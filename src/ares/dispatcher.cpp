@@ -7,6 +7,7 @@
 // DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ares/dispatcher.hpp"
+#include "ares/auto_inc_dec.hpp"
 #include "ares/command.hpp"
 #include "ares/error.hpp"
 #include "ares/guard.hpp"
@@ -16,22 +17,51 @@
 #include "ares/socket.hpp"
 #include "ares/string_util.hpp"
 #include "ares/trace.hpp"
+#include <cerrno>
 
 using namespace std;
 
+namespace {
+
+// Sizing of the io_uring, when one is used. At most one send per session is
+// in progress at a time.
+int const RING_ENTRIES = 256;
+
+// The maximum number of dispatches written to a session with one system
+// call.
+int const MAX_WRITE_RANGES = 64;
+
+// The number of milliseconds to wait for sends to complete when there is no
+// other work to do.
+int const SEND_WAIT = 1;
+
+// Default output limits (see Dispatcher::set_output_limits).
+int const DEFAULT_LOW_WATERMARK = 256*1024;
+int const DEFAULT_HIGH_WATERMARK = 1024*1024;
+int const DEFAULT_OUTPUT_QUOTA = 4*1024*1024;
+
+// The number of milliseconds a blocked sender waits before rechecking
+// whether the dispatcher is still running.
+int const DRAIN_WAIT = 100;
+
+} // namespace
+
 ares::Dispatcher::Dispatcher(Server_interface& server)
         : Component("dispatcher")
         , m_server(server)
-        , m_dispatch_queue(1000)  // FIXME kludge to prevent overloading
-        , m_last_snapshot(current_time())
+        , m_use_io_uring(false)
+        , m_pending_output(0)
+        , m_output_drained(m_output_lock)
+        , m_num_output_waiters(0)
+        , m_low_watermark(DEFAULT_LOW_WATERMARK)
+        , m_high_watermark(DEFAULT_HIGH_WATERMARK)
+        , m_quota(DEFAULT_OUTPUT_QUOTA)
+        , m_policy(OUTPUT_BLOCK)
         , m_num_buffers(0)
         , m_total_output_bytes(0)
         , m_total_output_bytes_left(0)
-        , m_buffers_added(0)
-        , m_buffers_sent(0)
-        , m_writes(0)
-        , m_zero_writes(0)
-        , m_bytes_sent(0)
+        , m_last_snapshot(current_time())
+        , m_previous(new Dispatcher_statistics)
 {}
 
 ares::Dispatcher::~Dispatcher()
@@ -39,38 +69,145 @@ ares::Dispatcher::~Dispatcher()
 
 void ares::Dispatcher::dispatch(Session c, Buffer* bp)
 {
-    m_dispatch_queue.enqueue(make_pair(c, Shared_buffer(bp)));
+    Shared_buffer buf(bp);
+    reserve_output(c, buf->size());
+    m_dispatch_queue.enqueue(make_pair(c, Dispatch(buf, 0, buf->size(),
+                                                   monotonic_micros())));
+}
+
+void ares::Dispatcher::dispatch(Session c, Gather_list const& list)
+{
+    Int64 const now = monotonic_micros();
+    Dispatch_array dispatches;
+    dispatches.reserve(list.num_segments());
+    int const last = list.num_segments() - 1;
+    for (int i = 0; i <= last; i++) {
+        Gather_list::Segment const& s = list.segment(i);
+        bool const is_first = i == 0 && !list.is_remainder();
+        dispatches.push_back(make_pair(c, Dispatch(s.m_buffer, s.m_offset,
+                                                   s.m_offset + s.m_count,
+                                                   now, is_first,
+                                                   i == last)));
+    }
+
+    reserve_output(c, list.size());
+    m_dispatch_queue.enqueue_all(dispatches.begin(), dispatches.end());
+}
+
+bool ares::Dispatcher::is_output_idle(Session const& c) const
+{
+    Guard guard(m_output_lock);
+    return c->m_queued_output == 0 && !c->m_output_closed;
+}
+
+void ares::Dispatcher::reserve_output(Session const& c, int n)
+{
+    // Adds n bytes to the session's queued output, which they are about to
+    // join.
+
+    Guard guard(m_output_lock);
+
+    // Under the blocking policy, wait for room in the session's quota. A
+    // session may always have one buffer (or gather list) queued, however
+    // large.
+    if (m_policy == OUTPUT_BLOCK && m_quota > 0 &&
+        c->m_queued_output > 0 &&
+        c->m_queued_output + n > m_quota)
+    {
+        m_blocked_sends.add();
+        while (c->m_queued_output > 0 &&
+               c->m_queued_output + n > m_quota &&
+               !c->m_output_closed && is_active() && !is_stopped())
+        {
+            Auto_inc_dec<int> inc_dec(m_num_output_waiters);
+            m_output_drained.wait(DRAIN_WAIT);
+        }
+    }
+
+    c->m_queued_output += n;
+    m_pending_output += n;
+    if (m_high_watermark > 0 && c->m_queued_output >= m_high_watermark)
+        c->m_send_blocked = true;
+}
+
+void ares::Dispatcher::set_output_limits(int low_watermark,
+                                         int high_watermark, int quota,
+                                         Output_overflow_policy policy)
+{
+    Guard guard(m_output_lock);
+    m_low_watermark = low_watermark;
+    m_high_watermark = high_watermark;
+    m_quota = quota;
+    m_policy = policy;
+    m_output_drained.broadcast();   // (blocked senders recheck the quota)
 }
 
 ares::Dispatcher_statistics ares::Dispatcher::statistics()
 {
-    Dispatcher_statistics stats;
+    Dispatcher_statistics stats = totals();
+    Dispatcher_statistics const totals = stats;
+    Guard guard(m_stats_lock);
 
     time_t current_time = ares::current_time();
     stats.m_elapsed_sec = current_time - m_last_snapshot;
     m_last_snapshot = current_time;
 
+    stats.subtract(*m_previous);
+    *m_previous = totals;
+    return stats;
+}
+
+ares::Int64 ares::Dispatcher::pending_output() const
+{
+    Guard guard(m_output_lock);
+    return m_pending_output;
+}
+
+ares::Dispatcher_statistics ares::Dispatcher::totals() const
+{
+    Dispatcher_statistics stats;
+    stats.m_elapsed_sec = uptime();
+
     stats.m_sessions_snap = m_sessions.size();
     stats.m_queued_dispatches_snap = m_dispatch_queue.size();
     stats.m_buffers_snap = m_num_buffers;
     stats.m_outbound_snap = m_total_output_bytes;
     stats.m_outbound_remaining_snap = m_total_output_bytes_left;
-    stats.m_buffers_added = m_buffers_added;
-    stats.m_buffers_sent = m_buffers_sent;
-    stats.m_writes = m_writes;
-    stats.m_zero_writes = m_zero_writes;
-    stats.m_bytes_sent = m_bytes_sent;
 
-    {
-        Guard guard(m_lock);   // lock to update stats
-        m_buffers_added = 0;
-        m_buffers_sent = 0;
-        m_writes = 0;
-        m_zero_writes = 0;
-        m_bytes_sent = 0;
+    stats.m_buffers_added = m_buffers_added.value();
+    stats.m_buffers_sent = m_buffers_sent.value();
+    stats.m_writes = m_writes.value();
+    stats.m_zero_writes = m_zero_writes.value();
+    stats.m_bytes_sent = m_bytes_sent.value();
+    stats.m_blocked_sends = m_blocked_sends.value();
+    stats.m_dropped_buffers = m_dropped_buffers.value();
+    stats.m_disconnects = m_disconnects.value();
+    stats.m_flush_latency = m_flush_latency.snapshot();
+    return stats;
+}
+
+void ares::Dispatcher::do_startup()
+{
+    assert(m_sends.empty());
+    m_ring.reset();
+
+    if (m_use_io_uring) {
+        try {
+            m_ring.reset(new Io_uring(RING_ENTRIES));
+        }
+        catch (Exception& e) {
+            Log::writef(Log::NOTICE, "dispatcher: io_uring unavailable, "
+                        "falling back to direct writes: %s",
+                        e.to_string().c_str());
+        }
     }
+}
 
-    return stats;
+void ares::Dispatcher::do_shutdown()
+{
+    // Destroying the ring cancels any sends in progress.
+    m_ring.reset();
+    m_sends.clear();
 }
 
 void ares::Dispatcher::run() try
@@ -93,9 +230,16 @@ void ares::Dispatcher::run() try
         for (int i = 0; i < count; i++) {
             add_dispatch(m_dispatches[i]);
         }
-        m_num_buffers += count;
         m_dispatches.clear();
 
+        // With io_uring, post sends and collect the ones that have finished,
+        // waiting briefly for them if nothing else is going on.
+        if (m_ring.get()) {
+            post_sends();
+            complete_sends(count > 0 ? 0 : SEND_WAIT);
+            continue;
+        }
+
         // Process outgoing dispatches
         Session_map::iterator end(m_sessions.end());
         for (Session_map::iterator iter(m_sessions.begin()); iter != end; ) {
@@ -108,7 +252,7 @@ void ares::Dispatcher::run() try
                             "session (%s), killing", s->to_string().c_str());
 
                 m_server.enqueue_command(new Remove_session_command(s));
-                m_sessions.erase(iter++);
+                close_output(iter++);
             }
         }
     }
@@ -118,50 +262,194 @@ catch (...) {
     shutdown();
 }
 
-void ares::Dispatcher::add_dispatch(Pending_dispatch p)
+void ares::Dispatcher::add_dispatch(Pending_dispatch const& p)
 {
-    // p is a (Session, Shared_buffer) pair.
-    m_sessions[p.first].push_back(Dispatch(0, p.second));
+    // p is a (Session, Dispatch) pair.
+    Session const& session = p.first;
+    int buf_size = p.second.size();
+
+    // Output to a session that is being disconnected is discarded.
+    if (session->m_output_closed) {
+        credit_output(session, buf_size);
+        return;
+    }
+
+    Session_map::iterator iter = m_sessions.find(session);
+    if (iter == m_sessions.end())
+        iter = m_sessions.insert(make_pair(session, Dispatch_list())).first;
+    iter->second.push_back(p.second);
 
     // Update statistics.
-    int buf_size = p.second->size();
+    m_num_buffers++;
     m_total_output_bytes += buf_size;
     m_total_output_bytes_left += buf_size;
-    m_buffers_added++;
+    m_buffers_added.add();
+
+    // (the quota is enforced once a whole message has been added)
+    if (m_policy != OUTPUT_BLOCK && p.second.m_is_last)
+        enforce_quota(iter);
 }
 
+void ares::Dispatcher::enforce_quota(Session_map::iterator iter)
+{
+    Session const session = iter->first;
+    Dispatch_list& dispatch_list = iter->second;
+
+    int queued_output;
+    int quota;
+    {
+        Guard guard(m_output_lock);
+        queued_output = session->m_queued_output;
+        quota = m_quota;
+    }
+    if (quota <= 0 || queued_output <= quota)
+        return;
+
+    if (m_policy == OUTPUT_DISCONNECT) {
+        Log::writef(Log::NOTICE, "dispatcher: session (%s) exceeded its "
+                    "output quota (%d bytes queued), killing",
+                    session->to_string().c_str(), queued_output);
+
+        m_disconnects.add();
+        m_server.enqueue_command(new Remove_session_command(session));
+        close_output(iter);
+        return;
+    }
+
+    // Discard the oldest messages until the session is within its quota,
+    // sparing the newest one and any message of which some bytes have been
+    // written or are being sent; a client sent part of a message would take
+    // the next bytes it receives for the rest of it. Since only whole
+    // messages are discarded, the message at the front of the list has
+    // begun if its first range has gone.
+    Dispatch_list::iterator it = dispatch_list.begin();
+    if (!it->m_is_first || it->is_partly_sent() ||
+        m_sends.find(session->id()) != m_sends.end())
+    {
+        it = next_message(dispatch_list, it);
+    }
+    while (queued_output > quota && it != dispatch_list.end()) {
+        Dispatch_list::iterator const next = next_message(dispatch_list, it);
+        if (next == dispatch_list.end())
+            break;                      // (the newest message)
+        while (it != next) {
+            queued_output -= it->size();
+            it = discard_dispatch(session, dispatch_list, it);
+            m_dropped_buffers.add();
+        }
+    }
+}
+
+ares::Dispatcher::Dispatch_list::iterator
+ares::Dispatcher::next_message(Dispatch_list& dispatch_list,
+                               Dispatch_list::iterator it)
+{
+    // Returns the first range of the message after the one that includes
+    // the range at it, or the end of the list if there is none.
+    while (it != dispatch_list.end() && !(it++)->m_is_last)
+        ;
+    return it;
+}
+
+void ares::Dispatcher::close_output(Session_map::iterator iter)
+{
+    // Discards the session's pending output, and any output dispatched to it
+    // later. A send in progress is left to complete_sends, which calls this
+    // function again when it finishes.
+
+    Session const session = iter->first;
+    Dispatch_list& dispatch_list = iter->second;
+    {
+        Guard guard(m_output_lock);
+        session->m_output_closed = true;
+    }
+
+    Dispatch_list::iterator it = dispatch_list.begin();
+    if (m_sends.find(session->id()) != m_sends.end())
+        ++it;
+    while (it != dispatch_list.end())
+        it = discard_dispatch(session, dispatch_list, it);
+
+    if (dispatch_list.empty())
+        m_sessions.erase(iter);
+}
+
+ares::Dispatcher::Dispatch_list::iterator
+ares::Dispatcher::discard_dispatch(Session const& session,
+                                   Dispatch_list& dispatch_list,
+                                   Dispatch_list::iterator it)
+{
+    int const buf_size = it->size();
+    int const bytes_left = it->bytes_left();
+
+    m_num_buffers--;
+    m_total_output_bytes -= buf_size;
+    m_total_output_bytes_left -= bytes_left;
+    credit_output(session, bytes_left);
+
+    return dispatch_list.erase(it);
+}
+
+void ares::Dispatcher::credit_output(Session const& session, int n)
+{
+    // Records that n bytes of the session's queued output were sent or
+    // discarded, and wakes anyone waiting for it to drain. The session's
+    // writable callback is run by a processor thread rather than here, since
+    // it will usually send more output, which may have to wait for this
+    // thread to drain the session.
+
+    bool writable = false;
+    {
+        Guard guard(m_output_lock);
+        session->m_queued_output -= n;
+        m_pending_output -= n;
+        assert(session->m_queued_output >= 0);
+
+        if (session->m_send_blocked &&
+            session->m_queued_output <= m_low_watermark)
+        {
+            session->m_send_blocked = false;
+            writable = !session->m_output_closed;
+        }
+
+        if (m_num_output_waiters > 0)
+            m_output_drained.broadcast();
+    }
+
+    if (writable)
+        m_server.enqueue_command(new Writable_session_command(session));
+}
+
+
 void ares::Dispatcher::write_dispatches(Session_map::iterator& iter)
 {
     Session session = iter->first;
     Dispatch_list& dispatch_list = iter->second;
     assert(!dispatch_list.empty());
 
+    // Consecutive dispatches, which are often the ranges of a single gather
+    // list, are written together.
+    struct iovec iov[MAX_WRITE_RANGES];
+
     while (!dispatch_list.empty()) {
-        Dispatch& dispatch = dispatch_list.front();
-        int& pos = dispatch.first;
-        Shared_buffer& buf = dispatch.second;
-        int buf_size = buf->size();
+        int count = 0;
+        Dispatch_list::const_iterator it = dispatch_list.begin();
+        for ( ; it != dispatch_list.end() && count < MAX_WRITE_RANGES; ++it) {
+            assert(it->bytes_left() > 0);
+            iov[count].iov_base = const_cast<Byte*>(it->next());
+            iov[count].iov_len = it->bytes_left();
+            count++;
+        }
 
-        assert(pos >= 0 && pos < buf_size);
-        int n = session->socket().write(buf->begin() + pos, buf_size - pos);
-        m_writes++;
+        int n = session->socket().writev(iov, count);
+        m_writes.add();
 
         if (n == 0) {
-            m_zero_writes++;
+            m_zero_writes.add();
             break;
         }
 
-        m_bytes_sent += n;
-        m_total_output_bytes_left -= n;
-        pos += n;
-
-        assert(pos >= 0 && pos <= buf_size);
-        if (pos == buf_size) {
-            dispatch_list.pop_front();
-            m_buffers_sent++;
-            m_num_buffers--;
-            m_total_output_bytes -= buf_size;
-        }
+        advance_dispatches(session, dispatch_list, n);
     }
 
     if (dispatch_list.empty())
@@ -170,6 +458,129 @@ void ares::Dispatcher::write_dispatches(Session_map::iterator& iter)
         ++iter;
 }
 
+void ares::Dispatcher::post_sends()
+{
+    // Each session has at most one send in progress, which keeps its output
+    // in order; the next send is posted when the current one completes. A
+    // send covers a single dispatch.
+    Session_map::iterator end(m_sessions.end());
+    for (Session_map::iterator iter(m_sessions.begin()); iter != end; ++iter) {
+        Session const& session = iter->first;
+        if (m_sends.find(session->id()) != m_sends.end())
+            continue;
+
+        Dispatch const& dispatch = iter->second.front();
+        assert(dispatch.bytes_left() > 0);
+        m_ring->send(session->socket().handle(), dispatch.next(),
+                     dispatch.bytes_left(), Uint64(session->id()));
+        m_sends.insert(make_pair(session->id(), session));
+    }
+}
+
+void ares::Dispatcher::complete_sends(int millis)
+{
+    m_ring->submit_and_wait(millis);
+
+    Io_uring::Completion c;
+    while (m_ring->next_completion(c)) {
+        Send_map::iterator send = m_sends.find(int(c.m_user_data));
+        assert(send != m_sends.end());
+        Session session = send->second;
+        m_sends.erase(send);
+
+        Session_map::iterator iter = m_sessions.find(session);
+        assert(iter != m_sessions.end());
+        m_writes.add();
+
+        int const n = c.m_result;
+        if (n > 0) {
+            session->socket().count_bytes_sent(n);
+            advance_dispatches(session, iter->second, n);
+            if (session->m_output_closed)
+                close_output(iter);
+            else if (iter->second.empty())
+                m_sessions.erase(iter);
+        }
+        else if (n == -EAGAIN || n == -EINTR) {
+            m_zero_writes.add();            // (the send will be re-posted)
+            if (session->m_output_closed)
+                close_output(iter);
+        }
+        else {
+            Log::writef(Log::NOTICE, "dispatcher: i/o error writing to "
+                        "session (%s), killing", session->to_string().c_str());
+
+            m_server.enqueue_command(new Remove_session_command(session));
+            close_output(iter);
+        }
+    }
+}
+
+void ares::Dispatcher::advance_dispatches(Session const& session,
+                                          Dispatch_list& dispatch_list, int n)
+{
+    // Records that n bytes were sent from the front of dispatch_list (which
+    // may span several dispatches), discarding any dispatches that were
+    // completely sent.
+
+    m_bytes_sent.add(n);
+    m_total_output_bytes_left -= n;
+    credit_output(session, n);
+
+    Int64 now = 0;      // (read the clock once, when a dispatch completes)
+
+    while (n > 0) {
+        assert(!dispatch_list.empty());
+        Dispatch& dispatch = dispatch_list.front();
+        int count = min(n, dispatch.bytes_left());
+
+        dispatch.m_pos += count;
+        n -= count;
+
+        assert(dispatch.m_pos <= dispatch.m_end);
+        if (dispatch.m_pos == dispatch.m_end) {
+            if (now == 0)
+                now = monotonic_micros();
+            m_flush_latency.record(now - dispatch.m_queued);
+            m_buffers_sent.add();
+            m_num_buffers--;
+            m_total_output_bytes -= dispatch.size();
+            dispatch_list.pop_front();
+        }
+    }
+}
+
+ares::Dispatcher_statistics::Dispatcher_statistics()
+        : m_elapsed_sec(0)
+        , m_sessions_snap(0)
+        , m_queued_dispatches_snap(0)
+        , m_buffers_snap(0)
+        , m_outbound_snap(0)
+        , m_outbound_remaining_snap(0)
+        , m_writes(0)
+        , m_zero_writes(0)
+        , m_bytes_sent(0)
+        , m_buffers_added(0)
+        , m_buffers_sent(0)
+        , m_blocked_sends(0)
+        , m_dropped_buffers(0)
+        , m_disconnects(0)
+{}
+
+void ares::Dispatcher_statistics::subtract(
+    Dispatcher_statistics const& earlier)
+{
+    m_writes -= earlier.m_writes;
+    m_zero_writes -= earlier.m_zero_writes;
+    m_bytes_sent -= earlier.m_bytes_sent;
+    m_buffers_added -= earlier.m_buffers_added;
+    m_buffers_sent -= earlier.m_buffers_sent;
+    m_blocked_sends -= earlier.m_blocked_sends;
+    m_dropped_buffers -= earlier.m_dropped_buffers;
+    m_disconnects -= earlier.m_disconnects;
+    m_flush_latency -= earlier.m_flush_latency;
+}
+
 double ares::Dispatcher_statistics::writes_per_sec() const
 {
     return elapsed_sec() == 0 ? 0 : 1.0*writes()/elapsed_sec();
@@ -187,7 +598,7 @@ double ares::Dispatcher_statistics::bytes_sent_per_sec() const
 
 int ares::Dispatcher_statistics::bytes_per_write() const
 {
-    return writes() == 0 ? 0 : bytes_sent()/writes();
+    return writes() == 0 ? 0 : int(bytes_sent()/writes());
 }
 
 double ares::Dispatcher_statistics::buffers_added_per_sec() const
@@ -13,11 +13,16 @@
 
 #include "ares/buffer.hpp"
 #include "ares/component.hpp"
+#include "ares/condition.hpp"
+#include "ares/gather_list.hpp"
+#include "ares/io_uring.hpp"
+#include "ares/metrics.hpp"
 #include "ares/mutex.hpp"
 #include "ares/session.hpp"
 #include "ares/shared_queue.hpp"
 #include <list>
 #include <map>
+#include <memory>
 #include <vector>
 
 namespace ares {
@@ -32,21 +37,117 @@ class Dispatcher : public Component {
     Dispatcher(Server_interface& server);
     virtual ~Dispatcher();
     void dispatch(Session s, Buffer* bp);
+
+    // Queues the bytes in a gather list for output to a session, without
+    // copying them. The list's ranges are queued together, so output
+    // dispatched to the session by other threads cannot come between them,
+    // and the session's quota applies to their total size. If the list is
+    // the remainder of some output that was partly written (see
+    // Gather_list::is_remainder), it is never discarded to enforce the
+    // quota.
+    void dispatch(Session s, Gather_list const& list);
     void cancel_dispatches(Session s);
+
+    // Returns true if all of the output dispatched to a session has been
+    // sent, and its output has not been closed.
+    bool is_output_idle(Session const& s) const;
+
+    // Returns the dispatcher's activity since the previous call to this
+    // function, and a snapshot of its state.
     Dispatcher_statistics statistics();
 
+    // Returns the dispatcher's activity since it was created, and a
+    // snapshot of its state, without beginning a new statistics window.
+    Dispatcher_statistics totals() const;
+
+    // Returns the number of bytes dispatched to all sessions that have not
+    // yet been sent or discarded, including those in dispatches the
+    // dispatcher has not yet seen.
+    Int64 pending_output() const;
+
+    // Selects the i/o engine used to write to sessions the next time the
+    // dispatcher is started. By default, the dispatcher writes to sockets
+    // directly; if b is true, it instead posts asynchronous sends through
+    // io_uring, falling back to direct writes if io_uring is unavailable.
+    // Has no effect on a running dispatcher.
+    void use_io_uring(bool b) { m_use_io_uring = b; }
+
+    // Returns true if the dispatcher is writing through io_uring.
+    bool is_using_io_uring() const { return m_ring.get() != 0; }
+
+    // Sets the limits on the output queued for each session. When a
+    // session's queued output reaches high_watermark bytes, the session is
+    // marked as send-blocked (see Session_rep::is_send_blocked) until it
+    // drains to low_watermark bytes, at which point a processor thread calls
+    // Session_rep::handle_writable. If a session's queued output would
+    // exceed quota bytes, the dispatcher applies the given policy:
+    // OUTPUT_BLOCK makes the sending thread wait for the output to drain;
+    // OUTPUT_DROP_OLDEST discards the session's oldest unsent messages (the
+    // output of whole calls to dispatch, never part of one); and
+    // OUTPUT_DISCONNECT discards all of the session's output and removes it
+    // from the server. A quota of zero or less disables the policy.
+    void set_output_limits(int low_watermark, int high_watermark, int quota,
+                           Output_overflow_policy policy);
+
   private:
-    typedef std::pair<Session, Shared_buffer> Pending_dispatch;
+    // A range of bytes in a shared buffer, queued for output to a session
+    // at the given time (a reading of monotonic_micros). Offsets are
+    // relative to the start of the buffer's contents. The output passed to
+    // each call to dispatch, which the dispatcher treats as a message, may
+    // span several ranges; the flags mark where it begins and ends, so that
+    // OUTPUT_DROP_OLDEST discards only whole messages.
+    struct Dispatch {
+        Dispatch(Shared_buffer const& buffer, int begin, int end,
+                 Int64 queued, bool is_first = true, bool is_last = true)
+                : m_buffer(buffer)
+                , m_begin(begin)
+                , m_pos(begin)
+                , m_end(end)
+                , m_queued(queued)
+                , m_is_first(is_first)
+                , m_is_last(is_last)
+        {}
+
+        int size() const { return m_end - m_begin; }
+        int bytes_left() const { return m_end - m_pos; }
+        bool is_partly_sent() const { return m_pos > m_begin; }
+        Byte const* next() const { return m_buffer->begin() + m_pos; }
+
+        Shared_buffer m_buffer;     // the buffer
+        int m_begin;                // offset of the range
+        int m_pos;                  // offset of the next byte to send
+        int m_end;                  // offset of the end of the range
+        Int64 m_queued;             // time of the call to dispatch
+        bool m_is_first;            // true if the range begins a message
+        bool m_is_last;             // true if the range ends a message
+    };
+
+    typedef std::pair<Session, Dispatch> Pending_dispatch;
     typedef Shared_queue<Pending_dispatch> Dispatch_queue;
     typedef std::vector<Pending_dispatch> Dispatch_array;
-    typedef std::pair<int, Shared_buffer> Dispatch;
     typedef std::list<Dispatch> Dispatch_list;
     typedef std::map<Session, Dispatch_list> Session_map;
+    typedef std::map<int, Session> Send_map;
 
   private:
+    void do_startup();
+    void do_shutdown();
     void run();
-    void add_dispatch(Pending_dispatch);
+    void reserve_output(Session const& session, int n);
+    void add_dispatch(Pending_dispatch const& p);
     void write_dispatches(Session_map::iterator& it);
+    void post_sends();
+    void complete_sends(int millis);
+    void advance_dispatches(Session const& session,
+                            Dispatch_list& dispatch_list, int n);
+    Dispatch_list::iterator discard_dispatch(Session const& session,
+                                             Dispatch_list& dispatch_list,
+                                             Dispatch_list::iterator it);
+    void enforce_quota(Session_map::iterator it);
+    static Dispatch_list::iterator next_message(Dispatch_list& dispatch_list,
+                                                Dispatch_list::iterator it);
+    void close_output(Session_map::iterator it);
+    void credit_output(Session const& session, int n);
 
   private:
     Server_interface& m_server;     // external server interface
@@ -54,38 +155,68 @@ class Dispatcher : public Component {
     Dispatch_queue m_dispatch_queue;// queue of pending dispatches
     Dispatch_array m_dispatches;    // for efficient dequeue_all
     Mutex m_lock;                   // general sychronization
+    bool m_use_io_uring;            // use io_uring when next started?
+    std::auto_ptr<Io_uring> m_ring; // io_uring, if in use
+    Send_map m_sends;               // sessions with a send in progress
+
+    // (output flow control)
+    mutable Mutex m_output_lock;    // guards sessions' queued output counts
+    Int64 m_pending_output;         // the sum of those counts
+    Condition m_output_drained;     // signaled when queued output drains
+    int m_num_output_waiters;       // threads waiting for output to drain
+    int m_low_watermark;            // see set_output_limits
+    int m_high_watermark;           // see set_output_limits
+    int m_quota;                    // see set_output_limits
+    Output_overflow_policy m_policy;// see set_output_limits
 
     // (statistics)
-    time_t m_last_snapshot;         // time of last snapshot
     int m_num_buffers;              // current number of buffers
     int m_total_output_bytes;       // total size of data in pending buffers
     int m_total_output_bytes_left;  // total size of unsent data in buffers
-    int m_buffers_added;            // outgoing buffers added
-    int m_buffers_sent;             // outgoing buffers sent
-    int m_writes;                   // network writes
-    int m_zero_writes;              // number of failed writes
-    int m_bytes_sent;               // total bytes read
+    Counter m_buffers_added;        // outgoing buffers added
+    Counter m_buffers_sent;         // outgoing buffers sent
+    Counter m_writes;               // network writes
+    Counter m_zero_writes;          // number of failed writes
+    Counter m_bytes_sent;           // total bytes sent
+    Counter m_blocked_sends;        // sends that waited for output to drain
+    Counter m_dropped_buffers;      // buffers discarded by OUTPUT_DROP_OLDEST
+    Counter m_disconnects;          // sessions disconnected for exceeding quota
+    Histogram m_flush_latency;      // micros from dispatch to last byte sent
+    Mutex m_stats_lock;             // guards the following
+    time_t m_last_snapshot;         // time of the previous call to statistics
+    std::auto_ptr<Dispatcher_statistics> m_previous;  // totals at that time
 };
 
 class Dispatcher_statistics {
   public:
+    Dispatcher_statistics();
     int elapsed_sec() const { return m_elapsed_sec; }
     int sessions_snap() const { return m_sessions_snap; }
     int queued_dispatches_snap() const { return m_queued_dispatches_snap; }
     int buffers_snap() const { return m_buffers_snap; }
     int outbound_snap() const { return m_outbound_snap; }
     int outbound_remaining_snap() const { return m_outbound_remaining_snap; }
-    int writes() const { return m_writes; }
+    Int64 writes() const { return m_writes; }
     double writes_per_sec() const;
-    int zero_writes() const { return m_zero_writes; }
+    Int64 zero_writes() const { return m_zero_writes; }
     double zero_writes_per_sec() const;
-    int bytes_sent() const { return m_bytes_sent; }
+    Int64 bytes_sent() const { return m_bytes_sent; }
     double bytes_sent_per_sec() const;
     int bytes_per_write() const;
-    int buffers_added() const { return m_buffers_added; }
+    Int64 buffers_added() const { return m_buffers_added; }
     double buffers_added_per_sec() const;
-    int buffers_sent() const { return m_buffers_sent; }
+    Int64 buffers_sent() const { return m_buffers_sent; }
     double buffers_sent_per_sec() const;
+    Int64 blocked_sends() const { return m_blocked_sends; }
+    Int64 dropped_buffers() const { return m_dropped_buffers; }
+    Int64 disconnects() const { return m_disconnects; }
+
+    // The distribution of the time, in microseconds, from each call to
+    // Dispatcher::dispatch to the write of the last byte it queued.
+    Histogram_snapshot const& flush_latency() const
+    {
+        return m_flush_latency;
+    }
 
   private:
     int m_elapsed_sec;              // seconds since last snapshot
@@ -94,11 +225,18 @@ class Dispatcher_statistics {
     int m_buffers_snap;             // pending output buffers
     int m_outbound_snap;            // total outbound bytes pending
     int m_outbound_remaining_snap;  // unsent outbound bytes pending
-    int m_writes;                   // total write operations
-    int m_zero_writes;              // total zero-byte write operations
-    int m_bytes_sent;               // total bytes sent
-    int m_buffers_added;            // outgoing buffers added
-    int m_buffers_sent;             // outgoing buffers sent
+    Int64 m_writes;                 // total write operations
+    Int64 m_zero_writes;            // total zero-byte write operations
+    Int64 m_bytes_sent;             // total bytes sent
+    Int64 m_buffers_added;          // outgoing buffers added
+    Int64 m_buffers_sent;           // outgoing buffers sent
+    Int64 m_blocked_sends;          // sends that waited for output to drain
+    Int64 m_dropped_buffers;        // buffers discarded to enforce quotas
+    Int64 m_disconnects;            // sessions disconnected to enforce quotas
+    Histogram_snapshot m_flush_latency; // dispatch to last byte sent
+
+    // Subtracts the activity counted in earlier statistics.
+    void subtract(Dispatcher_statistics const& earlier);
 
     friend class Dispatcher;
 };
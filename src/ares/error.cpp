@@ -106,6 +106,11 @@ char const* ares::Thread_exit_timeout_error::message() const
     return "timed out waiting for thread exit";
 }
 
+char const* ares::Invalid_cpu_list_error::message() const
+{
+    return "invalid cpu list: %1$s";
+}
+
 char const* ares::Cmdline_arg_parser_error::message() const
 {
     return "command line parser exception";
@@ -161,6 +166,11 @@ char const* ares::Packet_sequence_error::message() const
     return "packet read out of sequence";
 }
 
+char const* ares::Message_corrupt_error::message() const
+{
+    return "compressed message is corrupt";
+}
+
 char const* ares::Socket_acceptor_error::message() const
 {
     return "socket acceptor exception";
@@ -196,6 +206,11 @@ char const* ares::Log_file_attach_error::message() const
     return "could not attach to log file \"%1$s\"";
 }
 
+char const* ares::Traffic_capture_corrupt_error::message() const
+{
+    return "traffic capture file %1$s is truncated or corrupt";
+}
+
 char const* ares::Input_buffer_too_small_error::message() const
 {
     return "input buffer capacity %1$d is insufficient";
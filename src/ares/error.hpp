@@ -33,6 +33,7 @@ struct Errors {
         THREAD_ALREADY_RUNNING        = 910,
         THREAD_NOT_RUNNING            = 911,
         THREAD_EXIT_TIMEOUT           = 912,
+        INVALID_CPU_LIST              = 913,
 
         // utility
         CMDLINE_ARG_PARSER            = 2000,
@@ -48,6 +49,7 @@ struct Errors {
         PACKET_SIZE_EXCEEDED          = 3001,
         MESSAGE_SIZE_EXCEEDED         = 3002,
         PACKET_SEQUENCE               = 3003,
+        MESSAGE_CORRUPT               = 3004,
 
         // network
         SOCKET_ACCEPTOR               = 4000,
@@ -59,6 +61,7 @@ struct Errors {
         ILLEGAL_PROCESSOR_COUNT       = 5100,
         INVALID_LOG_LEVEL             = 5200,
         LOG_FILE_ATTACH               = 5201,
+        TRAFFIC_CAPTURE_CORRUPT       = 5300,
         INPUT_BUFFER_TOO_SMALL        = 5500,
     };
 };
@@ -168,6 +171,13 @@ struct Thread_exit_timeout_error : public Error {
     char const* message() const;
 };
 
+// A list of cpus was malformed, or named cpus that threads can't be bound to.
+struct Invalid_cpu_list_error : public Error {
+    Invalid_cpu_list_error(std::string const& cpus)
+            : Error(Errors::INVALID_CPU_LIST, "s", cpus.c_str()) {}
+    char const* message() const;
+};
+
 // Base class for all errors thrown by Cmdline_arg_parser objects.
 struct Cmdline_arg_parser_error : virtual public Error {
     Cmdline_arg_parser_error() : Error(Errors::CMDLINE_ARG_PARSER) {}
@@ -253,6 +263,14 @@ struct Packet_sequence_error : public Error {
     char const* message() const;
 };
 
+// Thrown when a compressed message cannot be decompressed (see
+// Message_writer::set_compression_threshold). Message_reader discards the
+// message, and will automatically recover from an error of this type.
+struct Message_corrupt_error : public Buffer_formatter_error {
+    Message_corrupt_error() : Error(Errors::MESSAGE_CORRUPT) {}
+    char const* message() const;
+};
+
 // Base class for all errors thrown by Socket_acceptor objects.
 struct Socket_acceptor_error : virtual public Error {
     Socket_acceptor_error() : Error(Errors::SOCKET_ACCEPTOR) {}
@@ -300,6 +318,14 @@ struct Log_file_attach_error : public Error {
     char const* message() const;
 };
 
+// A traffic capture file could not be read because it is truncated or
+// corrupt (see Traffic_reader).
+struct Traffic_capture_corrupt_error : public Error {
+    Traffic_capture_corrupt_error(std::string const& filename)
+            : Error(Errors::TRAFFIC_CAPTURE_CORRUPT, "s", filename.c_str()) {}
+    char const* message() const;
+};
+
 // Communication protocol failed because an input buffer was too small.
 struct Input_buffer_too_small_error : public Error {
     Input_buffer_too_small_error(int capacity)
@@ -0,0 +1,69 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/gather_list.hpp"
+#include <cassert>
+
+using ares::Gather_list;
+
+void Gather_list::append(Shared_buffer const& buffer, int offset, int count)
+{
+    assert(offset >= 0 && count >= 0 && offset + count <= buffer->size());
+    if (count == 0)
+        return;
+
+    if (!m_segments.empty()) {
+        Segment& last = m_segments.back();
+        if (last.m_buffer == buffer && last.m_offset + last.m_count == offset) {
+            last.m_count += count;
+            m_size += count;
+            return;
+        }
+    }
+
+    m_segments.push_back(Segment(buffer, offset, count));
+    m_size += count;
+}
+
+void Gather_list::append(Shared_buffer const& buffer)
+{
+    append(buffer, 0, buffer->size());
+}
+
+void Gather_list::consume(int n)
+{
+    assert(n >= 0 && n <= m_size);
+    if (n == 0)
+        return;
+    m_size -= n;
+    m_is_remainder = true;
+
+    unsigned i = 0;
+    while (n > 0 && n >= m_segments[i].m_count)
+        n -= m_segments[i++].m_count;
+    m_segments.erase(m_segments.begin(), m_segments.begin() + i);
+
+    if (n > 0) {
+        m_segments.front().m_offset += n;
+        m_segments.front().m_count -= n;
+    }
+}
+
+void Gather_list::clear()
+{
+    m_segments.clear();
+    m_size = 0;
+    m_is_remainder = false;
+}
+
+void Gather_list::copy_to(Buffer& b) const
+{
+    b.set_min_capacity(b.size() + m_size);
+    for (unsigned i = 0; i < m_segments.size(); i++)
+        b.put(m_segments[i].begin(), m_segments[i].m_count);
+}
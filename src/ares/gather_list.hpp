@@ -0,0 +1,92 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_gather_list
+#define included_ares_gather_list
+
+#include "ares/buffer.hpp"
+#include "ares/types.hpp"
+#include <vector>
+
+namespace ares {
+
+// A sequence of byte ranges in shared buffers, which together make up some
+// output (typically a message; see Message_writer). The ranges are written
+// out in order without first being copied into a single buffer: the
+// dispatcher holds references to the buffers until their contents have been
+// sent, and writes several ranges with each system call.
+//
+// The buffers are shared, not copied, so their contents must not change once
+// they have been added to a gather list (see Shared_buffer).
+class Gather_list {
+  public:
+    // A range of count bytes in a shared buffer, beginning offset bytes
+    // after the start of the buffer's contents (Buffer::begin).
+    struct Segment {
+        Segment(Shared_buffer const& buffer, int offset, int count)
+                : m_buffer(buffer)
+                , m_offset(offset)
+                , m_count(count)
+        {}
+
+        // Returns a pointer to the first byte in the range.
+        Byte const* begin() const { return m_buffer->begin() + m_offset; }
+
+        Shared_buffer m_buffer;     // the buffer
+        int m_offset;               // offset of the range in the buffer
+        int m_count;                // number of bytes in the range
+    };
+
+    // Constructs an empty gather list.
+    Gather_list() : m_size(0), m_is_remainder(false) {}
+
+    // Appends count bytes of the contents of buffer, beginning offset bytes
+    // after Buffer::begin. If the range directly follows the last range in
+    // the list, in the same buffer, the last range is extended instead.
+    // Empty ranges are ignored.
+    void append(Shared_buffer const& buffer, int offset, int count);
+
+    // Appends the entire contents of buffer.
+    void append(Shared_buffer const& buffer);
+
+    // Removes the first n bytes from the list, releasing the buffers that no
+    // longer contain any of its bytes. n must not exceed size().
+    void consume(int n);
+
+    // Removes all ranges, releasing the buffers.
+    void clear();
+
+    // Returns true if bytes have been removed from the front of the list by
+    // consume (since it was constructed or cleared), as when the rest of
+    // some partly written output is passed on.
+    bool is_remainder() const { return m_is_remainder; }
+
+    // Returns true if the list contains no bytes.
+    bool empty() const { return m_size == 0; }
+
+    // Returns the total number of bytes in the list.
+    int size() const { return m_size; }
+
+    // Returns the number of ranges in the list.
+    int num_segments() const { return m_segments.size(); }
+
+    // Returns a range in the list.
+    Segment const& segment(int i) const { return m_segments[i]; }
+
+    // Appends the bytes in the list to b, expanding b if necessary.
+    void copy_to(Buffer& b) const;
+
+  private:
+    std::vector<Segment> m_segments;    // the ranges
+    int m_size;                         // total bytes in m_segments
+    bool m_is_remainder;                // true if consume has removed any
+};
+
+} // namespace ares
+
+#endif
@@ -10,8 +10,12 @@
 #include "ares/http/error.hpp"
 #include "ares/http/http.hpp"
 #include "ares/http/request.hpp"
+#include "ares/buffer.hpp"
+#include "ares/line_reader.hpp"
+#include "ares/line_scan.hpp"
 #include "ares/string_util.hpp"
 #include <cassert>
+#include <cctype>
 #include <cerrno>
 #include <cstdio>       // used by Request_parser::parse_file
 
@@ -50,6 +54,11 @@ http::Request_parser::Request_parser()
 {}
 
 void http::Request_parser::add_line(string const& s)
+{
+    add_line(s.data(), s.size());
+}
+
+void http::Request_parser::add_line(char const* s, int length)
 {
     if (!wants_line())
         throw Server_error(Codes::INTERNAL_SERVER_ERROR);
@@ -66,7 +75,9 @@ void http::Request_parser::add_line(string const& s)
     // recognize a single LF as a line terminator and ignore the leading CR."
     // (RFC-2616)
 
-    string line = boost::trim_right_copy(s);
+    while (length > 0 && isspace((unsigned char) s[length - 1]))
+        length--;
+    string line(s, length);
 
     switch (m_state) {
         case STATE_REQUEST_LINE:
@@ -106,6 +117,39 @@ void http::Request_parser::add_data(char const* begin, char const* end)
     }
 }
 
+bool http::Request_parser::add_input(Buffer& b)
+{
+    while (!is_done()) {
+        if (wants_line()) {
+            // A carriage return at the end of the input may be the first
+            // half of a CRLF; wait for the rest rather than reading it as a
+            // newline by itself.
+
+            if (b.size() > 0 && b.end()[-1] == '\r' &&
+                find_newline(b.begin(), b.end()) == b.end() - 1)
+            {
+                return false;
+            }
+
+            Line_reader reader(b);
+            char const* line;
+            int length;
+            if (!reader.get_line_view(line, length))
+                return false;
+            add_line(line, length);     // (consumed by ~Line_reader)
+        }
+        else {
+            int n = min(num_bytes_wanted(), b.size());
+            if (n == 0)
+                return false;
+            char const* data = (char const*) b.begin();
+            add_data(data, data + n);
+            b.consume(n);
+        }
+    }
+    return true;
+}
+
 http::Request* http::Request_parser::make_request()
 {
     if (!is_done())
@@ -301,26 +345,9 @@ http::Request* http::Request_parser::parse_string(std::string const& s)
 {
     reset();
 
-    string line;
-    char const* p = s.data();
-    char const* end = p + s.length();
-    char* q;
-
-    while (!is_done()) {
-        if (wants_line()) {
-            if (!(q = strchr(p, '\n')))
-                throw Client_error(Codes::BAD_REQUEST);
-            line.assign(p, q - p + 1);
-            add_line(line);
-            p = q + 1;
-        }
-        else {
-            if (num_bytes_wanted() > end - p)
-                throw Client_error(Codes::BAD_REQUEST);
-            add_data(p, p + num_bytes_wanted());
-            p += num_bytes_wanted();
-        }
-    }
+    Buffer b(s);
+    if (!add_input(b))
+        throw Client_error(Codes::BAD_REQUEST);
 
     return make_request();
 }
@@ -15,7 +15,11 @@
 #include <string>
 #include <vector>
 
-namespace ares { namespace http {
+namespace ares {
+
+class Buffer;
+
+namespace http {
 
 class Request;
 
@@ -40,11 +44,22 @@ class Request_parser {
     // newline if desired.
     void add_line(std::string const& s);
 
+    // Works like add_line (above), but takes the line as a pointer and a
+    // length, so that it can be passed directly from an input buffer (see
+    // Line_reader::get_line_view).
+    void add_line(char const* line, int length);
+
     // Adds a range of bytes to the request. Raises a Server_error if called
     // when wants_data would return false or if the range of bytes is longer
     // than the value returned by num_bytes_wanted.
     void add_data(char const* begin, char const* end);
 
+    // Passes lines and data from the input buffer b to the parser, consuming
+    // them, until the request is complete or b runs out of input. Returns
+    // true if the request is complete (see is_done). A line is not passed
+    // until its terminating newline has been received in full.
+    bool add_input(Buffer& b);
+
     // Creates a new Request object from the parse results. Only returns a
     // valid object if is_done is true; otherwise, returns null.
     Request* make_request();
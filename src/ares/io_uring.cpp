@@ -0,0 +1,437 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/io_uring.hpp"
+#include "ares/config.h"
+#include "ares/error.hpp"
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+# include <linux/io_uring.h>
+# include <signal.h>
+# include <sys/mman.h>
+# include <sys/socket.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#  define USE_IO_URING 1
+# endif
+#endif
+
+using namespace std;
+using ares::Io_uring;
+
+#if defined(USE_IO_URING)
+
+namespace {
+
+// The buffer group ID under which provided buffers are registered. Each ring
+// has at most one group, so the ID is arbitrary.
+int const BUFFER_GROUP = 0;
+
+// The kernel features without which we refuse to use io_uring at all.
+unsigned const REQUIRED_FEATURES =
+        IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+int sys_io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags, void* arg, size_t arg_size)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, arg_size);
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, void* arg, unsigned n)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, n);
+}
+
+// The ring indices are shared with the kernel, so they must be read and
+// written with the appropriate memory ordering.
+
+unsigned load_acquire(unsigned const* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+void store_release(T* p, T value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+} // namespace
+
+struct Io_uring::Impl {
+    Impl(int num_entries);
+    ~Impl();
+    struct io_uring_sqe* get_sqe();
+    void provide_buffers(int num_buffers, int buffer_size);
+    void recycle_buffer(int id);
+    int submit_and_wait(int millis);
+    int num_ready() const;
+    bool next_completion(Completion& c);
+
+    int m_fd;                           // ring file descriptor
+    void* m_rings;                      // mapped submission/completion rings
+    size_t m_rings_size;                // size of m_rings
+    struct io_uring_sqe* m_sqes;        // mapped submission queue entries
+    size_t m_sqes_size;                 // size of m_sqes
+
+    unsigned* m_sq_head;                // submission queue (kernel reads)
+    unsigned* m_sq_tail;
+    unsigned* m_sq_array;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    unsigned m_sq_local_tail;           // tail including unflushed entries
+
+    unsigned* m_cq_head;                // completion queue (kernel writes)
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    struct io_uring_buf_ring* m_buf_ring; // provided buffer ring
+    size_t m_buf_ring_size;             // size of m_buf_ring
+    Byte* m_buf_data;                   // storage for provided buffers
+    int m_num_buffers;                  // no. of provided buffers
+    int m_buffer_size;                  // size of each provided buffer
+    Uint16 m_buf_tail;                  // local copy of buffer ring tail
+};
+
+Io_uring::Impl::Impl(int num_entries)
+        : m_fd(-1)
+        , m_rings(MAP_FAILED)
+        , m_rings_size(0)
+        , m_sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED))
+        , m_sqes_size(0)
+        , m_buf_ring(0)
+        , m_buf_ring_size(0)
+        , m_buf_data(0)
+        , m_num_buffers(0)
+        , m_buffer_size(0)
+        , m_buf_tail(0)
+{
+    // Multishot receives can produce completions much faster than we submit
+    // operations, so give the completion queue plenty of room.
+    struct io_uring_params p;
+    memset(&p, 0, sizeof p);
+    p.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    p.cq_entries = 8 * num_entries;
+
+    if ((m_fd = sys_io_uring_setup(num_entries, &p)) < 0)
+        throw System_error("io_uring_setup", errno);
+
+    if ((p.features & REQUIRED_FEATURES) != REQUIRED_FEATURES) {
+        close(m_fd);
+        throw System_error("io_uring_setup", ENOSYS);
+    }
+
+    // With IORING_FEAT_SINGLE_MMAP, both rings share a single mapping.
+    size_t const sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t const cq_size =
+            p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    m_rings_size = max(sq_size, cq_size);
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    m_rings = mmap(0, m_rings_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_rings == MAP_FAILED) {
+        int const err = errno;
+        close(m_fd);
+        throw System_error("mmap", err);
+    }
+
+    m_sqes = static_cast<struct io_uring_sqe*>(
+            mmap(0, m_sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED) {
+        int const err = errno;
+        munmap(m_rings, m_rings_size);
+        close(m_fd);
+        throw System_error("mmap", err);
+    }
+
+    char* const rings = static_cast<char*>(m_rings);
+    m_sq_head = reinterpret_cast<unsigned*>(rings + p.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(rings + p.sq_off.tail);
+    m_sq_array = reinterpret_cast<unsigned*>(rings + p.sq_off.array);
+    m_sq_mask = *reinterpret_cast<unsigned*>(rings + p.sq_off.ring_mask);
+    m_sq_entries = p.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+
+    m_cq_head = reinterpret_cast<unsigned*>(rings + p.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(rings + p.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(rings + p.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe*>(rings + p.cq_off.cqes);
+}
+
+Io_uring::Impl::~Impl()
+{
+    // Closing the ring cancels any operations that are still active.
+    close(m_fd);
+    munmap(m_sqes, m_sqes_size);
+    munmap(m_rings, m_rings_size);
+    if (m_buf_ring)
+        munmap(m_buf_ring, m_buf_ring_size);
+    delete[] m_buf_data;
+}
+
+struct io_uring_sqe* Io_uring::Impl::get_sqe()
+{
+    // If the submission queue is full, hand what we have to the kernel.
+    if (m_sq_local_tail - load_acquire(m_sq_head) >= m_sq_entries)
+        submit_and_wait(0);
+
+    unsigned const index = m_sq_local_tail & m_sq_mask;
+    struct io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof *sqe);
+    m_sq_array[index] = index;
+    m_sq_local_tail++;
+    return sqe;
+}
+
+void Io_uring::Impl::provide_buffers(int num_buffers, int buffer_size)
+{
+    assert(m_buf_ring == 0);
+    assert(num_buffers > 0 && num_buffers <= 32768);
+    assert((num_buffers & (num_buffers - 1)) == 0);
+
+    // The buffer ring must be page-aligned, so we map it directly.
+    m_buf_ring_size = num_buffers * sizeof(struct io_uring_buf);
+    void* ring = mmap(0, m_buf_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+        throw System_error("mmap", errno);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = reinterpret_cast<Uint64>(ring);
+    reg.ring_entries = num_buffers;
+    reg.bgid = BUFFER_GROUP;
+
+    if (sys_io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int const err = errno;
+        munmap(ring, m_buf_ring_size);
+        throw System_error("io_uring_register", err);
+    }
+
+    m_buf_ring = static_cast<struct io_uring_buf_ring*>(ring);
+    m_buf_data = new Byte[num_buffers * buffer_size];
+    m_num_buffers = num_buffers;
+    m_buffer_size = buffer_size;
+
+    for (int i = 0; i < num_buffers; i++)
+        recycle_buffer(i);
+}
+
+void Io_uring::Impl::recycle_buffer(int id)
+{
+    assert(id >= 0 && id < m_num_buffers);
+
+    // Note: the buffer ring's flexible array member can't be trusted from
+    // C++ (where it may be offset by an empty struct), so we index the ring
+    // ourselves; its tail overlays the first entry.
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(
+            m_buf_ring) + (m_buf_tail & (m_num_buffers - 1));
+    buf->addr = reinterpret_cast<Uint64>(m_buf_data + id * m_buffer_size);
+    buf->len = m_buffer_size;
+    buf->bid = id;
+    store_release(&m_buf_ring->tail, ++m_buf_tail);
+}
+
+int Io_uring::Impl::submit_and_wait(int millis)
+{
+    store_release(m_sq_tail, m_sq_local_tail);
+    unsigned const to_submit = m_sq_local_tail - load_acquire(m_sq_head);
+
+    // Don't block if there are completions waiting to be retrieved.
+    if (num_ready() > 0)
+        millis = 0;
+    if (to_submit == 0 && millis == 0)
+        return num_ready();
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof arg);
+    arg.sigmask_sz = _NSIG / 8;
+    if (millis > 0) {
+        ts.tv_sec = millis / 1000;
+        ts.tv_nsec = (millis % 1000) * 1000000L;
+        arg.ts = reinterpret_cast<Uint64>(&ts);
+    }
+
+    unsigned const flags = (millis != 0)
+                           ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG
+                           : 0;
+    int const r = sys_io_uring_enter(m_fd, to_submit, millis != 0 ? 1 : 0,
+                                     flags, millis != 0 ? &arg : 0,
+                                     millis != 0 ? sizeof arg : 0);
+
+    // ETIME means the wait timed out; EBUSY means the completion queue is
+    // backed up and must be drained before more operations are accepted.
+    if (r < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+        throw IO_error("io_uring_enter", errno);
+
+    return num_ready();
+}
+
+int Io_uring::Impl::num_ready() const
+{
+    return load_acquire(m_cq_tail) - *m_cq_head;
+}
+
+bool Io_uring::Impl::next_completion(Completion& c)
+{
+    unsigned const head = *m_cq_head;
+    if (head == load_acquire(m_cq_tail))
+        return false;
+
+    struct io_uring_cqe const& cqe = m_cqes[head & m_cq_mask];
+    c.m_user_data = cqe.user_data;
+    c.m_result = cqe.res;
+    c.m_flags = cqe.flags;
+    store_release(m_cq_head, head + 1);
+    return true;
+}
+
+
+bool Io_uring::Completion::has_more() const
+{
+    return (m_flags & IORING_CQE_F_MORE) != 0;
+}
+
+int Io_uring::Completion::buffer_id() const
+{
+    return (m_flags & IORING_CQE_F_BUFFER)
+           ? int(m_flags >> IORING_CQE_BUFFER_SHIFT)
+           : -1;
+}
+
+Io_uring::Io_uring(int num_entries)
+        : m_impl(new Impl(num_entries))
+{}
+
+Io_uring::~Io_uring()
+{
+    delete m_impl;
+}
+
+bool Io_uring::is_supported()
+{
+    // A kernel may set up rings, and even provided buffer rings, yet fail
+    // every multishot receive with EINVAL (as Linux 5.19 does), so we try
+    // one on a socket pair.
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        return false;
+
+    bool supported = false;
+    try {
+        Io_uring probe(4);
+        probe.provide_buffers(1, 64);
+        probe.recv_multishot(fds[0], 0);
+        if (write(fds[1], "x", 1) == 1 && probe.submit_and_wait(1000) > 0) {
+            Completion c;
+            supported = probe.next_completion(c) && c.m_result == 1
+                        && c.has_more();
+        }
+    }
+    catch (Exception&) {
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    return supported;
+}
+
+void Io_uring::provide_buffers(int num_buffers, int buffer_size)
+{
+    m_impl->provide_buffers(num_buffers, buffer_size);
+}
+
+ares::Byte* Io_uring::provided_buffer(int id)
+{
+    assert(id >= 0 && id < m_impl->m_num_buffers);
+    return m_impl->m_buf_data + id * m_impl->m_buffer_size;
+}
+
+void Io_uring::recycle_buffer(int id)
+{
+    m_impl->recycle_buffer(id);
+}
+
+void Io_uring::recv_multishot(Sockfd s, Uint64 user_data)
+{
+    struct io_uring_sqe* sqe = m_impl->get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = s;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = user_data;
+}
+
+void Io_uring::send(Sockfd s, Byte const* data, int count, Uint64 user_data)
+{
+    struct io_uring_sqe* sqe = m_impl->get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = s;
+    sqe->addr = reinterpret_cast<Uint64>(data);
+    sqe->len = count;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+}
+
+void Io_uring::cancel(Uint64 target, Uint64 user_data)
+{
+    struct io_uring_sqe* sqe = m_impl->get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = target;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = user_data;
+}
+
+int Io_uring::submit_and_wait(int millis)
+{
+    return m_impl->submit_and_wait(millis);
+}
+
+bool Io_uring::next_completion(Completion& c)
+{
+    return m_impl->next_completion(c);
+}
+
+#else // !defined(USE_IO_URING)
+
+bool Io_uring::Completion::has_more() const { return false; }
+int Io_uring::Completion::buffer_id() const { return -1; }
+
+Io_uring::Io_uring(int)
+        : m_impl(0)
+{
+    throw Not_implemented_error("io_uring");
+}
+
+Io_uring::~Io_uring() {}
+bool Io_uring::is_supported() { return false; }
+void Io_uring::provide_buffers(int, int) {}
+ares::Byte* Io_uring::provided_buffer(int) { return 0; }
+void Io_uring::recycle_buffer(int) {}
+void Io_uring::recv_multishot(Sockfd, Uint64) {}
+void Io_uring::send(Sockfd, Byte const*, int, Uint64) {}
+void Io_uring::cancel(Uint64, Uint64) {}
+int Io_uring::submit_and_wait(int) { return 0; }
+bool Io_uring::next_completion(Completion&) { return false; }
+
+#endif
@@ -0,0 +1,110 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_io_uring
+#define included_ares_io_uring
+
+// This is an implementation file; do not use directly.
+
+#include "ares/types.hpp"
+#include "ares/utility.hpp"
+
+namespace ares {
+
+// A thin wrapper around the Linux io_uring asynchronous i/o interface. Unlike
+// Sockfd_poller, which reports readiness and leaves the i/o to the caller,
+// an Io_uring object performs the i/o itself and reports its completion.
+// Operations are queued by the member functions recv_multishot, send and
+// cancel; they are handed to the kernel, and their completions collected, by
+// submit_and_wait and next_completion.
+//
+// Received data is placed in a pool of "provided" buffers that the object
+// registers with the kernel, so that a socket with no pending input doesn't
+// pin any memory. Each completed receive names the provided buffer holding
+// its data, and the caller must return that buffer with recycle_buffer once
+// it has copied the data out.
+//
+// An Io_uring object must only be used by one thread at a time. It is
+// available only when the library was configured on a system with
+// <linux/io_uring.h> and is running on a kernel that supports multishot
+// receives (Linux 6.0 or later); use is_supported to find out at runtime.
+class Io_uring : boost::noncopyable {
+  public:
+    // Describes a completed operation.
+    struct Completion {
+        Uint64 m_user_data;     // value passed when queueing the operation
+        int m_result;           // byte count, or a negated errno value
+        unsigned m_flags;       // completion flags (see below)
+
+        // Returns true if the operation is still active and will produce
+        // further completions (which is only the case for multishot
+        // operations).
+        bool has_more() const;
+
+        // Returns the ID of the provided buffer holding the received data,
+        // or -1 if no buffer was consumed by the operation.
+        int buffer_id() const;
+    };
+
+    // Creates a ring that can hold up to num_entries queued operations.
+    // Throws a System_error if the ring cannot be created, and a
+    // Not_implemented_error if io_uring support isn't available.
+    explicit Io_uring(int num_entries);
+    ~Io_uring();
+
+    // Returns true if io_uring is usable on this system, including multishot
+    // receives into provided buffers. This function performs a trial
+    // receive, so it is best called once, at startup.
+    static bool is_supported();
+
+    // Registers num_buffers provided buffers, each buffer_size bytes long,
+    // for use by recv_multishot. num_buffers must be a power of two no
+    // greater than 32768. May be called only once.
+    void provide_buffers(int num_buffers, int buffer_size);
+
+    // Returns a pointer to the provided buffer with the given ID.
+    Byte* provided_buffer(int id);
+
+    // Returns a provided buffer to the kernel once its contents have been
+    // consumed.
+    void recycle_buffer(int id);
+
+    // Queues a multishot receive on socket s. The receive remains active,
+    // producing one completion for each chunk of data that arrives, until it
+    // fails, reaches end-of-file, or is canceled. If a completion indicates
+    // that it is no longer active (see Completion::has_more), the caller
+    // must queue another receive to continue reading from the socket.
+    void recv_multishot(Sockfd s, Uint64 user_data);
+
+    // Queues a send of count bytes from data on socket s. The data must
+    // remain valid until the operation completes.
+    void send(Sockfd s, Byte const* data, int count, Uint64 user_data);
+
+    // Queues a request to cancel all active operations whose user data is
+    // equal to target. The cancellation itself produces a completion whose
+    // user data is user_data.
+    void cancel(Uint64 target, Uint64 user_data);
+
+    // Submits all queued operations to the kernel and waits up to millis
+    // milliseconds for at least one operation to complete. Specifying zero
+    // for millis submits without waiting; a negative value waits
+    // indefinitely. Returns the number of completions ready to be retrieved
+    // with next_completion.
+    int submit_and_wait(int millis);
+
+    // Retrieves the next ready completion. Returns false if there are none.
+    bool next_completion(Completion& c);
+
+  private:
+    struct Impl;
+    Impl* m_impl;
+};
+
+} // namespace ares
+
+#endif
@@ -19,6 +19,7 @@ ares::job::Job::Job(int id, Task* task, Date next_date, Interval interval)
         , m_interval(interval)
         , m_time_running(0)
         , m_total_time(0)
+        , m_num_failures(0)
         , m_broken(false)
 {
     assert(m_task != 0);
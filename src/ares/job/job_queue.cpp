@@ -33,6 +33,11 @@ bool ares::job::Job_queue::remove(Job* job)
     return m_set.erase(job);
 }
 
+bool ares::job::Job_queue::contains(Job* job) const
+{
+    return m_set.find(job) != m_set.end();
+}
+
 void ares::job::Job_queue::set_next_date(Job* job, Date next_date)
 {
     // Priority changes are implemented as remove-insert
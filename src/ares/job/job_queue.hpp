@@ -28,6 +28,9 @@ class Job_queue {
     // Removes a specific job from the priority queue.
     bool remove(Job* job);
 
+    // Returns true if a specific job is in the queue.
+    bool contains(Job* job) const;
+
     // Changes the next run date for a specific job.
     void set_next_date(Job* job, Date next_date);
 
@@ -42,7 +45,7 @@ class Job_queue {
     // Orders Job pointers by next_date ("less" is having a later next_date).
     // Jobs with equivalent next_date values are ordered by ID.
     struct Job_ptr_less {
-        bool operator()(Job* a, Job* b) {
+        bool operator()(Job* a, Job* b) const {
             if (a->next_date() == b->next_date())
                 return a->id() < b->id();
             return a->next_date() < b->next_date();
@@ -110,9 +110,10 @@ struct ares::job::Scheduler::Impl : public ares::Thread::Runnable {
 // itself immediately after its run function exits.
 class ares::job::Scheduler::Process : public ares::Thread::Runnable {
   public:
-    Process(Scheduler::Impl& scheduler);
+    Process(Scheduler::Impl& scheduler, Cpu_set const& cpus);
     virtual ~Process() {}
     void stop();
+    void set_cpu_affinity(Cpu_set const& cpus) { m_thread.set_affinity(cpus); }
     void run();
 
   private:
@@ -175,7 +176,8 @@ void ares::job::Scheduler::Impl::set_num_processes(int n)
 
     if (int(m_processes.size()) < n) {
         while (int(m_processes.size()) < n) {
-            auto_ptr<Process> process(new Process(*this));
+            auto_ptr<Process> process(new Process(*this,
+                                                  m_thread.affinity()));
             m_processes.push_back(process.release());
         }
     }
@@ -278,10 +280,12 @@ void ares::job::Scheduler::Impl::remove_process(Scheduler::Process* process)
 }
 
 
-ares::job::Scheduler::Process::Process(Scheduler::Impl& scheduler)
+ares::job::Scheduler::Process::Process(Scheduler::Impl& scheduler,
+                                       Cpu_set const& cpus)
         : m_scheduler(&scheduler)
         , m_thread(this)
 {
+    m_thread.set_affinity(cpus);
     m_thread.start();
 }
 
@@ -413,6 +417,20 @@ void ares::job::Scheduler::set_broken(int job_id, bool broken)
     m_impl->find_job(job_id)->set_broken(broken);
 }
 
+void ares::job::Scheduler::set_cpu_affinity(Cpu_set const& cpus)
+{
+    // (processes in the array can't exit while the lock is held)
+    Guard guard(m_impl->m_mutex);
+    m_impl->m_thread.set_affinity(cpus);
+    for (int i = 0; i < int(m_impl->m_processes.size()); i++)
+        m_impl->m_processes[i]->set_cpu_affinity(cpus);
+}
+
+ares::Cpu_set ares::job::Scheduler::current_cpu_affinity() const
+{
+    return m_impl->m_thread.current_affinity();
+}
+
 int ares::job::Scheduler::num_processes() const
 {
     Guard guard(m_impl->m_mutex);
@@ -436,3 +454,29 @@ bool ares::job::Scheduler::is_broken(int job_id) const
     Guard guard(m_impl->m_mutex);
     return m_impl->find_job(job_id)->is_broken();
 }
+
+void ares::job::Scheduler::jobs(vector<Job_info>& jobs) const
+{
+    Guard guard(m_impl->m_mutex);
+    jobs.clear();
+    jobs.reserve(m_impl->m_jobs.size());
+    Impl::Job_table::const_iterator it;
+    for (it = m_impl->m_jobs.begin(); it != m_impl->m_jobs.end(); ++it) {
+        Job* job = it->second;
+        jobs.push_back(Job_info());
+        Job_info& info = jobs.back();
+        info.m_id = job->id();
+
+        // A job that is not in the job queue is waiting for a worker or
+        // being run by one, which updates it without holding the lock.
+        if (!m_impl->m_job_queue.contains(job)) {
+            info.m_is_running = true;
+            continue;
+        }
+        info.m_next_date = job->next_date();
+        info.m_last_date = job->last_date();
+        info.m_is_broken = job->is_broken();
+        info.m_num_failures = job->num_failures();
+        info.m_last_failure = job->last_failure();
+    }
+}
@@ -11,10 +11,29 @@
 
 #include "ares/job/common.hpp"
 #include "ares/job/interval.hpp"
+#include "ares/platform.hpp"
 #include "ares/utility.hpp"
+#include <string>
+#include <vector>
 
 namespace ares { namespace job {
 
+// A snapshot of the state of a scheduled job; see Scheduler::jobs. While a
+// job is running (or waiting for a free job process), only m_id and
+// m_is_running are meaningful.
+struct Job_info {
+    Job_info() : m_id(0), m_is_running(false), m_is_broken(false),
+                 m_num_failures(0) {}
+
+    int m_id;                   // unique job ID
+    bool m_is_running;          // true if running or about to run
+    Date m_next_date;           // next time the job will run
+    Date m_last_date;           // last time the job ran
+    bool m_is_broken;           // true if the job will not be run
+    int m_num_failures;         // consecutive failures
+    std::string m_last_failure; // error message for the last failure
+};
+
 // A class that allows programs to schedule user jobs for periodic execution.
 // Each job is represented by a Thread::Runnable object, which corresponds to
 // the "main," or top-level, function for that job. Jobs can be run exactly
@@ -68,6 +87,15 @@ class Scheduler : boost::noncopyable {
     // it fails 16 consecutive times.
     void set_broken(int job_id, bool broken);
 
+    // Binds the scheduler's thread and its job processes to the given cpus,
+    // or unbinds them if cpus is empty (see Thread::set_affinity). Job
+    // processes created later are bound to the same cpus.
+    void set_cpu_affinity(Cpu_set const& cpus);
+
+    // Returns the cpus the scheduler's thread may run on, as reported by the
+    // system, or an empty set if the scheduler isn't running.
+    Cpu_set current_cpu_affinity() const;
+
     // Returns the number of threads the scheduler uses to run concurrent
     // jobs. If there are not enough job processes, some jobs may not run
     // according to their defined schedules.
@@ -82,6 +110,9 @@ class Scheduler : boost::noncopyable {
     // Returns the status of the job with ID job_id.
     bool is_broken(int job_id) const;
 
+    // Stores a snapshot of every job in jobs, in order of ID.
+    void jobs(std::vector<Job_info>& jobs) const;
+
   private:
     struct Impl;
     class Process;
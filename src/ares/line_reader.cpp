@@ -9,36 +9,60 @@
 #include "ares/line_reader.hpp"
 #include "ares/error.hpp"
 #include "ares/buffer.hpp"
+#include "ares/line_scan.hpp"
 #include <algorithm>
 
 using namespace std;
 
-namespace
-{
-// Returns a pointer to the first newline character in the range (begin, end].
-// If no newline is found, returns end. Both '\r' and '\n' are accepted as
-// newline characters.
-ares::Byte const* find_newline(ares::Byte const* begin,
-                               ares::Byte const* end)
-{
-    while (begin < end) {
-        if (*begin == '\r' || *begin == '\n')
-            return begin;
-        begin++;
-    }
-    return end;
-}
-}
-
 ares::Line_reader::Line_reader(Buffer& b)
         : Buffer_formatter(b)
         , m_discard(false)
+        , m_pending(0)
 {}
 
 ares::Line_reader::~Line_reader()
-{}
+{
+    consume_pending();
+}
 
 bool ares::Line_reader::get_line(string& s)
+{
+    int length;
+    int newline_length;
+
+    consume_pending();
+    if (!find_line(length, newline_length))
+        return false;
+
+    // Copy the line (including the terminating newline characters, unless
+    // they're discarded) into the destination string and skip the line in
+    // the read buffer.
+
+    const char* str = (char const*) buffer().begin();
+    s.assign(str, length + (m_discard ? 0 : newline_length));
+    buffer().consume(length + newline_length);
+    return true;
+}
+
+bool ares::Line_reader::get_line_view(char const*& line, int& length)
+{
+    int newline_length;
+
+    consume_pending();
+    if (!find_line(length, newline_length))
+        return false;
+
+    // Consuming the line now could move the buffer's contents, so it is
+    // deferred until the caller is done with the line.
+
+    line = (char const*) buffer().begin();
+    m_pending = length + newline_length;
+    if (!m_discard)
+        length += newline_length;
+    return true;
+}
+
+bool ares::Line_reader::find_line(int& length, int& newline_length)
 {
     // Abort the operation if we're in the failed state.
     if (!*this)
@@ -54,12 +78,11 @@ bool ares::Line_reader::get_line(string& s)
         return false;  // failed
     }
 
-    // We found a newline in the read buffer. Copy the line (including the
-    // terminating newline characters) into the destination string and skip
-    // the appropriate number of characters in the read buffer.
+    // We found a newline in the read buffer. The line consists of the bytes
+    // before it, followed by one or two newline characters.
 
-    int length = newline - buffer().begin();
-    int newline_length = 1;
+    length = newline - buffer().begin();
+    newline_length = 1;
 
     // If we are not at the end of the input and the current character is the
     // '\r', then the next character in the stream could be a '\n'. If it is,
@@ -71,8 +94,13 @@ bool ares::Line_reader::get_line(string& s)
         }
     }
 
-    const char* str = (char const*) buffer().begin();
-    s.assign(str, length + (m_discard ? 0 : newline_length));
-    buffer().consume(length + newline_length);
     return true;
 }
+
+void ares::Line_reader::consume_pending()
+{
+    if (m_pending > 0) {
+        buffer().consume(min(m_pending, buffer().size()));
+        m_pending = 0;
+    }
+}
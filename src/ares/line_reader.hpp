@@ -30,13 +30,26 @@ class Line_reader : public Buffer_formatter {
     // could not be read, the wrapped buffer is not modified.
     virtual bool get_line(std::string& s);
 
+    // Reads a line from the wrapped buffer without copying it: on success,
+    // line points to the start of the line within the buffer and length is
+    // its length. The line is consumed from the buffer when the next line is
+    // read or the line reader is destroyed, whichever comes first; until
+    // then, the pointer remains valid unless the buffer is modified by other
+    // means. If a line could not be read, returns false.
+    bool get_line_view(char const*& line, int& length);
+
     // Specifies whether the terminating newline characters should be stored
     // in the string returned by Line_reader::get_line. By default, the
     // newline characters are preserved.
     void set_discard_newline(bool b) { m_discard = b; }
 
+  private:
+    bool find_line(int& length, int& newline_length);
+    void consume_pending();
+
   private:
     bool m_discard;  // should newlines be discarded?
+    int m_pending;   // bytes of the last line view left to consume
 };
 
 } // namespace ares
@@ -0,0 +1,159 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/line_scan.hpp"
+#include <cassert>
+
+// The vector implementations are compiled with per-function target
+// attributes, so the library itself can still be built for (and run on) any
+// x86 processor; which one to use is decided at runtime.
+#if defined(__GNUC__) && !defined(__clang__) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define USE_X86_LINE_SCAN
+#include <immintrin.h>
+#endif
+
+using ares::Byte;
+using ares::Line_scan_isa;
+
+namespace
+{
+typedef Byte const* (*Scan_function)(Byte const*, Byte const*);
+
+Byte const* find_newline_generic(Byte const* begin, Byte const* end)
+{
+    while (begin < end) {
+        if (*begin == '\r' || *begin == '\n')
+            return begin;
+        begin++;
+    }
+    return end;
+}
+
+#if defined(USE_X86_LINE_SCAN)
+
+__attribute__((target("sse2")))
+Byte const* find_newline_sse2(Byte const* begin, Byte const* end)
+{
+    __m128i const cr = _mm_set1_epi8('\r');
+    __m128i const lf = _mm_set1_epi8('\n');
+
+    while (end - begin >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+        unsigned mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+        begin += 16;
+    }
+    return find_newline_generic(begin, end);
+}
+
+__attribute__((target("avx2")))
+Byte const* find_newline_avx2(Byte const* begin, Byte const* end)
+{
+    __m256i const cr = _mm256_set1_epi8('\r');
+    __m256i const lf = _mm256_set1_epi8('\n');
+
+    while (end - begin >= 32) {
+        __m256i v = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const*>(begin));
+        unsigned mask = _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+                                _mm256_cmpeq_epi8(v, lf)));
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+        begin += 32;
+    }
+    return find_newline_sse2(begin, end);
+}
+
+#endif // USE_X86_LINE_SCAN
+
+Scan_function scan_function(Line_scan_isa isa)
+{
+    switch (isa) {
+#if defined(USE_X86_LINE_SCAN)
+        case ares::LINE_SCAN_SSE2:
+            return find_newline_sse2;
+        case ares::LINE_SCAN_AVX2:
+            return find_newline_avx2;
+#endif
+        default:
+            return find_newline_generic;
+    }
+}
+
+// The selected instruction set. Selection is idempotent, so a race between
+// threads that call find_newline for the first time is harmless.
+Line_scan_isa s_isa = ares::LINE_SCAN_GENERIC;
+Scan_function s_scan = 0;
+
+Scan_function select_scan_function()
+{
+    if (ares::is_line_scan_isa_supported(ares::LINE_SCAN_AVX2))
+        s_isa = ares::LINE_SCAN_AVX2;
+    else if (ares::is_line_scan_isa_supported(ares::LINE_SCAN_SSE2))
+        s_isa = ares::LINE_SCAN_SSE2;
+    else
+        s_isa = ares::LINE_SCAN_GENERIC;
+
+    return s_scan = scan_function(s_isa);
+}
+}
+
+Byte const* ares::find_newline(Byte const* begin, Byte const* end)
+{
+    Scan_function scan = s_scan ? s_scan : select_scan_function();
+    return scan(begin, end);
+}
+
+Byte const* ares::find_newline(Byte const* begin, Byte const* end,
+                               Line_scan_isa isa)
+{
+    assert(is_line_scan_isa_supported(isa));
+    return scan_function(isa)(begin, end);
+}
+
+bool ares::is_line_scan_isa_supported(Line_scan_isa isa)
+{
+    switch (isa) {
+        case LINE_SCAN_GENERIC:
+            return true;
+#if defined(USE_X86_LINE_SCAN)
+        case LINE_SCAN_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case LINE_SCAN_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+Line_scan_isa ares::line_scan_isa()
+{
+    if (!s_scan)
+        select_scan_function();
+    return s_isa;
+}
+
+char const* ares::to_string(Line_scan_isa isa)
+{
+    switch (isa) {
+        case LINE_SCAN_SSE2:
+            return "sse2";
+        case LINE_SCAN_AVX2:
+            return "avx2";
+        default:
+            return "generic";
+    }
+}
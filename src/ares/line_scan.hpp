@@ -0,0 +1,47 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_line_scan
+#define included_ares_line_scan
+
+#include "ares/types.hpp"
+
+namespace ares {
+
+// The instruction sets that find_newline can use. On x86 processors, the
+// widest one supported by the processor is selected the first time
+// find_newline is called; elsewhere, only LINE_SCAN_GENERIC is available.
+enum Line_scan_isa {
+    LINE_SCAN_GENERIC,      // one byte at a time
+    LINE_SCAN_SSE2,         // 16 bytes at a time
+    LINE_SCAN_AVX2          // 32 bytes at a time
+};
+
+// Returns a pointer to the first carriage return ('\r') or line feed ('\n')
+// in the range [begin, end). If there is none, returns end.
+Byte const* find_newline(Byte const* begin, Byte const* end);
+
+// Works like find_newline, but uses the given instruction set, which must be
+// supported (see is_line_scan_isa_supported). Intended for testing and
+// benchmarking.
+Byte const* find_newline(Byte const* begin, Byte const* end,
+                         Line_scan_isa isa);
+
+// Returns true if this processor supports the given instruction set, and
+// the library was built with an implementation of find_newline for it.
+bool is_line_scan_isa_supported(Line_scan_isa isa);
+
+// Returns the instruction set used by find_newline.
+Line_scan_isa line_scan_isa();
+
+// Returns the name of an instruction set ("generic", "sse2" or "avx2").
+char const* to_string(Line_scan_isa isa);
+
+} // namespace ares
+
+#endif
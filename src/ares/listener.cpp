@@ -16,14 +16,17 @@
 #include "ares/socket.hpp"
 #include "ares/string_util.hpp"
 #include "ares/trace.hpp"
+#include <memory>
 
 using namespace std;
 using ares::Listener;
 
-Listener::Listener(Service& service, Server_interface& server, int id)
+Listener::Listener(Service& service, Server_interface& server,
+                   Admission_gate& gate, int id)
         : Component("listener", service.name())
         , m_service(service)
         , m_server(server)
+        , m_gate(gate)
         , m_id(id)
 {
     // Bind our socket acceptor to our specified address and port. Let
@@ -42,13 +45,31 @@ void Listener::run()
     Trace::set_thread_name(format("lsnr_%d", m_id).c_str());
 
     // Loop until stopped, polling for queued incoming connections. Delegate
-    // the action to take on a new connection to the held Listener_strategy.
+    // the action to take on a new connection to the held Listener_strategy,
+    // unless the server is overloaded and the strategy is subject to
+    // admission control.
 
+    bool const is_controlled = m_service.strategy()->is_admission_controlled();
     while (!is_stopped()) {
         try {
+            Admission_policy policy = ADMISSION_PAUSE;
+            string reject_message;
+            bool const admit = !is_controlled
+                               || m_gate.admit(policy, reject_message);
+            if (!admit && policy == ADMISSION_PAUSE) {
+                // Leave new connections in the listen queue until the
+                // server can take them on.
+                milli_sleep(DELAY);
+                continue;
+            }
+
             m_acceptor.wait_for_connection(DELAY, m_sockets);
             for (int i = 0; i < int(m_sockets.size()); i++) {
                 Socket* socket = m_sockets[i];
+                if (!admit) {
+                    reject(socket, reject_message);
+                    continue;
+                }
                 Log::writef(Log::DEBUG,
                             "lsnr (%d): connection to %s:%s from %s", m_id,
                             m_service.address().c_str(),
@@ -74,3 +95,22 @@ void Listener::run()
         }
     }
 }
+
+void Listener::reject(Socket* socket, string const& message)
+{
+    // The message is sent without waiting, since the listener must not be
+    // held up by a slow client; a client that can't take it at once just
+    // sees the connection closed.
+    auto_ptr<Socket> s(socket);
+    m_gate.count_rejection();
+    Log::writef(Log::DEBUG, "lsnr (%d): rejected connection to %s:%s from %s",
+                m_id, m_service.address().c_str(), m_service.port().c_str(),
+                s->to_string().c_str());
+    if (!message.empty()) {
+        try {
+            s->try_write(reinterpret_cast<Byte const*>(message.data()),
+                         message.size());
+        }
+        catch (Network_error&) {}
+    }
+}
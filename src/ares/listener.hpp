@@ -11,32 +11,55 @@
 
 // This is an implementation file; do not use directly.
 
+#include "ares/admission_control.hpp"
 #include "ares/command_queue.hpp"
 #include "ares/component.hpp"
 #include "ares/service.hpp"
 #include "ares/socket_acceptor.hpp"
+#include <string>
 
 namespace ares {
 
 class Server_interface;
 class Service;
 
+// Decides whether listeners take on new connections (see Server::
+// set_admission_limits).
+class Admission_gate {
+  public:
+    virtual ~Admission_gate() {}
+
+    // Returns true if new connections should be handed to the service's
+    // strategy. Otherwise, stores in policy what should be done with them
+    // instead, and in reject_message what should be sent to those that are
+    // rejected.
+    virtual bool admit(Admission_policy& policy,
+                       std::string& reject_message) = 0;
+
+    // Records that a connection was rejected.
+    virtual void count_rejection() = 0;
+};
+
 // Listener is the framework component responsible for accepting incoming
 // connections and constructing new sessions.
 class Listener : public Component {
   public:
-    // Constructs a listener for a specified service.
-    Listener(Service& service, Server_interface& server, int id);
+    // Constructs a listener for a specified service, which asks gate before
+    // accepting connections.
+    Listener(Service& service, Server_interface& server,
+             Admission_gate& gate, int id);
 
     // Destroys this object and closes its listen socket.
     ~Listener();
 
   private:
     void run();
+    void reject(Socket* socket, std::string const& message);
 
   private:
     Service& m_service;             // the listen service
     Server_interface& m_server;     // server interface
+    Admission_gate& m_gate;         // decides whether to take connections
     int const m_id;                 // unique ID assigned to this listener
     Socket_acceptor m_acceptor;     // socket acceptor/factory
     std::vector<Socket*> m_sockets; // for passing to acceptor
@@ -28,6 +28,12 @@ class Listener_strategy {
     // new connection is first established.
     virtual void handle_connection(Server_interface& server,
                                    Socket* socket) = 0;
+
+    // Returns true if the server's admission control applies to this
+    // strategy's connections (see Server::set_admission_limits). A strategy
+    // whose connections must be taken even while the server is overloaded,
+    // such as one that serves its operators, may return false.
+    virtual bool is_admission_controlled() const { return true; }
 };
 
 } // namespace ares
@@ -215,6 +215,16 @@ void Log::shutdown()
     s_log->m_lgwr_thread.wait_for_exit(10*1000);
 }
 
+void Log::set_cpu_affinity(Cpu_set const& cpus)
+{
+    s_log->m_lgwr_thread.set_affinity(cpus);
+}
+
+Cpu_set Log::current_cpu_affinity()
+{
+    return s_log->m_lgwr_thread.current_affinity();
+}
+
 void Log::attach(string filename, int level) try
 {
     filename = boost::trim_copy(filename);
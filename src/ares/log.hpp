@@ -9,6 +9,7 @@
 #ifndef included_ares_log
 #define included_ares_log
 
+#include "ares/platform.hpp"
 #include "ares/socket.hpp"
 #include <string>
 
@@ -44,6 +45,14 @@ struct Log {
     // before returning. Has no effect if the log writer is not running.
     static void shutdown();
 
+    // Binds the log writer thread to the given cpus, or unbinds it if cpus
+    // is empty (see Thread::set_affinity).
+    static void set_cpu_affinity(Cpu_set const& cpus);
+
+    // Returns the cpus the log writer thread may run on, as reported by the
+    // system, or an empty set if the log writer isn't running.
+    static Cpu_set current_cpu_affinity();
+
     // Attaches a file backend to the log. The file is specified by its path,
     // and if it can't be opened, this function will raise an error. If
     // successful, all log messages with a log level of at least the specified
@@ -0,0 +1,200 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/lz_codec.hpp"
+#include <cstring>
+
+using ares::Byte;
+using ares::Lz_codec;
+using ares::Uint32;
+
+namespace
+{
+// Constants of the block format.
+int const MIN_MATCH = 4;            // shortest match
+int const MAX_OFFSET = 65535;       // farthest match
+int const LAST_LITERALS = 5;        // the last 5 bytes are always literals
+int const MATCH_LIMIT = 12;         // no match starts in the last 12 bytes
+
+inline Uint32 read32(Byte const* p)
+{
+    Uint32 n;
+    std::memcpy(&n, p, sizeof(n));  // (unaligned)
+    return n;
+}
+
+inline Uint32 hash(Uint32 n, int bits)
+{
+    return (n*2654435761U) >> (32 - bits);
+}
+
+// Writes the length extension of a literal or match length n, which has
+// already been reduced by 15; returns the new output position.
+inline Byte* put_length(Byte* op, int n)
+{
+    for ( ; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = Byte(n);
+    return op;
+}
+
+// Writes a sequence of literals [anchor, ip) followed by a match of
+// match_length bytes at the given offset (no match if match_length is zero).
+// Returns the new output position, or 0 if the sequence might not fit
+// before oend.
+Byte* put_sequence(Byte* op, Byte* oend, Byte const* anchor, Byte const* ip,
+                   int offset, int match_length)
+{
+    int const literals = ip - anchor;
+    if (oend - op < 1 + literals + literals/255 + 1 + 2 + match_length/255 + 1)
+        return 0;
+
+    Byte* token = op++;
+    int m = match_length > 0 ? match_length - MIN_MATCH : 0;
+    *token = Byte((literals < 15 ? literals : 15) << 4 | (m < 15 ? m : 15));
+
+    if (literals >= 15)
+        op = put_length(op, literals - 15);
+    std::memcpy(op, anchor, literals);
+    op += literals;
+
+    if (match_length > 0) {
+        *op++ = Byte(offset);
+        *op++ = Byte(offset >> 8);
+        if (m >= 15)
+            op = put_length(op, m - 15);
+    }
+    return op;
+}
+
+// Reads a length extension into n. Returns false if it runs past iend or
+// past limit.
+inline bool get_length(Byte const*& ip, Byte const* iend, int& n, int limit)
+{
+    Byte b;
+    do {
+        if (ip >= iend)
+            return false;
+        b = *ip++;
+        n += b;
+        if (n > limit)
+            return false;
+    } while (b == 255);
+    return true;
+}
+}
+
+Lz_codec::Lz_codec()
+{}
+
+int Lz_codec::compress(Byte const* src, int count, Byte* dst, int capacity)
+{
+    Byte const* ip = src;
+    Byte const* anchor = src;           // start of pending literals
+    Byte const* const iend = src + count;
+    Byte* op = dst;
+    Byte* const oend = dst + capacity;
+
+    if (count > MATCH_LIMIT) {
+        Byte const* const mflimit = iend - MATCH_LIMIT;
+        Byte const* const matchlimit = iend - LAST_LITERALS;
+
+        std::memset(m_table, 0, sizeof(m_table));
+        ip++;
+
+        while (ip < mflimit) {
+            Uint32 const h = hash(read32(ip), HASH_BITS);
+            Byte const* ref = src + m_table[h];
+            m_table[h] = ip - src;
+
+            if (ip - ref > MAX_OFFSET || read32(ref) != read32(ip)) {
+                // Skip faster through data that does not compress.
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            // Extend the match backward, then forward.
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            Byte const* end = ip + MIN_MATCH;
+            Byte const* r = ref + MIN_MATCH;
+            while (end < matchlimit && *end == *r) {
+                end++;
+                r++;
+            }
+
+            op = put_sequence(op, oend, anchor, ip, ip - ref, end - ip);
+            if (!op)
+                return 0;
+
+            ip = anchor = end;
+            if (ip - 2 > src && ip < mflimit)
+                m_table[hash(read32(ip - 2), HASH_BITS)] = ip - 2 - src;
+        }
+    }
+
+    op = put_sequence(op, oend, anchor, iend, 0, 0);
+    return op ? op - dst : 0;
+}
+
+int Lz_codec::decompress(Byte const* src, int count, Byte* dst,
+                         int dst_count)
+{
+    Byte const* ip = src;
+    Byte const* const iend = src + count;
+    Byte* op = dst;
+    Byte* const oend = dst + dst_count;
+
+    for (;;) {
+        if (ip >= iend)
+            return -1;
+        int const token = *ip++;
+
+        // Copy the literals.
+        int literals = token >> 4;
+        if (literals == 15 && !get_length(ip, iend, literals, dst_count))
+            return -1;
+        if (literals > iend - ip || literals > oend - op)
+            return -1;
+        std::memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip == iend)
+            break;                      // (the last sequence)
+
+        // Copy the match, which may overlap its own output.
+        if (iend - ip < 2)
+            return -1;
+        int const offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > op - dst)
+            return -1;
+
+        int length = token & 15;
+        if (length == 15 && !get_length(ip, iend, length, dst_count))
+            return -1;
+        length += MIN_MATCH;
+        if (length > oend - op)
+            return -1;
+
+        Byte const* ref = op - offset;
+        if (offset >= length) {
+            std::memcpy(op, ref, length);
+            op += length;
+        }
+        else {
+            for (int i = 0; i < length; i++)
+                *op++ = *ref++;
+        }
+    }
+
+    return op == oend ? dst_count : -1;
+}
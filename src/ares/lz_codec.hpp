@@ -0,0 +1,58 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_lz_codec
+#define included_ares_lz_codec
+
+#include "ares/types.hpp"
+#include "ares/utility.hpp"
+
+namespace ares {
+
+// A fast LZ77 block compressor, which writes the LZ4 block format: a series
+// of sequences, each consisting of a run of literal bytes and a match (a
+// copy of 4 or more bytes from up to 64KB earlier in the output), the last
+// of which has literals only. It trades compression ratio for speed, which
+// suits repetitive data such as text-encoded messages, at several hundred
+// megabytes per second.
+//
+// An Lz_codec object holds the compressor's hash table (16KB), so a caller
+// that compresses repeatedly should keep one object around rather than
+// construct one for each block. Decompression needs no state.
+class Lz_codec : boost::noncopyable {
+  public:
+    // Constructs a codec.
+    Lz_codec();
+
+    // Compresses count bytes from src into dst, which has room for capacity
+    // bytes. Returns the size of the compressed block, or 0 if it would not
+    // fit, in which case the contents of dst are undefined. A capacity of
+    // max_compressed_size(count) is always enough.
+    int compress(Byte const* src, int count, Byte* dst, int capacity);
+
+    // Decompresses the count-byte block at src, which must decompress to
+    // exactly dst_count bytes, into dst. Returns dst_count, or -1 if the block
+    // is corrupt; no byte outside [dst, dst+dst_count) is ever written.
+    static int decompress(Byte const* src, int count, Byte* dst,
+                          int dst_count);
+
+    // Returns the largest size to which count bytes can compress.
+    static int max_compressed_size(int count)
+    {
+        return count + count/255 + 16;
+    }
+
+  private:
+    enum { HASH_BITS = 12 };
+
+    Uint32 m_table[1 << HASH_BITS];     // recent positions, by hash of 4 bytes
+};
+
+} // namespace ares
+
+#endif
@@ -8,16 +8,26 @@
 
 #include "ares/message_reader.hpp"
 #include "ares/data_reader.hpp"
+#include "ares/bin_util.hpp"
 #include "ares/error.hpp"
+#include <algorithm>
 
 using namespace std;
 using ares::Message_reader;
 
 namespace
 {
+// Bits of the flags in a packet header, and of the size of a single frame;
+// see Message_writer.
+int const CHAINED_FLAG = 0x01;
+int const COMPRESSED_FLAG = 0x02;
+ares::Uint32 const COMPRESSED_FRAME_BIT = 0x40000000U;
+ares::Uint32 const FRAME_SIZE_MASK = 0x3FFFFFFFU;
+
 inline bool read_packet_headers(int& packet_size,
                                 int& seq_num,
                                 bool& chained,
+                                bool& compressed,
                                 ares::Data_reader& reader,
                                 ares::Buffer& b,
                                 int max_packet_size)
@@ -36,14 +46,16 @@ inline bool read_packet_headers(int& packet_size,
     // Read the packet header.
     b.consume(sizeof(packet_size));
     seq_num = reader.get_int16();
-    chained = reader.get_int8();
+    int flags = reader.get_int8();
+    chained = flags & CHAINED_FLAG;
+    compressed = flags & COMPRESSED_FLAG;
     packet_size -= sizeof(Int16) + sizeof(Int8);
     return true;
 }
 }
 
 enum {
-    DEFAULT_MAX_PACKET_SIZE = 1*1024,
+    DEFAULT_MAX_PACKET_SIZE = 64*1024,
     DEFAULT_MAX_MESSAGE_SIZE = 1024*1024,
     DEFAULT_RETAINED_SIZE = 1024*1024,
 };
@@ -56,6 +68,12 @@ Message_reader::Message_reader(Sink& sink)
         , m_retained_size(DEFAULT_RETAINED_SIZE)
         , m_num_messages(0)
         , m_overflow(false)
+        , m_frame_left(0)
+        , m_discard_frame(false)
+        , m_single_frames(false)
+        , m_frame_compressed(false)
+        , m_compression(false)
+        , m_inflated_size(0)
 {}
 
 int Message_reader::read_messages(Buffer& input)
@@ -64,16 +82,22 @@ int Message_reader::read_messages(Buffer& input)
     int packet_size;
     int seq_num;
     bool chained;
+    bool compressed;
 
     m_num_messages = 0;     // return value of this function
 
+    // Finish reading a single frame begun by a previous call.
+    if (m_frame_left > 0 && !read_frame_data(input))
+        return 0;
+
     if (m_overflow) {
         // A previous message caused a Message_size_exceeded_error exception
         // to be raised. We must now discard packets until we find one whose
         // chained-flag is zero, which indicates that the subsequent packet
         // will begin a new logical message.
         for (;;) {
-            if (!read_packet_headers(packet_size, seq_num, chained, reader,
+            if (!read_packet_headers(packet_size, seq_num, chained,
+                                     compressed, reader,
                                      input, m_max_packet_size))
                 return 0;
 
@@ -86,7 +110,17 @@ int Message_reader::read_messages(Buffer& input)
     }
 
     for (;;) {
-        if (!read_packet_headers(packet_size, seq_num, chained, reader,
+        // Single frames have negative sizes; see Message_writer.
+        if (input.size() >= int(sizeof(Int32)) && reader.peek_int32() < 0) {
+            if (m_buffer.size() > 0)
+                throw Packet_sequence_error();
+            if (!read_frame(input))
+                break;
+            continue;
+        }
+
+        if (!read_packet_headers(packet_size, seq_num, chained,
+                                 compressed, reader,
                                  input, m_max_packet_size))
             break;
 
@@ -99,25 +133,28 @@ int Message_reader::read_messages(Buffer& input)
         }
 
         if (m_buffer.size() > 0) {  // we previously read a partial message
-            if (seq_num != ++m_seq_num)
+            // (the sequence number wraps around after 65535 packets)
+            if (Int16(seq_num) != Int16(++m_seq_num))
                 throw Packet_sequence_error();
 
             m_buffer.set_min_capacity(msg_size);
             m_buffer.put(input.begin(), packet_size);
 
             if (!chained) {
-                m_sink.send(m_buffer);
+                bool sent = send(m_buffer, m_buffer.size(), compressed);
                 m_buffer.clear();
-                m_num_messages++;
+                input.consume(packet_size);
+                if (!sent)
+                    raise_inflate_error();
+                continue;
             }
         }
         else if (!chained) {        // the whole message is available
-            if (input.size() == packet_size)
-                m_sink.send(input);
-            else
-                m_sink.send(input.begin(), packet_size);
-
-            m_num_messages++;
+            bool sent = send(input, packet_size, compressed);
+            input.consume(packet_size);
+            if (!sent)
+                raise_inflate_error();
+            continue;
         }
         else {                      // this message is chained
             m_buffer.assign(input.begin(), packet_size);
@@ -127,8 +164,9 @@ int Message_reader::read_messages(Buffer& input)
         input.consume(packet_size);
     }
 
-    // If our internal buffer is over our retained size, compact it.
-    if (m_buffer.capacity() > m_retained_size &&
+    // If our internal buffer is over our retained size, compact it (unless
+    // it was allocated for the single frame being read).
+    if (m_frame_left == 0 && m_buffer.capacity() > m_retained_size &&
         m_buffer.size() < m_retained_size)
     {
         Buffer temp(m_retained_size);
@@ -139,6 +177,116 @@ int Message_reader::read_messages(Buffer& input)
     return m_num_messages;
 }
 
+bool Message_reader::read_frame(Buffer& input)
+{
+    // Reads a single frame from the front of the input buffer, which begins
+    // with its header. Returns false if more input is needed.
+
+    Uint32 const header = unpack_uint32(input.begin());
+    int const size = header & FRAME_SIZE_MASK;
+    m_single_frames = true;
+    m_frame_compressed = header & COMPRESSED_FRAME_BIT;
+
+    if (size > m_max_message_size) {
+        input.consume(sizeof(Int32));
+        m_frame_left = size;
+        m_discard_frame = true;
+        read_frame_data(input);     // (discards what is already here)
+        throw Message_size_exceeded_error(size, m_max_message_size);
+    }
+
+    // When the whole frame is here, send it from the input buffer.
+    if (input.size() - int(sizeof(Int32)) >= size) {
+        input.consume(sizeof(Int32));
+        bool sent = send(input, size, m_frame_compressed);
+        input.consume(size);
+        if (!sent)
+            raise_inflate_error();
+        return true;
+    }
+
+    // Otherwise collect it in our own buffer, allocated to size.
+    input.consume(sizeof(Int32));
+    m_buffer.clear();
+    m_buffer.set_min_capacity(size);
+    m_frame_left = size;
+    return read_frame_data(input);
+}
+
+bool Message_reader::read_frame_data(Buffer& input)
+{
+    // Moves the rest of a single frame from the input buffer to m_buffer (or
+    // discards it), sending the frame to the sink once it is complete.
+    // Returns false if more input is needed.
+
+    int n = min(input.size(), m_frame_left);
+    if (!m_discard_frame)
+        m_buffer.put(input.begin(), n);
+    input.consume(n);
+    m_frame_left -= n;
+    if (m_frame_left > 0)
+        return false;
+
+    if (m_discard_frame) {
+        m_discard_frame = false;
+    }
+    else {
+        bool sent = send(m_buffer, m_buffer.size(), m_frame_compressed);
+        m_buffer.clear();
+        if (!sent)
+            raise_inflate_error();
+    }
+    return true;
+}
+
+bool Message_reader::send(Buffer& message, int count, bool compressed)
+{
+    // Sends the message in the first count bytes of a buffer to the sink,
+    // decompressing it first if necessary. Returns false if it could not be
+    // decompressed; the caller must then remove it from the buffer and call
+    // raise_inflate_error.
+
+    if (!compressed) {
+        if (message.size() == count)
+            m_sink.send(message);
+        else
+            m_sink.send(message.begin(), count);
+        m_num_messages++;
+        return true;
+    }
+
+    m_compression = true;
+    if (count < int(sizeof(Int32)))
+        return false;
+    Byte const* const data = message.begin();
+    m_inflated_size = unpack_int32(data);
+    if (m_inflated_size < 0 || m_inflated_size > m_max_message_size)
+        return false;
+
+    m_inflated.clear();
+    m_inflated.set_min_capacity(m_inflated_size);
+    if (Lz_codec::decompress(data + sizeof(Int32), count - sizeof(Int32),
+                             m_inflated.begin(), m_inflated_size) < 0)
+        return false;
+    m_inflated.advance(m_inflated_size);
+
+    m_sink.send(m_inflated);
+    m_num_messages++;
+
+    // Like m_buffer, m_inflated does not keep an unusually large capacity.
+    if (m_inflated.capacity() > m_retained_size)
+        Buffer().swap(m_inflated);
+    return true;
+}
+
+void Message_reader::raise_inflate_error()
+{
+    if (m_inflated_size > m_max_message_size)
+        throw Message_size_exceeded_error(m_inflated_size,
+                                          m_max_message_size);
+    throw Message_corrupt_error();
+}
+
 void Message_reader::set_max_packet_size(int n)
 {
     m_max_packet_size = n > 0 ? n : 1;
@@ -11,6 +11,7 @@
 
 #include "ares/buffer.hpp"
 #include "ares/buffer_formatter.hpp"
+#include "ares/lz_codec.hpp"
 #include "ares/sink.hpp"
 #include <cstring>
 #include <string>
@@ -19,7 +20,13 @@ namespace ares {
 
 // A buffer formatter that parses messages from an input buffer. The messages
 // must be in the same format as those created by the Message_writer class.
-// See that class's documentation for more details.
+// See that class's documentation for more details. Both chained packets and
+// single frames are accepted, in any mix, and so are compressed messages,
+// which are decompressed before they are sent to the sink.
+//
+// A single frame that is not yet entirely in the input buffer is moved into
+// an internal buffer of exactly the frame's size as it arrives, so the input
+// buffer need not be large enough to hold it.
 class Message_reader : public Buffer_formatter {
   public:
     // Constructs a message reader given a Sink to which messages can be sent.
@@ -37,17 +44,24 @@ class Message_reader : public Buffer_formatter {
     // results.
     //
     // Throws a Packet_size_exceeded_error if an input packet exceeds the
-    // maximum size (see Message_reader::max_packet_size).
+    // maximum size (see Message_reader::max_packet_size). Single frames are
+    // limited only by the maximum message size.
     //
     // Throws a Message_size_exceeded_error if an input message exceeds the
-    // maximum size (see (see Message_reader::max_message_size).
+    // maximum size (see (see Message_reader::max_message_size). The limit
+    // applies to compressed messages both before and after decompression.
+    //
+    // Throws a Message_corrupt_error if a compressed message cannot be
+    // decompressed. The message is discarded, and the channel can be kept
+    // open.
     //
     // Throws a Packet_sequence_error if an input packet is received out of
-    // sequence.
+    // sequence, or a single frame is received in the middle of a chained
+    // message.
     int read_messages(Buffer& input);
 
     // Sets the maximum packet size allowed by this object. The default packet
-    // size limit is 1KB. Any input packets that exceed n bytes in length will
+    // size limit is 64KB. Any input packets that exceed n bytes in length will
     // cause Message_reader::read_messages to raise an exception. Note that if
     // n is less than one, the size limit will be set to one.
     void set_max_packet_size(int n);
@@ -86,6 +100,22 @@ class Message_reader : public Buffer_formatter {
     // or more messages.
     int num_messages() const { return m_num_messages; }
 
+    // Returns true if this object has read a single frame (see
+    // Message_writer), which shows that the peer supports them; a session
+    // may then switch its own Message_writer to FRAMING_SINGLE.
+    bool peer_uses_single_frames() const { return m_single_frames; }
+
+    // Returns true if this object has read a compressed message, which shows
+    // that the peer supports them (see
+    // Message_writer::set_compression_threshold).
+    bool peer_uses_compression() const { return m_compression; }
+
+  private:
+    bool read_frame(Buffer& input);
+    bool read_frame_data(Buffer& input);
+    bool send(Buffer& message, int count, bool compressed);
+    void raise_inflate_error();
+
   private:
     Sink& m_sink;           // where to send message buffers
     Buffer m_buffer;        // for storing partial messages
@@ -95,6 +125,13 @@ class Message_reader : public Buffer_formatter {
     int m_seq_num;          // for ordering packets in a sequence
     int m_num_messages;     // # successfully read by last read_messages call
     bool m_overflow;        // set when an input message was too big
+    int m_frame_left;       // bytes of a single frame yet to be read
+    bool m_discard_frame;   // set when that frame was too big
+    bool m_single_frames;   // set once a single frame has been read
+    bool m_frame_compressed;    // is the frame being read compressed?
+    bool m_compression;     // set once a compressed message has been read
+    Buffer m_inflated;      // the last compressed message, decompressed
+    int m_inflated_size;    // its size, according to the sender
 };
 
 } // namespace ares
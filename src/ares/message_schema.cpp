@@ -0,0 +1,176 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/message_schema.hpp"
+#include "ares/bin_util.hpp"
+
+using namespace std;
+using ares::Schema_decoder;
+using ares::Schema_sizer;
+
+int Schema_sizer::size(Uint32 n)
+{
+    Byte buf[5];
+    return encode_varint32(buf, n);
+}
+
+int Schema_sizer::size(string const& s)
+{
+    return sizeof(Int32) + s.size();
+}
+
+int Schema_sizer::size(vector<Int32> const& v)
+{
+    return sizeof(Int32) + v.size()*sizeof(Int32);
+}
+
+int Schema_sizer::size(vector<Uint32> const& v)
+{
+    return size(Uint32(v.size())) +
+           compressed_uint32_array_size(v.empty() ? 0 : &v[0], v.size());
+}
+
+bool Schema_decoder::can_read(int n)
+{
+    if (m_ok && m_end - m_pos >= n)
+        return true;
+    m_ok = false;
+    return false;
+}
+
+void Schema_decoder::read(Int8& n)
+{
+    if (can_read(sizeof(n)))
+        n = static_cast<Int8>(*m_pos++);
+}
+
+void Schema_decoder::read(Int16& n)
+{
+    if (can_read(sizeof(n))) {
+        n = unpack_int16(m_pos);
+        m_pos += sizeof(n);
+    }
+}
+
+void Schema_decoder::read(Int32& n)
+{
+    if (can_read(sizeof(n))) {
+        n = unpack_int32(m_pos);
+        m_pos += sizeof(n);
+    }
+}
+
+void Schema_decoder::read(Int64& n)
+{
+    if (can_read(sizeof(n))) {
+        n = unpack_int64(m_pos);
+        m_pos += sizeof(n);
+    }
+}
+
+void Schema_decoder::read(bool& b)
+{
+    if (can_read(sizeof(Int8)))
+        b = *m_pos++ != 0;
+}
+
+void Schema_decoder::read(double& d)
+{
+    if (can_read(sizeof(d))) {
+        d = unpack_double(m_pos);
+        m_pos += sizeof(d);
+    }
+}
+
+void Schema_decoder::read(Uint32& n)
+{
+    if (!m_ok)
+        return;
+    int used = decode_varint32(m_pos, m_end - m_pos, n);
+    if (used > 0)
+        m_pos += used;
+    else
+        m_ok = false;
+}
+
+void Schema_decoder::read(string& s)
+{
+    Int32 length;
+    read(length);
+    if (m_ok && (length < 0 || !can_read(length)))
+        m_ok = false;
+    if (m_ok) {
+        s.assign(reinterpret_cast<char const*>(m_pos), length);
+        m_pos += length;
+    }
+}
+
+void Schema_decoder::read(vector<Int32>& v)
+{
+    Int32 count;
+    read(count);
+    if (m_ok && (count < 0 || (m_end - m_pos)/4 < count))
+        m_ok = false;
+    if (m_ok) {
+        v.resize(count);
+        if (count > 0)
+            unpack_int32_array(m_pos, &v[0], count);
+        m_pos += count*sizeof(Int32);
+    }
+}
+
+void Schema_decoder::read(vector<Uint32>& v)
+{
+    Uint32 count;
+    read(count);
+
+    // Every integer takes at least one byte; see
+    // Data_reader::get_uint32_array.
+    if (m_ok && count > Uint32(m_end - m_pos))
+        m_ok = false;
+    if (!m_ok)
+        return;
+
+    v.resize(count);
+    if (count > 0) {
+        int used = decompress_uint32_array(m_pos, m_end - m_pos, &v[0],
+                                           count);
+        if (used == 0)
+            m_ok = false;
+        m_pos += used;
+    }
+}
+
+int ares::read_message_header(Data_reader& reader, int& version,
+                              Byte const*& begin, Byte const*& end)
+{
+    int available;
+    Byte const* p = reader.peek(available);
+    if (!p)
+        return 0;
+
+    Uint32 v, length;
+    int version_size = decode_varint32(p, available, v);
+    int length_size = version_size > 0
+            ? decode_varint32(p + version_size, available - version_size,
+                              length)
+            : 0;
+    int header_size = version_size + length_size;
+
+    if (version_size <= 0 || length_size <= 0 || v > 0x7FFFFFFF ||
+        length > Uint32(available - header_size))
+    {
+        reader.fail();
+        return 0;
+    }
+
+    version = v;
+    begin = p + header_size;
+    end = begin + length;
+    return header_size + length;
+}
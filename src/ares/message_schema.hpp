@@ -0,0 +1,315 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_message_schema
+#define included_ares_message_schema
+
+// Message schemas: a message type declares its fields once, and
+// write_message and read_message encode and decode it, instead of a handler
+// calling Message_writer::put_* and Data_reader::get_* field by field (and
+// checking the reader after each call). For example:
+//
+//      struct Login_request {
+//          enum { VERSION = 2 };
+//
+//          Int32 user_id;
+//          std::string name;
+//          std::vector<Uint32> group_ids;
+//          Optional<std::string> locale;       // added in version 2
+//
+//          template<class Visitor>
+//          void visit_fields(Visitor& v) {
+//              v.field(user_id);
+//              v.field(name);
+//              v.field(group_ids);
+//              v.field(locale, 2);
+//          }
+//      };
+//
+//      writer.begin_message();
+//      write_message(writer, request);
+//      writer.end_message();
+//      ...
+//      Data_reader reader(message);
+//      Login_request request;
+//      if (!read_message(reader, request))
+//          ...
+//
+// An encoded message consists of a header and the fields, in the order in
+// which visit_fields visits them:
+//
+//  +---------+--------+-----------+
+//  | version | length | fields... |
+//  +---------+--------+-----------+
+//
+// version and length are varints (see Data_writer::put_varint): the schema
+// version the message was written with, and the number of bytes of field
+// data that follow. Each field is encoded exactly as the corresponding
+// Data_writer function would encode it, so messages remain readable by hand
+// with a Data_reader:
+//
+//      Int8, Int16, Int32, Int64       put_int8, ..., put_int64
+//      bool                            put_int8 (0 or 1)
+//      Uint32                          put_varint
+//      double                          put_double
+//      std::string                     put_string
+//      std::vector<Int32>              put_int32_array
+//      std::vector<Uint32>             put_uint32_array
+//      Optional<T>                     put_int8 (0 or 1), then T if present
+//
+// Versioning: each field has a "since" version (1 unless given as the second
+// argument to field), and a message written with version N contains exactly
+// the fields whose since-version is at most N. New fields must therefore be
+// added at the end of visit_fields, with the schema's new VERSION. A reader
+// that is older than the writer skips the fields it does not know, using the
+// length; a reader that is newer resets the fields the writer did not know
+// to their default values (T(), or absent for Optional fields).
+//
+// read_message checks once that the whole message is in the buffer, then
+// decodes the fields directly from memory, bounded by the message length.
+
+#include "ares/data_reader.hpp"
+#include "ares/types.hpp"
+#include <string>
+#include <vector>
+
+namespace ares {
+
+// A message field that may be absent. Absent fields cost one byte.
+template<class T>
+class Optional {
+  public:
+    // Constructs an absent value.
+    Optional() : m_present(false), m_value() {}
+
+    // Constructs a present value.
+    Optional(T const& value) : m_present(true), m_value(value) {}
+
+    // Returns true if the value is present.
+    bool present() const { return m_present; }
+
+    // Returns the value, which must be present.
+    T const& get() const { return m_value; }
+
+    // Returns the value if present, or dflt otherwise.
+    T const& get(T const& dflt) const { return m_present ? m_value : dflt; }
+
+    // Makes the value present and equal to value.
+    void set(T const& value) { m_value = value; m_present = true; }
+
+    // Makes the value absent.
+    void clear() { m_value = T(); m_present = false; }
+
+    // Makes the value present, returning a reference to it. Intended for
+    // decoders.
+    T& set() { m_present = true; return m_value; }
+
+  private:
+    bool m_present;     // true if m_value is meaningful
+    T m_value;          // the value, if present
+};
+
+// A field visitor that computes the encoded size of a message's fields.
+class Schema_sizer {
+  public:
+    // Constructs a sizer for the given schema version.
+    explicit Schema_sizer(int version) : m_version(version), m_size(0) {}
+
+    // Adds the size of a field, if it is in this version.
+    template<class T>
+    void field(T const& x, int since = 1)
+    {
+        if (since <= m_version)
+            m_size += size(x);
+    }
+
+    template<class T>
+    void field(Optional<T> const& x, int since = 1)
+    {
+        if (since <= m_version)
+            m_size += 1 + (x.present() ? size(x.get()) : 0);
+    }
+
+    // Returns the total size of the fields visited so far.
+    int size() const { return m_size; }
+
+  private:
+    static int size(Int8)   { return sizeof(Int8); }
+    static int size(Int16)  { return sizeof(Int16); }
+    static int size(Int32)  { return sizeof(Int32); }
+    static int size(Int64)  { return sizeof(Int64); }
+    static int size(bool)   { return sizeof(Int8); }
+    static int size(double) { return sizeof(double); }
+    static int size(Uint32 n);
+    static int size(std::string const& s);
+    static int size(std::vector<Int32> const& v);
+    static int size(std::vector<Uint32> const& v);
+
+  private:
+    int m_version;      // the schema version being encoded
+    int m_size;         // total size of the fields visited so far
+};
+
+// A field visitor that writes a message's fields with a Writer, which is
+// either a Message_writer or a Data_writer.
+template<class Writer>
+class Schema_encoder {
+  public:
+    // Constructs an encoder for the given schema version.
+    Schema_encoder(Writer& writer, int version)
+            : m_writer(writer)
+            , m_version(version)
+    {}
+
+    // Writes a field, if it is in this version.
+    template<class T>
+    void field(T const& x, int since = 1)
+    {
+        if (since <= m_version)
+            write(x);
+    }
+
+    template<class T>
+    void field(Optional<T> const& x, int since = 1)
+    {
+        if (since <= m_version) {
+            m_writer.put_int8(x.present());
+            if (x.present())
+                write(x.get());
+        }
+    }
+
+  private:
+    void write(Int8 n)                      { m_writer.put_int8(n); }
+    void write(Int16 n)                     { m_writer.put_int16(n); }
+    void write(Int32 n)                     { m_writer.put_int32(n); }
+    void write(Int64 n)                     { m_writer.put_int64(n); }
+    void write(bool b)                      { m_writer.put_int8(b); }
+    void write(double d)                    { m_writer.put_double(d); }
+    void write(Uint32 n)                    { m_writer.put_varint(n); }
+    void write(std::string const& s)        { m_writer.put_string(s); }
+    void write(std::vector<Int32> const& v) { m_writer.put_int32_array(v); }
+    void write(std::vector<Uint32> const& v){ m_writer.put_uint32_array(v); }
+
+  private:
+    Writer& m_writer;   // destination of the fields
+    int m_version;      // the schema version being encoded
+};
+
+// A field visitor that decodes a message's fields from memory. Once a field
+// cannot be decoded, this object enters the error state and the remaining
+// fields are left unchanged.
+class Schema_decoder {
+  public:
+    // Constructs a decoder for fields written with the given schema version,
+    // stored in [begin, end).
+    Schema_decoder(Byte const* begin, Byte const* end, int version)
+            : m_pos(begin)
+            , m_end(end)
+            , m_version(version)
+            , m_ok(true)
+    {}
+
+    // Decodes a field, if it is in the version the message was written with;
+    // otherwise resets it to its default value.
+    template<class T>
+    void field(T& x, int since = 1)
+    {
+        if (since <= m_version)
+            read(x);
+        else
+            x = T();
+    }
+
+    template<class T>
+    void field(Optional<T>& x, int since = 1)
+    {
+        Int8 present = 0;
+        if (since <= m_version)
+            read(present);
+        if (present && m_ok)
+            read(x.set());
+        else
+            x.clear();
+    }
+
+    // Returns false if a field could not be decoded.
+    bool ok() const { return m_ok; }
+
+  private:
+    void read(Int8& n);
+    void read(Int16& n);
+    void read(Int32& n);
+    void read(Int64& n);
+    void read(bool& b);
+    void read(double& d);
+    void read(Uint32& n);
+    void read(std::string& s);
+    void read(std::vector<Int32>& v);
+    void read(std::vector<Uint32>& v);
+    bool can_read(int n);
+
+  private:
+    Byte const* m_pos;  // next field
+    Byte const* m_end;  // end of the message
+    int m_version;      // the schema version the message was written with
+    bool m_ok;          // false once a field could not be decoded
+};
+
+// Writes message to writer (a Message_writer or Data_writer), encoded with
+// the given schema version. Message_writer::begin_message and
+// Message_writer::end_message remain the caller's responsibility.
+template<class Writer, class T>
+void write_message(Writer& writer, T const& message, int version = T::VERSION)
+{
+    T& fields = const_cast<T&>(message);    // visit_fields is not const
+
+    Schema_sizer sizer(version);
+    fields.visit_fields(sizer);
+    writer.put_varint(version);
+    writer.put_varint(sizer.size());
+
+    Schema_encoder<Writer> encoder(writer, version);
+    fields.visit_fields(encoder);
+}
+
+// Reads the header of a message written by write_message, checking that the
+// whole message is available. On success, stores the schema version and the
+// location of the field data, and returns the total size of the message;
+// nothing is removed from the buffer. Returns 0 (and puts the reader in the
+// error state) if the buffer does not begin with a whole message. Used by
+// read_message.
+int read_message_header(Data_reader& reader, int& version,
+                        Byte const*& begin, Byte const*& end);
+
+// Reads a message written by write_message, removing it from the reader's
+// buffer. Returns false, leaving the buffer unchanged and the reader in the
+// error state, if the buffer does not begin with a whole, valid message; in
+// that case the contents of message are undefined.
+template<class T>
+bool read_message(Data_reader& reader, T& message)
+{
+    int version;
+    Byte const* begin;
+    Byte const* end;
+    int size = read_message_header(reader, version, begin, end);
+    if (size == 0)
+        return false;
+
+    Schema_decoder decoder(begin, end, version);
+    message.visit_fields(decoder);
+    if (!decoder.ok()) {
+        reader.fail();
+        return false;
+    }
+    return reader.skip(size);
+}
+
+} // namespace ares
+
+#endif
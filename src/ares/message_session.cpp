@@ -11,12 +11,19 @@
 #include "ares/guard.hpp"
 #include "ares/server_interface.hpp"
 #include "ares/socket.hpp"
+#include "ares/thread.hpp"
 #include "ares/trace.hpp"
-#include <memory>
 
 using namespace std;
 using ares::Message_session;
 
+namespace
+{
+// The count of processed messages in the batch that this thread is
+// processing; see Message_session::Batch.
+ares::Thread_specific_value<int> batch_progress;
+}
+
 // This class insures that, even if an exception is thrown while processing a
 // message, the remaining messages will be processed by the server. Note that
 // this class begins in the disabled state and must be explicitly enabled;
@@ -26,11 +33,14 @@ class Message_session::Post_processing {
     Post_processing(Message_session* sess)
             : m_session(*sess)
             , m_enabled(false)
+            , m_pending(false)
     {}
 
     ~Post_processing()
     {
-        if (m_enabled && !m_session.m_message_queue.is_empty()) {
+        if (m_enabled &&
+            (m_pending || !m_session.m_message_queue.is_empty()))
+        {
             m_session.server().enqueue_command(
                 new Process_session_command(&m_session));
         }
@@ -41,16 +51,105 @@ class Message_session::Post_processing {
         m_enabled=true;
     }
 
+    // Notes that messages remain in the session's batch.
+    void set_pending(bool pending)
+    {
+        m_pending = pending;
+    }
+
   private:
     Message_session& m_session;
     bool m_enabled;
+    bool m_pending;
+};
+
+// This class deletes the messages of a batch that have been processed, even
+// if an exception is thrown while processing them, and leaves the others in
+// the batch. While it exists, the default process_messages counts the
+// messages it processes in m_done.
+class Message_session::Batch {
+  public:
+    Batch(vector<Buffer*>& messages, Post_processing* post_processing = 0)
+            : m_messages(messages)
+            , m_post_processing(post_processing)
+            , m_done(0)
+    {
+        batch_progress.reset(&m_done);
+    }
+
+    ~Batch()
+    {
+        batch_progress.reset(0);
+
+        // An override of process_messages that fails discards its batch.
+        if (m_done == 0)
+            m_done = m_messages.size();
+
+        for (int i = 0; i < m_done; i++)
+            delete m_messages[i];
+        m_messages.erase(m_messages.begin(), m_messages.begin() + m_done);
+        if (m_post_processing)
+            m_post_processing->set_pending(!m_messages.empty());
+    }
+
+    // Notes that every message in the batch has been processed.
+    void finish()
+    {
+        m_done = m_messages.size();
+    }
+
+  private:
+    vector<Buffer*>& m_messages;
+    Post_processing* m_post_processing;
+    int m_done;
 };
 
+// This class returns a stream to the idle state when a processor has
+// finished with it, even if an exception was thrown, and has the server
+// process it again if messages arrived meanwhile (or were left unprocessed).
+class Message_session::Stream_processing {
+  public:
+    Stream_processing(Message_session* sess, Stream_map::iterator stream)
+            : m_session(*sess)
+            , m_stream(stream)
+    {}
+
+    ~Stream_processing()
+    {
+        bool ready = false;
+        {
+            Guard guard(m_session.m_stream_lock);
+            Stream& s = m_stream->second;
+            s.m_queue.insert(s.m_queue.begin(), s.m_batch.begin(),
+                             s.m_batch.end());
+            s.m_batch.clear();
+            s.m_busy = false;
+
+            if (s.m_queue.empty()) {
+                m_session.m_streams.erase(m_stream);
+            }
+            else {
+                m_session.m_ready_streams.push_back(m_stream->first);
+                ready = true;
+            }
+        }
+        if (ready) {
+            m_session.server().enqueue_command(
+                new Process_session_command(&m_session));
+        }
+    }
+
+  private:
+    Message_session& m_session;
+    Stream_map::iterator m_stream;
+};
 
 Message_session::Message_session(Server_interface& server, Socket* socket)
         : Session_rep(server, socket)
         , m_sink(*this)
         , m_reader(m_sink)
+        , m_parallel_streams(false)
+        , m_num_ready(0)
 {}
 
 void Message_session::set_max_packet_size(int n)
@@ -90,16 +189,25 @@ bool Message_session::do_handle_input(Buffer& input_buffer)
             if (!handle_error(e))
                 return false;
         }
+        catch (Message_corrupt_error& e) {
+            if (!handle_error(e))
+                return false;
+        }
         total_messages += m_reader.num_messages();
     }
 
-    if (total_messages > 0) {
+    if (total_messages > 0 && !m_parallel_streams) {
         Command* cmd = new Process_session_command(this);
         server().enqueue_command(cmd);
         ARES_TRACE(("read %d message(s) [%s] [cmd=%p]", total_messages,
                     socket().to_string().c_str(), cmd));
     }
 
+    // With parallel streams, each stream that has become ready needs a
+    // processor of its own.
+    for ( ; m_num_ready > 0; m_num_ready--)
+        server().enqueue_command(new Process_session_command(this));
+
     // If the input buffer is full but we did not get a message, we must do
     // something (presumably one of [1] expand the input buffer, [2] invoke a
     // custom error routine, or [3] throw an exception).
@@ -126,6 +234,11 @@ void Message_session::do_handle_processing(int pid)
 
     ARES_TRACE(("callback: handle_processing"));
 
+    if (m_parallel_streams) {
+        process_stream(pid);
+        return;
+    }
+
     Post_processing post_processing(this);  // post-processing actions
 
     Guard guard(m_process_lock, false);
@@ -136,14 +249,80 @@ void Message_session::do_handle_processing(int pid)
 
     post_processing.enable();               // OK, lock is acquired
 
-    int count = m_message_queue.size();     // process a fixed # of messages
+    // Take every queued message at once, with a single lock of the queue,
+    // unless an exception left some of the last batch unprocessed.
+    if (m_batch.empty())
+        m_message_queue.dequeue_all(m_batch);
+    if (m_batch.empty())
+        return;
+
+    Batch batch(m_batch, &post_processing);
+    ARES_TRACE(("processing %d message(s)", int(m_batch.size())));
+    process_messages(&m_batch[0], m_batch.size(), pid);
+    batch.finish();
+}
+
+void Message_session::process_stream(int pid)
+{
+    // Takes the next ready stream, if any, and processes the messages that
+    // have arrived for it.
+
+    Stream_map::iterator stream;
+    {
+        Guard guard(m_stream_lock);
+        if (m_ready_streams.empty())
+            return;
+        stream = m_streams.find(m_ready_streams.front());
+        m_ready_streams.pop_front();
+        stream->second.m_busy = true;
+        stream->second.m_batch.swap(stream->second.m_queue);
+    }
+
+    // (the stream's vectors are ours alone until it is idle again)
+    Stream_processing stream_processing(this, stream);
+    vector<Buffer*>& messages = stream->second.m_batch;
+    Batch batch(messages);
+    ARES_TRACE(("processing %d message(s) of stream %d",
+                int(messages.size()), stream->first));
+    process_messages(&messages[0], messages.size(), pid);
+    batch.finish();
+}
+
+void Message_session::enqueue_message(Buffer* message)
+{
+    if (!m_parallel_streams) {
+        m_message_queue.enqueue(message);
+        return;
+    }
+
+    int key = stream_key(*message);
+    Guard guard(m_stream_lock);
+    Stream& stream = m_streams[key];
+    stream.m_queue.push_back(message);
+    if (!stream.m_busy && stream.m_queue.size() == 1) {
+        m_ready_streams.push_back(key);
+        m_num_ready++;
+    }
+}
+
+void Message_session::process_messages(Buffer* const* messages, int count,
+                                       int pid)
+{
+    // Each message counts as processed before it is processed, so one that
+    // raises an exception is not processed again.
+    int* done = batch_progress.get();
     for (int i = 0; i < count; i++) {
-        auto_ptr<Buffer> message(m_message_queue.dequeue());
-        ARES_TRACE(("processing %d-byte message", message->size()));
-        process_message(*message, pid);
+        if (done) ++*done;
+        ARES_TRACE(("processing %d-byte message", messages[i]->size()));
+        process_message(*messages[i], pid);
     }
 }
 
+int Message_session::stream_key(Buffer const&)
+{
+    return 0;
+}
+
 bool Message_session::handle_error(Packet_size_exceeded_error& e)
 {
     throw e;
@@ -159,6 +338,11 @@ bool Message_session::handle_error(Packet_sequence_error& e)
     throw e;
 }
 
+bool Message_session::handle_error(Message_corrupt_error& e)
+{
+    throw e;
+}
+
 bool Message_session::handle_input_buffer_too_small(Buffer& input_buffer)
 {
     if (input_buffer.capacity() >= m_reader.max_packet_size())
@@ -14,6 +14,9 @@
 #include "ares/mutex.hpp"
 #include "ares/session.hpp"
 #include "ares/sync_queue.hpp"
+#include <deque>
+#include <map>
+#include <vector>
 
 namespace ares {
 
@@ -27,6 +30,19 @@ namespace ares {
 // Session_rep if its protocol is based on "messages" (see
 // ares::Message_writer for a technical description of "message") and the
 // messages must be processed in the same order in which they were received.
+//
+// By default, a session's messages are processed by one processor at a
+// time. A session that multiplexes independent streams of messages over its
+// connection may instead enable parallel streams (see
+// set_parallel_streams), in which case each message is assigned to a stream
+// by Message_session::stream_key, and messages of different streams may be
+// processed concurrently by different processors. Messages are still
+// processed in the order in which they were received within each stream,
+// but not across streams; responses are sent in the order in which they are
+// completed. Since process_messages may then run in several threads at
+// once, it must synchronize access to the session's own data, and each
+// thread must write its responses with a Message_writer of its own (for
+// example, one per processor id).
 class Message_session : public Session_rep {
   public:
     // Constructs a session.
@@ -47,6 +63,18 @@ class Message_session : public Session_rep {
     // greater than the expected average input message size.
     void set_retained_size(int n);
 
+    // Returns true once the client has sent a message as a single frame,
+    // showing that it can also read them (see Message_writer::set_framing).
+    bool peer_uses_single_frames() const
+    {
+        return m_reader.peer_uses_single_frames();
+    }
+
+    // Enables or disables parallel streams; they are disabled by default.
+    // This function must be called before the first message arrives, for
+    // example by the constructor of the derived class.
+    void set_parallel_streams(bool enable) { m_parallel_streams = enable; }
+
   private:
     // Inherited from Session_rep:
     bool do_handle_input(Buffer& input_buffer);
@@ -58,6 +86,28 @@ class Message_session : public Session_rep {
     // this function with their session logic.
     virtual void process_message(Buffer& message, int pid) = 0;
 
+    // Processes a batch of count input messages: every message that arrived
+    // since the previous batch, in the order in which they were received.
+    // By default, this function calls Message_session::process_message for
+    // each message in turn. Derived classes may override it to handle a
+    // batch at once, for example to look up the data for all of its
+    // messages together, or to send a single combined response. The
+    // messages are deleted when this function returns.
+    //
+    // If this function raises an exception, the messages in the batch are
+    // discarded, except that the default implementation keeps those after
+    // the one whose processing failed, which are processed later.
+    virtual void process_messages(Buffer* const* messages, int count,
+                                  int pid);
+
+    // Returns the key of the stream to which a message belongs, if parallel
+    // streams are enabled; messages with the same key are processed in
+    // order, one batch at a time. This function is called by the thread that
+    // reads the session's input, before the message is queued, so it must
+    // be quick, and must not change the message. By default, it returns
+    // zero, which puts every message in the same stream.
+    virtual int stream_key(Buffer const& message);
+
     // Handler for a packet-size-exceeded error. This function will be called
     // automatically after reading an input packet whose size exceeds the
     // value passed to Message_session::set_max_packet_size. Derived classes
@@ -84,6 +134,14 @@ class Message_session : public Session_rep {
     // default, this function simply re-raises the exception.
     virtual bool handle_error(Packet_sequence_error& e);
 
+    // Handler for a message-corrupt error. This function will be called
+    // automatically after reading a compressed message that cannot be
+    // decompressed, which has been discarded. As with
+    // Message_session::handle_error(Packet_size_exceeded_error&), derived
+    // classes may implement custom error handling via this function. By
+    // default, this function simply re-raises the exception.
+    virtual bool handle_error(Message_corrupt_error& e);
+
     // This handler is invoked when the input buffer is full but does not
     // contain a complete message. Typically, the only way to recover from
     // this situation is to expand the input buffer. By default, this function
@@ -98,26 +156,49 @@ class Message_session : public Session_rep {
                 : m_session(session) {}
 
         void send(Buffer const& msg)
-        { m_session.m_message_queue.enqueue(new Buffer(msg)); }
+        { m_session.enqueue_message(new Buffer(msg)); }
 
         void send(Byte const* data, int count)
-        { m_session.m_message_queue.enqueue(new Buffer(data, count)); }
+        { m_session.enqueue_message(new Buffer(data, count)); }
 
       private:
         Message_session& m_session;
     };
 
+    // A stream of messages, when parallel streams are enabled.
+    struct Stream {
+        Stream() : m_busy(false) {}
+
+        std::vector<Buffer*> m_queue;   // messages yet to be processed
+        std::vector<Buffer*> m_batch;   // messages being processed
+        bool m_busy;                    // is a processor working on it?
+    };
+
     typedef Sync_queue<Buffer*> Message_queue;
+    typedef std::map<int, Stream> Stream_map;
+
+    void enqueue_message(Buffer* message);
+    void process_stream(int pid);
 
     Mutex m_process_lock;           // prevents concurrent processing
     Message_sink m_sink;            // the callback object given to m_reader
     Message_reader m_reader;        // persistent message reader
     Message_queue m_message_queue;  // queue of unprocessed messages
+    std::vector<Buffer*> m_batch;   // messages being processed
+    bool m_parallel_streams;        // see set_parallel_streams
+    Mutex m_stream_lock;            // protects the following
+    Stream_map m_streams;           // streams with messages, by key
+    std::deque<int> m_ready_streams;    // idle streams with messages
+    int m_num_ready;                // streams made ready by the last input
 
     class Post_processing;
+    class Batch;
+    class Stream_processing;
 
     friend class Message_sink;
     friend class Post_processing;
+    friend class Batch;
+    friend class Stream_processing;
 };
 
 } // namespace ares
@@ -8,21 +8,70 @@
 
 #include "ares/message_writer.hpp"
 #include "ares/bin_util.hpp"
+#include <algorithm>
 
 using namespace std;
+using ares::Buffer;
+
+namespace
+{
+// Size of a packet header: size, seq_num and is_chained.
+int const HEADER_SIZE = sizeof(ares::Int32) + sizeof(ares::Int16) + 1;
+
+// Size of a single frame's header.
+int const FRAME_HEADER_SIZE = sizeof(ares::Int32);
+
+// Set in the size of a single frame.
+ares::Uint32 const SINGLE_FRAME_BIT = 0x80000000U;
+
+// Set in the size of a compressed single frame.
+ares::Uint32 const COMPRESSED_FRAME_BIT = 0x40000000U;
+
+// Offset of the flags in a packet header, and the flags.
+int const FLAGS_OFFSET = sizeof(ares::Int32) + sizeof(ares::Int16);
+ares::Byte const CHAINED_FLAG = 0x01;
+ares::Byte const COMPRESSED_FLAG = 0x02;
+
+// The number of unused chunks a writer keeps for later messages.
+unsigned const MAX_FREE_CHUNKS = 4;
+
+// Message_writer writes to chunks, not to the buffer its Buffer_formatter
+// base class refers to; this is that buffer.
+Buffer unused_buffer(1);
+}
 
 ares::Message_writer::Message_writer()
-        : Buffer_formatter(m_buffer)
+        : Buffer_formatter(unused_buffer)
         , m_sink(0)
-        , m_buffer(DEFAULT_PACKET_SIZE)
-        , m_packet_writer(m_buffer)
+        , m_max_packet_size(DEFAULT_PACKET_SIZE)
+        , m_framing(FRAMING_CHAINED)
+        , m_is_single_frame(false)
+        , m_packet_limit(DEFAULT_PACKET_SIZE)
+        , m_chunk(new Buffer(CHUNK_SIZE))
+        , m_flushed(0)
+        , m_header(0)
+        , m_packet_size(0)
+        , m_seq_num(0)
+        , m_message_size(0)
+        , m_compression_threshold(0)
+        , m_is_compressed(false)
 {}
 
 ares::Message_writer::Message_writer(Sink& sink)
-        : Buffer_formatter(m_buffer)
+        : Buffer_formatter(unused_buffer)
         , m_sink(&sink)
-        , m_buffer(DEFAULT_PACKET_SIZE)
-        , m_packet_writer(m_buffer)
+        , m_max_packet_size(DEFAULT_PACKET_SIZE)
+        , m_framing(FRAMING_CHAINED)
+        , m_is_single_frame(false)
+        , m_packet_limit(DEFAULT_PACKET_SIZE)
+        , m_chunk(new Buffer(CHUNK_SIZE))
+        , m_flushed(0)
+        , m_header(0)
+        , m_packet_size(0)
+        , m_seq_num(0)
+        , m_message_size(0)
+        , m_compression_threshold(0)
+        , m_is_compressed(false)
 {}
 
 ares::Message_writer::~Message_writer()
@@ -42,26 +91,33 @@ void ares::Message_writer::set_max_packet_size(int n)
     else if (n > MAX_PACKET_SIZE) {
         n = MAX_PACKET_SIZE;
     }
-
-    // Change the buffer capacity, compacting if capacity was reduced.
-    int old_capacity = m_buffer.capacity();
-    m_buffer.set_capacity(n);
-    if (old_capacity > n) {
-        Buffer(n).swap(m_buffer);   // compacts buffer
-    }
+    m_max_packet_size = n;
 }
 
 void ares::Message_writer::begin_message()
 {
+    m_list.clear();
+    m_flushed = m_chunk->size();
     m_seq_num = 0;
-    clear_buffer();
+    m_message_size = 0;
+    m_is_compressed = false;
+
+    // A single frame is one packet of (almost) unlimited size.
+    m_is_single_frame = m_framing == FRAMING_SINGLE;
+    m_packet_limit = m_is_single_frame ? 0x3FFFFFFF : m_max_packet_size;
     write_header();
 }
 
 void ares::Message_writer::end_message()
 {
-    m_packet_writer.end_packet();
-    if (m_sink) m_sink->send(m_buffer);
+    end_packet(false);
+    flush_chunk();
+    if (m_compression_threshold > 0 &&
+        m_message_size >= m_compression_threshold)
+        compress_message();
+    if (m_sink) m_sink->send(m_list);
+    m_list.clear();
+    recycle_chunks();
 }
 
 void ares::Message_writer::put_int8(Int8 n)
@@ -104,6 +160,62 @@ void ares::Message_writer::put_uint32(Uint32 n)
     put(buf, sizeof(buf));
 }
 
+void ares::Message_writer::put_int64(Int64 n)
+{
+    Byte buf[sizeof(n)];
+    pack_int64(buf, n);
+    put(buf, sizeof(buf));
+}
+
+void ares::Message_writer::put_uint64(Uint64 n)
+{
+    Byte buf[sizeof(n)];
+    pack_uint64(buf, n);
+    put(buf, sizeof(buf));
+}
+
+void ares::Message_writer::put_double(double d)
+{
+    Byte buf[sizeof(d)];
+    pack_double(buf, d);
+    put(buf, sizeof(buf));
+}
+
+void ares::Message_writer::put_int32_array(Int32 const* values, int count)
+{
+    put_int32(count);
+
+    // Packed a slice at a time, as in put_uint32_array.
+    enum { SLICE = 256 };
+    Byte buf[SLICE*sizeof(Int32)];
+    for (int i = 0; i < count; i += SLICE) {
+        int n = count - i < SLICE ? count - i : SLICE;
+        pack_int32_array(buf, values + i, n);
+        put(buf, n*sizeof(Int32));
+    }
+}
+
+void ares::Message_writer::put_varint(Uint32 n)
+{
+    Byte buf[5];
+    put(buf, encode_varint32(buf, n));
+}
+
+void ares::Message_writer::put_uint32_array(Uint32 const* values, int count)
+{
+    put_varint(count);
+
+    // Large arrays are packed a slice at a time, so the scratch space stays
+    // small; slices are multiples of four integers, so the result is the
+    // same as packing the whole array at once.
+    enum { SLICE = 256 };
+    Byte buf[(SLICE + 3)/4 + SLICE*sizeof(Uint32)];
+    for (int i = 0; i < count; i += SLICE) {
+        int n = count - i < SLICE ? count - i : SLICE;
+        put(buf, compress_uint32_array(buf, values + i, n));
+    }
+}
+
 void ares::Message_writer::put_bytes(Byte const* data, int len)
 {
     /*
@@ -114,38 +226,201 @@ void ares::Message_writer::put_bytes(Byte const* data, int len)
     put(data, len);
 }
 
+void ares::Message_writer::put_bytes_ref(Shared_buffer const& buffer,
+                                         int offset, int count)
+{
+    put_int32(count);
+    if (count < MIN_REF_SIZE)
+        put(buffer->begin() + offset, count);
+    else
+        put_ref(buffer, offset, count);
+}
+
 void ares::Message_writer::put(Byte const* data, int count)
 {
-    do {
-        if (m_buffer.free() >= count) {
-            m_buffer.put(data, count);
-            break;
+    m_message_size += count;
+    while (count > 0) {
+        if (m_packet_size == m_packet_limit) {
+            end_packet(true);
+            write_header();
         }
-        else {
-            int n = m_buffer.free();
-            m_buffer.put(data, n);
-            data += n;
-            count -= n;
-            int pos = m_buffer.mark();
-            m_buffer.reset(m_mark);
-            m_buffer.end()[0] = 1;      // message is chained
-            m_buffer.reset(pos);
-            end_message();
-            clear_buffer();
+        int n = min(count, m_packet_limit - m_packet_size);
+        copy(data, n);
+        m_packet_size += n;
+        data += n;
+        count -= n;
+    }
+}
+
+void ares::Message_writer::put_ref(Shared_buffer const& buffer, int offset,
+                                   int count)
+{
+    // Like put, but the data are added to the message by reference.
+    m_message_size += count;
+    while (count > 0) {
+        if (m_packet_size == m_packet_limit) {
+            end_packet(true);
             write_header();
         }
-    } while (count > 0);
+        int n = min(count, m_packet_limit - m_packet_size);
+        flush_chunk();
+        m_list.append(buffer, offset, n);
+        m_packet_size += n;
+        offset += n;
+        count -= n;
+    }
+}
+
+void ares::Message_writer::copy(Byte const* data, int count)
+{
+    // Copies data to the chunks, regardless of packet boundaries.
+    while (count > 0) {
+        if (m_chunk->free() == 0)
+            next_chunk();
+        int n = min(count, m_chunk->free());
+        m_chunk->put(data, n);
+        data += n;
+        count -= n;
+    }
 }
 
 void ares::Message_writer::write_header()
 {
-    put_int16(m_seq_num++);
-    m_mark = m_buffer.mark();
-    put_int8(0); // assume this will be final packet in seq.
+    // The header is patched by end_packet, so it must not be split between
+    // chunks. A single frame's header is just the size.
+    int const size = m_is_single_frame ? FRAME_HEADER_SIZE : HEADER_SIZE;
+    if (m_chunk->free() < size)
+        next_chunk();
+
+    m_header = m_chunk->end();
+    Byte buf[HEADER_SIZE];
+    pack_int32(buf, 0);                 // (see end_packet)
+    pack_int16(buf + sizeof(Int32), m_seq_num++);
+    buf[FLAGS_OFFSET] = 0;
+    m_chunk->put(buf, size);
+    m_packet_size = size;
+}
+
+void ares::Message_writer::end_packet(bool is_chained)
+{
+    int const size = m_packet_size - sizeof(Int32);
+    if (m_is_single_frame) {
+        pack_uint32(m_header, Uint32(size) | SINGLE_FRAME_BIT |
+                              (m_is_compressed ? COMPRESSED_FRAME_BIT : 0));
+    }
+    else {
+        pack_int32(m_header, size);
+        m_header[FLAGS_OFFSET] = (is_chained ? CHAINED_FLAG : 0) |
+                                 (m_is_compressed ? COMPRESSED_FLAG : 0);
+    }
+}
+
+void ares::Message_writer::flush_chunk()
+{
+    // Adds the bytes written to the current chunk since it was last flushed
+    // to the message.
+    m_list.append(m_chunk, m_flushed, m_chunk->size() - m_flushed);
+    m_flushed = m_chunk->size();
+}
+
+void ares::Message_writer::next_chunk()
+{
+    flush_chunk();
+    m_full_chunks.push_back(m_chunk);
+    if (m_free_chunks.empty()) {
+        m_chunk = new Buffer(CHUNK_SIZE);
+    }
+    else {
+        m_chunk = m_free_chunks.back();
+        m_free_chunks.pop_back();
+    }
+    m_flushed = 0;
 }
 
-void ares::Message_writer::clear_buffer()
+void ares::Message_writer::recycle_chunks()
 {
-    m_buffer.clear();
-    m_packet_writer.begin_packet();
+    // Chunks that the sink did not keep are reused; the others are released
+    // to the sink, which frees them when it is done with them. The current
+    // chunk is kept either way, since data may still be added after the
+    // bytes the sink has kept.
+
+    for (unsigned i = 0; i < m_full_chunks.size(); i++) {
+        Shared_buffer& chunk = m_full_chunks[i];
+        if (chunk->ref_count() == 1 &&
+            m_free_chunks.size() < MAX_FREE_CHUNKS)
+        {
+            chunk->clear();
+            m_free_chunks.push_back(chunk);
+        }
+    }
+    m_full_chunks.clear();
+
+    if (m_chunk->ref_count() == 1) {
+        m_chunk->clear();
+        m_flushed = 0;
+    }
+}
+
+void ares::Message_writer::compress_message()
+{
+    // Replaces the message in m_list, which is complete, with its compressed
+    // form if that is smaller. First the data are gathered into m_plain and
+    // the packet headers squeezed out.
+
+    m_plain.clear();
+    m_plain.set_min_capacity(m_list.size());
+    m_list.copy_to(m_plain);
+
+    Byte* const data = m_plain.begin();
+    int count;
+    if (m_is_single_frame) {
+        m_plain.consume(FRAME_HEADER_SIZE);
+        count = m_plain.size();
+    }
+    else {
+        Byte const* p = data;
+        Byte const* const end = m_plain.end();
+        count = 0;
+        while (p < end) {
+            int n = unpack_int32(p) + sizeof(Int32) - HEADER_SIZE;
+            memmove(data + count, p + HEADER_SIZE, n);
+            count += n;
+            p += HEADER_SIZE + n;
+        }
+    }
+    Byte const* const plain = m_plain.begin();
+
+    // A message too small to hold the uncompressed size and a byte of
+    // compressed data cannot shrink.
+    if (count <= int(sizeof(Int32)) + 1)
+        return;
+
+    // The compressed data go into a buffer of their own, which the sink may
+    // keep; it is reused unless it is still shared.
+    if (!m_packed || m_packed->ref_count() > 1)
+        m_packed = new Buffer(count);
+    m_packed->clear();
+    m_packed->set_min_capacity(count);
+    if (!m_codec.get())
+        m_codec.reset(new Lz_codec);
+
+    // Compressed messages that would not be smaller are not sent.
+    Byte* const out = m_packed->begin();
+    pack_int32(out, count);
+    int size = m_codec->compress(plain, count, out + sizeof(Int32),
+                                 count - sizeof(Int32) - 1);
+    if (size == 0)
+        return;
+    m_packed->advance(sizeof(Int32) + size);
+
+    // Write the compressed message in place of the original.
+    m_list.clear();
+    recycle_chunks();
+    m_flushed = m_chunk->size();
+    m_seq_num = 0;
+    m_is_compressed = true;
+    write_header();
+    put_ref(m_packed, 0, m_packed->size());
+    end_packet(false);
+    flush_chunk();
 }
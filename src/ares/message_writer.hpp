@@ -10,31 +10,41 @@
 #define included_ares_message_writer
 
 #include "ares/buffer.hpp"
+#include "ares/buffer_formatter.hpp"
 #include "ares/bytes.hpp"
-#include "ares/packet_writer.hpp"
+#include "ares/gather_list.hpp"
+#include "ares/lz_codec.hpp"
 #include "ares/sink.hpp"
 #include "ares/types.hpp"
 #include <cstring>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace ares {
 
-// A buffer formatter that gracefully handles overflow of its internal Buffer
-// object, and is otherwise similar to Data_writer and Packet_writer in its
-// interface. Message_writer works by requiring a Sink object to which it can
-// send the contents of its internal buffer whenever overflow occurs. We refer
-// to the overflow buffers as physical packets, or more simply _packets_.
-// While the _message_ comprises the data the user wishes to send to the sink,
-// the packets are the chunks of data into which the message is divided when
-// overflow occurs. Each packet has the following structure:
+// Wire formats for messages; see Message_writer.
+enum Message_framing {
+    FRAMING_CHAINED,        // a chain of packets, each with a header
+    FRAMING_SINGLE,         // a single frame with a 30-bit length
+};
+
+// A formatter for messages of any size, similar to Data_writer and
+// Packet_writer in its interface. Message_writer divides each message into
+// physical packets, or more simply _packets_, of at most max_packet_size
+// bytes, and sends the whole message to a Sink object as a single gather
+// list (see Sink::send(Gather_list const&)) when it ends. While the _message_
+// comprises the data the user wishes to send to the sink, the packets are the
+// chunks of data into which the message is divided. Each packet has the
+// following structure:
 //
-//  +------+---------+------------+---------+
-//  | size | seq_num | is_chained | data... |
-//  +------+---------+------------+---------+
+//  +------+---------+-------+---------+
+//  | size | seq_num | flags | data... |
+//  +------+---------+-------+---------+
 //
 // size is a 4-byte integer that indicates the number of bytes in the packet,
 // excluding size itself (in other words, the combined size of seq_num,
-// is_chained, and data).
+// flags, and data).
 //
 // seq_num is a 2-byte integer containing the packet's sequence number, which
 // begins at zero and increments by one for each subsequent packet describing
@@ -43,9 +53,11 @@ namespace ares {
 // is present only as a sanity-check, since packets for different messages
 // should never be interleaved (see the warning below).
 //
-// is_chained is a single byte. It is zero when the current packet is the
-// final one in a sequence that comprises a single message. Otherwise, the
-// message is incomplete and another packet follows.
+// flags is a single byte. Its low bit (is_chained) is zero when the current
+// packet is the final one in a sequence that comprises a single message.
+// Otherwise, the message is incomplete and another packet follows. The next
+// bit is set in every packet of a compressed message (see below). The other
+// bits are zero.
 //
 // data is a sequence of bytes containing the message data. When the packet
 // headers have been discarded, their data sections can be concatenated to
@@ -56,21 +68,55 @@ namespace ares {
 // within the range described by Message_writer::MIN_PACKET_SIZE and
 // Message_writer::MAX_PACKET_SIZE.
 //
-// The rationale for Message_writer is that some programs need to share a
-// limited pool of memory among a large number of clients, while also sending
-// large messages to those clients. This class simplifies the task of sending
-// such large messages using a single, much smaller memory buffer. The sink
-// object then becomes responsible for accepting, buffering, and sending those
-// packets.
+// The rationale for packets is that some programs need to share a limited
+// pool of memory among a large number of clients, while also receiving large
+// messages from those clients; see Message_reader.
+//
+// Message data are copied once, into a chain of fixed-size chunks that the
+// writer recycles, and packet headers are written in place among them. Large
+// byte ranges that are already held in a shared buffer can be added with
+// put_bytes_ref, which refers to them instead of copying them. A sink that
+// overrides Sink::send(Gather_list const&), such as Session_rep, passes the
+// chunks and referenced buffers on to the socket or the dispatcher without
+// copying them again; other sinks receive the message as a single buffer.
+//
+// A writer whose peer is known to support it (see set_framing) may instead
+// send each message as a single frame:
+//
+//  +------+---------+
+//  | size | data... |
+//  +------+---------+
+//
+// size is a 4-byte integer with its high bit set; the next bit is set if the
+// message is compressed, and the other 30 bits give the number of bytes of
+// data. A frame is not divided into packets, so
+// max_packet_size does not apply to it, and the reader can allocate a buffer
+// for the whole message after parsing a single header. Since the size of a
+// chained packet is never negative, Message_reader tells the two formats
+// apart message by message; older readers reject single frames as oversized
+// packets (Packet_size_exceeded_error) rather than misreading them.
+//
+// How peers agree to use single frames is left to their protocol: a writer
+// should switch to them only once it knows that the peer reads them, for
+// example from a capability in a handshake message, or because the peer has
+// sent some (see Message_reader::peer_uses_single_frames).
+//
+// A writer may also compress large messages (see
+// set_compression_threshold). The data of a compressed message, in either
+// format, are its original size as a 4-byte integer followed by the message
+// compressed by Lz_codec; a message that does not shrink is sent as it is.
+// Compression pays off for repetitive data, such as text, on links where
+// bandwidth, or the dispatcher's time spent writing, is scarcer than CPU
+// time. Readers that predate compression take the flag for part of
+// is_chained or of the size, so it too must be agreed with the peer (see
+// Message_reader::peer_uses_compression).
 //
 // Note: multi-byte integers are transmitted in network byte order. See the
 // Data_writer documentation for more information.
 //
-// Warning: sending to the sink pointed to by a Message_writer object between
-// calls to Message_writer::begin_message and Message_writer::end_message must
-// be avoided. Otherwise, the sequence of packets sent to the sink by the
-// Message_writer will be hopelessly confused, making it impossible to
-// recombine them into a valid message.
+// Warning: the bytes referred to by put_bytes_ref must not change until the
+// sink has finished with them, which for a session may be long after
+// end_message returns.
 class Message_writer : public Buffer_formatter {
   public:
     // Constructs a stream packet writer. Until the Message_writer::set_sink
@@ -87,22 +133,42 @@ class Message_writer : public Buffer_formatter {
     // Specifies the destination for output packets.
     void set_sink(Sink& sink);
 
-    // Sets the capacity of the internal buffer, and therefore the maximum
-    // size of output packets. If n is less than
+    // Sets the maximum size of output packets. If n is less than
     // Message_writer::MIN_PACKET_SIZE or greater than
     // Message_writer::MAX_PACKET_SIZE, it will be brought into range as
     // expected.
     void set_max_packet_size(int n);
 
+    // Selects the wire format of the messages begun after this call. The
+    // default, FRAMING_CHAINED, is readable by every Message_reader;
+    // FRAMING_SINGLE must only be used if the peer is known to support it.
+    void set_framing(Message_framing framing) { m_framing = framing; }
+
+    // Returns the wire format selected by set_framing.
+    Message_framing framing() const { return m_framing; }
+
+    // Compresses messages of at least n bytes of data, if they shrink. Zero,
+    // the default, disables compression, which must only be enabled if the
+    // peer is known to support it. The compressor's state (about 16KB) and
+    // the buffers it works in are allocated once, and reused for every
+    // message that this object compresses.
+    void set_compression_threshold(int n)
+    {
+        m_compression_threshold = n > 0 ? n : 0;
+    }
+
+    // Returns the threshold set by set_compression_threshold.
+    int compression_threshold() const { return m_compression_threshold; }
+
     // Begins a new logical packet. This call must eventually be followed by a
     // call to Message_writer::end_message, which ends the logical packet.
     void begin_message();
 
     // Ends the logical packet begun by a prior call to
-    // Message_writer::begin_message. Any intervening writes operations
-    // constitute the actual packet data. Undefined if called out of sequence
-    // (that is, if it does not follow a prior call to
-    // Message_writer::begin_message).
+    // Message_writer::begin_message, and sends the message's packets to the
+    // sink. Any intervening writes operations constitute the actual packet
+    // data. Undefined if called out of sequence (that is, if it does not
+    // follow a prior call to Message_writer::begin_message).
     void end_message();
 
     // Adds an 8-bit integer to the message.
@@ -123,6 +189,37 @@ class Message_writer : public Buffer_formatter {
     // Adds an unsigned 32-bit integer to the message.
     void put_uint32(Uint32 n);
 
+    // Adds a 64-bit integer to the message.
+    void put_int64(Int64 n);
+
+    // Adds an unsigned 64-bit integer to the message.
+    void put_uint64(Uint64 n);
+
+    // Adds a double to the message exactly as Data_writer::put_double would.
+    void put_double(double d);
+
+    // Adds an array of count 32-bit integers to the message exactly as
+    // Data_writer::put_int32_array would. Use Data_reader::get_int32_array
+    // to read it.
+    void put_int32_array(Int32 const* values, int count);
+
+    // Adds an array of 32-bit integers to the message. This function is
+    // semantically equivalent to put_int32_array(&values[0],values.size()).
+    void put_int32_array(std::vector<Int32> const& values);
+
+    // Adds an unsigned 32-bit integer to the message exactly as
+    // Data_writer::put_varint would.
+    void put_varint(Uint32 n);
+
+    // Adds a packed array of count integers to the message exactly as
+    // Data_writer::put_uint32_array would. Use Data_reader::get_uint32_array
+    // to read it.
+    void put_uint32_array(Uint32 const* values, int count);
+
+    // Adds a packed array of integers to the message. This function is
+    // semantically equivalent to put_uint32_array(&values[0],values.size()).
+    void put_uint32_array(std::vector<Uint32> const& values);
+
     // Adds a null-terminated string to the message. This function is
     // semantically equivalent to put_string(s,strlen(s)).
     void put_string(char const* s);
@@ -140,27 +237,59 @@ class Message_writer : public Buffer_formatter {
     // semantically equivalent to put_string(bytes.begin(),bytes.length()).
     void put_bytes(Bytes const& bytes);
 
-    // Returns the current capacity of the internal buffer, and therefore the
-    // maximum size of output packets.
-    int max_packet_size() const { return m_buffer.capacity(); }
+    // Adds count bytes of the contents of a shared buffer, beginning offset
+    // bytes after Buffer::begin, exactly as put_bytes would, but without
+    // copying them: the message refers to the buffer, which must therefore
+    // not change while it is shared (see Shared_buffer). Ranges shorter than
+    // MIN_REF_SIZE bytes are copied anyway, since that is cheaper.
+    void put_bytes_ref(Shared_buffer const& buffer, int offset, int count);
+
+    // Adds the entire contents of a shared buffer to the message without
+    // copying them; see put_bytes_ref(Shared_buffer const&, int, int).
+    void put_bytes_ref(Shared_buffer const& buffer);
+
+    // Returns the maximum size of output packets.
+    int max_packet_size() const { return m_max_packet_size; }
 
     enum {
         DEFAULT_PACKET_SIZE = 4*1024, // default output packet size
         MIN_PACKET_SIZE = 8,          // minimum output packet size
-        MAX_PACKET_SIZE = 512*1024,   // maximum output packet size
+        MAX_PACKET_SIZE = 16*1024*1024, // maximum output packet size
+        CHUNK_SIZE = 16*1024,         // size of the writer's chunks
+        MIN_REF_SIZE = 512,           // see put_bytes_ref
     };
 
   private:
     void put(Byte const* data, int count);
+    void put_ref(Shared_buffer const& buffer, int offset, int count);
+    void copy(Byte const* data, int count);
     void write_header();
-    void clear_buffer();
+    void end_packet(bool is_chained);
+    void flush_chunk();
+    void next_chunk();
+    void recycle_chunks();
+    void compress_message();
 
   private:
-    Sink* m_sink;                   // destination for full buffers
-    Buffer m_buffer;                // the output buffer
-    Packet_writer m_packet_writer;  // for writing packet headers
+    Sink* m_sink;                   // destination for messages
+    int m_max_packet_size;          // see set_max_packet_size
+    Message_framing m_framing;      // see set_framing
+    bool m_is_single_frame;         // is the current message a single frame?
+    int m_packet_limit;             // maximum size of its packets
+    Gather_list m_list;             // the message being written
+    Shared_buffer m_chunk;          // the chunk being written
+    int m_flushed;                  // bytes of m_chunk already in m_list
+    std::vector<Shared_buffer> m_full_chunks;   // other chunks in m_list
+    std::vector<Shared_buffer> m_free_chunks;   // chunks ready for reuse
+    Byte* m_header;                 // header of the current packet
+    int m_packet_size;              // bytes in the current packet
     int m_seq_num;                  // for ordering packets in a sequence
-    int m_mark;                     // marks start of packet header
+    int m_message_size;             // bytes of data in the current message
+    int m_compression_threshold;    // see set_compression_threshold
+    bool m_is_compressed;           // is the current message compressed?
+    std::auto_ptr<Lz_codec> m_codec;    // allocated on first use
+    Buffer m_plain;                 // a message being compressed
+    Shared_buffer m_packed;         // the compressed data sent last
 };
 
 // #########################################################################
@@ -177,11 +306,27 @@ inline void Message_writer::put_string(std::string const& s)
     put_bytes((Byte const*) s.data(), s.length());
 }
 
+inline void Message_writer::put_int32_array(std::vector<Int32> const& values)
+{
+    put_int32_array(values.empty() ? 0 : &values[0], values.size());
+}
+
+inline void Message_writer::put_uint32_array(
+        std::vector<Uint32> const& values)
+{
+    put_uint32_array(values.empty() ? 0 : &values[0], values.size());
+}
+
 inline void Message_writer::put_bytes(Bytes const& bytes)
 {
     put_bytes(bytes.begin(), bytes.size());
 }
 
+inline void Message_writer::put_bytes_ref(Shared_buffer const& buffer)
+{
+    put_bytes_ref(buffer, 0, buffer->size());
+}
+
 } // namespace ares
 
 #endif
@@ -0,0 +1,167 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/metrics.hpp"
+#include "ares/platform.hpp"
+#include "ares/thread.hpp"
+#include <cstring>
+
+using namespace std;
+using ares::Counter;
+using ares::Histogram;
+using ares::Histogram_snapshot;
+
+namespace
+{
+using namespace ares::metrics_detail;
+
+// A thread's shard index is stored as a pointer into this array, so that
+// assigning one allocates nothing.
+int shard_ids[NUM_SHARDS];
+
+ares::Thread_specific_value<int> thread_shard;
+int next_shard = 0;
+
+// Reads a 64-bit value that other threads may be updating.
+inline ares::Int64 atomic_read(ares::Int64 const& n)
+{
+    return __sync_fetch_and_add(const_cast<ares::Int64*>(&n), 0);
+}
+}
+
+int ares::metrics_detail::shard_index()
+{
+    int* p = thread_shard.get();
+    if (!p) {
+        p = &shard_ids[__sync_fetch_and_add(&next_shard, 1) % NUM_SHARDS];
+        thread_shard.reset(p);
+    }
+    return p - shard_ids;
+}
+
+Counter::Counter()
+{
+    memset(m_cells, 0, sizeof(m_cells));
+}
+
+ares::Int64 Counter::value() const
+{
+    Int64 sum = 0;
+    for (int i = 0; i < NUM_SHARDS; i++)
+        sum += atomic_read(m_cells[i].m_value);
+    return sum;
+}
+
+Histogram::Histogram()
+{
+    memset(m_shards, 0, sizeof(m_shards));
+}
+
+void Histogram::record(Int64 n)
+{
+    Shard& shard = m_shards[shard_index()];
+    if (n < 0)
+        n = 0;
+    __sync_fetch_and_add(&shard.m_counts[bucket(n)], 1);
+    __sync_fetch_and_add(&shard.m_sum, n);
+}
+
+void Histogram::record_since(Int64 start)
+{
+    record(monotonic_micros() - start);
+}
+
+ares::Histogram_snapshot Histogram::snapshot() const
+{
+    Histogram_snapshot s;
+    for (int i = 0; i < NUM_SHARDS; i++) {
+        Shard const& shard = m_shards[i];
+        for (int j = 0; j < NUM_BUCKETS; j++) {
+            Int64 const n = atomic_read(shard.m_counts[j]);
+            s.m_counts[j] += n;
+            s.m_count += n;
+        }
+        s.m_sum += atomic_read(shard.m_sum);
+    }
+    return s;
+}
+
+int Histogram::bucket(Int64 n)
+{
+    if (n < EXACT_LIMIT)
+        return n < 0 ? 0 : int(n);
+    if (n >> MAX_BITS)
+        return NUM_BUCKETS - 1;
+
+    // The position of the highest set bit selects the power of two, and the
+    // five bits below it select the sub-bucket.
+    int msb = 63 - __builtin_clzll(n);
+    int sub = int(n >> (msb - 5)) - SUB_BUCKETS;
+    return EXACT_LIMIT + (msb - 6)*SUB_BUCKETS + sub;
+}
+
+ares::Int64 Histogram::bucket_limit(int index)
+{
+    if (index < EXACT_LIMIT)
+        return index;
+    int const k = index - EXACT_LIMIT;
+    int const shift = k/SUB_BUCKETS + 1;
+    return (Int64(SUB_BUCKETS + k%SUB_BUCKETS + 1) << shift) - 1;
+}
+
+Histogram_snapshot::Histogram_snapshot()
+        : m_counts(Histogram::NUM_BUCKETS)
+        , m_count(0)
+        , m_sum(0)
+{}
+
+double Histogram_snapshot::mean() const
+{
+    return m_count == 0 ? 0 : 1.0*m_sum/m_count;
+}
+
+ares::Int64 Histogram_snapshot::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0;
+
+    // The rank of the value sought, counting from one.
+    Int64 rank = Int64(p/100*m_count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > m_count)
+        rank = m_count;
+
+    Int64 seen = 0;
+    for (int i = 0; i < Histogram::NUM_BUCKETS; i++) {
+        seen += m_counts[i];
+        if (seen >= rank)
+            return Histogram::bucket_limit(i);
+    }
+    return Histogram::bucket_limit(Histogram::NUM_BUCKETS - 1);
+}
+
+Histogram_snapshot& Histogram_snapshot::operator-=(
+    Histogram_snapshot const& earlier)
+{
+    for (int i = 0; i < Histogram::NUM_BUCKETS; i++)
+        m_counts[i] -= earlier.m_counts[i];
+    m_count -= earlier.m_count;
+    m_sum -= earlier.m_sum;
+    return *this;
+}
+
+Histogram_snapshot& Histogram_snapshot::operator+=(
+    Histogram_snapshot const& other)
+{
+    for (int i = 0; i < Histogram::NUM_BUCKETS; i++)
+        m_counts[i] += other.m_counts[i];
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    return *this;
+}
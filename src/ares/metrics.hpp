@@ -0,0 +1,144 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_metrics
+#define included_ares_metrics
+
+// Counters and latency histograms that may be updated by any number of
+// threads without locking. Each object is split into shards, and each thread
+// updates the shard assigned to it, so threads running on different cpus
+// rarely write to the same cache line. Reading a value sums the shards; it
+// is exact once the writers are quiet, and otherwise may miss updates that
+// are in progress. Neither kind of object is ever reset: to measure an
+// interval, subtract an earlier reading from a later one.
+
+#include "ares/types.hpp"
+#include <boost/utility.hpp>
+#include <vector>
+
+namespace ares {
+
+namespace metrics_detail {
+
+enum {
+    NUM_SHARDS = 8,             // shards per counter or histogram
+    CACHE_LINE_SIZE = 64
+};
+
+// Returns the shard assigned to the calling thread, in [0, NUM_SHARDS).
+// Threads are assigned shards round-robin when they first call this.
+int shard_index();
+
+} // namespace metrics_detail
+
+// A 64-bit event counter.
+class Counter : boost::noncopyable {
+  public:
+    Counter();
+
+    // Adds n to the counter.
+    void add(Int64 n = 1)
+    {
+        __sync_fetch_and_add(&m_cells[metrics_detail::shard_index()].m_value,
+                             n);
+    }
+
+    // Returns the sum of all the values added to the counter.
+    Int64 value() const;
+
+  private:
+    struct Cell {
+        Int64 m_value;
+        char m_pad[metrics_detail::CACHE_LINE_SIZE - sizeof(Int64)];
+    };
+
+    Cell m_cells[metrics_detail::NUM_SHARDS];
+};
+
+class Histogram_snapshot;
+
+// A histogram of non-negative values, typically latencies in microseconds.
+// Values below 64 are counted exactly; larger values are counted in buckets
+// whose width is 1/32 of the power of two below them, so a bucket's bounds
+// are within about 3% of any value in it. Values of 2^40 or more (about 12
+// days, in microseconds) are counted in the last bucket.
+class Histogram : boost::noncopyable {
+  public:
+    enum {
+        EXACT_LIMIT = 64,       // values below this have their own bucket
+        SUB_BUCKETS = 32,       // buckets per power of two above it
+        MAX_BITS = 40,          // larger values share the last bucket
+        NUM_BUCKETS = EXACT_LIMIT + (MAX_BITS - 6)*SUB_BUCKETS
+    };
+
+    Histogram();
+
+    // Counts the value n. Negative values are counted as zero.
+    void record(Int64 n);
+
+    // Counts the time elapsed since start, a reading of monotonic_micros.
+    void record_since(Int64 start);
+
+    // Returns the current contents of the histogram.
+    Histogram_snapshot snapshot() const;
+
+    // Returns the index of the bucket that counts the value n, and the
+    // largest value counted by a bucket.
+    static int bucket(Int64 n);
+    static Int64 bucket_limit(int index);
+
+  private:
+    struct Shard {
+        Int64 m_counts[NUM_BUCKETS];
+        Int64 m_sum;
+        char m_pad[metrics_detail::CACHE_LINE_SIZE - sizeof(Int64)];
+    };
+
+    Shard m_shards[metrics_detail::NUM_SHARDS];
+};
+
+// The contents of a Histogram at some point in time. Percentiles and the
+// maximum are reported as the largest value counted by the bucket that
+// holds them, so they may overstate the true value by about 3%.
+class Histogram_snapshot {
+  public:
+    // Constructs an empty snapshot.
+    Histogram_snapshot();
+
+    // The number of values counted, and their sum.
+    Int64 count() const { return m_count; }
+    Int64 sum() const { return m_sum; }
+
+    // The mean of the values counted, or zero if there are none.
+    double mean() const;
+
+    // The value that p percent of the values counted do not exceed, for p
+    // in [0, 100]; zero if no values were counted.
+    Int64 percentile(double p) const;
+
+    // The largest value counted, or zero if there are none.
+    Int64 max() const { return percentile(100); }
+
+    // Removes the values counted in an earlier snapshot of the same
+    // histogram, leaving the values counted between the two snapshots.
+    Histogram_snapshot& operator-=(Histogram_snapshot const& earlier);
+
+    // Adds the values counted in another snapshot.
+    Histogram_snapshot& operator+=(Histogram_snapshot const& other);
+
+  private:
+    std::vector<Int64> m_counts;    // values counted, by bucket
+    Int64 m_count;                  // total values counted
+    Int64 m_sum;                    // sum of the values counted
+
+    friend class Histogram;
+};
+
+} // namespace ares
+
+#endif
@@ -37,6 +37,55 @@ inline bool is_transient_send_error(int err_num)
     return errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR;
 }
 
+// Sends up to count bytes with the given send flags; see write_tcp.
+int send_tcp(ares::Sockfd sock, ares::Byte const* buf, int count, int flags)
+{
+    if (count <= 0)
+        return 0;
+
+    int n;
+
+    errno = 0;
+    if ((n = send(sock, buf, count, flags)) < 0) {
+        if (!is_transient_send_error(errno))
+            throw ares::Network_io_error("write", errno);
+        return 0;   // ok: non-blocking i/o would have blocked
+    }
+    else if (n == 0)
+        return -1;  // end-of-file encountered
+    return n;
+}
+
+// Sends the contents of count buffers with the given send flags; see
+// writev_tcp.
+int sendmsg_tcp(ares::Sockfd sock, struct iovec const* iov, int count,
+                int flags)
+{
+    if (count <= 0)
+        return 0;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = count;
+
+    int n;
+
+    errno = 0;
+    if ((n = sendmsg(sock, &msg, flags)) < 0) {
+        if (!is_transient_send_error(errno))
+            throw ares::Network_io_error("write", errno);
+        return 0;   // ok: non-blocking i/o would have blocked
+    }
+    else if (n == 0) {
+        for (int i = 0; i < count; i++) {
+            if (iov[i].iov_len > 0)
+                return -1;  // end-of-file encountered
+        }
+    }
+    return n;
+}
+
 // Returns true if a given socket handle was just connected successfully,
 // false otherwise. This function _must_ called after any apparently
 // successful non-blocking connect to verify that it did in fact succeed.
@@ -522,20 +571,37 @@ int ares::net_tk::read_all_tcp(Sockfd sock, Byte* buf, int count)
 
 int ares::net_tk::write_tcp(Sockfd sock, Byte const* buf, int count)
 {
-    if (count <= 0)
+    return send_tcp(sock, buf, count, 0);
+}
+
+int ares::net_tk::try_write_tcp(Sockfd sock, Byte const* buf, int count)
+{
+#if defined(MSG_DONTWAIT)
+    return send_tcp(sock, buf, count, MSG_DONTWAIT);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0 || !(flags & O_NONBLOCK))
         return 0;
+    return send_tcp(sock, buf, count, 0);
+#endif
+}
 
-    int n;
+int ares::net_tk::writev_tcp(Sockfd sock, struct iovec const* iov, int count)
+{
+    return sendmsg_tcp(sock, iov, count, 0);
+}
 
-    errno = 0;
-    if ((n = send(sock, buf, count, 0)) < 0) {
-        if (!is_transient_send_error(errno))
-            throw Network_io_error("write", errno);
-        return 0;   // ok: non-blocking i/o would have blocked
-    }
-    else if (n == 0)
-        return -1;  // end-of-file encountered
-    return n;
+int ares::net_tk::try_writev_tcp(Sockfd sock, struct iovec const* iov,
+                                 int count)
+{
+#if defined(MSG_DONTWAIT)
+    return sendmsg_tcp(sock, iov, count, MSG_DONTWAIT);
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0 || !(flags & O_NONBLOCK))
+        return 0;
+    return sendmsg_tcp(sock, iov, count, 0);
+#endif
 }
 
 int ares::net_tk::write_all_tcp(Sockfd sock, Byte const* buf, int count)
@@ -598,9 +664,14 @@ void ares::net_tk::set_blocking(Sockfd sock, bool on)
 
 void ares::net_tk::set_tcp_no_delay(Sockfd sock, bool on)
 {
+    // Local (non-TCP) sockets, such as those of a Traffic_replay, have no
+    // Nagle algorithm to disable.
     int const val = on;
-    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val)) != 0)
+    if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val)) != 0
+        && errno != EOPNOTSUPP)
+    {
         throw Network_error("setsockopt", errno);
+    }
 }
 
 string ares::net_tk::my_hostname()
@@ -11,6 +11,7 @@
 
 #include "ares/types.hpp"
 #include <string>
+#include <sys/uio.h>        // struct iovec
 
 namespace ares { namespace net_tk {
 
@@ -58,11 +59,26 @@ int read_all_tcp(Sockfd sock, Byte* buf, int count);
 // Network_io_error exception if an i/o error occurs.
 int write_tcp(Sockfd sock, Byte const* buf, int count);
 
+// Works similarly to write_tcp, but this function never blocks, even if the
+// socket is in blocking mode; it returns 0 if no data could be sent without
+// blocking. On platforms that cannot send without blocking on a blocking
+// socket, it sends nothing and returns 0 unless the socket is non-blocking.
+int try_write_tcp(Sockfd sock, Byte const* buf, int count);
+
 // Works similarly to write_tcp, but this function continues trying to send
 // until the requested number of bytes are sent, an i/o error occurs, or
 // end-of-file is encountered.
 int write_all_tcp(Sockfd sock, Byte const* buf, int count);
 
+// Works similarly to write_tcp, but sends the contents of count buffers, in
+// order, with a single system call (a "gather" write). The return value is
+// the total number of bytes sent, which may end partway through any of the
+// buffers. count must not exceed the system's IOV_MAX.
+int writev_tcp(Sockfd sock, struct iovec const* iov, int count);
+
+// Works similarly to writev_tcp, but never blocks; see try_write_tcp.
+int try_writev_tcp(Sockfd sock, struct iovec const* iov, int count);
+
 void set_blocking(Sockfd sock, bool on);
 void set_tcp_no_delay(Sockfd sock, bool on);
 
@@ -12,19 +12,23 @@
 
 // Standard headers
 #include <cassert>
-#include <cstdlib>          // realpath
+#include <cctype>           // isdigit isspace
+#include <cstdlib>          // realpath strtol
 #include <cstdio>           // snprintf
 #include <cstring>          // memset memcpy strncpy
 #include <memory>           // auto_ptr
 #include <vector>
 
 // UNIX headers
+#include <dirent.h>         // for opendir(3) and readdir(3)
 #include <pwd.h>            // for getpwuid(3) and struct passwd
+#include <sched.h>          // for sched_getcpu(3)
 #include <signal.h>         // ANSI C signals
 #include <sys/resource.h>   // for getrlimit(2) and setrlimit(2)
 #include <sys/stat.h>       // for S_xxx file mode constants and umask(2)
 #include <sys/time.h>       // timeval{} for gettimeofday()
 #include <sys/types.h>      // basic system data types
+#include <time.h>           // clock_gettime(2)
 #include <unistd.h>
 
 using namespace std;
@@ -58,6 +62,14 @@ ares::Int64 ares::current_time_millis()
             : -1;  // error
 }
 
+ares::Int64 ares::monotonic_micros()
+{
+    struct timespec ts;
+    return clock_gettime(CLOCK_MONOTONIC, &ts) >= 0
+            ? Int64(ts.tv_sec)*1000000 + Int64(ts.tv_nsec)/1000
+            : -1;  // error
+}
+
 void ares::milli_sleep(int millis)
 {
 #if defined(HAVE_USLEEP)
@@ -86,6 +98,106 @@ void ares::micro_sleep(int micros)
 #endif
 }
 
+namespace
+{
+// The highest cpu number accepted by parse_cpu_list.
+int const MAX_CPU = 64*1024 - 1;
+
+// Parses the cpu number at p, advancing p past it. Returns -1 if there is
+// no number at p, or if it is too large.
+int parse_cpu(char const*& p)
+{
+    if (!isdigit(static_cast<unsigned char>(*p)))
+        return -1;
+    char* end = 0;
+    long const n = strtol(p, &end, 10);
+    p = end;
+    return n <= MAX_CPU ? int(n) : -1;
+}
+}
+
+ares::Cpu_set ares::parse_cpu_list(string const& s)
+{
+    Cpu_set cpus;
+    char const* p = s.c_str();
+    while (isspace(static_cast<unsigned char>(*p)))
+        p++;
+    if (*p == '\0')
+        return cpus;
+
+    for (;;) {
+        int const first = parse_cpu(p);
+        int last = first;
+        if (*p == '-') {
+            p++;
+            last = parse_cpu(p);
+        }
+        if (first < 0 || last < first)
+            throw Invalid_cpu_list_error(s);
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.insert(cpu);
+
+        while (isspace(static_cast<unsigned char>(*p)))
+            p++;
+        if (*p == '\0')
+            return cpus;
+        if (*p++ != ',')
+            throw Invalid_cpu_list_error(s);
+        while (isspace(static_cast<unsigned char>(*p)))
+            p++;
+    }
+}
+
+string ares::format_cpu_list(Cpu_set const& cpus)
+{
+    string s;
+    Cpu_set::const_iterator i = cpus.begin();
+    while (i != cpus.end()) {
+        int const first = *i;
+        int last = first;
+        while (++i != cpus.end() && *i == last + 1)
+            last = *i;
+
+        if (!s.empty())
+            s += ',';
+        s += boost::lexical_cast<string>(first);
+        if (last != first)
+            s += '-' + boost::lexical_cast<string>(last);
+    }
+    return s;
+}
+
+int ares::cpu_numa_node(int cpu)
+{
+    // Each cpu's sysfs directory holds a link named for its node.
+    string const path = "/sys/devices/system/cpu/cpu"
+                        + boost::lexical_cast<string>(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return -1;
+
+    int node = -1;
+    while (struct dirent* e = readdir(dir)) {
+        if (strncmp(e->d_name, "node", 4) == 0
+            && isdigit(static_cast<unsigned char>(e->d_name[4])))
+        {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int ares::current_cpu()
+{
+#if defined(HAVE_SCHED_GETCPU)
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
 static int const s_resources[] = {  // This table translates our resource
     RLIMIT_CPU,                     // constants (ResourceType) to the values
     RLIMIT_CORE,                    // in <sys/resource.h>
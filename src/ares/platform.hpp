@@ -15,6 +15,7 @@
 #include "ares/utility.hpp"
 #include <cerrno>
 #include <ctime>
+#include <set>
 #include <string>
 #include <utility>
 
@@ -51,12 +52,43 @@ std::time_t current_time();
 // milliseconds, i.e. milliseconds since 1970-01-01 00:00:00 UTC.
 Int64 current_time_millis();
 
+// Returns the time in microseconds since an arbitrary, fixed point in the
+// past. Unlike current_time_millis, the value is unaffected by adjustments
+// to the system clock, so it is suitable for measuring intervals.
+Int64 monotonic_micros();
+
 // Puts the current thread to sleep for the specified number of milliseconds.
 void milli_sleep(int millis);
 
 // Puts the current thread to sleep for the specified number of microseconds.
 void micro_sleep(int micros);
 
+// +---------------+
+// | CPU placement |
+// +---------------+
+
+// A set of cpus, by number, to which a thread can be bound (see
+// Thread::set_affinity). An empty set places no restriction on a thread.
+typedef std::set<int> Cpu_set;
+
+// Parses a list of cpus and ranges of cpus, such as "0-3,8,10-11" (the form
+// used by taskset and by Linux's cpulist files), into a Cpu_set. A blank
+// string yields an empty set. Raises an Invalid_cpu_list_error if s is
+// malformed.
+Cpu_set parse_cpu_list(std::string const& s);
+
+// Formats cpus in the form accepted by parse_cpu_list, with runs of
+// consecutive cpus written as ranges.
+std::string format_cpu_list(Cpu_set const& cpus);
+
+// Returns the NUMA node that cpu belongs to, or -1 if the system doesn't
+// say (as on machines with a single node and no NUMA support).
+int cpu_numa_node(int cpu);
+
+// Returns the cpu the calling thread is running on, or -1 if the system
+// can't tell.
+int current_cpu();
+
 // +---------------------------+
 // | System resource functions |
 // +---------------------------+
@@ -8,6 +8,7 @@
 
 #include "ares/command.hpp"
 #include "ares/error.hpp"
+#include "ares/guard.hpp"
 #include "ares/log.hpp"
 #include "ares/platform.hpp"
 #include "ares/processor.hpp"
@@ -21,13 +22,14 @@ using ares::Processor;
 
 Processor::Processor(Server_interface& server,
                      Command_queue& queue,
+                     Command_timer& timer,
                      int id)
         : Component("processor", boost::lexical_cast<string>(id))
         , m_server(server)
         , m_queue(queue)
+        , m_timer(timer)
         , m_id(id)
         , m_last_snapshot(current_time())
-        , m_commands_executed(0)
 {}
 
 Processor::~Processor()
@@ -35,16 +37,32 @@ Processor::~Processor()
 
 ares::Processor_statistics Processor::statistics()
 {
-    Processor_statistics stats;
+    Processor_statistics stats = totals();
+    Processor_statistics const totals = stats;
+    Guard guard(m_stats_lock);
 
     time_t current_time = ares::current_time();
     stats.m_elapsed_sec = current_time - m_last_snapshot;
     m_last_snapshot = current_time;
 
-    stats.m_commands_executed = m_commands_executed;
-
-    m_commands_executed = 0;
+    stats.m_commands_executed -= m_previous.m_commands_executed;
+    stats.m_busy_micros -= m_previous.m_busy_micros;
+    stats.m_commands_expired -= m_previous.m_commands_expired;
+    stats.m_commands_dropped -= m_previous.m_commands_dropped;
+    stats.m_queue_latency -= m_previous.m_queue_latency;
+    m_previous = totals;
+    return stats;
+}
 
+ares::Processor_statistics Processor::totals() const
+{
+    Processor_statistics stats;
+    stats.m_elapsed_sec = uptime();
+    stats.m_commands_executed = m_commands_executed.value();
+    stats.m_busy_micros = m_busy_micros.value();
+    stats.m_commands_expired = m_commands_expired.value();
+    stats.m_commands_dropped = m_commands_dropped.value();
+    stats.m_queue_latency = m_queue_latency.snapshot();
     return stats;
 }
 
@@ -65,11 +83,42 @@ void Processor::run()
             Command* cmdp;
             if (m_queue.dequeue(cmdp, DEQUEUE_TIMEOUT)) {
                 auto_ptr<Command> cmd(cmdp);    // insure cleanup
+                Int64 const started = monotonic_micros();
+                Int64 waited = -1;
+                if (cmdp->enqueued() != 0) {
+                    waited = started - cmdp->enqueued();
+                    m_queue_latency.record(waited);
+                }
+                if (cmdp->deadline() != 0 && started > cmdp->deadline()) {
+                    cmdp->set_expired(true);
+                    m_commands_expired.add();
+                    if (m_queue.drops_expired()) {
+                        ARES_TRACE(("discarding expired command [%p]",
+                                    cmdp));
+                        m_commands_dropped.add();
+                        cmdp->discard(m_server, m_id);
+                        continue;
+                    }
+                }
                 ARES_TRACE(("processing command [%p] for [%s]",
                             cmdp, COMMAND_SESSION_NAME(cmdp)));
                 cmdp->execute(m_server, m_id);
                 ARES_TRACE(("finished processing command"));
-                m_commands_executed++;
+                Int64 const executed = monotonic_micros() - started;
+                m_timer.record(*cmdp, waited, executed, m_timer_cache);
+                m_commands_executed.add();
+                m_busy_micros.add(executed);
+
+                int const threshold = m_timer.slow_threshold();
+                if (threshold > 0 && executed >= Int64(threshold)*1000) {
+                    Log::writef(Log::NOTICE, "processor (%d): slow command "
+                                "%s for [%s]: executed in %lld us after "
+                                "waiting %lld us", m_id,
+                                cmdp->name().c_str(),
+                                COMMAND_SESSION_NAME(cmdp),
+                                static_cast<long long>(executed),
+                                static_cast<long long>(waited));
+                }
             }
         }
         catch (Exception& e) {
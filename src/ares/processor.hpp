@@ -12,18 +12,47 @@
 // This is an implementation file; do not use directly.
 
 #include "ares/command_queue.hpp"
+#include "ares/command_timer.hpp"
 #include "ares/component.hpp"
+#include "ares/metrics.hpp"
+#include "ares/mutex.hpp"
 
 namespace ares {
 
-struct Processor_statistics;
 class Server_interface;
 
+struct Processor_statistics {
+    Processor_statistics()
+            : m_elapsed_sec(0), m_commands_executed(0), m_busy_micros(0)
+            , m_commands_expired(0), m_commands_dropped(0) {}
+
+    int m_elapsed_sec;              // seconds since last snapshot
+    Int64 m_commands_executed;      // number of commands executed
+    Int64 m_busy_micros;            // microseconds spent executing them
+    Int64 m_commands_expired;       // commands dequeued past their deadline
+    Int64 m_commands_dropped;       // expired commands discarded
+    Histogram_snapshot m_queue_latency;     // microseconds commands waited
+                                            // in the queue
+};
+
 class Processor : public Component {
   public:
-    Processor(Server_interface& server, Command_queue& queue, int id);
+    Processor(Server_interface& server, Command_queue& queue,
+              Command_timer& timer, int id);
     ~Processor();
+
+    // Returns the processor's activity since the previous call to this
+    // function.
     Processor_statistics statistics();
+
+    // Returns the processor's activity since it was created, without
+    // beginning a new statistics window.
+    Processor_statistics totals() const;
+
+    // Returns the number of microseconds the processor has spent executing
+    // commands since it was created.
+    Int64 busy_micros() const { return m_busy_micros.value(); }
+
     int id() const { return m_id; }
 
   private:
@@ -31,16 +60,19 @@ class Processor : public Component {
 
     Server_interface& m_server;     // server context to pass to commands
     Command_queue& m_queue;         // shared command queue
+    Command_timer& m_timer;         // shared timings by type of command
+    Command_timer::Cache m_timer_cache; // this processor's cache for m_timer
     int const m_id;                 // unique ID assigned to this processor
 
     // (for statistics)
-    time_t m_last_snapshot;
-    int m_commands_executed;
-};
-
-struct Processor_statistics {
-    int m_elapsed_sec;          // seconds since last snapshot
-    int m_commands_executed;    // number of commands executed
+    Counter m_commands_executed;    // commands executed
+    Counter m_busy_micros;          // micros spent executing commands
+    Counter m_commands_expired;     // commands dequeued past their deadline
+    Counter m_commands_dropped;     // expired commands discarded
+    Histogram m_queue_latency;      // micros from enqueue to execution
+    Mutex m_stats_lock;             // guards the following
+    time_t m_last_snapshot;         // time of the previous call to statistics
+    Processor_statistics m_previous;// totals at that time
 };
 
 } // namespace ares
@@ -0,0 +1,75 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/processor_scaler.hpp"
+#include <algorithm>
+
+using namespace std;
+using ares::Processor_scaler;
+
+ares::Processor_scaling::Processor_scaling()
+        : m_min_processors(1)
+        , m_max_processors(16)
+        , m_sample_millis(250)
+        , m_grow_queue_depth(4)
+        , m_grow_utilization(0.9)
+        , m_shrink_utilization(0.3)
+        , m_grow_samples(2)
+        , m_shrink_samples(40)
+{}
+
+Processor_scaler::Processor_scaler(Processor_scaling const& scaling)
+        : m_scaling(scaling)
+        , m_processors(0)
+        , m_overloaded(0)
+        , m_underloaded(0)
+{
+    m_scaling.m_min_processors = max(m_scaling.m_min_processors, 1);
+    m_scaling.m_max_processors = max(m_scaling.m_max_processors,
+                                     m_scaling.m_min_processors);
+    m_scaling.m_sample_millis = max(m_scaling.m_sample_millis, 1);
+    m_scaling.m_grow_queue_depth = max(m_scaling.m_grow_queue_depth, 1);
+    m_scaling.m_grow_samples = max(m_scaling.m_grow_samples, 1);
+    m_scaling.m_shrink_samples = max(m_scaling.m_shrink_samples, 1);
+}
+
+int Processor_scaler::sample(int num_processors, int queued,
+                             double utilization)
+{
+    Processor_scaling const& s = m_scaling;
+
+    // Any change to the pool, including one made by someone else, begins
+    // new runs. A pool outside the limits is brought within them at once.
+    if (num_processors != m_processors)
+        m_overloaded = m_underloaded = 0;
+    m_processors = min(max(num_processors, s.m_min_processors),
+                       s.m_max_processors);
+    int const n = m_processors;
+    if (n != num_processors)
+        return n;
+
+    if (queued >= s.m_grow_queue_depth*n
+        || (queued > 0 && utilization >= s.m_grow_utilization))
+    {
+        m_underloaded = 0;
+        if (n < s.m_max_processors && ++m_overloaded >= s.m_grow_samples)
+            m_processors = min(2*n, s.m_max_processors);
+    }
+    else if (queued == 0 && utilization <= s.m_shrink_utilization) {
+        m_overloaded = 0;
+        if (n > s.m_min_processors && ++m_underloaded >= s.m_shrink_samples)
+            m_processors = n - 1;
+    }
+    else {
+        m_overloaded = m_underloaded = 0;
+    }
+
+    if (m_processors != n)
+        m_overloaded = m_underloaded = 0;
+    return m_processors;
+}
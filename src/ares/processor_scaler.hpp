@@ -0,0 +1,75 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_processor_scaler
+#define included_ares_processor_scaler
+
+namespace ares {
+
+// The limits and thresholds that govern a server that chooses its own number
+// of processors (see Server::set_processor_scaling and Processor_scaler).
+// The defaults are given in parentheses.
+struct Processor_scaling {
+    int m_min_processors;           // fewest processors (1)
+    int m_max_processors;           // most processors (16)
+    int m_sample_millis;            // time between samples (250)
+
+    // A sample shows the processors to be overloaded if at least
+    // m_grow_queue_depth commands per processor are waiting to be executed,
+    // or if any are waiting while the processors were busy for at least
+    // m_grow_utilization of the time since the previous sample. It shows
+    // them to be underloaded if no commands are waiting and they were busy
+    // for at most m_shrink_utilization of that time.
+    int m_grow_queue_depth;         // (4)
+    double m_grow_utilization;      // (0.9)
+    double m_shrink_utilization;    // (0.3)
+
+    // The number of consecutive overloaded samples after which processors
+    // are added, and of underloaded samples after which one is removed.
+    int m_grow_samples;             // (2)
+    int m_shrink_samples;           // (40, or ten seconds)
+
+    Processor_scaling();
+};
+
+// Processor_scaler decides, from periodic samples of a server's command
+// queue and of how busy its processors are, how many processors the server
+// should have. It grows the pool quickly, doubling it (up to the maximum)
+// after a short run of overloaded samples, and shrinks it slowly, by one
+// processor after a long run of underloaded ones. Any other sample breaks
+// a run, and any change to the pool (whether or not the scaler called for
+// it) begins new runs, so the number of processors doesn't oscillate when
+// the load is near a threshold.
+//
+// This class is not synchronized.
+class Processor_scaler {
+  public:
+    // Constructs a scaler governed by scaling, whose limits are put in
+    // order (and made at least one processor) if they aren't already.
+    explicit Processor_scaler(Processor_scaling const& scaling);
+
+    // Returns the limits and thresholds the scaler is governed by.
+    Processor_scaling const& scaling() const { return m_scaling; }
+
+    // Records a sample of a server that has num_processors processors, with
+    // queued commands waiting to be executed, whose processors were busy
+    // for the given fraction of the time since the previous sample. Returns
+    // the number of processors the server should have, which is
+    // num_processors unless a change is called for.
+    int sample(int num_processors, int queued, double utilization);
+
+  private:
+    Processor_scaling m_scaling;    // limits and thresholds
+    int m_processors;               // the result of the previous sample
+    int m_overloaded;               // consecutive overloaded samples
+    int m_underloaded;              // consecutive underloaded samples
+};
+
+} // namespace ares
+
+#endif
@@ -8,6 +8,14 @@
 
 // This file includes all publicly exported ares headers.
 
+#ifndef included_ares_admin_service
+#include "ares/admin_service.hpp"
+#endif
+
+#ifndef included_ares_admission_control
+#include "ares/admission_control.hpp"
+#endif
+
 #ifndef included_ares_basic_reader
 #include "ares/basic_reader.hpp"
 #endif
@@ -80,6 +88,10 @@
 #include "ares/fixed_allocator.hpp"
 #endif
 
+#ifndef included_ares_gather_list
+#include "ares/gather_list.hpp"
+#endif
+
 #ifndef included_ares_guard
 #include "ares/guard.hpp"
 #endif
@@ -116,6 +128,10 @@
 #include "ares/log.hpp"
 #endif
 
+#ifndef included_ares_lz_codec
+#include "ares/lz_codec.hpp"
+#endif
+
 #ifndef included_ares_math_util
 #include "ares/math_util.hpp"
 #endif
@@ -124,6 +140,10 @@
 #include "ares/message_reader.hpp"
 #endif
 
+#ifndef included_ares_message_schema
+#include "ares/message_schema.hpp"
+#endif
+
 #ifndef included_ares_message_session
 #include "ares/message_session.hpp"
 #endif
@@ -132,6 +152,10 @@
 #include "ares/message_writer.hpp"
 #endif
 
+#ifndef included_ares_metrics
+#include "ares/metrics.hpp"
+#endif
+
 #ifndef included_ares_mutex
 #include "ares/mutex.hpp"
 #endif
@@ -160,6 +184,10 @@
 #include "ares/platform.hpp"
 #endif
 
+#ifndef included_ares_processor_scaler
+#include "ares/processor_scaler.hpp"
+#endif
+
 #ifndef included_ares_random
 #include "ares/random.hpp"
 #endif
@@ -236,6 +264,14 @@
 #include "ares/trace.hpp"
 #endif
 
+#ifndef included_ares_traffic_capture
+#include "ares/traffic_capture.hpp"
+#endif
+
+#ifndef included_ares_traffic_replay
+#include "ares/traffic_replay.hpp"
+#endif
+
 #ifndef included_ares_types
 #include "ares/types.hpp"
 #endif
@@ -16,21 +16,64 @@
 #include "ares/string_util.hpp"
 #include "ares/trace.hpp"
 #include "ares/utility.hpp"
+#include <algorithm>
+#include <cerrno>
 #include <vector>
 
 using namespace std;
 using ares::Receiver;
 
+namespace {
+
+// Sizing of the io_uring, when one is used. Received data is staged in the
+// provided buffers only until it can be copied into the session's input
+// buffer, so a modest pool goes a long way.
+int const RING_ENTRIES = 256;
+int const NUM_RECV_BUFFERS = 512;
+int const RECV_BUFFER_SIZE = 4096;
+
+// Each input event may read from a session's socket at most READ_BUDGET
+// times, so that one busy session can't starve the others; a session that
+// still has input pending is revisited on the next pass.
+int const READ_BUDGET = 16;
+
+// Session input buffers are grown (by doubling) up to this capacity in
+// response to full reads. Sessions may choose larger buffers themselves.
+int const MAX_ADAPTIVE_CAPACITY = 64*1024;
+
+// When input buffers are shared, at most this many free buffers are kept
+// in the pool; the rest are deleted.
+int const MAX_POOLED_BUFFERS = 256;
+
+// The user data attached to cancellation requests, whose completions are
+// ignored.
+ares::Uint64 const CANCEL_USER_DATA = ~ares::Uint64(0);
+
+// Returns the user data that identifies a session's receive operations. The
+// socket handle locates the session; the session ID guards against
+// completions that arrive after the handle has been reused.
+ares::Uint64 recv_user_data(ares::Session const& s)
+{
+    return (ares::Uint64(ares::Uint32(s->id())) << 32)
+           | ares::Uint32(s->socket().handle());
+}
+
+} // namespace
+
 Receiver::Receiver(Server_interface& server)
         : Component("receiver")
         , m_server(server)
+        , m_use_io_uring(false)
+        , m_share_input_buffers(false)
+        , m_scratch(MAX_ADAPTIVE_CAPACITY)
         , m_last_snapshot(current_time())
-        , m_reads(0)
-        , m_bytes_read(0)
+        , m_previous(new Receiver_statistics)
 {}
 
 Receiver::~Receiver()
-{}
+{
+    for_each(m_buffer_pool.begin(), m_buffer_pool.end(), delete_fun<Buffer>);
+}
 
 void Receiver::add_session(Session s)
 {
@@ -50,28 +93,166 @@ int Receiver::num_sessions() const
 
 ares::Receiver_statistics Receiver::statistics()
 {
-    Receiver_statistics stats;
-    Guard guard(m_lock);             // lock access to m_sessions
+    Receiver_statistics stats = totals();
+    Receiver_statistics const totals = stats;
+    Guard guard(m_stats_lock);
 
     time_t const current_time = ares::current_time();
     stats.m_elapsed_sec = current_time - m_last_snapshot;
     m_last_snapshot = current_time;
 
-    stats.m_reads = m_reads;
-    stats.m_bytes_read = m_bytes_read;
+    stats.subtract(*m_previous);
+    *m_previous = totals;
+    return stats;
+}
 
-    m_reads = 0;
-    m_bytes_read = 0;
+ares::Receiver_statistics Receiver::totals() const
+{
+    Receiver_statistics stats;
+    stats.m_elapsed_sec = uptime();
+    stats.m_events = m_events.value();
+    stats.m_reads = m_reads.value();
+    stats.m_bytes_read = m_bytes_read.value();
+    stats.m_buffer_grows = m_buffer_grows.value();
+    stats.m_buffer_shrinks = m_buffer_shrinks.value();
+    stats.m_input_latency = m_input_latency.snapshot();
 
+    Guard guard(m_lock);             // lock access to m_sessions
     stats.m_sessions_snap = m_sessions.size();
     stats.m_queued_updates_snap = m_update_queue.size();
 
+    for (Session_map::const_iterator i = m_sessions.begin();
+         i != m_sessions.end(); ++i)
+    {
+        if (i->second->m_buffer)
+            stats.m_attached_buffers_snap++;
+    }
+    stats.m_pooled_buffers_snap = m_buffer_pool.size();
+
     return stats;
 }
 
+void Receiver::start_capture(string const& path)
+{
+    auto_ptr<Traffic_capture> capture(new Traffic_capture(path));
+
+    // The event handlers run with the lock held, so the capture can be
+    // replaced between events.
+    Guard guard(m_lock);
+    for (Session_map::const_iterator i = m_sessions.begin();
+         i != m_sessions.end(); ++i)
+    {
+        Socket_event_handler const& handler = *i->second;
+        capture->record_open(handler.m_session->id(),
+                             handler.m_session->to_string());
+        if (handler.m_buffer && handler.m_buffer->size() > 0) {
+            capture->record_input(handler.m_session->id(),
+                                  handler.m_buffer->begin(),
+                                  handler.m_buffer->size());
+        }
+    }
+    m_capture = capture;
+    Log::writef(Log::NOTICE, "rcvr: capturing session input to %s",
+                path.c_str());
+}
+
+void Receiver::stop_capture()
+{
+    Guard guard(m_lock);
+    if (m_capture.get()) {
+        m_capture.reset();
+        Log::writef(Log::NOTICE, "rcvr: stopped capturing session input");
+    }
+}
+
+void Receiver::sessions(vector<Session>& v) const
+{
+    Guard guard(m_lock);
+    v.reserve(v.size() + m_sessions.size());
+    for (Session_map::const_iterator i = m_sessions.begin();
+         i != m_sessions.end(); ++i)
+    {
+        v.push_back(i->second->m_session);
+    }
+}
+
+void Receiver::do_startup()
+{
+    m_ring.reset();
+
+    if (m_use_io_uring) {
+        try {
+            if (!Io_uring::is_supported())
+                throw Not_implemented_error("io_uring multishot receive");
+            auto_ptr<Io_uring> ring(new Io_uring(RING_ENTRIES));
+            ring->provide_buffers(NUM_RECV_BUFFERS, RECV_BUFFER_SIZE);
+            m_ring = ring;
+        }
+        catch (Exception& e) {
+            Log::writef(Log::NOTICE, "rcvr: io_uring unavailable, falling "
+                        "back to polling: %s", e.to_string().c_str());
+        }
+    }
+
+    // Sessions left from before the receiver was shut down are carried over
+    // to the i/o engine now in use, which may differ from the previous one.
+    Guard guard(m_lock);
+    for (Session_map::iterator i = m_sessions.begin();
+         i != m_sessions.end(); ++i)
+    {
+        Sockfd const fd = i->first;
+        Session const& session = i->second->m_session;
+        m_poller.remove(fd);
+        if (m_ring.get()) {
+            m_ring->recv_multishot(fd, recv_user_data(session));
+        }
+        else if (!m_poller.add(fd, Sockfd_poller::EVENT_READABLE,
+                               *i->second))
+        {
+            ARES_PANIC(("couldn't add session [%s] to i/o event poller",
+                        session->to_string().c_str()));
+        }
+    }
+}
+
+void Receiver::do_shutdown()
+{
+    m_ring.reset();
+}
+
 void Receiver::run() try
 {
     Trace::set_thread_name("receiver");
+
+    // A receiver bound to cpus replaces the buffers it was left with by ones
+    // it allocates itself, so that the kernel places them (when they are
+    // first touched) in memory local to those cpus. Pooled buffers are
+    // allocated by this thread as they are needed.
+    if (!cpu_affinity().empty()) {
+        Guard guard(m_lock);
+        Buffer(MAX_ADAPTIVE_CAPACITY).swap(m_scratch);
+        for_each(m_buffer_pool.begin(), m_buffer_pool.end(),
+                 delete_fun<Buffer>);
+        m_buffer_pool.clear();
+    }
+
+    if (m_ring.get())
+        run_io_uring();
+    else
+        run_poller();
+}
+catch (Exception& e) {
+    Log::writef(Log::ERROR, "rcvr: unexpected exception, shutting down: %s",
+                e.to_string().c_str());
+    shutdown();
+}
+catch (...) {
+    Log::writef(Log::ERROR, "rcvr: unexpected exception, shutting down");
+    shutdown();
+}
+
+void Receiver::run_poller()
+{
     int const DELAY = 50;             // milliseconds to wait for an event
 
     while (!is_stopped()) {
@@ -100,19 +281,49 @@ void Receiver::run() try
         }
     }
 }
-catch (Exception& e) {
-    Log::writef(Log::ERROR, "rcvr: unexpected exception, shutting down: %s",
-                e.to_string().c_str());
-    shutdown();
-}
-catch (...) {
-    Log::writef(Log::ERROR, "rcvr: unexpected exception, shutting down");
-    shutdown();
+
+void Receiver::run_io_uring()
+{
+    int const DELAY = 50;             // milliseconds to wait for a completion
+
+    while (!is_stopped()) {
+        // If we're not managing any sockets, check for new sessions.
+        if (m_sessions.empty()) {
+            briefly_wait_for_update();
+            if (m_sessions.empty())
+                continue;
+        }
+
+        // Submit queued receives and wait for some of them to complete.
+        int const num_completions = m_ring->submit_and_wait(DELAY);
+
+        // Acquire an exclusive lock on the receiver.
+        Guard guard(m_lock);
+
+        // Process any completions.
+        if (num_completions > 0) {
+            Io_uring::Completion c;
+            while (m_ring->next_completion(c))
+                process(c);
+        }
+
+        // Process the add-remove queue.
+        if (int count = m_update_queue.dequeue_all(m_updates)) {
+            for (int i = 0; i < count; i++)
+                process(m_updates[i]);
+            m_updates.clear();
+        }
+    }
 }
 
 void Receiver::briefly_wait_for_update()
 {
-    try { process(m_update_queue.dequeue(100)); } catch (Timeout_error&) {}
+    // Wait without the lock, but process the update with it held, as the
+    // event loops do.
+    Pending_update p;
+    try { p = m_update_queue.dequeue(100); } catch (Timeout_error&) { return; }
+    Guard guard(m_lock);
+    process(p);
 }
 
 void Receiver::process(Pending_update p)
@@ -134,11 +345,20 @@ void Receiver::process(Pending_update p)
         if (was_inserted) {
             // Give the session a chance to initialize the input buffer.
             session->handle_init(*handler->m_buffer);
-
-            // Add the socket to our i/o event poller.
-            if (!m_poller.add(session->socket().handle(),
-                              Sockfd_poller::EVENT_READABLE,
-                              *handler))
+            handler->m_min_capacity = handler->m_buffer->capacity();
+            handler->end_input();       // (idle sessions may hold no buffer)
+            if (m_capture.get())
+                m_capture->record_open(session->id(), session->to_string());
+
+            // Start receiving from the socket, or add it to our i/o event
+            // poller.
+            if (m_ring.get()) {
+                m_ring->recv_multishot(session->socket().handle(),
+                                       recv_user_data(session));
+            }
+            else if (!m_poller.add(session->socket().handle(),
+                                   Sockfd_poller::EVENT_READABLE,
+                                   *handler))
             {
                 ARES_PANIC(("couldn't add session [%s] to i/o event poller",
                             session->to_string().c_str()));
@@ -151,7 +371,7 @@ void Receiver::process(Pending_update p)
                         "for session (%s)", session->to_string().c_str());
         }
 
-        assert(int(m_sessions.size()) == m_poller.num_sockets());
+        assert(m_ring.get() || int(m_sessions.size())==m_poller.num_sockets());
     }
     else {
         ARES_TRACE(("removing session [%s]", session->to_string().c_str()));
@@ -161,21 +381,74 @@ void Receiver::process(Pending_update p)
         // not reused, socket handles (which the poller uses as a key) may be
         // reused immediately.
 
+        // The same holds for the io_uring: a receive may complete after the
+        // session is gone, so completions are matched against the session
+        // id as well as the socket handle (see process(Completion)).
+
         Session_map::iterator i = m_sessions.find(session->socket().handle());
-        if (i != m_sessions.end()) {
+        if (i != m_sessions.end() && i->second->m_session == session) {
             delete i->second;           // delete the socket event handler
             session->handle_shutdown(); // call session's shutdown handler
             m_sessions.erase(i);
-            m_poller.remove(session->socket().handle());  // ok to fail
+            if (m_capture.get())
+                m_capture->record_close(session->id());
+            if (m_ring.get())
+                m_ring->cancel(recv_user_data(session), CANCEL_USER_DATA);
+            else
+                m_poller.remove(session->socket().handle());  // ok to fail
         }
-        assert(int(m_sessions.size()) == m_poller.num_sockets());
+        assert(m_ring.get() || int(m_sessions.size())==m_poller.num_sockets());
+    }
+}
+
+ares::Buffer* Receiver::acquire_buffer()
+{
+    if (m_buffer_pool.empty())
+        return new Buffer;
+
+    Buffer* b = m_buffer_pool.back();
+    m_buffer_pool.pop_back();
+    return b;
+}
+
+void Receiver::release_buffer(Buffer* b)
+{
+    if (m_share_input_buffers
+        && int(m_buffer_pool.size()) < MAX_POOLED_BUFFERS
+        && b->capacity() <= MAX_ADAPTIVE_CAPACITY)
+    {
+        b->clear();
+        m_buffer_pool.push_back(b);
+    }
+    else {
+        delete b;
+    }
+}
+
+void Receiver::process(Io_uring::Completion const& c)
+{
+    if (c.m_user_data == CANCEL_USER_DATA)
+        return;
+
+    Sockfd const fd = Sockfd(c.m_user_data & 0xffffffff);
+    int const id = int(c.m_user_data >> 32);
+
+    Session_map::iterator i = m_sessions.find(fd);
+    if (i != m_sessions.end() && i->second->m_session->id() == id) {
+        (*i->second)(c);
+    }
+    else if (c.buffer_id() >= 0) {
+        // The session has been removed; discard the data.
+        m_ring->recycle_buffer(c.buffer_id());
     }
 }
 
 
 Receiver::Socket_event_handler::~Socket_event_handler()
 {
-    delete m_buffer;
+    assert(m_buffer != &m_receiver.m_scratch);
+    if (m_buffer)
+        m_receiver.release_buffer(m_buffer);
 }
 
 Receiver::Socket_event_handler::Action
@@ -183,29 +456,62 @@ Receiver::Socket_event_handler::operator()()
 {
     // First, we fill the session's input buffer, watching for an i/o
     // exception (if one is raised, we kill the session). After the physical
-    // read, we invoke the session's input callback. Finally, if the session
-    // callback returns false, we kill the session.
+    // read, we invoke the session's input callback; if the callback returns
+    // false, we kill the session. A read that fills the buffer means more
+    // input is probably waiting, so we grow the buffer and read again, until
+    // the socket is drained or the session's read budget is spent.
 
     bool remove = false;
     Action action = DISCARD_EVENT;
+    int bytes_read = 0;
 
     try {
-        // Try to fill the session's input buffer.
-        int const free_space = m_buffer->free();
-        int const n = m_session->socket().read(*m_buffer);
-        m_receiver.m_reads++;
+        m_receiver.m_events.add();
+        begin_input();
 
-        if (n > 0) {                        // successfully read n bytes
-            m_receiver.m_bytes_read += n;
-            if (!m_session->handle_input(*m_buffer))
+        for (int num_reads = 0; ; num_reads++) {
+            if (num_reads == READ_BUDGET) {
+                action = KEEP_EVENT;            // revisit on the next pass
+                break;
+            }
+
+            // Try to fill the session's input buffer.
+            int const free_space = m_buffer->free();
+            int const n = m_session->socket().read(*m_buffer);
+            m_receiver.m_reads.add();
+
+            if (n > 0) {                        // successfully read n bytes
+                Int64 const read_done = monotonic_micros();
+                m_receiver.m_bytes_read.add(n);
+                if (m_receiver.m_capture.get()) {
+                    m_receiver.m_capture->record_input(m_session->id(),
+                                                       m_buffer->end() - n,
+                                                       n);
+                }
+                bytes_read += n;
+                bool const ok = m_session->handle_input(*m_buffer);
+                m_receiver.m_input_latency.record_since(read_done);
+                if (!ok) {
+                    remove = true;
+                    break;
+                }
+                if (n < free_space)             // socket has been drained
+                    break;
+                grow_buffer(0);
+            }
+            else if (n < 0) {                   // end-of-file received
                 remove = true;
-            else if (n == free_space)
-                action = KEEP_EVENT;
+                break;
+            }
+            else {                              // no input, or buffer full
+                if (free_space == 0)
+                    action = KEEP_EVENT;
+                break;
+            }
         }
-        else if (n < 0)                     // end-of-file received
-            remove = true;
-        else if (n == 0 && free_space == 0) // input buffer was full
-            action = KEEP_EVENT;
+
+        if (!remove)
+            shrink_buffer(bytes_read);
     }
     catch (IO_error& e) {
         remove = true;
@@ -218,6 +524,8 @@ Receiver::Socket_event_handler::operator()()
         Log::writef(Log::WARNING, "rcvr: error: %s", e.to_string().c_str());
     }
 
+    end_input();
+
     if (remove) {
         // Note: we don't actually need to return REMOVE_SOCKET from this
         // function because the receiver will automatically remove sockets
@@ -228,6 +536,162 @@ Receiver::Socket_event_handler::operator()()
     return action;
 }
 
+void Receiver::Socket_event_handler::operator()(Io_uring::Completion const& c)
+{
+    // The data has already been read into one of the ring's provided
+    // buffers. We copy it to the end of the session's input buffer (growing
+    // the buffer if necessary), return the provided buffer to the kernel,
+    // and invoke the session's input callback as in the polled case. If the
+    // multishot receive has terminated, we post another one.
+
+    Io_uring& ring = *m_receiver.m_ring;
+    bool remove = false;
+
+    try {
+        int const n = c.m_result;
+
+        m_receiver.m_events.add();
+
+        if (n > 0) {                        // successfully read n bytes
+            int const id = c.buffer_id();
+            assert(id >= 0);
+            begin_input();
+            if (m_buffer->free() < n)
+                grow_buffer(n);
+            m_buffer->put(ring.provided_buffer(id), n);
+            if (m_receiver.m_capture.get()) {
+                m_receiver.m_capture->record_input(m_session->id(),
+                                                   ring.provided_buffer(id),
+                                                   n);
+            }
+            ring.recycle_buffer(id);
+
+            m_session->socket().count_bytes_received(n);
+            m_receiver.m_reads.add();
+            m_receiver.m_bytes_read.add(n);
+            Int64 const read_done = monotonic_micros();
+            bool const ok = m_session->handle_input(*m_buffer);
+            m_receiver.m_input_latency.record_since(read_done);
+            if (!ok)
+                remove = true;
+            else
+                shrink_buffer(n);
+        }
+        else if (n == 0)                    // end-of-file received
+            remove = true;
+        else if (n != -ENOBUFS)             // (out of buffers: just re-post)
+            throw Network_io_error("recv", -n);
+
+        if (!remove && !c.has_more()) {
+            ring.recv_multishot(m_session->socket().handle(),
+                                recv_user_data(m_session));
+        }
+    }
+    catch (IO_error& e) {
+        remove = true;
+        Log::writef(Log::NOTICE, "rcvr: i/o error reading from session (%s), "
+                    "closing connection: %s", m_session->to_string().c_str(),
+                    e.to_string().c_str());
+    }
+    catch (Exception& e) {
+        remove = true;
+        Log::writef(Log::WARNING, "rcvr: error: %s", e.to_string().c_str());
+    }
+
+    end_input();
+
+    if (remove)
+        m_receiver.process(make_pair(false, m_session));
+}
+
+void Receiver::Socket_event_handler::grow_buffer(int min_free)
+{
+    // Doubles the capacity of the input buffer, up to MAX_ADAPTIVE_CAPACITY,
+    // but in any case makes room for at least min_free more bytes.
+
+    int const capacity = m_buffer->capacity();
+    int const new_capacity = max(min(2 * capacity, MAX_ADAPTIVE_CAPACITY),
+                                 m_buffer->size() + min_free);
+
+    if (new_capacity > capacity) {
+        m_buffer->set_capacity(new_capacity);
+        m_receiver.m_buffer_grows.add();
+    }
+}
+
+void Receiver::Socket_event_handler::shrink_buffer(int bytes_read)
+{
+    // Shrinks an empty input buffer by half (but never below the capacity
+    // the session chose) if the most recent event used less than a quarter
+    // of it. Busy sessions keep their large buffers; idle ones give the
+    // memory back.
+
+    int const capacity = m_buffer->capacity();
+    if (m_buffer != &m_receiver.m_scratch
+        && m_buffer->size() == 0
+        && capacity > m_min_capacity
+        && bytes_read < capacity / 4)
+    {
+        m_buffer->set_capacity(max(capacity / 2, m_min_capacity));
+        m_receiver.m_buffer_shrinks.add();
+    }
+}
+
+void Receiver::Socket_event_handler::begin_input()
+{
+    if (!m_buffer) {
+        assert(m_receiver.m_scratch.size() == 0);
+        m_buffer = &m_receiver.m_scratch;
+    }
+}
+
+void Receiver::Socket_event_handler::end_input()
+{
+    Buffer& scratch = m_receiver.m_scratch;
+
+    if (m_buffer == &scratch) {
+        // Retain a partial message in a pooled buffer, leaving room for the
+        // rest of it to arrive.
+        m_buffer = 0;
+        if (scratch.size() > 0) {
+            m_buffer = m_receiver.acquire_buffer();
+            m_buffer->set_min_capacity(max(m_min_capacity, 2*scratch.size()));
+            m_buffer->put(scratch);
+            scratch.clear();
+        }
+    }
+    else if (m_receiver.m_share_input_buffers
+             && m_buffer
+             && m_buffer->size() == 0)
+    {
+        m_receiver.release_buffer(m_buffer);
+        m_buffer = 0;
+    }
+}
+
+
+ares::Receiver_statistics::Receiver_statistics()
+        : m_elapsed_sec(0)
+        , m_sessions_snap(0)
+        , m_queued_updates_snap(0)
+        , m_attached_buffers_snap(0)
+        , m_pooled_buffers_snap(0)
+        , m_events(0)
+        , m_reads(0)
+        , m_bytes_read(0)
+        , m_buffer_grows(0)
+        , m_buffer_shrinks(0)
+{}
+
+void ares::Receiver_statistics::subtract(Receiver_statistics const& earlier)
+{
+    m_events -= earlier.m_events;
+    m_reads -= earlier.m_reads;
+    m_bytes_read -= earlier.m_bytes_read;
+    m_buffer_grows -= earlier.m_buffer_grows;
+    m_buffer_shrinks -= earlier.m_buffer_shrinks;
+    m_input_latency -= earlier.m_input_latency;
+}
 
 double ares::Receiver_statistics::reads_per_sec() const
 {
@@ -241,5 +705,10 @@ double ares::Receiver_statistics::bytes_read_per_sec() const
 
 int ares::Receiver_statistics::bytes_per_read() const
 {
-    return reads() == 0 ? 0 : bytes_read()/reads();
+    return reads() == 0 ? 0 : int(bytes_read()/reads());
+}
+
+double ares::Receiver_statistics::reads_per_event() const
+{
+    return events() == 0 ? 0 : 1.0*reads()/events();
 }
@@ -11,14 +11,20 @@
 
 // This is an implementation file; do not use directly.
 
+#include "ares/buffer.hpp"
 #include "ares/command_queue.hpp"
 #include "ares/component.hpp"
+#include "ares/io_uring.hpp"
+#include "ares/metrics.hpp"
 #include "ares/mutex.hpp"
 #include "ares/server_interface.hpp"
 #include "ares/session.hpp"
 #include "ares/shared_queue.hpp"
 #include "ares/sockfd_poller.hpp"
+#include "ares/traffic_capture.hpp"
 #include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace ares {
@@ -49,50 +55,137 @@ class Receiver : public Component {
     // receiver. Note that this may not include recent additions or removals.
     int num_sessions() const;
 
+    // Selects the i/o engine used to read from sessions the next time the
+    // receiver is started. By default, the receiver polls sockets for
+    // readiness and reads from them itself; if b is true, it instead posts
+    // asynchronous receives through io_uring, falling back to polling if
+    // io_uring is unavailable. Has no effect on a running receiver.
+    void use_io_uring(bool b) { m_use_io_uring = b; }
+
+    // Returns true if the receiver is reading through io_uring.
+    bool is_using_io_uring() const { return m_ring.get() != 0; }
+
+    // Enables or disables sharing of session input buffers. Normally each
+    // session owns an input buffer for its whole life. When sharing is
+    // enabled, idle sessions hold no input buffer at all: the receiver reads
+    // into its own scratch buffer and gives a session a buffer (taken from a
+    // pool) only when it must retain a partial message between reads. This
+    // greatly reduces the memory used by large numbers of mostly-idle
+    // connections. It should be set before the receiver is started.
+    void use_shared_input_buffers(bool b) { m_share_input_buffers = b; }
+
+    // Begins appending the input of every session to a new capture file at
+    // path (see Traffic_capture), ending any capture in progress. Sessions
+    // that are already open are recorded as if they had just been added,
+    // along with any input they have not yet consumed. Raises an IO_error if
+    // the file cannot be created. May be called while the receiver runs.
+    void start_capture(std::string const& path);
+
+    // Ends the capture in progress, if any, and closes its file.
+    void stop_capture();
+
+    // Returns the receiver's activity since the previous call to this
+    // function, and a snapshot of its state.
     Receiver_statistics statistics();
 
+    // Returns the receiver's activity since it was created, and a snapshot
+    // of its state. Unlike statistics, does not begin a new statistics
+    // window, so any number of observers may call it.
+    Receiver_statistics totals() const;
+
+    // Stores the sessions currently managed by this receiver in v.
+    void sessions(std::vector<Session>& v) const;
+
   private:
     struct Socket_event_handler : public Sockfd_poller::Event_handler {
         Receiver& m_receiver;   // reference to the parent class
         Session m_session;      // session to associate with events
         Buffer* m_buffer;       // the session input buffer
+        int m_min_capacity;     // input buffer capacity chosen by session
 
         Socket_event_handler(Receiver& r, Session s, Buffer* b)
                 : m_receiver(r)
                 , m_session(s)
                 , m_buffer(b)
+                , m_min_capacity(0)
         {}
 
         virtual ~Socket_event_handler();
         Action operator()();  // the event handler callback
+
+        // Handles the completion of an asynchronous receive.
+        void operator()(Io_uring::Completion const& c);
+
+        // Adapts the input buffer to the observed input rate: it is grown
+        // when a read fills it, and shrunk back towards its original
+        // capacity when it is empty and the last event read little data.
+        void grow_buffer(int min_free);
+        void shrink_buffer(int bytes_read);
+
+        // When input buffers are shared, an idle session has no input
+        // buffer (m_buffer is null). begin_input lends it the receiver's
+        // scratch buffer for the duration of an event; end_input moves any
+        // unconsumed input from the scratch buffer into a pooled buffer, or
+        // returns an emptied pooled buffer to the pool.
+        void begin_input();
+        void end_input();
     };
 
     typedef std::pair<bool, Session> Pending_update;
     typedef Shared_queue<Pending_update> Update_queue;
     typedef std::vector<Pending_update> Update_array;
     typedef std::map<Sockfd, Socket_event_handler*> Session_map;
+    typedef std::vector<Buffer*> Buffer_pool;
 
   private:
+    // Implements Component::do_startup and Component::do_shutdown.
+    void do_startup();
+    void do_shutdown();
+
     // Implements Thread::Runnable::run.
     void run();
 
+    // The main loops for each i/o engine.
+    void run_poller();
+    void run_io_uring();
+
+    // Dispatches a completion from the io_uring to its session.
+    void process(Io_uring::Completion const& c);
+
     // Waits very briefly for an incoming session update.
     void briefly_wait_for_update();
 
     // Performs the actual work involved in handling an update.
     void process(Pending_update);
 
+    // Takes a buffer from the pool of shared input buffers (or creates one),
+    // and returns one to the pool (or deletes it if the pool is full).
+    Buffer* acquire_buffer();
+    void release_buffer(Buffer* b);
+
     Server_interface& m_server;     // external server interface
     Session_map m_sessions;         // maps sockets to session data
     Sockfd_poller m_poller;         // socket I/O event poller
+    bool m_use_io_uring;            // use io_uring when next started?
+    std::auto_ptr<Io_uring> m_ring; // io_uring, if in use
+    bool m_share_input_buffers;     // lend idle sessions no buffer?
+    Buffer m_scratch;               // input buffer lent to idle sessions
+    Buffer_pool m_buffer_pool;      // free input buffers
     Update_queue m_update_queue;    // queued added/removed sessions
     Update_array m_updates;         // for efficient dequeue_all
+    std::auto_ptr<Traffic_capture> m_capture;   // input capture, if any
     mutable Mutex m_lock;           // general sychronization
 
     // (statistics)
-    time_t m_last_snapshot;
-    int m_reads;
-    int m_bytes_read;
+    Counter m_events;
+    Counter m_reads;
+    Counter m_bytes_read;
+    Counter m_buffer_grows;
+    Counter m_buffer_shrinks;
+    Histogram m_input_latency;      // micros from read to end of handle_input
+    Mutex m_stats_lock;             // guards the following
+    time_t m_last_snapshot;         // time of the previous call to statistics
+    std::auto_ptr<Receiver_statistics> m_previous;  // totals at that time
 
     friend struct Socket_event_handler;
 };
@@ -101,6 +194,9 @@ class Receiver : public Component {
 // created by calling the Receiver::statistics function.
 class Receiver_statistics {
   public:
+    // Constructs empty statistics.
+    Receiver_statistics();
+
     // The number of seconds since the last call to Receiver::statistics. All
     // rate-based statistics are relative to the time period returned by this
     // function.
@@ -116,13 +212,13 @@ class Receiver_statistics {
     int queued_updates_snap() const { return m_queued_updates_snap; }
 
     // The number of network read operations executed by the receiver.
-    int reads() const { return m_reads; }
+    Int64 reads() const { return m_reads; }
 
     // The mean network reads per second during the statistics window.
     double reads_per_sec() const;
 
     // The number of bytes read by the receiver.
-    int bytes_read() const { return m_bytes_read; }
+    Int64 bytes_read() const { return m_bytes_read; }
 
     // The mean bytes read per second during the statistics window.
     double bytes_read_per_sec() const;
@@ -131,12 +227,49 @@ class Receiver_statistics {
     // window.
     int bytes_per_read() const;
 
+    // The number of input events (socket readiness notifications or
+    // completed asynchronous receives) handled by the receiver.
+    Int64 events() const { return m_events; }
+
+    // The mean network reads per input event during the statistics window.
+    // Values well above one indicate that sessions are receiving data in
+    // bursts larger than their input buffers.
+    double reads_per_event() const;
+
+    // The number of times a session input buffer was grown or shrunk to
+    // adapt to the amount of incoming data.
+    Int64 buffer_grows() const { return m_buffer_grows; }
+    Int64 buffer_shrinks() const { return m_buffer_shrinks; }
+
+    // The distribution of the time, in microseconds, from the completion of
+    // each read to the return of the session's input handler, during the
+    // statistics window.
+    Histogram_snapshot const& input_latency() const
+    {
+        return m_input_latency;
+    }
+
+    // When input buffers are shared, a snapshot of the number of sessions
+    // holding an input buffer, and of the number of free buffers in the
+    // receiver's pool.
+    int attached_buffers_snap() const { return m_attached_buffers_snap; }
+    int pooled_buffers_snap() const { return m_pooled_buffers_snap; }
+
   private:
     int m_elapsed_sec;              // seconds since last snapshot
     int m_sessions_snap;            // current number of managed sessions
     int m_queued_updates_snap;      // queued (unprocessed) session updates
-    int m_reads;                    // total read operations
-    int m_bytes_read;               // total bytes read
+    int m_attached_buffers_snap;    // sessions holding an input buffer
+    int m_pooled_buffers_snap;      // free input buffers in the pool
+    Int64 m_events;                 // total input events
+    Int64 m_reads;                  // total read operations
+    Int64 m_bytes_read;             // total bytes read
+    Int64 m_buffer_grows;           // total input buffer expansions
+    Int64 m_buffer_shrinks;         // total input buffer contractions
+    Histogram_snapshot m_input_latency; // read to end of input handling
+
+    // Subtracts the activity counted in earlier statistics.
+    void subtract(Receiver_statistics const& earlier);
 
     friend class Receiver;
 };
@@ -7,21 +7,27 @@
 // DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ares/server.hpp"
+#include "ares/command.hpp"
 #include "ares/command_queue.hpp"
+#include "ares/command_timer.hpp"
 #include "ares/date.hpp"
 #include "ares/dispatcher.hpp"
 #include "ares/error.hpp"
 #include "ares/guard.hpp"
 #include "ares/listener.hpp"
 #include "ares/log.hpp"
+#include "ares/mutex.hpp"
 #include "ares/platform.hpp"
 #include "ares/processor.hpp"
+#include "ares/processor_scaler.hpp"
 #include "ares/receiver.hpp"
 #include "ares/service.hpp"
 #include "ares/string_util.hpp"
 #include "ares/thread.hpp"
 #include "ares/trace.hpp"
+#include <algorithm>
 #include <list>
+#include <set>
 #include <vector>
 
 using namespace std;
@@ -33,6 +39,120 @@ using namespace ares;
 
 typedef list<pair<Service*, Listener*> > Service_list;
 
+namespace
+{
+// Copies the statistics of a server component into stats.
+void add_statistics(Server_statistics& stats, Receiver_statistics const& rs)
+{
+    stats.m_elapsed_sec = rs.elapsed_sec();
+    stats.m_sessions_snap = rs.sessions_snap();
+    stats.m_queued_updates_snap = rs.queued_updates_snap();
+    stats.m_events = rs.events();
+    stats.m_reads = rs.reads();
+    stats.m_bytes_read = rs.bytes_read();
+    stats.m_buffer_grows = rs.buffer_grows();
+    stats.m_buffer_shrinks = rs.buffer_shrinks();
+    stats.m_attached_buffers_snap = rs.attached_buffers_snap();
+    stats.m_pooled_buffers_snap = rs.pooled_buffers_snap();
+    stats.m_input_latency = rs.input_latency();
+}
+
+void add_statistics(Server_statistics& stats,
+                    Dispatcher_statistics const& ds)
+{
+    stats.m_output_sessions_snap = ds.sessions_snap();
+    stats.m_queued_dispatches_snap = ds.queued_dispatches_snap();
+    stats.m_output_buffers_snap = ds.buffers_snap();
+    stats.m_output_bytes_snap = ds.outbound_remaining_snap();
+    stats.m_writes = ds.writes();
+    stats.m_zero_writes = ds.zero_writes();
+    stats.m_bytes_sent = ds.bytes_sent();
+    stats.m_buffers_added = ds.buffers_added();
+    stats.m_buffers_sent = ds.buffers_sent();
+    stats.m_blocked_sends = ds.blocked_sends();
+    stats.m_dropped_buffers = ds.dropped_buffers();
+    stats.m_disconnects = ds.disconnects();
+    stats.m_flush_latency = ds.flush_latency();
+}
+
+void add_statistics(Server_statistics& stats,
+                    Processor_statistics const& ps)
+{
+    stats.m_commands_executed.push_back(ps.m_commands_executed);
+    stats.m_busy_micros += ps.m_busy_micros;
+    stats.m_commands_expired += ps.m_commands_expired;
+    stats.m_commands_dropped += ps.m_commands_dropped;
+    stats.m_queue_latency += ps.m_queue_latency;
+}
+
+// Adds ps, the activity of a processor that is being removed, to retired,
+// the activity of the processors removed before it.
+void accumulate(Processor_statistics& retired, Processor_statistics const& ps)
+{
+    retired.m_busy_micros += ps.m_busy_micros;
+    retired.m_commands_expired += ps.m_commands_expired;
+    retired.m_commands_dropped += ps.m_commands_dropped;
+    retired.m_queue_latency += ps.m_queue_latency;
+}
+
+// Adds the activity of processors that have been removed to stats. (The
+// commands they executed are not added, since those are reported by
+// processor id.)
+void add_retired_statistics(Server_statistics& stats,
+                            Processor_statistics const& retired)
+{
+    stats.m_busy_micros += retired.m_busy_micros;
+    stats.m_commands_expired += retired.m_commands_expired;
+    stats.m_commands_dropped += retired.m_commands_dropped;
+    stats.m_queue_latency += retired.m_queue_latency;
+}
+
+// Appends the placement of a running thread to stats.
+void add_placement(Server_statistics& stats, string const& name,
+                   Cpu_set const& cpus)
+{
+    if (cpus.empty())
+        return;
+
+    stats.m_placement.push_back(Thread_placement());
+    Thread_placement& placement = stats.m_placement.back();
+    placement.m_name = name;
+    placement.m_cpus = cpus;
+    for (Cpu_set::const_iterator i = cpus.begin(); i != cpus.end(); ++i) {
+        int const node = cpu_numa_node(*i);
+        if (node >= 0)
+            placement.m_nodes.insert(node);
+    }
+}
+
+// Appends a line to the text form of Server_statistics.
+void put_value(string& s, string const& name, Int64 n)
+{
+    s += format("%-32s %lld\n", name.c_str(), static_cast<long long>(n));
+}
+
+// Appends a count, with its rate over a window of elapsed_sec seconds.
+void put_count(string& s, string const& name, Int64 n, int elapsed_sec)
+{
+    s += format("%-32s %lld (%.2f/s)\n", name.c_str(),
+                static_cast<long long>(n),
+                elapsed_sec == 0 ? 0 : 1.0*n/elapsed_sec);
+}
+
+// Appends the size and shape of a latency distribution.
+void put_latency(string& s, string const& name, Histogram_snapshot const& h)
+{
+    s += format("%-32s count %lld mean %.0f p50 %lld p90 %lld p99 %lld "
+                "p99.9 %lld max %lld (us)\n", name.c_str(),
+                static_cast<long long>(h.count()), h.mean(),
+                static_cast<long long>(h.percentile(50)),
+                static_cast<long long>(h.percentile(90)),
+                static_cast<long long>(h.percentile(99)),
+                static_cast<long long>(h.percentile(99.9)),
+                static_cast<long long>(h.max()));
+}
+}
+
 // This simple class manages a pool of integer IDs. The IDs it generates begin
 // at 0 and increase up to 2^31-1. It always returns the lowest available ID.
 // IDs can be returned to the pool of available IDs for subsequent reuse.
@@ -62,26 +182,220 @@ class ID_table {
 };
 
 
-struct Server::Impl {
+struct Server::Impl : public Admission_gate {
+    // Samples the command queue and the processors periodically, and resizes
+    // the pool of processors as m_scaler directs.
+    class Scaling_controller : public Component {
+      public:
+        Scaling_controller(Server& server);
+
+      private:
+        void run();
+
+        Server& m_server;           // the server whose pool is resized
+    };
+
     Command_queue m_queue;              // primary command queue for components
+    Command_timer m_command_timer;      // timings by type of command
+    Mutex m_resize_lock;                // serializes changes to m_processors
+    Mutex m_processor_lock;             // guards m_processors
     vector<Processor*> m_processors;    // processor components
+    Processor_statistics m_retired;     // totals of removed processors
+    Processor_statistics m_retired_window;  // their activity since the
+                                            // previous call to
+                                            // Server::statistics
+    auto_ptr<Processor_scaler> m_scaler;// sizes m_processors (if enabled)
+    Scaling_controller m_controller;    // applies m_scaler's decisions
+    Counter m_processor_grows;          // times m_controller added processors
+    Counter m_processor_shrinks;        // times it removed one
+    Int64 m_previous_grows;             // m_processor_grows,
+    Int64 m_previous_shrinks;           // m_processor_shrinks and
+    Int64 m_previous_aged;              // m_queue.aged() at the previous
+                                        // call to Server::statistics
     Receiver m_receiver;                // receiver component
     Dispatcher m_dispatcher;            // dispatcher component
     Service_list m_services;            // list of service-listener pairs
     job::Scheduler m_scheduler;         // system job scheduler
     ID_table m_pid_tab;                 // processor ID table
     ID_table m_lid_tab;                 // listener ID table
-
-    Impl(Server_interface& server);
+    vector<Cpu_set> m_processor_cpus;   // processor placement, by ID
+    Mutex m_admission_lock;             // guards m_admission
+    auto_ptr<Admission_control> m_admission;    // decides whether listeners
+                                                // take connections (if
+                                                // enabled)
+    Counter m_admission_closures;       // times the server became overloaded
+    Counter m_rejected_connections;     // connections the listeners rejected
+    Int64 m_previous_closures;          // m_admission_closures and the
+    Int64 m_previous_rejected;          // listeners' rejected connections at
+                                        // the previous call to
+                                        // Server::statistics
+
+    Impl(Server& server);
     ~Impl();
+
+    // Returns the microseconds the processors, including those that have
+    // been removed, have spent executing commands.
+    Int64 busy_micros();
+
+    // Binds the processor to its cpus, according to m_processor_cpus.
+    void place(Processor& p);
+
+    // Adds the placement of the server's threads to stats.
+    void add_placements(Server_statistics& stats);
+
+    // Adds a snapshot of the command queue to stats.
+    void add_queue_snapshot(Server_statistics& stats);
+
+    // Samples the load on the server for m_admission (see Admission_gate).
+    bool admit(Admission_policy& policy, string& reject_message);
+    void count_rejection() { m_rejected_connections.add(); }
 };
 
 
-Server::Impl::Impl(Server_interface& server)
-        : m_receiver(server)
+Server::Impl::Impl(Server& server)
+        : m_controller(server)
+        , m_previous_grows(0)
+        , m_previous_shrinks(0)
+        , m_previous_aged(0)
+        , m_receiver(server)
         , m_dispatcher(server)
+        , m_previous_closures(0)
+        , m_previous_rejected(0)
 {}
 
+ares::Int64 Server::Impl::busy_micros()
+{
+    Guard guard(m_processor_lock);
+    Int64 total = m_retired.m_busy_micros;
+    for (int i = 0; i < int(m_processors.size()); i++)
+        total += m_processors[i]->busy_micros();
+    return total;
+}
+
+void Server::Impl::place(Processor& p)
+{
+    p.set_cpu_affinity(m_processor_cpus.empty()
+                       ? Cpu_set()
+                       : m_processor_cpus[p.id() % m_processor_cpus.size()]);
+}
+
+void Server::Impl::add_placements(Server_statistics& stats)
+{
+    add_placement(stats, "rcvr", m_receiver.current_cpu_affinity());
+    add_placement(stats, "dspr", m_dispatcher.current_cpu_affinity());
+    {
+        Guard guard(m_processor_lock);
+        for (int i = 0; i < int(m_processors.size()); i++) {
+            add_placement(stats, format("prcr-%03d", m_processors[i]->id()),
+                          m_processors[i]->current_cpu_affinity());
+        }
+    }
+    add_placement(stats, "schd", m_scheduler.current_cpu_affinity());
+    add_placement(stats, "lgwr", Log::current_cpu_affinity());
+}
+
+bool Server::Impl::admit(Admission_policy& policy, string& reject_message)
+{
+    Guard guard(m_admission_lock);
+    if (!m_admission.get())
+        return true;
+
+    Server_load load;
+    load.m_queued_commands = m_queue.size();
+    load.m_pending_output = m_dispatcher.pending_output();
+    load.m_sessions = m_receiver.num_sessions();
+
+    Admission_limits const& limits = m_admission->limits();
+    bool const was_overloaded = m_admission->is_overloaded();
+    bool const admit = m_admission->admit(load);
+    if (!admit && !was_overloaded) {
+        m_admission_closures.add();
+        Log::writef(Log::NOTICE, "admission: server overloaded, %s new "
+                    "connections: %s",
+                    limits.m_policy == ADMISSION_PAUSE ? "pausing"
+                                                       : "rejecting",
+                    load.to_string().c_str());
+    }
+    else if (admit && was_overloaded) {
+        Log::writef(Log::NOTICE, "admission: admitting new connections "
+                    "again: %s", load.to_string().c_str());
+    }
+
+    if (!admit) {
+        policy = limits.m_policy;
+        reject_message = limits.m_reject_message;
+    }
+    return admit;
+}
+
+void Server::Impl::add_queue_snapshot(Server_statistics& stats)
+{
+    stats.m_queued_commands_snap = m_queue.size();
+    stats.m_queued_by_priority_snap.resize(Command::NUM_PRIORITIES);
+    for (int i = 0; i < Command::NUM_PRIORITIES; i++) {
+        stats.m_queued_by_priority_snap[i] =
+            m_queue.size(Command::Priority(i));
+    }
+}
+
+Server::Impl::Scaling_controller::Scaling_controller(Server& server)
+        : Component("processor scaler")
+        , m_server(server)
+{}
+
+void Server::Impl::Scaling_controller::run() try
+{
+    int const DELAY = 50;             // longest sleep, in milliseconds
+
+    Trace::set_thread_name("scaler");
+    Impl& impl = *m_server.m_impl;
+    Processor_scaler& scaler = *impl.m_scaler;
+    Int64 const period = Int64(scaler.scaling().m_sample_millis)*1000;
+
+    Int64 last_sample = monotonic_micros();
+    Int64 last_busy = impl.busy_micros();
+    while (!is_stopped()) {
+        Int64 const now = monotonic_micros();
+        if (now - last_sample < period) {
+            milli_sleep(int(min(Int64(DELAY),
+                                (period - (now - last_sample) + 999)/1000)));
+            continue;
+        }
+
+        // The utilization is the fraction of the time since the previous
+        // sample that the processors spent executing commands.
+        int const n = m_server.num_processors();
+        int const queued = impl.m_queue.size();
+        Int64 const busy = impl.busy_micros();
+        double const utilization =
+                n == 0 ? 0 : 1.0*(busy - last_busy) / (now - last_sample) / n;
+        last_sample = now;
+        last_busy = busy;
+
+        int const target = scaler.sample(n, queued, utilization);
+        if (target == n)
+            continue;
+
+        Log::writef(Log::NOTICE, "scaler: %s processors from %d to %d "
+                    "(%d commands queued, %.0f%% busy)",
+                    target > n ? "growing" : "shrinking", n, target, queued,
+                    100*utilization);
+        m_server.set_num_processors(target);
+        (target > n ? impl.m_processor_grows
+                    : impl.m_processor_shrinks).add();
+        last_sample = monotonic_micros();
+        last_busy = impl.busy_micros();
+    }
+}
+catch (Exception& e) {
+    Log::writef(Log::ERROR, "scaler: unexpected exception, no longer "
+                "resizing processors: %s", e.to_string().c_str());
+}
+catch (...) {
+    Log::writef(Log::ERROR, "scaler: unexpected exception, no longer "
+                "resizing processors");
+}
+
 Server::Impl::~Impl()
 {
     for (Service_list::iterator i = m_services.begin();
@@ -111,7 +425,7 @@ void Server::add_service(Service* service)
 {
     // Create a listener for this service.
     auto_ptr<Listener> listener(
-        new Listener(*service, *this, m_impl->m_lid_tab.get_id()));
+        new Listener(*service, *this, *m_impl, m_impl->m_lid_tab.get_id()));
 
     // Start the listener only if the server is currently running.
     if (is_active())
@@ -123,27 +437,139 @@ void Server::add_service(Service* service)
 
 void Server::set_num_processors(int n)
 {
-    if (n < 0) {
+    if (n < 0)
         throw Illegal_processor_count_error(n);
+
+    // Processors are started and shut down without m_processor_lock held,
+    // since shutting one down waits for its current command to finish; the
+    // resize lock keeps other callers from changing the pool meanwhile.
+    Guard resizing(m_impl->m_resize_lock);
+    vector<Processor*>& processors = m_impl->m_processors;
+
+    while (int(processors.size()) < n) {
+        auto_ptr<Processor> p(new Processor(*this, m_impl->m_queue,
+                                            m_impl->m_command_timer,
+                                            m_impl->m_pid_tab.get_id()));
+        m_impl->place(*p);
+        p->startup();
+        Guard guard(m_impl->m_processor_lock);
+        processors.push_back(p.release());
     }
-    else if (num_processors() < n) {
-        while (num_processors() < n) {
-            auto_ptr<Processor> p(new Processor(*this, m_impl->m_queue,
-                                                m_impl->m_pid_tab.get_id()));
-            p->startup();
-            m_impl->m_processors.push_back(p.release());
-        }
-    }
-    else if (num_processors() > n) {
-        while (num_processors() > n) {
-            auto_ptr<Processor> p(m_impl->m_processors.back());
-            m_impl->m_processors.pop_back();
-            m_impl->m_pid_tab.release_id(p->id());
-            p->shutdown();
+
+    // A processor is removed only once it has been shut down, and its
+    // activity is then kept with that of the other removed processors, so
+    // that none of it is missing from the statistics.
+    while (int(processors.size()) > n) {
+        Processor* const p = processors.back();
+        p->shutdown();
+        {
+            Guard guard(m_impl->m_processor_lock);
+            processors.pop_back();
+            accumulate(m_impl->m_retired, p->totals());
+            accumulate(m_impl->m_retired_window, p->statistics());
         }
+        m_impl->m_pid_tab.release_id(p->id());
+        delete p;
     }
 }
 
+void Server::set_processor_scaling(Processor_scaling const& scaling)
+{
+    m_impl->m_controller.shutdown();
+    m_impl->m_scaler.reset(new Processor_scaler(scaling));
+    if (is_active())
+        m_impl->m_controller.startup();
+}
+
+void Server::disable_processor_scaling()
+{
+    m_impl->m_controller.shutdown();
+    m_impl->m_scaler.reset();
+}
+
+void Server::set_admission_limits(Admission_limits const& limits)
+{
+    Guard guard(m_impl->m_admission_lock);
+    m_impl->m_admission.reset(new Admission_control(limits));
+}
+
+void Server::disable_admission_control()
+{
+    Guard guard(m_impl->m_admission_lock);
+    m_impl->m_admission.reset();
+}
+
+void Server::use_io_uring(bool b)
+{
+    m_impl->m_receiver.use_io_uring(b);
+    m_impl->m_dispatcher.use_io_uring(b);
+}
+
+void Server::use_shared_input_buffers(bool b)
+{
+    m_impl->m_receiver.use_shared_input_buffers(b);
+}
+
+void Server::set_output_limits(int low_watermark, int high_watermark,
+                               int quota, Output_overflow_policy policy)
+{
+    m_impl->m_dispatcher.set_output_limits(low_watermark, high_watermark,
+                                           quota, policy);
+}
+
+void Server::set_slow_command_threshold(int millis)
+{
+    m_impl->m_command_timer.set_slow_threshold(millis);
+}
+
+void Server::set_command_aging(int millis)
+{
+    m_impl->m_queue.set_aging(millis);
+}
+
+void Server::drop_expired_commands(bool b)
+{
+    m_impl->m_queue.set_drop_expired(b);
+}
+
+void Server::set_receiver_cpus(Cpu_set const& cpus)
+{
+    m_impl->m_receiver.set_cpu_affinity(cpus);
+}
+
+void Server::set_dispatcher_cpus(Cpu_set const& cpus)
+{
+    m_impl->m_dispatcher.set_cpu_affinity(cpus);
+}
+
+void Server::set_processor_cpus(vector<Cpu_set> const& cpus)
+{
+    Guard resizing(m_impl->m_resize_lock);
+    m_impl->m_processor_cpus = cpus;
+    for (int i = 0; i < int(m_impl->m_processors.size()); i++)
+        m_impl->place(*m_impl->m_processors[i]);
+}
+
+void Server::set_scheduler_cpus(Cpu_set const& cpus)
+{
+    m_impl->m_scheduler.set_cpu_affinity(cpus);
+}
+
+void Server::set_log_writer_cpus(Cpu_set const& cpus)
+{
+    Log::set_cpu_affinity(cpus);
+}
+
+void Server::start_traffic_capture(string const& path)
+{
+    m_impl->m_receiver.start_capture(path);
+}
+
+void Server::stop_traffic_capture()
+{
+    m_impl->m_receiver.stop_capture();
+}
+
 void Server::add_session(Session s)
 {
     ARES_TRACE(("adding session [%s]", s->to_string().c_str()));
@@ -159,8 +585,7 @@ void Server::remove_session(Session s)
 void Server::enqueue_command(Command* c)
 {
     ARES_TRACE(("enqueing command [%p]", c));
-    bool success = m_impl->m_queue.enqueue(c);
-    assert(success);
+    m_impl->m_queue.enqueue(c);
 }
 
 void Server::enqueue_delayed_command(Command* c, int num_seconds)
@@ -177,7 +602,7 @@ void Server::enqueue_delayed_command(Command* c, int num_seconds)
     };
 
     if (num_seconds <= 0)
-        m_impl->m_queue.enqueue(c);
+        enqueue_command(c);
     else
         scheduler().submit(new Delayed_action(*this, c),
                            Date::now().add_seconds(num_seconds));
@@ -188,6 +613,16 @@ void Server::dispatch(Session c, Buffer* bp)
     m_impl->m_dispatcher.dispatch(c, bp);
 }
 
+void Server::dispatch(Session c, Gather_list const& list)
+{
+    m_impl->m_dispatcher.dispatch(c, list);
+}
+
+bool Server::is_output_idle(Session c)
+{
+    return m_impl->m_dispatcher.is_output_idle(c);
+}
+
 ares::job::Scheduler& Server::scheduler()
 {
     return m_impl->m_scheduler;
@@ -201,7 +636,8 @@ void Server::shutdown()
 void Server::do_startup()
 {
     // Create Processor instances.
-    set_num_processors(1);
+    Processor_scaler const* scaler = m_impl->m_scaler.get();
+    set_num_processors(scaler ? scaler->scaling().m_min_processors : 1);
 
     // Start up our Receiver and Dispatcher.
     m_impl->m_receiver.startup();
@@ -213,6 +649,9 @@ void Server::do_startup()
     {
         i->second->startup();
     }
+
+    if (scaler)
+        m_impl->m_controller.startup();
 }
 
 void Server::do_shutdown()
@@ -223,11 +662,15 @@ void Server::do_shutdown()
 
 void Server::stop_all_components()
 {
+    m_impl->m_controller.stop();
     m_impl->m_receiver.stop();
     m_impl->m_dispatcher.stop();
 
-    for (int i = 0; i < num_processors(); i++)
-        m_impl->m_processors[i]->stop();
+    {
+        Guard guard(m_impl->m_processor_lock);
+        for (int i = 0; i < int(m_impl->m_processors.size()); i++)
+            m_impl->m_processors[i]->stop();
+    }
 
     for (Service_list::iterator i = m_impl->m_services.begin();
          i != m_impl->m_services.end(); ++i)
@@ -238,6 +681,7 @@ void Server::stop_all_components()
 
 void Server::shutdown_all_components()
 {
+    m_impl->m_controller.shutdown();
     m_impl->m_receiver.shutdown();
     m_impl->m_dispatcher.shutdown();
 
@@ -255,41 +699,88 @@ void Server::run()
     // the server has no independent thread of execution
 }
 
-void Server::display_statistics()    // FIXME
+ares::Server_statistics Server::statistics()
 {
-    fprintf(stderr, "==================================\n\n");
-
-    Receiver_statistics rs = m_impl->m_receiver.statistics();
-
-    fprintf(stderr, "RCVR.interval                    %d s\n", rs.elapsed_sec());
-    fprintf(stderr, "RCVR.sessions_snap               %d\n", rs.sessions_snap());
-    fprintf(stderr, "RCVR.queued_updates_snap         %d\n", rs.queued_updates_snap());
-    fprintf(stderr, "RCVR.reads                       %d (%.2f/s)\n", rs.reads(), rs.reads_per_sec());
-    fprintf(stderr, "RCVR.bytes_read                  %d (%.2f/s)\n", rs.bytes_read(), rs.bytes_read_per_sec());
-    fprintf(stderr, "RCVR.bytes_per_read              %d\n", rs.bytes_per_read());
+    Server_statistics stats;
+    add_statistics(stats, m_impl->m_receiver.statistics());
+    add_statistics(stats, m_impl->m_dispatcher.statistics());
+    {
+        Guard guard(m_impl->m_processor_lock);
+        for (int i = 0; i < int(m_impl->m_processors.size()); i++)
+            add_statistics(stats, m_impl->m_processors[i]->statistics());
+        add_retired_statistics(stats, m_impl->m_retired_window);
+        m_impl->m_retired_window = Processor_statistics();
+
+        Int64 const grows = m_impl->m_processor_grows.value();
+        Int64 const shrinks = m_impl->m_processor_shrinks.value();
+        stats.m_processor_grows = grows - m_impl->m_previous_grows;
+        stats.m_processor_shrinks = shrinks - m_impl->m_previous_shrinks;
+        m_impl->m_previous_grows = grows;
+        m_impl->m_previous_shrinks = shrinks;
+
+        Int64 const aged = m_impl->m_queue.aged();
+        stats.m_commands_aged = aged - m_impl->m_previous_aged;
+        m_impl->m_previous_aged = aged;
+    }
+    m_impl->add_queue_snapshot(stats);
+    {
+        Guard guard(m_impl->m_admission_lock);
+        Int64 const closures = m_impl->m_admission_closures.value();
+        Int64 const rejected = m_impl->m_rejected_connections.value();
+        stats.m_admission_closures = closures - m_impl->m_previous_closures;
+        stats.m_rejected_connections = rejected - m_impl->m_previous_rejected;
+        m_impl->m_previous_closures = closures;
+        m_impl->m_previous_rejected = rejected;
+        stats.m_overloaded_snap = m_impl->m_admission.get()
+            && m_impl->m_admission->is_overloaded();
+    }
+    m_impl->m_command_timer.statistics(stats.m_commands);
+    m_impl->add_placements(stats);
+    return stats;
+}
 
-    Dispatcher_statistics ds = m_impl->m_dispatcher.statistics();
+ares::Server_statistics Server::totals()
+{
+    Server_statistics stats;
+    add_statistics(stats, m_impl->m_receiver.totals());
+    add_statistics(stats, m_impl->m_dispatcher.totals());
+    {
+        Guard guard(m_impl->m_processor_lock);
+        for (int i = 0; i < int(m_impl->m_processors.size()); i++)
+            add_statistics(stats, m_impl->m_processors[i]->totals());
+        add_retired_statistics(stats, m_impl->m_retired);
+    }
+    m_impl->add_queue_snapshot(stats);
+    stats.m_commands_aged = m_impl->m_queue.aged();
+    {
+        Guard guard(m_impl->m_admission_lock);
+        stats.m_admission_closures = m_impl->m_admission_closures.value();
+        stats.m_rejected_connections =
+            m_impl->m_rejected_connections.value();
+        stats.m_overloaded_snap = m_impl->m_admission.get()
+            && m_impl->m_admission->is_overloaded();
+    }
+    stats.m_processor_grows = m_impl->m_processor_grows.value();
+    stats.m_processor_shrinks = m_impl->m_processor_shrinks.value();
+    m_impl->m_command_timer.totals(stats.m_commands);
+    m_impl->add_placements(stats);
+    return stats;
+}
 
-    fprintf(stderr, "DSPR.interval                    %d s\n", ds.elapsed_sec());
-    fprintf(stderr, "DSPR.sessions_snap               %d\n", ds.sessions_snap());
-    fprintf(stderr, "DSPR.queued_dispatches_snap      %d\n", ds.queued_dispatches_snap());
-    fprintf(stderr, "DSPR.buffers_snap                %d\n", ds.buffers_snap());
-    fprintf(stderr, "DSPR.outbound_snap               %d\n", ds.outbound_snap());
-    fprintf(stderr, "DSPR.outbound_remaining_snap     %d\n", ds.outbound_remaining_snap());
-    fprintf(stderr, "DSPR.writes                      %d (%.2f/s)\n", ds.writes(), ds.writes_per_sec());
-    fprintf(stderr, "DSPR.zero_writes                 %d (%.2f/s)\n", ds.zero_writes(), ds.zero_writes_per_sec());
-    fprintf(stderr, "DSPR.bytes_sent                  %d (%.2f/s)\n", ds.bytes_sent(), ds.bytes_sent_per_sec());
-    fprintf(stderr, "DSPR.bytes_per_write             %d\n", ds.bytes_per_write());
-    fprintf(stderr, "DSPR.buffers_added               %d (%.2f/s)\n", ds.buffers_added(), ds.buffers_added_per_sec());
-    fprintf(stderr, "DSPR.buffers_sent                %d (%.2f/s)\n", ds.buffers_sent(), ds.buffers_sent_per_sec());
+void Server::sessions(vector<Session>& v)
+{
+    m_impl->m_receiver.sessions(v);
+}
 
-    for (int i = 0; i < int(m_impl->m_processors.size()); i++) {
-        Processor_statistics ps = m_impl->m_processors[i]->statistics();
-        fprintf(stderr, "PRCR-%03d.interval                %d s\n", i, ps.m_elapsed_sec);
-        fprintf(stderr, "PRCR-%03d.commands_executed       %d (%.2f/s)\n", i, ps.m_commands_executed, 1.0*ps.m_commands_executed/ps.m_elapsed_sec);
+void Server::display_statistics()
+{
+    string const text = statistics().to_string();
+    string::size_type begin = 0;
+    while (begin < text.size()) {
+        string::size_type end = text.find('\n', begin);
+        Log::write(Log::NOTICE, "stats: " + text.substr(begin, end - begin));
+        begin = end + 1;
     }
-
-    fprintf(stderr, "\n");
 }
 
 ares::Date Server::started() const
@@ -304,5 +795,128 @@ int Server::uptime() const
 
 int Server::num_processors() const
 {
+    Guard guard(m_impl->m_processor_lock);
     return m_impl->m_processors.size();
 }
+
+ares::Server_statistics::Server_statistics()
+        : m_elapsed_sec(0)
+        , m_sessions_snap(0)
+        , m_queued_updates_snap(0)
+        , m_events(0)
+        , m_reads(0)
+        , m_bytes_read(0)
+        , m_buffer_grows(0)
+        , m_buffer_shrinks(0)
+        , m_attached_buffers_snap(0)
+        , m_pooled_buffers_snap(0)
+        , m_output_sessions_snap(0)
+        , m_queued_dispatches_snap(0)
+        , m_output_buffers_snap(0)
+        , m_output_bytes_snap(0)
+        , m_writes(0)
+        , m_zero_writes(0)
+        , m_bytes_sent(0)
+        , m_buffers_added(0)
+        , m_buffers_sent(0)
+        , m_blocked_sends(0)
+        , m_dropped_buffers(0)
+        , m_disconnects(0)
+        , m_busy_micros(0)
+        , m_queued_commands_snap(0)
+        , m_processor_grows(0)
+        , m_processor_shrinks(0)
+        , m_commands_aged(0)
+        , m_commands_expired(0)
+        , m_commands_dropped(0)
+        , m_overloaded_snap(false)
+        , m_admission_closures(0)
+        , m_rejected_connections(0)
+{}
+
+ares::Int64 ares::Server_statistics::total_commands_executed() const
+{
+    Int64 total = 0;
+    for (int i = 0; i < int(m_commands_executed.size()); i++)
+        total += m_commands_executed[i];
+    return total;
+}
+
+string ares::Server_statistics::to_string() const
+{
+    string s;
+    put_value(s, "interval_sec", m_elapsed_sec);
+
+    put_value(s, "rcvr.sessions_snap", m_sessions_snap);
+    put_value(s, "rcvr.queued_updates_snap", m_queued_updates_snap);
+    put_count(s, "rcvr.events", m_events, m_elapsed_sec);
+    put_count(s, "rcvr.reads", m_reads, m_elapsed_sec);
+    put_count(s, "rcvr.bytes_read", m_bytes_read, m_elapsed_sec);
+    put_value(s, "rcvr.buffer_grows", m_buffer_grows);
+    put_value(s, "rcvr.buffer_shrinks", m_buffer_shrinks);
+    put_value(s, "rcvr.attached_buffers_snap", m_attached_buffers_snap);
+    put_value(s, "rcvr.pooled_buffers_snap", m_pooled_buffers_snap);
+    put_latency(s, "rcvr.input_latency", m_input_latency);
+
+    put_value(s, "dspr.sessions_snap", m_output_sessions_snap);
+    put_value(s, "dspr.queued_dispatches_snap", m_queued_dispatches_snap);
+    put_value(s, "dspr.buffers_snap", m_output_buffers_snap);
+    put_value(s, "dspr.bytes_snap", m_output_bytes_snap);
+    put_count(s, "dspr.writes", m_writes, m_elapsed_sec);
+    put_count(s, "dspr.zero_writes", m_zero_writes, m_elapsed_sec);
+    put_count(s, "dspr.bytes_sent", m_bytes_sent, m_elapsed_sec);
+    put_count(s, "dspr.buffers_added", m_buffers_added, m_elapsed_sec);
+    put_count(s, "dspr.buffers_sent", m_buffers_sent, m_elapsed_sec);
+    put_value(s, "dspr.blocked_sends", m_blocked_sends);
+    put_value(s, "dspr.dropped_buffers", m_dropped_buffers);
+    put_value(s, "dspr.disconnects", m_disconnects);
+    put_latency(s, "dspr.flush_latency", m_flush_latency);
+
+    for (int i = 0; i < int(m_commands_executed.size()); i++) {
+        put_count(s, format("prcr-%03d.commands_executed", i),
+                  m_commands_executed[i], m_elapsed_sec);
+    }
+    put_count(s, "prcr.commands_executed", total_commands_executed(),
+              m_elapsed_sec);
+    put_count(s, "prcr.busy_micros", m_busy_micros, m_elapsed_sec);
+    put_value(s, "prcr.queued_commands_snap", m_queued_commands_snap);
+    for (int i = 0; i < int(m_queued_by_priority_snap.size()); i++) {
+        char const* const name = Command::priority_name(Command::Priority(i));
+        put_value(s, format("prcr.queued_%s_snap", name),
+                  m_queued_by_priority_snap[i]);
+    }
+    put_value(s, "prcr.grows", m_processor_grows);
+    put_value(s, "prcr.shrinks", m_processor_shrinks);
+    put_value(s, "prcr.commands_aged", m_commands_aged);
+    put_value(s, "prcr.commands_expired", m_commands_expired);
+    put_value(s, "prcr.commands_dropped", m_commands_dropped);
+    put_latency(s, "prcr.queue_latency", m_queue_latency);
+
+    put_value(s, "lsnr.overloaded_snap", m_overloaded_snap);
+    put_value(s, "lsnr.admission_closures", m_admission_closures);
+    put_value(s, "lsnr.rejected_connections", m_rejected_connections);
+
+    int const n = min(int(m_commands.size()), int(MAX_COMMAND_TYPES));
+    for (int i = 0; i < n; i++) {
+        string const name = "cmd." + m_commands[i].m_name;
+        put_latency(s, name + ".queue_latency",
+                    m_commands[i].m_queue_latency);
+        put_latency(s, name + ".execution_latency",
+                    m_commands[i].m_execution_latency);
+    }
+
+    for (int i = 0; i < int(m_placement.size()); i++) {
+        Thread_placement const& p = m_placement[i];
+        string nodes;
+        for (set<int>::const_iterator j = p.m_nodes.begin();
+             j != p.m_nodes.end(); ++j)
+        {
+            nodes += format(nodes.empty() ? "%d" : ",%d", *j);
+        }
+        s += format("%-32s cpus %s nodes %s\n",
+                    ("place." + p.m_name).c_str(),
+                    format_cpu_list(p.m_cpus).c_str(),
+                    nodes.empty() ? "unknown" : nodes.c_str());
+    }
+    return s;
+}
@@ -9,12 +9,21 @@
 #ifndef included_ares_server
 #define included_ares_server
 
+#include "ares/admission_control.hpp"
+#include "ares/command.hpp"
 #include "ares/component.hpp"
+#include "ares/metrics.hpp"
+#include "ares/platform.hpp"
+#include "ares/processor_scaler.hpp"
 #include "ares/server_interface.hpp"
+#include <set>
+#include <string>
+#include <vector>
 
 namespace ares {
 
 class Service;
+struct Server_statistics;
 
 // Represents the server in the ares framework. A typical server program would
 // instantiate exactly one of these objects and configure it to accept
@@ -40,14 +49,140 @@ class Server : public Server_interface, public Component {
     // exception if n is less than zero.
     //
     // Note: If you bounce the server, the number of processors will be reset
-    // to the default (one). Avoid setting the number of processors to zero in
-    // a running server unless you intend to bounce it.
+    // to the default (one, or the minimum set by set_processor_scaling). Avoid
+    // setting the number of processors to zero in a running server unless
+    // you intend to bounce it. While processor scaling is enabled, the
+    // server may change the number of processors again at any time.
     void set_num_processors(int n);
 
+    // Lets the server choose its own number of processors, within the limits
+    // set by scaling, according to the number of commands waiting to be
+    // executed and how busy its processors are (see Processor_scaler). Each
+    // change is logged at the NOTICE level and counted in Server_statistics.
+    // Takes effect immediately if the server is running, and otherwise when
+    // it is started.
+    void set_processor_scaling(Processor_scaling const& scaling);
+
+    // Stops the server from choosing its own number of processors, leaving
+    // the number as it is.
+    void disable_processor_scaling();
+
+    // Makes the server shed load by refusing new connections while it is
+    // overloaded, as governed by limits (see Admission_limits): from the
+    // time the load reaches any of the limits until it has fallen well
+    // below all of them, the listeners either leave new connections waiting
+    // to be accepted (ADMISSION_PAUSE) or accept them, send them
+    // limits.m_reject_message and close them (ADMISSION_REJECT). Each change
+    // is logged at the NOTICE level and counted in Server_statistics. Takes
+    // effect immediately. Services whose strategies are exempt (see
+    // Listener_strategy::is_admission_controlled) take every connection.
+    void set_admission_limits(Admission_limits const& limits);
+
+    // Makes the server admit every new connection (the default).
+    void disable_admission_control();
+
     // Returns the number of Processor objects currently managed by this
     // server. See set_num_processors for more information.
     int num_processors() const;
 
+    // Selects the i/o engine used by the server to read from and write to
+    // sessions. If b is true, the server performs session i/o through the
+    // Linux io_uring interface where it is available, and falls back to
+    // polling (the default) where it isn't. Takes effect the next time the
+    // server is started.
+    void use_io_uring(bool b);
+
+    // Enables or disables sharing of session input buffers, which reduces
+    // the memory used by idle sessions (see Receiver::
+    // use_shared_input_buffers). Takes effect the next time the server is
+    // started.
+    void use_shared_input_buffers(bool b);
+
+    // Sets the limits on the output queued for each session, and the policy
+    // applied to a session that exceeds its quota (see Output_overflow_policy
+    // and Session_rep::is_send_blocked). By default, the low watermark is
+    // 256KB, the high watermark is 1MB, and a thread that would queue more
+    // than 4MB for one session waits for the session's output to drain
+    // (OUTPUT_BLOCK). Takes effect immediately.
+    void set_output_limits(int low_watermark, int high_watermark, int quota,
+                           Output_overflow_policy policy);
+
+    // Sets the execution time, in milliseconds, at or above which a command
+    // is logged (at the NOTICE level) as slow, with its name, its session
+    // and how long it waited to be executed. Zero, the default, disables the
+    // log. Takes effect immediately.
+    void set_slow_command_threshold(int millis);
+
+    // Sets the time, in milliseconds, after which a waiting command is
+    // executed ahead of higher priority commands that have waited less (see
+    // Command::Priority and Command_queue). Zero or less makes priority
+    // strict, so that lower priority commands wait for as long as higher
+    // priority ones are waiting. The default is 100ms. Takes effect
+    // immediately.
+    void set_command_aging(int millis);
+
+    // If b is true, commands whose deadlines have passed when a processor
+    // dequeues them are discarded instead of executed (see Command::
+    // set_deadline), which sheds load when the server is overloaded. If b
+    // is false (the default), they are executed, and may test
+    // Command::is_expired. Either way, they are counted in
+    // Server_statistics. Takes effect immediately.
+    void drop_expired_commands(bool b);
+
+    // Binds the receiver's thread to the given cpus, or unbinds it if cpus
+    // is empty (see Thread::set_affinity and parse_cpu_list). A bound
+    // receiver allocates its input buffers from its own thread, so that on
+    // NUMA machines they are placed in memory local to its cpus. Takes
+    // effect immediately, though buffers are reallocated only when the
+    // server is next started.
+    void set_receiver_cpus(Cpu_set const& cpus);
+
+    // Binds the dispatcher's thread to the given cpus, as above.
+    void set_dispatcher_cpus(Cpu_set const& cpus);
+
+    // Binds the processors' threads to cpus: the processor with id i (see
+    // Server_statistics::m_commands_executed) is bound to cpus[i %
+    // cpus.size()], so a single set binds them all to the same cpus, while
+    // one set per processor gives each its own. An empty vector unbinds
+    // them. Applies to processors created later, as well as to the current
+    // ones.
+    void set_processor_cpus(std::vector<Cpu_set> const& cpus);
+
+    // Binds the threads of the server's job scheduler to the given cpus.
+    void set_scheduler_cpus(Cpu_set const& cpus);
+
+    // Binds the log writer thread to the given cpus. (The log writer is
+    // shared by all of the servers in the process; see Log.)
+    void set_log_writer_cpus(Cpu_set const& cpus);
+
+    // Begins recording the raw input of every session, with its timing, to
+    // a new file at path, ending any recording in progress. The file can be
+    // replayed through sessions, without a network, by a Traffic_replay.
+    // Takes effect immediately. Raises an IO_error if the file cannot be
+    // created.
+    void start_traffic_capture(std::string const& path);
+
+    // Ends the recording begun by start_traffic_capture, if any.
+    void stop_traffic_capture();
+
+    // Returns the activity of the server's components since the previous
+    // call to this function (or to display_statistics), and a snapshot of
+    // their current state. See Server_statistics.
+    Server_statistics statistics();
+
+    // Returns the activity of the server's components since they were
+    // created, and a snapshot of their current state. Unlike statistics,
+    // does not begin a new statistics window, so any number of observers
+    // (such as an Admin_strategy) may call it; m_elapsed_sec is the uptime
+    // of the receiver.
+    Server_statistics totals();
+
+    // Stores the sessions that the server is reading from in v.
+    void sessions(std::vector<Session>& v);
+
+    // Writes the result of statistics to the log, one value per line.
+    void display_statistics();
+
     // (the following functions are inherited from Server_interface; see that
     // class for documentation)
     void add_session(Session s);
@@ -55,13 +190,13 @@ class Server : public Server_interface, public Component {
     void enqueue_command(Command* c);
     void enqueue_delayed_command(Command* c, int num_seconds);
     void dispatch(Session s, Buffer* bp);
+    void dispatch(Session s, Gather_list const& list);
+    bool is_output_idle(Session s);
     job::Scheduler& scheduler();
     void shutdown();
     Date started() const;
     int uptime() const;
 
-    void display_statistics();  // FIXME
-
   private:
     void do_startup();
     void do_shutdown();
@@ -74,6 +209,88 @@ class Server : public Server_interface, public Component {
     Impl* m_impl;
 };
 
+// The cpus that one of a server's threads may run on.
+struct Thread_placement {
+    std::string m_name;             // the thread, as in Server_statistics::
+                                    // to_string
+    Cpu_set m_cpus;                 // cpus it may run on
+    std::set<int> m_nodes;          // the NUMA nodes of those cpus, if known
+};
+
+// The activity of a server during a statistics window (the time between two
+// calls to Server::statistics), and a snapshot of its state at the end of
+// the window (the members whose names end in _snap). Latencies are in
+// microseconds.
+struct Server_statistics {
+    int m_elapsed_sec;              // length of the window, in seconds
+
+    // (receiver)
+    int m_sessions_snap;            // sessions being read from
+    int m_queued_updates_snap;      // session additions/removals not yet made
+    Int64 m_events;                 // input events handled
+    Int64 m_reads;                  // network reads
+    Int64 m_bytes_read;             // bytes read
+    Int64 m_buffer_grows;           // input buffer expansions
+    Int64 m_buffer_shrinks;         // input buffer contractions
+    int m_attached_buffers_snap;    // sessions holding an input buffer
+    int m_pooled_buffers_snap;      // input buffers pooled for reuse
+    Histogram_snapshot m_input_latency;     // read to end of handle_input
+
+    // (dispatcher)
+    int m_output_sessions_snap;     // sessions with output queued
+    int m_queued_dispatches_snap;   // dispatches not yet seen by the
+                                    // dispatcher
+    int m_output_buffers_snap;      // buffers queued for output
+    int m_output_bytes_snap;        // unsent bytes in those buffers
+    Int64 m_writes;                 // network writes
+    Int64 m_zero_writes;            // writes that sent nothing
+    Int64 m_bytes_sent;             // bytes written
+    Int64 m_buffers_added;          // buffers queued for output
+    Int64 m_buffers_sent;           // buffers completely written
+    Int64 m_blocked_sends;          // sends that waited for output to drain
+    Int64 m_dropped_buffers;        // buffers discarded to enforce quotas
+    Int64 m_disconnects;            // sessions disconnected to enforce quotas
+    Histogram_snapshot m_flush_latency;     // dispatch to last byte written
+
+    // (processors)
+    std::vector<Int64> m_commands_executed; // commands executed, by
+                                            // processor id
+    Histogram_snapshot m_queue_latency;     // enqueue to start of execution
+    Int64 m_busy_micros;            // time spent executing commands
+    int m_queued_commands_snap;     // commands waiting for a processor
+    std::vector<int> m_queued_by_priority_snap; // the same, by
+                                                // Command::Priority
+    Int64 m_processor_grows;        // times processors were added by
+                                    // processor scaling
+    Int64 m_processor_shrinks;      // times one was removed by it
+    Int64 m_commands_aged;          // commands executed ahead of higher
+                                    // priority ones because they aged
+    Int64 m_commands_expired;       // commands dequeued past their deadline
+    Int64 m_commands_dropped;       // expired commands discarded
+
+    // (listeners)
+    bool m_overloaded_snap;         // true if refusing new connections
+    Int64 m_admission_closures;     // times the server began refusing them
+    Int64 m_rejected_connections;   // connections accepted and closed
+
+    // (commands)
+    enum { MAX_COMMAND_TYPES = 10 };        // types shown by to_string
+    std::vector<Command_statistics> m_commands; // by type of command,
+                                                // slowest first
+
+    // (placement)
+    std::vector<Thread_placement> m_placement;  // where each running thread
+                                                // may run
+
+    Server_statistics();
+
+    // Returns the total number of commands executed by all processors.
+    Int64 total_commands_executed() const;
+
+    // Returns the statistics as text, one "name value" pair per line.
+    std::string to_string() const;
+};
+
 } // namespace ares
 
 #endif
@@ -17,6 +17,7 @@ namespace ares {
 
 class Buffer;
 class Command;
+class Gather_list;
 
 // Server_interface is the interface through with Command objects communicate
 // with the ares framework. All member functions must be thread-safe because
@@ -47,6 +48,16 @@ class Server_interface {
     // Sends a buffer to the output processor for deferred handling.
     virtual void dispatch(Session s, Buffer* bp) = 0;
 
+    // Sends the bytes in a gather list to the output processor for deferred
+    // handling. The list's buffers are shared with the output processor
+    // rather than copied.
+    virtual void dispatch(Session s, Gather_list const& list) = 0;
+
+    // Returns true if none of the output dispatched to a session remains to
+    // be sent, and its output has not been closed, so that the session may
+    // write to its socket directly without reordering its output.
+    virtual bool is_output_idle(Session s) = 0;
+
     // Returns a reference to the server's central job scheduler. The job
     // facility allows users to schedule runnable objects to be run on a
     // periodic basis.
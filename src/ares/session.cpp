@@ -8,12 +8,16 @@
 
 #include "ares/session.hpp"
 #include "ares/buffer.hpp"
+#include "ares/error.hpp"
+#include "ares/gather_list.hpp"
+#include "ares/guard.hpp"
 #include "ares/mutex.hpp"
 #include "ares/sequence.hpp"
 #include "ares/server_interface.hpp"
 #include "ares/socket.hpp"
 #include "ares/string_util.hpp"
 #include "ares/trace.hpp"
+#include <algorithm>
 
 using namespace std;
 using ares::Session_info;
@@ -35,6 +39,9 @@ string const ACTION_SHUTDOWN   = "shutting down";
 string const ACTION_INPUT      = "processing input";
 string const ACTION_PROCESSING = "processing";
 string const ACTION_IDLE       = "idle";
+
+// The maximum number of gather list ranges send tries to write directly.
+enum { MAX_DIRECT_RANGES = 64 };
 }
 
 Session_rep::Session_rep(Server_interface& server, Socket* socket)
@@ -42,6 +49,10 @@ Session_rep::Session_rep(Server_interface& server, Socket* socket)
         , m_socket(socket)
         , m_server(server)
         , m_use_io_slave(false)
+        , m_use_direct_output(false)
+        , m_queued_output(0)
+        , m_send_blocked(false)
+        , m_output_closed(false)
 {
     assert(socket != 0);
     m_use_io_slave = false;
@@ -55,10 +66,89 @@ Session_rep::~Session_rep()
 
 void Session_rep::send(Buffer const& buffer)
 {
-    if (m_use_io_slave)
-        server().dispatch(this, new Buffer(buffer));
-    else
+    if (!m_use_io_slave) {
+        // (the lock keeps concurrent processors' messages whole; see
+        // Message_session::set_parallel_streams)
+        Guard guard(m_send_lock);
         socket().write_all(buffer);
+        return;
+    }
+    if (!m_use_direct_output) {
+        server().dispatch(this, new Buffer(buffer));
+        return;
+    }
+
+    // Write what the socket will take now, unless output is already queued
+    // for the i/o slave, and hand over the remainder. The lock keeps other
+    // threads' output from slipping in between the two parts.
+    Guard guard(m_send_lock);
+
+    int n = 0;
+    if (server().is_output_idle(this)) {
+        try {
+            n = max(socket().try_write(buffer.begin(), buffer.size()), 0);
+        }
+        catch (IO_error&) {
+            // The i/o slave will encounter the error too, and remove the
+            // session.
+        }
+    }
+
+    // The rest of a partly written buffer is passed on as a remainder, so
+    // that the dispatcher won't discard it (see Dispatcher::dispatch).
+    if (n == 0) {
+        server().dispatch(this, new Buffer(buffer));
+    }
+    else if (n < buffer.size()) {
+        Gather_list rest;
+        rest.append(Shared_buffer(new Buffer(buffer)));
+        rest.consume(n);
+        server().dispatch(this, rest);
+    }
+}
+
+void Session_rep::send(Gather_list const& list)
+{
+    if (!m_use_io_slave) {
+        Guard guard(m_send_lock);
+        for (int i = 0; i < list.num_segments(); i++) {
+            Gather_list::Segment const& s = list.segment(i);
+            socket().write_all(s.begin(), s.m_count);
+        }
+        return;
+    }
+    if (!m_use_direct_output) {
+        server().dispatch(this, list);
+        return;
+    }
+
+    // As in send(Buffer), but with a single gather write.
+    Guard guard(m_send_lock);
+
+    int n = 0;
+    if (server().is_output_idle(this)) {
+        struct iovec iov[MAX_DIRECT_RANGES];
+        int count = min(list.num_segments(), int(MAX_DIRECT_RANGES));
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = const_cast<Byte*>(list.segment(i).begin());
+            iov[i].iov_len = list.segment(i).m_count;
+        }
+        try {
+            n = max(socket().try_writev(iov, count), 0);
+        }
+        catch (IO_error&) {
+            // See send(Buffer).
+        }
+    }
+
+    if (n == 0) {
+        server().dispatch(this, list);
+    }
+    else if (n < list.size()) {
+        Gather_list rest(list);
+        rest.consume(n);
+        server().dispatch(this, rest);
+    }
 }
 
 bool Session_rep::handle_input(Buffer& input_buffer)
@@ -83,6 +173,11 @@ void Session_rep::handle_init(Buffer& input_buffer)
     set_action(ACTION_IDLE);
 }
 
+void Session_rep::handle_writable()
+{
+    on_writable();
+}
+
 void Session_rep::handle_shutdown()
 {
     set_action(ACTION_SHUTDOWN);
@@ -10,6 +10,7 @@
 #define included_ares_session
 
 #include "ares/date.hpp"
+#include "ares/mutex.hpp"
 #include "ares/shared_ptr.hpp"
 #include "ares/sink.hpp"
 
@@ -17,10 +18,19 @@ namespace ares {
 
 // forward declarations
 class Buffer;
+class Gather_list;
 class Server_interface;
 class Session_rep;
 class Socket;
 
+// Specifies what the dispatcher does when a session's queued output exceeds
+// its quota (see Server::set_output_limits).
+enum Output_overflow_policy {
+    OUTPUT_BLOCK,           // the sending thread waits for output to drain
+    OUTPUT_DROP_OLDEST,     // the oldest unsent buffers are discarded
+    OUTPUT_DISCONNECT,      // the session is disconnected
+};
+
 // Given a session, Session_info takes a snapshot of the session's state so
 // that it may be queried afterward.
 class Session_info {
@@ -82,14 +92,43 @@ class Session_rep : public Thread_safe_reference_counted,
     // belongs. This function either writes directly to the session's socket
     // or passes the buffer to an i/o slave process for writing. By default,
     // it does the latter; the default behavior can be controlled by calling
-    // Session_rep::use_slave_process_for_output.
+    // Session_rep::use_slave_process_for_output. If direct output is enabled
+    // as well (see use_direct_output), it does both: it writes as much of
+    // the buffer as the socket accepts without blocking, and passes only the
+    // rest to the i/o slave process.
     void send(Buffer const& buffer);
 
+    // Sends the bytes in a gather list to the client, exactly as send(Buffer)
+    // sends a buffer's contents, except that the list's buffers are passed to
+    // the i/o slave process without being copied, and are written with as
+    // few system calls as possible.
+    void send(Gather_list const& list);
+
     // Specifies whether a slave process should be used to write data to this
     // session's socket. By default, the i/o slave process is used. See
     // Session_rep::send for more details.
     void use_slave_process_for_output(bool b) { m_use_io_slave = b; }
 
+    // Specifies whether send should try to write to the session's socket
+    // before resorting to the i/o slave process. This saves copying the
+    // buffer and waking the slave when the client keeps up with its output,
+    // which is usually the case for small responses. Output is written
+    // directly only when none is queued for the slave, so it is never
+    // reordered. Has no effect unless the slave process is used for output.
+    // Direct output is disabled by default.
+    void use_direct_output(bool b) { m_use_direct_output = b; }
+
+    // Returns the number of bytes this session has passed to the i/o slave
+    // process that have not yet been written to its socket.
+    int queued_output() const { return m_queued_output; }
+
+    // Returns true if the session's queued output has reached the server's
+    // high watermark and has not yet drained to the low watermark (see
+    // Server::set_output_limits). A session that produces output on its own
+    // initiative should stop doing so while this function returns true, and
+    // resume when on_writable is called.
+    bool is_send_blocked() const { return m_send_blocked; }
+
     // Sets the session's current action. The action should be a description
     // of the task currently being performed by the session. For more
     // information, see the documentation for #action.
@@ -154,6 +193,15 @@ class Session_rep : public Thread_safe_reference_counted,
     // function is optional; it does nothing by default.
     void handle_shutdown();
 
+    // The writable callback function. This function is called by a processor
+    // thread after the session's queued output, having reached the high
+    // watermark, drains to the low watermark; that is, after is_send_blocked
+    // changes from true to false. By the time it is called the session may
+    // be send-blocked again, so it should check before resuming output.
+    // Overriding this function (on_writable) is optional; it does nothing by
+    // default.
+    void handle_writable();
+
     // Returns an integer identifying this session. The returned value is
     // guaranteed to be unique among sessions currently in the system.
     int id() const { return m_id; }
@@ -170,12 +218,23 @@ class Session_rep : public Thread_safe_reference_counted,
     virtual void do_handle_init(Buffer& input_buffer) {}
     virtual void do_handle_shutdown() {}
 
+    virtual void on_writable() {}
+
   private:
     int const m_id;             // session id
     Socket* m_socket;           // client socket
     Server_interface& m_server; // reference to the server interface
     std::string m_action;       // the session's current task
     bool m_use_io_slave;        // specifies whether to use i/o slave process
+    bool m_use_direct_output;   // try writing before using i/o slave?
+    Mutex m_send_lock;          // serializes direct or blocking output
+
+    // (output flow control; maintained by the dispatcher)
+    int m_queued_output;        // bytes queued but not yet sent
+    bool m_send_blocked;        // true if above the high watermark
+    bool m_output_closed;       // true if further output is discarded
+
+    friend class Dispatcher;
 };
 
 // A shared pointer to a Session_rep instance. Session_rep objects are always
@@ -31,16 +31,32 @@ class Reference_counted {
 };
 
 // Similar to Reference_counted, but this class's functions are reentrant.
+// Where the compiler provides atomic builtins, the count is updated with
+// them; otherwise it is guarded by a mutex.
+#if defined(__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define ARES_ATOMIC_REFERENCE_COUNT
+#endif
+
 class Thread_safe_reference_counted {
   public:
     Thread_safe_reference_counted() : m_count(0) {}
     virtual ~Thread_safe_reference_counted();
+#if defined(ARES_ATOMIC_REFERENCE_COUNT)
+    void add_ref() { __sync_add_and_fetch(&m_count, 1); }
+    bool release() { return __sync_sub_and_fetch(&m_count, 1) == 0; }
+    int ref_count() const { return __sync_add_and_fetch(&m_count, 0); }
+#else
     void add_ref() { Guard g(m_mutex); ++m_count; }
     bool release() { Guard g(m_mutex); return --m_count == 0; }
+    int ref_count() const { Guard g(m_mutex); return m_count; }
+#endif
 
   private:
-    Mutex m_mutex;
-    int m_count;
+#if !defined(ARES_ATOMIC_REFERENCE_COUNT)
+    mutable Mutex m_mutex;
+#endif
+    mutable int m_count;
 };
 
 // The following functions are designed to work with the boost::intrusive_ptr
@@ -16,8 +16,6 @@
 #include "ares/sync_queue.hpp"
 #include <list>
 
-// TODO add enqueue_all to optimize 1:N producer:consumer case? (prob. no)
-
 // FIXME The line "m_empty_cond.wait(max_wait_millis)" is broken wherever it
 // appears, it means we will wait more than the specified amount of time if we
 // are woken up spuriously.
@@ -73,6 +71,39 @@ class Shared_queue {
         return true;
     }
 
+    // Enqueues the values in [first, last) together, so that no other value
+    // is enqueued between them. Waits for the queue not to be full exactly
+    // as enqueue does, then enqueues all of the values, even if that leaves
+    // the queue over capacity. Returns true if the items were enqueued, false
+    // if the function timed out.
+    template<class Iterator>
+    bool enqueue_all(Iterator first, Iterator last, int max_wait_millis = 0)
+    {
+        Guard guard(m_mutex);
+
+        if (is_full_i()) {
+            if (max_wait_millis <= 0)
+                return false;
+
+            while (is_full_i()) {   // loop to avoid race condition
+                Auto_inc_dec<int> inc_dec(m_num_enqueue_waiters);
+                if (!m_full_cond.wait(max_wait_millis))
+                    return false;
+            }
+        }
+
+        for ( ; first != last; ++first)
+            m_queue.enqueue(*first);
+
+        // Every waiting consumer may now have something to dequeue.
+        if (m_num_dequeue_waiters > 0)
+            m_empty_cond.broadcast();
+        else if (m_num_enqueue_waiters > 0 && !is_full_i())
+            m_full_cond.signal();
+
+        return true;
+    }
+
     // Dequeues a value from the queue. If the queue is empty, waits up to
     // max_wait_millis milliseconds for a value to become available. Does not
     // wait at all if max_wait_millis is zero or less. This method requires
@@ -8,6 +8,7 @@
 
 #include "ares/sink.hpp"
 #include "ares/buffer.hpp"
+#include "ares/gather_list.hpp"
 
 using ares::Sink;
 
@@ -19,3 +20,10 @@ void Sink::send(Byte const* data, int count)
     Buffer b(data, count);
     send(b);
 }
+
+void Sink::send(Gather_list const& list)
+{
+    Buffer b(list.size());
+    list.copy_to(b);
+    send(b);
+}
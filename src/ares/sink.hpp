@@ -14,6 +14,7 @@
 namespace ares {
 
 class Buffer;
+class Gather_list;
 
 // An interface for objects that can receive Buffer objects, sending them to
 // some destination.
@@ -29,6 +30,12 @@ class Sink {
     // function constructs a temporary Buffer object and calls
     // Sink::send(Buffer&).
     virtual void send(Byte const* data, int count);
+
+    // Sends the bytes in a gather list to the sink, in order. By default,
+    // this function copies them into a temporary Buffer object and calls
+    // Sink::send(Buffer&); sinks that can write or queue the list's buffers
+    // without copying them should override it.
+    virtual void send(Gather_list const& list);
 };
 
 } // namespace ares
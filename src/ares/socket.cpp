@@ -58,6 +58,30 @@ int Socket::write(Buffer const& b)
     return write(b.begin(), b.size());
 }
 
+int Socket::try_write(Byte const* data, int count)
+{
+    int n = net_tk::try_write_tcp(m_handle, data, count);
+    if (n > 0)
+        m_num_bytes_sent += n;
+    return n;
+}
+
+int Socket::writev(struct iovec const* iov, int count)
+{
+    int n = net_tk::writev_tcp(m_handle, iov, count);
+    if (n > 0)
+        m_num_bytes_sent += n;
+    return n;
+}
+
+int Socket::try_writev(struct iovec const* iov, int count)
+{
+    int n = net_tk::try_writev_tcp(m_handle, iov, count);
+    if (n > 0)
+        m_num_bytes_sent += n;
+    return n;
+}
+
 int Socket::write_all(Byte const* data, int count)
 {
     int n = net_tk::write_all_tcp(m_handle, data, count);
@@ -14,6 +14,7 @@
 #include "ares/types.hpp"
 #include "ares/utility.hpp"
 #include <string>
+#include <sys/uio.h>
 
 namespace ares {
 
@@ -27,9 +28,17 @@ class Socket : boost::noncopyable {
     int write(Buffer const& b);
     int write_all(Byte const* data, int count);
     int write_all(Buffer const& b);
+    int try_write(Byte const* data, int count);
+    int writev(struct iovec const* iov, int count);
+    int try_writev(struct iovec const* iov, int count);
     void set_blocking(bool on);
     void set_tcp_no_delay(bool on);
 
+    // Updates the byte counters for i/o performed on this socket's handle
+    // by other means (e.g. by an Io_uring object).
+    void count_bytes_received(int n) { m_num_bytes_received += n; }
+    void count_bytes_sent(int n) { m_num_bytes_sent += n; }
+
     bool is_blocking() const { return m_is_blocking; }
     Sockfd handle() const { return m_handle; }
     Date created() const { return m_created; }
@@ -56,6 +65,7 @@ class Socket : boost::noncopyable {
 
     friend Socket* connect_tcp(std::string const&,std::string const&,int);
     friend class Socket_acceptor;
+    friend class Traffic_replay;
 };
 
 
@@ -28,6 +28,150 @@ inline bool is_hex_digit(char ch)
             (ch >= 'A' && ch <= 'F') ||
             isdigit(ch);
 }
+
+// (hash_bytes) Multiplies a by b, storing the low 64 bits of the product
+// in a and the high 64 bits in b.
+inline void mul128(ares::Uint64& a, ares::Uint64& b)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = a;
+    r *= b;
+    a = ares::Uint64(r);
+    b = ares::Uint64(r >> 64);
+#else
+    ares::Uint64 ha = a >> 32, hb = b >> 32;
+    ares::Uint64 la = ares::Uint32(a), lb = ares::Uint32(b);
+    ares::Uint64 rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+    ares::Uint64 t = rl + (rm0 << 32);
+    ares::Uint64 c = t < rl;
+    ares::Uint64 lo = t + (rm1 << 32);
+    c += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+// (hash_bytes) Multiplies a by b and folds the 128-bit product to 64 bits.
+inline ares::Uint64 mix(ares::Uint64 a, ares::Uint64 b)
+{
+    mul128(a, b);
+    return a ^ b;
+}
+
+// (hash_bytes) Reads input words verbatim.
+struct Read_exact {
+    static ares::Uint64 read8(unsigned char const* p)
+    {
+        ares::Uint64 v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    static ares::Uint64 read4(unsigned char const* p)
+    {
+        ares::Uint32 v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static ares::Uint64 read1(unsigned char const* p) { return *p; }
+};
+
+// (hash_bytes_ignore_case) Reads input words with ASCII letters folded to
+// lower case. Words are folded eight bytes at a time: a byte is upper case if
+// its high bit is clear and adding ('\x80' - 'A') sets the high bit but
+// adding ('\x7f' - 'Z') does not; for those bytes, 0x20 is or'ed in.
+struct Read_folded {
+    static ares::Uint64 fold(ares::Uint64 w)
+    {
+        ares::Uint64 const ONES = 0x0101010101010101ULL;
+        ares::Uint64 const HIGH = 0x8080808080808080ULL;
+        ares::Uint64 low7 = w & ~HIGH;
+        ares::Uint64 ge_a = low7 + ONES*(0x80 - 'A');
+        ares::Uint64 gt_z = low7 + ONES*(0x7f - 'Z');
+        ares::Uint64 upper = (ge_a ^ gt_z) & ~w & HIGH;
+        return w | (upper >> 2);
+    }
+
+    static ares::Uint64 read8(unsigned char const* p)
+    {
+        return fold(Read_exact::read8(p));
+    }
+
+    static ares::Uint64 read4(unsigned char const* p)
+    {
+        return fold(Read_exact::read4(p));
+    }
+
+    static ares::Uint64 read1(unsigned char const* p)
+    {
+        return (*p >= 'A' && *p <= 'Z') ? *p | 0x20 : *p;
+    }
+};
+
+// The wyhash algorithm, parameterized by how input words are read.
+template<class Read>
+ares::Uint64 wyhash(void const* data, int count, ares::Uint64 seed)
+{
+    typedef ares::Uint64 u64;   // for readability
+
+    static u64 const SECRET[4] = {
+        0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+        0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+    };
+
+    unsigned char const* p = static_cast<unsigned char const*>(data);
+    u64 const len = count;
+    u64 a, b;
+
+    seed ^= mix(seed ^ SECRET[0], SECRET[1]);
+
+    if (count <= 16) {
+        if (count >= 4) {
+            int const quarter = (count >> 3) << 2;
+            a = (Read::read4(p) << 32) | Read::read4(p + quarter);
+            b = (Read::read4(p + count - 4) << 32) |
+                Read::read4(p + count - 4 - quarter);
+        }
+        else if (count > 0) {
+            a = (Read::read1(p) << 16) | (Read::read1(p + (count >> 1)) << 8) |
+                Read::read1(p + count - 1);
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        int i = count;
+        if (i > 48) {
+            u64 see1 = seed, see2 = seed;
+            do {
+                seed = mix(Read::read8(p) ^ SECRET[1],
+                           Read::read8(p + 8) ^ seed);
+                see1 = mix(Read::read8(p + 16) ^ SECRET[2],
+                           Read::read8(p + 24) ^ see1);
+                see2 = mix(Read::read8(p + 32) ^ SECRET[3],
+                           Read::read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mix(Read::read8(p) ^ SECRET[1], Read::read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = Read::read8(p + i - 16);
+        b = Read::read8(p + i - 8);
+    }
+
+    a ^= SECRET[1];
+    b ^= seed;
+    mul128(a, b);
+    return mix(a ^ SECRET[0] ^ len, b ^ SECRET[1]);
+}
 }
 
 // Function object for lowercasing a character.
@@ -78,6 +222,28 @@ string ares::erase_trailing_chars(string const& s,
     return s.substr(0, i + 1);
 }
 
+ares::Uint64 ares::hash_bytes(void const* data, int count, Uint64 seed)
+{
+    return wyhash<Read_exact>(data, count, seed);
+}
+
+ares::Uint64 ares::hash_bytes_ignore_case(void const* data, int count,
+                                          Uint64 seed)
+{
+    return wyhash<Read_folded>(data, count, seed);
+}
+
+bool ares::equal_bytes_ignore_case(void const* a, void const* b, int count)
+{
+    unsigned char const* p = static_cast<unsigned char const*>(a);
+    unsigned char const* q = static_cast<unsigned char const*>(b);
+    for (int i = 0; i < count; i++) {
+        if (Read_folded::read1(p + i) != Read_folded::read1(q + i))
+            return false;
+    }
+    return true;
+}
+
 int ares::compare_ignore_case(char const* s, char const* t)
 {
     // FIXME: check that we have this function in our configure script
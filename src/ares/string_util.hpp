@@ -43,65 +43,59 @@ struct Compare_string_ignore_case {
     }
 };
 
-// A hash functor for std::string, suitable for use with the non-standard
-// unique associative hash-table containers (e.g., std::hash_map).
-//
-// Note: This hash function was created by Robert J. Jenkins Jr. See
-// http://burtleburtle.net/bob/hash/evahash.html for more information.
+// Returns true if the count bytes at a and at b are the same, ignoring the
+// case of ASCII letters. It folds case exactly as hash_bytes_ignore_case
+// does, regardless of the locale.
+bool equal_bytes_ignore_case(void const* a, void const* b, int count);
+
+// A case-insensitive string equality predicate, the counterpart of
+// Compare_string_ignore_case for use with hash tables (see
+// Hash_string_ignore_case). Unlike Compare_string_ignore_case, it compares
+// every byte, and folds only ASCII letters, so that strings it finds equal
+// always have the same hash value.
+struct Equal_string_ignore_case {
+    inline bool operator()(std::string const& a, std::string const& b) const {
+        return a.length() == b.length() &&
+            equal_bytes_ignore_case(a.data(), b.data(), a.length());
+    }
+};
+
+// Computes a 64-bit hash of the count bytes at data. Different seeds yield
+// unrelated hash functions. The algorithm is based on wyhash (by Wang Yi): it
+// consumes the input eight bytes at a time and mixes it with 64x64->128 bit
+// multiplications, which makes it both fast and of high quality. The hash
+// values are not guaranteed to be the same on different platforms.
+Uint64 hash_bytes(void const* data, int count, Uint64 seed = 0);
+
+// Works like hash_bytes, but ignores the case of ASCII letters, so that two
+// strings that differ only in case have the same hash value.
+Uint64 hash_bytes_ignore_case(void const* data, int count, Uint64 seed = 0);
+
+// A hash functor for std::string, suitable for use with ares::Hashtable and
+// the non-standard unique associative hash-table containers (e.g.,
+// std::hash_map). See hash_bytes.
 struct Hash_string {
-    inline ares::Uint32 operator()(std::string const& s) const
-    {
-        typedef ares::Uint32 u32;  // for readability
-
-#define mix(a, b, c) {                          \
-            a -= b; a -= c; a ^= (c>>13);       \
-            b -= c; b -= a; b ^= (a<< 8);       \
-            c -= a; c -= b; c ^= (b>>13);       \
-            a -= b; a -= c; a ^= (c>>12);       \
-            b -= c; b -= a; b ^= (a<<16);       \
-            c -= a; c -= b; c ^= (b>> 5);       \
-            a -= b; a -= c; a ^= (c>> 3);       \
-            b -= c; b -= a; b ^= (a<<10);       \
-            c -= a; c -= b; c ^= (b>>15);       \
-        }
-
-        unsigned char const* k = (unsigned char const*) s.data();
-        u32 a, b, c, len;
-
-        len = s.length();
-        a = b = 0x9e3779b9;  // the golden ratio; an arbitrary value
-        c = 0;
-
-        // Handle most of the key:
-        while (len >= 12) {
-            a += k[0] + u32(k[1]<<8) + u32(k[ 2]<<16) + u32(k[ 3]<<24);
-            b += k[4] + u32(k[5]<<8) + u32(k[ 6]<<16) + u32(k[ 7]<<24);
-            c += k[8] + u32(k[9]<<8) + u32(k[10]<<16) + u32(k[11]<<24);
-            mix(a, b, c);
-            k += 12; len -= 12;
-        }
-
-        // Handle the last 11 bytes:
-        c += len;
-        switch (len) {
-            case 11: c += u32(k[10]<<24);
-            case 10: c += u32(k[9]<<16);
-            case  9: c += u32(k[8]<<8);
-            case  8: b += u32(k[7]<<24);
-            case  7: b += u32(k[6]<<16);
-            case  6: b += u32(k[5]<<8);
-            case  5: b += k[4];
-            case  4: a += u32(k[3]<<24);
-            case  3: a += u32(k[2]<<16);
-            case  2: a += u32(k[1]<<8);
-            case  1: a += k[0];
-        }
-
-        mix(a, b, c);
-        return c;
-
-#undef mix
+    explicit Hash_string(Uint64 seed = 0) : m_seed(seed) {}
+
+    inline Uint64 operator()(std::string const& s) const {
+        return hash_bytes(s.data(), s.length(), m_seed);
     }
+
+  private:
+    Uint64 m_seed;
+};
+
+// A case-insensitive hash functor for std::string, for use together with
+// Equal_string_ignore_case. See hash_bytes_ignore_case.
+struct Hash_string_ignore_case {
+    explicit Hash_string_ignore_case(Uint64 seed = 0) : m_seed(seed) {}
+
+    inline Uint64 operator()(std::string const& s) const {
+        return hash_bytes_ignore_case(s.data(), s.length(), m_seed);
+    }
+
+  private:
+    Uint64 m_seed;
 };
 
 // Determines whether a string contains a textual representation of an integer
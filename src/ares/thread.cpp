@@ -11,10 +11,24 @@
 #include "ares/platform.hpp"
 #include <cassert>
 #include <cerrno>
+#include <sched.h>
 
 using namespace std;
 using ares::Thread;
 
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP)
+namespace
+{
+// Converts cpus to an affinity mask.
+void to_mask(ares::Cpu_set const& cpus, cpu_set_t& mask)
+{
+    CPU_ZERO(&mask);
+    for (ares::Cpu_set::const_iterator i = cpus.begin(); i != cpus.end(); ++i)
+        CPU_SET(*i, &mask);
+}
+}
+#endif
+
 Thread::Thread(Runnable* r)
         : m_runnable(r)
         , m_running(false)
@@ -35,8 +49,15 @@ void Thread::start()
         throw Thread_already_running_error();
     }
 
-    if (pthread_create(&m_thread, &m_attr, thread_wrapper, this) != 0) {
-        throw System_error("pthread_create", errno);
+    // The thread counts as running from now on, rather than from when it is
+    // first scheduled, so that a wait_for_exit that comes first still waits
+    // for it.
+    m_running = true;
+    int const error = pthread_create(&m_thread, &m_attr, thread_wrapper,
+                                     this);
+    if (error != 0) {
+        m_running = false;
+        throw System_error("pthread_create", error);
     }
 }
 
@@ -98,6 +119,70 @@ ares::Thread_id Thread::current_thread_id()
     return pthread_self();
 }
 
+void Thread::set_affinity(Cpu_set const& cpus)
+{
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP)
+    if (!cpus.empty() && (*cpus.begin() < 0 || *cpus.rbegin() >= CPU_SETSIZE))
+        throw Invalid_cpu_list_error(format_cpu_list(cpus));
+
+    // The affinity is kept in the thread's attributes, which apply each
+    // time it is started. A thread without one gets fresh attributes, since
+    // they can't be told to forget an affinity.
+    if (cpus.empty()) {
+        pthread_attr_destroy(&m_attr);
+        pthread_attr_init(&m_attr);
+        pthread_attr_setdetachstate(&m_attr, PTHREAD_CREATE_DETACHED);
+    }
+    else {
+        cpu_set_t mask;
+        to_mask(cpus, mask);
+        int const error = pthread_attr_setaffinity_np(&m_attr, sizeof(mask),
+                                                      &mask);
+        if (error != 0)
+            throw System_error("pthread_attr_setaffinity_np", error);
+    }
+
+    if (is_running()) {
+        cpu_set_t mask;
+        if (cpus.empty()) {
+            // (the kernel ignores cpus that aren't present)
+            CPU_ZERO(&mask);
+            for (int i = 0; i < CPU_SETSIZE; i++)
+                CPU_SET(i, &mask);
+        }
+        else {
+            to_mask(cpus, mask);
+        }
+        int const error = pthread_setaffinity_np(m_thread, sizeof(mask),
+                                                 &mask);
+        if (error != 0)
+            throw System_error("pthread_setaffinity_np", error);
+    }
+    m_affinity = cpus;
+#else
+    if (!cpus.empty())
+        throw Not_implemented_error("thread affinity");
+    m_affinity.clear();
+#endif
+}
+
+ares::Cpu_set Thread::current_affinity() const
+{
+    Cpu_set cpus;
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP)
+    cpu_set_t mask;
+    if (is_running()
+        && pthread_getaffinity_np(m_thread, sizeof(mask), &mask) == 0)
+    {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &mask))
+                cpus.insert(i);
+        }
+    }
+#endif
+    return cpus;
+}
+
 void* Thread::thread_wrapper(void* self)
 {
     // Call the run method of the thread's runnable object.
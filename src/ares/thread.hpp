@@ -33,11 +33,27 @@ class Thread : boost::noncopyable {
     Thread_id id() const;
     static Thread_id current_thread_id();
 
+    // Binds the thread to the given cpus, or lets it run on any cpu if cpus
+    // is empty. Takes effect immediately if the thread is running, and in
+    // any case whenever it is started. Raises an Invalid_cpu_list_error if
+    // a cpu can't be named in an affinity mask, or a Not_implemented_error
+    // if the platform can't bind threads.
+    void set_affinity(Cpu_set const& cpus);
+
+    // Returns the cpus passed to set_affinity.
+    Cpu_set const& affinity() const { return m_affinity; }
+
+    // Returns the cpus the thread may run on, as reported by the system
+    // (which also reflects restrictions placed on the whole process), or an
+    // empty set if the thread isn't running or the system can't tell.
+    Cpu_set current_affinity() const;
+
   private:
     pthread_t m_thread;     // platform-specific thread type
     pthread_attr_t m_attr;  // thread attribute type
     Runnable* m_runnable;   // runnable object handle
-    bool m_running;         // true if thread is in Runnable::run
+    bool m_running;         // true from start until Runnable::run returns
+    Cpu_set m_affinity;     // cpus the thread is bound to (if any)
 
     static void* thread_wrapper(void*);
 };
@@ -0,0 +1,223 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/traffic_capture.hpp"
+#include "ares/bin_util.hpp"
+#include "ares/error.hpp"
+#include "ares/log.hpp"
+#include "ares/platform.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+using namespace std;
+using ares::Traffic_capture;
+using ares::Traffic_reader;
+
+namespace
+{
+char const MAGIC[] = "ares-cap";
+int const MAGIC_SIZE = 8;
+int const VERSION = 1;
+int const HEADER_SIZE = MAGIC_SIZE + 1 + 8;
+
+// The size of the capture file's stdio buffer, and of the reads made by a
+// Traffic_reader.
+int const IO_BUFFER_SIZE = 64*1024;
+
+// Records longer than this are taken to be corrupt.
+int const MAX_RECORD_DATA = 256*1024*1024;
+}
+
+Traffic_capture::Traffic_capture(string const& path)
+        : m_path(path)
+        , m_fp(fopen(path.c_str(), "wb"))
+        , m_last_time(monotonic_micros())
+        , m_bytes_written(0)
+{
+    if (!m_fp)
+        throw IO_error("fopen", errno);
+    setvbuf(m_fp, 0, _IOFBF, IO_BUFFER_SIZE);
+
+    Byte header[HEADER_SIZE];
+    memcpy(header, MAGIC, MAGIC_SIZE);
+    header[MAGIC_SIZE] = VERSION;
+    pack_int64(header + MAGIC_SIZE + 1, current_time_millis());
+    write(header, HEADER_SIZE);
+}
+
+Traffic_capture::~Traffic_capture()
+{
+    if (m_fp && fclose(m_fp) != 0) {
+        Log::writef(Log::ERROR, "capture: could not write traffic capture "
+                    "file %s: %s", m_path.c_str(), strerror(errno));
+    }
+}
+
+void Traffic_capture::record_open(int session_id, string const& description)
+{
+    write_record(TRAFFIC_OPEN, session_id,
+                 reinterpret_cast<Byte const*>(description.data()),
+                 description.size());
+}
+
+void Traffic_capture::record_input(int session_id, Byte const* data,
+                                   int count)
+{
+    write_record(TRAFFIC_INPUT, session_id, data, count);
+}
+
+void Traffic_capture::record_close(int session_id)
+{
+    write_record(TRAFFIC_CLOSE, session_id, 0, 0);
+}
+
+void Traffic_capture::write_record(Traffic_record_type type, int session_id,
+                                   Byte const* data, int count)
+{
+    if (!m_fp)
+        return;
+
+    Int64 const now = monotonic_micros();
+    Int64 const delta = min(max(now - m_last_time, Int64(0)),
+                            Int64(0xFFFFFFFFU));
+    m_last_time = now;
+
+    Byte header[1 + 3*5];
+    int n = 0;
+    header[n++] = type;
+    n += encode_varint32(header + n, Uint32(delta));
+    n += encode_varint32(header + n, Uint32(session_id));
+    if (type != TRAFFIC_CLOSE)
+        n += encode_varint32(header + n, Uint32(count));
+    write(header, n);
+    write(data, count);
+}
+
+void Traffic_capture::write(Byte const* data, int count)
+{
+    if (!m_fp || count == 0)
+        return;
+
+    if (fwrite(data, 1, count, m_fp) != size_t(count)) {
+        Log::writef(Log::ERROR, "capture: could not write traffic capture "
+                    "file %s, discarding the rest of the capture: %s",
+                    m_path.c_str(), strerror(errno));
+        fclose(m_fp);
+        m_fp = 0;
+        return;
+    }
+    m_bytes_written += count;
+}
+
+
+Traffic_reader::Traffic_reader(string const& path)
+        : m_path(path)
+        , m_fp(fopen(path.c_str(), "rb"))
+        , m_buffer(IO_BUFFER_SIZE)
+        , m_started(0)
+        , m_time(0)
+{
+    if (!m_fp)
+        throw IO_error("fopen", errno);
+
+    fill(HEADER_SIZE);
+    Byte const* header = m_buffer.begin();
+    if (m_buffer.size() < HEADER_SIZE
+        || memcmp(header, MAGIC, MAGIC_SIZE) != 0
+        || header[MAGIC_SIZE] != VERSION)
+    {
+        fclose(m_fp);
+        throw Traffic_capture_corrupt_error(m_path);
+    }
+    m_started = unpack_int64(header + MAGIC_SIZE + 1);
+    m_buffer.consume(HEADER_SIZE);
+}
+
+Traffic_reader::~Traffic_reader()
+{
+    fclose(m_fp);
+}
+
+bool Traffic_reader::next(Traffic_record& r)
+{
+    // Parses the record at the front of the buffer, reading more of the
+    // file whenever the record is incomplete.
+
+    for (int needed = 1; ; ) {
+        if (m_buffer.size() < needed && !fill(needed)) {
+            if (m_buffer.size() == 0)
+                return false;
+            throw Traffic_capture_corrupt_error(m_path);
+        }
+
+        Byte const* p = m_buffer.begin();
+        int const size = m_buffer.size();
+        int const type = p[0];
+        if (type < TRAFFIC_OPEN || type > TRAFFIC_CLOSE)
+            throw Traffic_capture_corrupt_error(m_path);
+
+        // Reads the integers that follow the type, up to three of them.
+        Uint32 values[3];
+        int const num_values = type == TRAFFIC_CLOSE ? 2 : 3;
+        int n = 1;
+        for (int i = 0; i < num_values && n > 0; i++) {
+            int const k = decode_varint32(p + n, size - n, values[i]);
+            if (k < 0)
+                throw Traffic_capture_corrupt_error(m_path);
+            n = k == 0 ? 0 : n + k;
+        }
+        if (n == 0) {                   // the integers are incomplete
+            needed = size + 1;
+            continue;
+        }
+
+        int count = 0;
+        if (type != TRAFFIC_CLOSE) {
+            if (values[2] > Uint32(MAX_RECORD_DATA))
+                throw Traffic_capture_corrupt_error(m_path);
+            count = values[2];
+            if (size < n + count) {     // the data is incomplete
+                needed = n + count;
+                continue;
+            }
+        }
+
+        m_time += values[0];
+        r.m_type = Traffic_record_type(type);
+        r.m_time = m_time;
+        r.m_session_id = int(values[1]);
+        r.m_description.clear();
+        r.m_data.clear();
+        if (type == TRAFFIC_OPEN)
+            r.m_description.assign(reinterpret_cast<char const*>(p + n),
+                                   count);
+        else if (type == TRAFFIC_INPUT)
+            r.m_data.assign(p + n, p + n + count);
+        m_buffer.consume(n + count);
+        return true;
+    }
+}
+
+bool Traffic_reader::fill(int n)
+{
+    // Reads until the buffer holds at least n bytes, or the file ends.
+    // Returns true if it holds n bytes.
+
+    m_buffer.set_min_capacity(max(n, IO_BUFFER_SIZE));
+    while (m_buffer.size() < n) {
+        size_t const count = fread(m_buffer.end(), 1, m_buffer.free(), m_fp);
+        if (count == 0) {
+            if (ferror(m_fp))
+                throw IO_error("fread", errno);
+            return false;
+        }
+        m_buffer.advance(count);
+    }
+    return true;
+}
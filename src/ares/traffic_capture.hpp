@@ -0,0 +1,122 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_traffic_capture
+#define included_ares_traffic_capture
+
+#include "ares/buffer.hpp"
+#include "ares/types.hpp"
+#include <boost/utility.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace ares {
+
+// The kinds of record in a traffic capture file.
+enum Traffic_record_type {
+    TRAFFIC_OPEN = 1,       // a session was added, or was already open when
+                            // the capture began
+    TRAFFIC_INPUT = 2,      // bytes were read from a session
+    TRAFFIC_CLOSE = 3,      // a session was removed
+};
+
+// One record of a traffic capture file.
+struct Traffic_record {
+    Traffic_record_type m_type;
+    Int64 m_time;                   // microseconds since the capture began
+    int m_session_id;               // the captured session's id
+    std::string m_description;      // (open) the session's to_string
+    std::vector<Byte> m_data;       // (input) the bytes read
+};
+
+// Traffic_capture appends the raw input of sessions, with the times at which
+// it was read, to a file, so that it can later be fed through sessions again
+// by a Traffic_replay. A server captures its traffic when told to with
+// Server::start_traffic_capture.
+//
+// The file begins with the eight bytes "ares-cap", a version byte (1) and
+// the time the capture began, in milliseconds since the epoch (see
+// pack_int64). Each record that follows is a type byte (see
+// Traffic_record_type), then as LEB128 integers (see encode_varint32) the
+// microseconds since the previous record and the session id. An open record
+// ends with the length and bytes of the session's description, an input
+// record with the length and bytes of its data; a close record has nothing
+// more. Gaps of more than about 71 minutes between records are recorded as
+// that long.
+//
+// Records are buffered, and written when the buffer fills or the capture is
+// destroyed. If a write fails, the error is logged and the rest of the
+// capture is discarded, so that capturing never interferes with the server.
+// This class is not synchronized.
+class Traffic_capture : boost::noncopyable {
+  public:
+    // Creates or truncates the file at path and begins a capture. Raises an
+    // IO_error if the file cannot be opened.
+    explicit Traffic_capture(std::string const& path);
+
+    // Writes any buffered records and closes the file.
+    ~Traffic_capture();
+
+    // Records that a session was opened; description is its to_string.
+    void record_open(int session_id, std::string const& description);
+
+    // Records that count bytes were read from the session with the given id.
+    void record_input(int session_id, Byte const* data, int count);
+
+    // Records that the session with the given id was closed.
+    void record_close(int session_id);
+
+    // Returns the number of bytes written to the file so far, including
+    // buffered ones.
+    Int64 bytes_written() const { return m_bytes_written; }
+
+  private:
+    void write_record(Traffic_record_type type, int session_id,
+                      Byte const* data, int count);
+    void write(Byte const* data, int count);
+
+    std::string const m_path;       // name of the capture file
+    FILE* m_fp;                     // the file, or null after an error
+    Int64 m_last_time;              // monotonic_micros of the last record
+    Int64 m_bytes_written;          // bytes written to m_fp
+};
+
+// Traffic_reader reads the records of a file written by a Traffic_capture,
+// in order.
+class Traffic_reader : boost::noncopyable {
+  public:
+    // Opens the file at path and reads its header. Raises an IO_error if
+    // the file cannot be opened, or a Traffic_capture_corrupt_error if it
+    // is not a capture file.
+    explicit Traffic_reader(std::string const& path);
+
+    // Closes the file.
+    ~Traffic_reader();
+
+    // Reads the next record into r. Returns false at the end of the file.
+    // Raises a Traffic_capture_corrupt_error if the file ends in the middle
+    // of a record or the record is invalid.
+    bool next(Traffic_record& r);
+
+    // Returns the time the capture began, in milliseconds since the epoch.
+    Int64 started() const { return m_started; }
+
+  private:
+    bool fill(int n);
+
+    std::string const m_path;       // name of the capture file
+    FILE* m_fp;                     // the file
+    Buffer m_buffer;                // unparsed bytes read from m_fp
+    Int64 m_started;                // time the capture began
+    Int64 m_time;                   // time of the last record read
+};
+
+} // namespace ares
+
+#endif
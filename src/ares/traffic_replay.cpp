@@ -0,0 +1,240 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/traffic_replay.hpp"
+#include "ares/error.hpp"
+#include "ares/log.hpp"
+#include "ares/platform.hpp"
+#include "ares/socket.hpp"
+#include "ares/traffic_capture.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <memory>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using ares::Traffic_replay;
+
+namespace
+{
+// When the input has been replayed, output is drained until none has
+// arrived for QUIET_MILLIS, but for no more than MAX_DRAIN_MICROS.
+int const QUIET_MILLIS = 50;
+ares::Int64 const MAX_DRAIN_MICROS = 1000*1000;
+
+// The longest wait for output while waiting to replay the next record.
+int const MAX_WAIT_MILLIS = 100;
+}
+
+ares::Traffic_replay_statistics::Traffic_replay_statistics()
+        : m_sessions(0)
+        , m_inputs(0)
+        , m_bytes_replayed(0)
+        , m_bytes_sent(0)
+        , m_elapsed_micros(0)
+{}
+
+Traffic_replay::Traffic_replay(Server_interface& server,
+                               Session_factory& factory)
+        : m_server(server)
+        , m_factory(factory)
+        , m_speed(0)
+        , m_polls_stale(false)
+{}
+
+Traffic_replay::~Traffic_replay()
+{
+    close_all();
+}
+
+ares::Traffic_replay_statistics Traffic_replay::run(string const& path)
+{
+    Traffic_reader reader(path);
+    m_stats = Traffic_replay_statistics();
+    Histogram_snapshot const earlier = m_input_latency.snapshot();
+    Int64 const start = monotonic_micros();
+
+    try {
+        Traffic_record r;
+        while (reader.next(r)) {
+            if (m_speed > 0)
+                wait_until(start + Int64(r.m_time/m_speed));
+            else
+                drain_output(0);
+
+            switch (r.m_type) {
+              case TRAFFIC_OPEN:
+                open(r);
+                break;
+
+              case TRAFFIC_INPUT:
+                input(r);
+                break;
+
+              case TRAFFIC_CLOSE:
+                close(r.m_session_id);
+                break;
+            }
+        }
+    }
+    catch (...) {
+        close_all();
+        throw;
+    }
+    m_stats.m_elapsed_micros = monotonic_micros() - start;
+
+    // Lets the responses to the last input arrive before the sessions are
+    // shut down.
+    Int64 const limit = monotonic_micros() + MAX_DRAIN_MICROS;
+    while (drain_output(QUIET_MILLIS) > 0 && monotonic_micros() < limit)
+        ;
+    close_all();
+
+    m_stats.m_input_latency = m_input_latency.snapshot();
+    m_stats.m_input_latency -= earlier;
+    return m_stats;
+}
+
+void Traffic_replay::open(Traffic_record const& r)
+{
+    close(r.m_session_id);          // (in case the id was reused)
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        throw System_error("socketpair", errno);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    auto_ptr<Replayed_session> rs(new Replayed_session);
+    rs->m_peer = fds[1];
+    try {
+        Socket* socket = new Socket(fds[0], "replay", r.m_session_id);
+        rs->m_session = m_factory.create(m_server, socket, r.m_description);
+    }
+    catch (...) {
+        ::close(fds[1]);
+        throw;
+    }
+
+    rs->m_session->handle_init(rs->m_input);
+    m_sessions[r.m_session_id] = rs.release();
+    m_polls_stale = true;
+    m_stats.m_sessions++;
+}
+
+void Traffic_replay::input(Traffic_record const& r)
+{
+    Session_map::iterator i = m_sessions.find(r.m_session_id);
+    int const n = r.m_data.size();
+    if (i == m_sessions.end() || n == 0)
+        return;
+
+    // Appends the input to the session's buffer, growing it as the receiver
+    // would, and passes the buffer to the session.
+    Session& session = i->second->m_session;
+    Buffer& b = i->second->m_input;
+    if (b.free() < n)
+        b.set_capacity(max(2*b.capacity(), b.size() + n));
+    b.put(&r.m_data[0], n);
+    session->socket().count_bytes_received(n);
+    m_stats.m_inputs++;
+    m_stats.m_bytes_replayed += n;
+
+    bool ok = false;
+    Int64 const started = monotonic_micros();
+    try {
+        ok = session->handle_input(b);
+    }
+    catch (Exception& e) {
+        Log::writef(Log::WARNING, "replay: error: %s", e.to_string().c_str());
+    }
+    m_input_latency.record_since(started);
+
+    if (!ok)
+        close(r.m_session_id);
+}
+
+void Traffic_replay::close(int id)
+{
+    Session_map::iterator i = m_sessions.find(id);
+    if (i == m_sessions.end())
+        return;
+
+    auto_ptr<Replayed_session> rs(i->second);
+    m_sessions.erase(i);
+    m_polls_stale = true;
+    rs->m_session->handle_shutdown();
+    m_stats.m_bytes_sent += drain(rs->m_peer);
+    ::close(rs->m_peer);
+}
+
+void Traffic_replay::close_all()
+{
+    while (!m_sessions.empty())
+        close(m_sessions.begin()->first);
+}
+
+void Traffic_replay::wait_until(Int64 deadline)
+{
+    for (;;) {
+        Int64 const now = monotonic_micros();
+        if (now >= deadline) {
+            drain_output(0);
+            return;
+        }
+        drain_output(int(min((deadline - now + 999)/1000,
+                             Int64(MAX_WAIT_MILLIS))));
+    }
+}
+
+int Traffic_replay::drain_output(int timeout_millis)
+{
+    // Waits up to timeout_millis for output from any session, then reads
+    // and discards all of the output that is ready. Returns the number of
+    // bytes read.
+
+    if (m_polls_stale) {
+        m_polls.clear();
+        for (Session_map::iterator i = m_sessions.begin();
+             i != m_sessions.end(); ++i)
+        {
+            pollfd p;
+            p.fd = i->second->m_peer;
+            p.events = POLLIN;
+            p.revents = 0;
+            m_polls.push_back(p);
+        }
+        m_polls_stale = false;
+    }
+
+    int const num_ready = poll(m_polls.empty() ? 0 : &m_polls[0],
+                               m_polls.size(), timeout_millis);
+    if (num_ready <= 0)
+        return 0;
+
+    int total = 0;
+    for (int i = 0; i < int(m_polls.size()); i++) {
+        if (m_polls[i].revents != 0)
+            total += drain(m_polls[i].fd);
+    }
+    m_stats.m_bytes_sent += total;
+    return total;
+}
+
+int Traffic_replay::drain(Sockfd peer)
+{
+    // Reads and discards the output waiting at peer, and returns its size.
+
+    int total = 0;
+    int n;
+    Byte buf[16*1024];
+    while ((n = read(peer, buf, sizeof(buf))) > 0)
+        total += n;
+    return total;
+}
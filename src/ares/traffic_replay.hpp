@@ -0,0 +1,120 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#ifndef included_ares_traffic_replay
+#define included_ares_traffic_replay
+
+#include "ares/buffer.hpp"
+#include "ares/metrics.hpp"
+#include "ares/session.hpp"
+#include "ares/types.hpp"
+#include <boost/utility.hpp>
+#include <map>
+#include <poll.h>
+#include <string>
+#include <vector>
+
+namespace ares {
+
+class Server_interface;
+class Socket;
+struct Traffic_record;
+
+// The results of one Traffic_replay::run. Latencies are in microseconds.
+struct Traffic_replay_statistics {
+    int m_sessions;                 // sessions replayed
+    Int64 m_inputs;                 // calls to handle_input
+    Int64 m_bytes_replayed;         // bytes passed to handle_input
+    Int64 m_bytes_sent;             // bytes the sessions sent in response
+    Int64 m_elapsed_micros;         // duration of the replay
+    Histogram_snapshot m_input_latency;     // duration of handle_input
+
+    Traffic_replay_statistics();
+};
+
+// Traffic_replay feeds the input recorded by a Traffic_capture through new
+// sessions, with no network involved, so that a production traffic mix can
+// be profiled or benchmarked offline. For each captured session it asks a
+// factory for a session of the application's own type, then calls the
+// session's handle_init, handle_input and handle_shutdown functions as the
+// receiver would have: each recorded read is appended to the session's
+// input buffer and handle_input is called, and the session is shut down when
+// it was closed in the capture or when handle_input returns false.
+//
+// The replay runs in the calling thread, which takes the place of the
+// receiver; commands the sessions enqueue are executed by the server passed
+// to the constructor, which should be running. Each session's socket is one
+// end of a local socket pair, whose remote address is "replay" and whose
+// remote port is the captured session's id; whatever the session sends is
+// read from the other end and discarded, and counted in m_bytes_sent.
+//
+// By default, the input is replayed as fast as the sessions accept it. See
+// set_speed to replay it at the recorded pace, or a multiple of it.
+class Traffic_replay : boost::noncopyable {
+  public:
+    // Creates the sessions that stand in for captured ones.
+    struct Session_factory {
+        virtual ~Session_factory() {}
+
+        // Returns a new session for the server that reads from the given
+        // socket, which the session owns, to replay the input of the
+        // captured session that had the given description (see
+        // Session_rep::to_string).
+        virtual Session_rep* create(Server_interface& server, Socket* socket,
+                                    std::string const& description) = 0;
+    };
+
+    // Constructs a replay that creates its sessions with factory, for
+    // server. Neither is owned, and both must outlive the replay.
+    Traffic_replay(Server_interface& server, Session_factory& factory);
+
+    // Shuts down any sessions left by an interrupted replay.
+    ~Traffic_replay();
+
+    // Sets the pace of the replay, as a multiple of the recorded one: 1
+    // replays the input with its recorded timing, 10 ten times as fast.
+    // Zero or less (the default) replays the input without waiting.
+    void set_speed(double speed) { m_speed = speed; }
+
+    // Replays the capture file at path, and returns the results. Raises an
+    // IO_error if the file cannot be read, or a
+    // Traffic_capture_corrupt_error if it is corrupt; sessions still open
+    // when the replay ends are shut down.
+    Traffic_replay_statistics run(std::string const& path);
+
+  private:
+    struct Replayed_session {
+        Session m_session;          // the session standing in for a
+                                    // captured one
+        Sockfd m_peer;              // the other end of its socket
+        Buffer m_input;             // its input buffer
+    };
+
+    typedef std::map<int, Replayed_session*> Session_map;
+
+    void open(Traffic_record const& r);
+    void input(Traffic_record const& r);
+    void close(int id);
+    void close_all();
+    void wait_until(Int64 deadline);
+    int drain_output(int timeout_millis);
+    int drain(Sockfd peer);
+
+    Server_interface& m_server;     // server the sessions belong to
+    Session_factory& m_factory;     // creates the sessions
+    double m_speed;                 // pace, relative to the recorded one
+    Session_map m_sessions;         // open sessions, by captured id
+    std::vector<pollfd> m_polls;    // the peers of the open sessions
+    bool m_polls_stale;             // true if m_polls must be rebuilt
+    Traffic_replay_statistics m_stats;      // results of the current run
+    Histogram m_input_latency;      // duration of handle_input
+};
+
+} // namespace ares
+
+#endif
@@ -0,0 +1,397 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/bin_util.hpp"
+#include "ares/cmdline_arg_parser.hpp"
+#include "ares/command.hpp"
+#include "ares/listener_strategy.hpp"
+#include "ares/message_reader.hpp"
+#include "ares/message_session.hpp"
+#include "ares/message_writer.hpp"
+#include "ares/metrics.hpp"
+#include "ares/platform.hpp"
+#include "ares/server.hpp"
+#include "ares/service.hpp"
+#include "ares/sink.hpp"
+#include "ares/socket.hpp"
+#include "ares/string_util.hpp"
+#include "ares/thread.hpp"
+#include "ares/utility.hpp"
+#include <algorithm>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+string port = "27463";
+int num_connections = 16;           // client connections
+int num_in_flight = 8;              // messages in flight per connection
+int message_size = 64;              // bytes per message
+int num_processors = 2;             // server processor threads
+int num_client_threads = 2;         // threads driving the connections
+int warmup_sec = 2;                 // seconds before measuring
+int measure_sec = 10;               // seconds measured
+bool use_io_uring = false;
+bool json_output = false;
+
+// The benchmark's phases; the client threads watch for changes.
+enum { PHASE_WARMUP, PHASE_MEASURE, PHASE_DONE };
+int volatile phase = PHASE_WARMUP;
+
+Counter messages_received;          // echoed messages received by clients
+Histogram round_trip;               // micros from send to echo received
+Counter client_cpu_micros;          // cpu used by client threads while
+                                    // measuring
+Counter client_threads_done;
+
+// Print usage instructions to stdout, then exit the program.
+void display_usage()
+{
+    printf("\n"
+           "bench: Measure the throughput and latency of the server core.\n"
+           "\n"
+           "Runs an echo server, whose sessions send back every message\n"
+           "they receive, and a load generator that keeps a number of\n"
+           "messages in flight on each of a number of loopback connections\n"
+           "to it, in the same process. After a warmup, reports messages\n"
+           "per second, round-trip latency percentiles, and cpu time per\n"
+           "message, both in all and for the server alone. Keywords are NOT\n"
+           "case sensitive:\n"
+           "\n"
+           "    Format: bench KEYWORD=value (KEYWORD=value ...)\n"
+           "    Example: bench CONNECTIONS=100 INFLIGHT=1 SIZE=1024 JSON=Y\n"
+           "\n"
+           "Keyword         Description (Default)\n"
+           "------------------------------------------------------------\n"
+           "HELP            if 'Y', displays this message and exits (N)\n"
+           "PORT            loopback port of the echo server (27463)\n"
+           "CONNECTIONS     client connections (16)\n"
+           "INFLIGHT        messages in flight per connection (8)\n"
+           "SIZE            bytes per message, at least 12 (64)\n"
+           "PROCESSORS      server processor threads (2)\n"
+           "CLIENTS         client threads (2)\n"
+           "WARMUP          seconds of load before measuring (2)\n"
+           "SECONDS         seconds measured (10)\n"
+           "IO_URING        if 'Y', the server reads through io_uring (N)\n"
+           "JSON            if 'Y', prints the results as one JSON object\n"
+           "                instead of text, for comparing runs (N)\n"
+           "\n");
+    exit(0);
+}
+
+// Returns the cpu time used by the calling thread, in microseconds.
+Int64 thread_cpu_micros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return Int64(ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
+// Returns the cpu time used by the process, in microseconds.
+Int64 process_cpu_micros()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (Int64(ru.ru_utime.tv_sec) + ru.ru_stime.tv_sec)*1000000 +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+}
+
+// A session that sends back every message it receives.
+class Echo_session : public Message_session {
+  public:
+    Echo_session(Server_interface& server, Socket* socket)
+            : Message_session(server, socket)
+            , m_writer(*this)
+    {}
+
+  private:
+    void process_message(Buffer& message, int)
+    {
+        Int64 const stamp = unpack_int64(message.begin());
+        int const length = unpack_int32(message.begin() + 8);
+        m_writer.begin_message();
+        m_writer.put_int64(stamp);
+        m_writer.put_bytes(message.begin() + 12, length);
+        m_writer.end_message();
+    }
+
+    Message_writer m_writer;
+};
+
+class Echo_strategy : public Listener_strategy {
+  public:
+    void handle_connection(Server_interface& server, Socket* socket)
+    {
+        socket->set_tcp_no_delay(true);
+        server.enqueue_command(
+            new Add_session_command(new Echo_session(server, socket)));
+    }
+};
+
+// Writes everything sent to it to a socket.
+class Socket_sink : public Sink {
+  public:
+    Socket_sink(Socket& socket) : m_socket(socket) {}
+    void send(Buffer const& b) { m_socket.write_all(b); }
+
+  private:
+    Socket& m_socket;
+};
+
+// A client connection to the echo server, which sends a new message as soon
+// as each echo arrives.
+class Connection : public Sink {
+  public:
+    Connection(Socket* socket)
+            : m_socket(socket)
+            , m_socket_sink(*socket)
+            , m_writer(m_socket_sink)
+            , m_reader(*this)
+            , m_input(max(64*1024, 2*message_size + 64))
+            , m_payload(message_size - 12, 'x')
+    {
+        m_socket->set_blocking(false);
+        m_socket->set_tcp_no_delay(true);
+        m_reader.set_max_message_size(message_size + 64);
+    }
+
+    ~Connection() { delete m_socket; }
+
+    Socket& socket() { return *m_socket; }
+
+    // Sends a new message, stamped with the time.
+    void send_message()
+    {
+        m_writer.begin_message();
+        m_writer.put_int64(monotonic_micros());
+        m_writer.put_string(m_payload);
+        m_writer.end_message();
+    }
+
+    // Reads the echoes that have arrived, and replaces each with a new
+    // message. Returns false if the server closed the connection.
+    bool read_input()
+    {
+        int n = m_socket->read(m_input);
+        if (n < 0)
+            return false;
+        m_reader.read_messages(m_input);
+        return true;
+    }
+
+    // (called by m_reader for each echo)
+    void send(Buffer const& message)
+    {
+        round_trip.record_since(unpack_int64(message.begin()));
+        messages_received.add();
+        if (phase != PHASE_DONE)
+            send_message();
+    }
+
+  private:
+    Socket* m_socket;
+    Socket_sink m_socket_sink;
+    Message_writer m_writer;
+    Message_reader m_reader;
+    Buffer m_input;
+    string const m_payload;
+};
+
+// Drives a group of connections until the benchmark is done.
+class Client : public Thread::Runnable {
+  public:
+    Client(vector<Connection*> const& connections)
+            : m_connections(connections)
+    {}
+
+    void run() try
+    {
+        vector<struct pollfd> fds(m_connections.size());
+        for (int i = 0; i < int(m_connections.size()); i++) {
+            fds[i].fd = m_connections[i]->socket().handle();
+            fds[i].events = POLLIN;
+            for (int j = 0; j < num_in_flight; j++)
+                m_connections[i]->send_message();
+        }
+
+        Int64 cpu_started = 0;
+        bool measuring = false;
+        while (phase != PHASE_DONE) {
+            if (!measuring && phase == PHASE_MEASURE) {
+                cpu_started = thread_cpu_micros();
+                measuring = true;
+            }
+            if (poll(&fds[0], fds.size(), 10) <= 0)
+                continue;
+            for (int i = 0; i < int(fds.size()); i++) {
+                if (fds[i].revents && !m_connections[i]->read_input()) {
+                    fprintf(stderr, "client: FATAL: server closed a "
+                            "connection\n");
+                    exit(2);
+                }
+            }
+        }
+        if (measuring)
+            client_cpu_micros.add(thread_cpu_micros() - cpu_started);
+        client_threads_done.add();
+    }
+    catch (Exception& e) {
+        fprintf(stderr, "client: FATAL: %s\n", e.to_string().c_str());
+        exit(2);
+    }
+
+  private:
+    vector<Connection*> m_connections;
+};
+
+int main(int argc, char** argv) try
+{
+    Cmdline_arg_parser args(argc, argv);
+
+    // Display help message if requested.
+    if (args.exists("help"))
+        if (boost::to_lower_copy(args.get_string("help")) != "n")
+            display_usage();
+
+    // Process command-line arguments.
+    port = args.get_string("port", port);
+    if (args.exists("connections"))
+        num_connections = args.get_int("connections");
+    if (args.exists("inflight"))
+        num_in_flight = args.get_int("inflight");
+    if (args.exists("size"))
+        message_size = max(12, args.get_int("size"));
+    if (args.exists("processors"))
+        num_processors = args.get_int("processors");
+    if (args.exists("clients"))
+        num_client_threads = args.get_int("clients");
+    if (args.exists("warmup"))
+        warmup_sec = args.get_int("warmup");
+    if (args.exists("seconds"))
+        measure_sec = max(1, args.get_int("seconds"));
+    use_io_uring = args.exists("io_uring") && args.get_yes_or_no("io_uring");
+    json_output = args.exists("json") && args.get_yes_or_no("json");
+    num_client_threads = max(1, min(num_client_threads, num_connections));
+
+    // Start the echo server.
+    Server server;
+    server.use_io_uring(use_io_uring);
+    server.add_service(new Service("echo", "127.0.0.1", port,
+                                   new Echo_strategy));
+    server.startup();
+    server.set_num_processors(num_processors);
+    milli_sleep(200);   // gives the listener a chance to start
+
+    // Connect, and wait for the server to add every session.
+    vector<Connection*> connections;
+    for (int i = 0; i < num_connections; i++)
+        connections.push_back(new Connection(connect_tcp("127.0.0.1", port)));
+    for (int i = 0; server.totals().m_sessions_snap < num_connections; i++) {
+        if (i == 500) {
+            fprintf(stderr, "main: FATAL: the server has %d of %d "
+                    "sessions\n", server.totals().m_sessions_snap,
+                    num_connections);
+            return 2;
+        }
+        milli_sleep(10);
+    }
+
+    // Divide the connections among the client threads, and start them.
+    vector<Client*> clients;
+    vector<Thread*> threads;
+    for (int i = 0; i < num_client_threads; i++) {
+        vector<Connection*> group;
+        for (int j = i; j < num_connections; j += num_client_threads)
+            group.push_back(connections[j]);
+        clients.push_back(new Client(group));
+        threads.push_back(new Thread(clients.back()));
+        threads.back()->start();
+    }
+
+    // Measure.
+    milli_sleep(warmup_sec*1000);
+    Int64 const messages_before = messages_received.value();
+    Histogram_snapshot const latency_before = round_trip.snapshot();
+    Int64 const cpu_before = process_cpu_micros();
+    Int64 const started = monotonic_micros();
+    phase = PHASE_MEASURE;
+
+    milli_sleep(measure_sec*1000);
+    Int64 const elapsed = monotonic_micros() - started;
+    Int64 const cpu = process_cpu_micros() - cpu_before;
+    Int64 const messages = messages_received.value() - messages_before;
+    Histogram_snapshot latency = round_trip.snapshot();
+    latency -= latency_before;
+    phase = PHASE_DONE;
+
+    while (client_threads_done.value() < num_client_threads)
+        milli_sleep(10);
+    for (int i = 0; i < int(threads.size()); i++)
+        threads[i]->wait_for_exit(0);
+    Int64 const server_cpu = cpu - client_cpu_micros.value();
+
+    double const msgs_per_sec = messages*1e6/elapsed;
+    double const cpu_per_msg = messages == 0 ? 0 : 1.0*cpu/messages;
+    double const server_cpu_per_msg =
+        messages == 0 ? 0 : 1.0*server_cpu/messages;
+
+    if (json_output) {
+        printf("{\"connections\": %d, \"in_flight\": %d, \"size\": %d, "
+               "\"processors\": %d, \"clients\": %d, \"io_uring\": %s, "
+               "\"seconds\": %.3f, \"messages\": %lld, "
+               "\"msgs_per_sec\": %.1f, \"latency_us\": {\"mean\": %.1f, "
+               "\"p50\": %lld, \"p99\": %lld, \"p999\": %lld, "
+               "\"max\": %lld}, \"cpu_us_per_msg\": %.3f, "
+               "\"server_cpu_us_per_msg\": %.3f}\n",
+               num_connections, num_in_flight, message_size,
+               num_processors, num_client_threads,
+               use_io_uring ? "true" : "false", elapsed/1e6,
+               static_cast<long long>(messages), msgs_per_sec,
+               latency.mean(),
+               static_cast<long long>(latency.percentile(50)),
+               static_cast<long long>(latency.percentile(99)),
+               static_cast<long long>(latency.percentile(99.9)),
+               static_cast<long long>(latency.max()), cpu_per_msg,
+               server_cpu_per_msg);
+    }
+    else {
+        printf("bench: %d connections x %d in flight, %d-byte messages, "
+               "%d processors, %d client threads%s\n", num_connections,
+               num_in_flight, message_size, num_processors,
+               num_client_threads, use_io_uring ? ", io_uring" : "");
+        printf("  messages:            %lld in %.3fs\n",
+               static_cast<long long>(messages), elapsed/1e6);
+        printf("  throughput:          %.1f msgs/s\n", msgs_per_sec);
+        printf("  round trip (us):     mean %.1f p50 %lld p99 %lld "
+               "p99.9 %lld max %lld\n", latency.mean(),
+               static_cast<long long>(latency.percentile(50)),
+               static_cast<long long>(latency.percentile(99)),
+               static_cast<long long>(latency.percentile(99.9)),
+               static_cast<long long>(latency.max()));
+        printf("  cpu per message:     %.3f us (server %.3f us)\n",
+               cpu_per_msg, server_cpu_per_msg);
+    }
+
+    server.shutdown();
+    for_each(threads.begin(), threads.end(), delete_fun<Thread>);
+    for_each(clients.begin(), clients.end(), delete_fun<Client>);
+    for_each(connections.begin(), connections.end(), delete_fun<Connection>);
+    return messages > 0 ? 0 : 1;
+}
+catch (Exception& e) {
+    fprintf(stderr, "main: FATAL: %s\n", e.to_string().c_str());
+    return 1;
+}
@@ -9,6 +9,7 @@
 #include "ares/buffer.hpp"
 #include "ares/cmdline_arg_parser.hpp"
 #include "ares/dispatcher.hpp"
+#include "ares/gather_list.hpp"
 #include "ares/net_tk.hpp"
 #include "ares/random.hpp"
 #include "ares/server_interface.hpp"
@@ -31,7 +32,11 @@ int num_bytes = 100*1024*1024;      // total amount to send (all sessions)
 int num_sessions = 50;              // number of sessions
 int num_bytes_per_session = 0;      // amount to send per session
 bool random_order = true;           // send data in random order?
+bool use_io_uring = false;          // send data through io_uring?
 int num_bytes_per_send = 0;         // send chunk size (<= 0 means random)
+int output_quota = 4*1024*1024;     // per-session output quota
+bool use_direct_output = false;     // write directly when possible?
+bool use_gather = false;            // send gather lists?
 
 vector<vector<Byte> > send_data;    // N vectors of M random bytes
 vector<vector<Byte> > recv_data;    // should be == send_data
@@ -59,6 +64,10 @@ void display_usage()
            "NBYTES          total number of bytes to send (100MB)\n"
            "NBYTES_PER_SEND bytes to send at a time (random)\n"
            "RANDOM_ORDER    send to sessions in random order? (Y)\n"
+           "IO_URING        send data through io_uring if available? (N)\n"
+           "QUOTA           per-session output quota in bytes (4MB)\n"
+           "DIRECT          write directly to sockets when possible? (N)\n"
+           "GATHER          send each chunk as a gather list? (N)\n"
            "\n");
     exit(0);
 }
@@ -71,6 +80,26 @@ vector<Byte> generate_random_bytes(int n)
         v[i] = Byte(Random::next_int(256));
     return v;
 }
+
+// Sends count bytes to a session, in a single buffer or, if use_gather is
+// true, as a gather list of up to four buffers.
+void send_bytes(Session const& session, Byte const* data, int count)
+{
+    if (!use_gather) {
+        session->send(Buffer(data, count));
+        return;
+    }
+
+    Gather_list list;
+    int const num_buffers = 1 + Random::next_int(4);
+    for (int i = 0; i < num_buffers; i++) {
+        int n = i == num_buffers-1 ? count : Random::next_int(count + 1);
+        list.append(Shared_buffer(new Buffer(data, n)));
+        data += n;
+        count -= n;
+    }
+    session->send(list);
+}
 }
 
 // Reader's job is to connect to the test server and read up to
@@ -149,6 +178,7 @@ class Test_session : public Session_rep {
             : Session_rep(server, socket), m_id(id)
     {
         use_slave_process_for_output(true); // use dispatcher
+        use_direct_output(::use_direct_output);
     }
 
     bool do_handle_input(ares::Buffer&) { return false; }
@@ -159,13 +189,25 @@ class Test_session : public Session_rep {
 
 class Test_server : public Server_interface {
   public:
-    Test_server() : m_dispatcher(*this) { m_dispatcher.startup(); }
+    Test_server(bool use_io_uring, int quota) : m_dispatcher(*this)
+    {
+        m_dispatcher.use_io_uring(use_io_uring);
+        m_dispatcher.set_output_limits(quota/4, quota/2, quota, OUTPUT_BLOCK);
+        m_dispatcher.startup();
+    }
+
+    bool is_using_io_uring() const { return m_dispatcher.is_using_io_uring(); }
     virtual ~Test_server() { m_dispatcher.shutdown(); }
     void add_session(Session) {}
     void remove_session(Session) {}
     void enqueue_command(Command*) {}
     void enqueue_delayed_command(Command*, int) {}
     void dispatch(Session s, Buffer* b) { m_dispatcher.dispatch(s, b); }
+    void dispatch(Session s, Gather_list const& l)
+    {
+        m_dispatcher.dispatch(s, l);
+    }
+    bool is_output_idle(Session s) { return m_dispatcher.is_output_idle(s); }
     job::Scheduler& scheduler() { return m_scheduler; }
     void shutdown() {}
     Date started() const { return Date(); }
@@ -177,27 +219,29 @@ class Test_server : public Server_interface {
         printf("dispatcher: elapsed_sec: %d\n",
                s.elapsed_sec());
         printf("dispatcher: writes: %d\n",
-               s.writes());
+               int(s.writes()));
         printf("dispatcher: writes_per_sec: %.2f\n",
                s.writes_per_sec());
         printf("dispatcher: zero_writes: %d\n",
-               s.zero_writes());
+               int(s.zero_writes()));
         printf("dispatcher: zero_writes_per_sec: %.2f\n",
                s.zero_writes_per_sec());
         printf("dispatcher: bytes_sent: %d\n",
-               s.bytes_sent());
+               int(s.bytes_sent()));
         printf("dispatcher: bytes_sent_per_sec: %.2f\n",
                s.bytes_sent_per_sec());
         printf("dispatcher: bytes_per_write: %d\n",
                s.bytes_per_write());
         printf("dispatcher: buffers_added: %d\n",
-               s.buffers_added());
+               int(s.buffers_added()));
         printf("dispatcher: buffers_added_per_sec: %.2f\n",
                s.buffers_added_per_sec());
         printf("dispatcher: buffers_sent: %d\n",
-               s.buffers_sent());
+               int(s.buffers_sent()));
         printf("dispatcher: buffers_sent_per_sec: %.2f\n",
                s.buffers_sent_per_sec());
+        printf("dispatcher: blocked_sends: %d\n",
+               int(s.blocked_sends()));
     }
 
   private:
@@ -230,6 +274,16 @@ int main(int argc, char** argv) try
     if (args.exists("random_order"))
         random_order =
                 boost::to_lower_copy(args.get_string("random_order")) != "n";
+    if (args.exists("io_uring"))
+        use_io_uring =
+                boost::to_lower_copy(args.get_string("io_uring")) != "n";
+    if (args.exists("direct"))
+        use_direct_output =
+                boost::to_lower_copy(args.get_string("direct")) != "n";
+    if (args.exists("gather"))
+        use_gather = boost::to_lower_copy(args.get_string("gather")) != "n";
+    if (args.exists("quota"))
+        output_quota = args.get_int("quota");
 
     num_bytes_per_session = num_bytes / num_sessions;
 
@@ -259,7 +313,11 @@ int main(int argc, char** argv) try
 
     // Create a test server object.
     printf("main: creating test server\n");
-    Test_server server;
+    Test_server server(use_io_uring, output_quota);
+    if (server.is_using_io_uring())
+        printf("main: dispatcher is using io_uring\n");
+    else
+        printf("main: dispatcher is writing to sockets directly\n");
 
     // Create a listen socket.
     printf("main: binding listen socket to %s:%s\n",
@@ -308,8 +366,8 @@ int main(int argc, char** argv) try
                                     : 1 + Random::next_int(remaining);
 
             // Send a dispatch.
-            sessions[session_num]->send(Buffer(&send_data[session_num][pos],
-                                               num_bytes_to_send));
+            send_bytes(sessions[session_num], &send_data[session_num][pos],
+                       num_bytes_to_send);
             printf("main: session %d sent %d of %d\n",
                    session_num, num_bytes_to_send, remaining);
             send_pos[session_num] += num_bytes_to_send;
@@ -334,8 +392,8 @@ int main(int argc, char** argv) try
                                         ? min(remaining, num_bytes_per_send)
                                         : 1 + Random::next_int(remaining);
 
-                sessions[i]->send(Buffer(&send_data[i][pos],
-                                         num_bytes_to_send));
+                send_bytes(sessions[i], &send_data[i][pos],
+                           num_bytes_to_send);
                 printf("main: session %d sent %d of %d\n",
                        i, num_bytes_to_send, remaining);
                 send_pos[i] += num_bytes_to_send;
@@ -0,0 +1,220 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/cmdline_arg_parser.hpp"
+#include "ares/hashtable.hpp"
+#include "ares/platform.hpp"
+#include "ares/random.hpp"
+#include "ares/string_util.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+int num_keys = 100000;              // keys per hash-table test
+int num_bytes = 256*1024*1024;      // bytes hashed per throughput test
+volatile Uint64 hash_sink;          // keeps hashing from being optimized away
+
+// Print usage instructions to stdout, then exit the program.
+void display_usage()
+{
+    printf("\n"
+           "hash_string: Measure the quality and speed of string hashing.\n"
+           "\n"
+           "Fills Hashtables with several kinds of string keys, using the\n"
+           "old Jenkins lookup2 hash and the current Hash_string, and\n"
+           "reports their probe counts (see hashtable_statistics); then\n"
+           "measures hashing throughput for several key lengths. Keywords\n"
+           "are NOT case sensitive:\n"
+           "\n"
+           "    Format: hash_string KEYWORD=value (KEYWORD=value ...)\n"
+           "    Example: hash_string NKEYS=1000000\n"
+           "\n"
+           "Keyword         Description (Default)\n"
+           "------------------------------------------------------------\n"
+           "HELP            if 'Y', displays this message and exits (N)\n"
+           "NKEYS           number of keys per table (100000)\n"
+           "NBYTES          bytes hashed per throughput test (256MB)\n"
+           "\n");
+    exit(0);
+}
+
+// The hash function Hash_string used to compute: Bob Jenkins' lookup2, one
+// byte at a time. Kept here for comparison.
+struct Hash_lookup2 {
+    Uint32 operator()(string const& s) const
+    {
+        typedef Uint32 u32;
+
+#define mix(a, b, c) {                          \
+            a -= b; a -= c; a ^= (c>>13);       \
+            b -= c; b -= a; b ^= (a<< 8);       \
+            c -= a; c -= b; c ^= (b>>13);       \
+            a -= b; a -= c; a ^= (c>>12);       \
+            b -= c; b -= a; b ^= (a<<16);       \
+            c -= a; c -= b; c ^= (b>> 5);       \
+            a -= b; a -= c; a ^= (c>> 3);       \
+            b -= c; b -= a; b ^= (a<<10);       \
+            c -= a; c -= b; c ^= (b>>15);       \
+        }
+
+        unsigned char const* k = (unsigned char const*) s.data();
+        u32 a, b, c, len;
+
+        len = s.length();
+        a = b = 0x9e3779b9;
+        c = 0;
+
+        while (len >= 12) {
+            a += k[0] + u32(k[1]<<8) + u32(k[ 2]<<16) + u32(k[ 3]<<24);
+            b += k[4] + u32(k[5]<<8) + u32(k[ 6]<<16) + u32(k[ 7]<<24);
+            c += k[8] + u32(k[9]<<8) + u32(k[10]<<16) + u32(k[11]<<24);
+            mix(a, b, c);
+            k += 12; len -= 12;
+        }
+
+        c += len;
+        switch (len) {
+            case 11: c += u32(k[10]<<24);
+            case 10: c += u32(k[9]<<16);
+            case  9: c += u32(k[8]<<8);
+            case  8: b += u32(k[7]<<24);
+            case  7: b += u32(k[6]<<16);
+            case  6: b += u32(k[5]<<8);
+            case  5: b += k[4];
+            case  4: a += u32(k[3]<<24);
+            case  3: a += u32(k[2]<<16);
+            case  2: a += u32(k[1]<<8);
+            case  1: a += k[0];
+        }
+
+        mix(a, b, c);
+        return c;
+
+#undef mix
+    }
+};
+
+// Returns a random string of n printable characters.
+string random_string(int n)
+{
+    string s(n, ' ');
+    for (int i = 0; i < n; i++)
+        s[i] = char('!' + Random::next_int(94));
+    return s;
+}
+
+// Returns num_keys keys of the given kind.
+vector<string> generate_keys(string const& kind)
+{
+    vector<string> keys;
+    for (int i = 0; i < num_keys; i++) {
+        if (kind == "sequential")
+            keys.push_back(format("session-%d", i));
+        else if (kind == "route")
+            keys.push_back(format("/api/v1/users/%d/items/%d", i/16, i%16));
+        else if (kind == "short")
+            keys.push_back(random_string(1 + Random::next_int(8)));
+        else
+            keys.push_back(random_string(8 + Random::next_int(120)));
+    }
+    return keys;
+}
+
+// Fills a Hashtable using hash function H and reports its probe counts.
+template<class H>
+void report_quality(char const* hash_name, string const& kind,
+                    vector<string> const& keys)
+{
+    Hashtable<string, int, H> table;
+    for (unsigned i = 0; i < keys.size(); i++)
+        table.insert(keys[i], i);
+
+    Hashtable_statistics s = hashtable_statistics(table);
+    printf("%-12s %-12s size %7d load %.2f mean_probes %.3f "
+           "max_probes %d\n", hash_name, kind.c_str(), s.size,
+           s.load_factor, s.mean_probes, s.max_probes);
+}
+
+// Hashes num_bytes bytes in keys of the given length with hash function H
+// and reports the throughput.
+template<class H>
+void report_speed(char const* hash_name, int length)
+{
+    H hash;
+    vector<string> keys;
+    for (int i = 0; i < 64; i++)
+        keys.push_back(random_string(length));
+
+    int const iterations = num_bytes/length;
+    Uint64 sum = 0;
+
+    Int64 start = current_time_millis();
+    for (int i = 0; i < iterations; i++)
+        sum += hash(keys[i & 63]);
+    Int64 millis = current_time_millis() - start;
+    hash_sink = sum;
+
+    double mb_per_sec = millis == 0 ? 0 :
+            1.0*iterations*length/1048576.0/(millis/1000.0);
+    double ns_per_key = 1e6*millis/iterations;
+    printf("%-12s length %5d %8.1f MB/s %8.1f ns/key\n", hash_name,
+           length, mb_per_sec, ns_per_key);
+}
+}
+
+int main(int argc, char** argv) try
+{
+    Cmdline_arg_parser args(argc, argv);
+
+    // Display help message if requested.
+    if (args.exists("help"))
+        if (boost::to_lower_copy(args.get_string("help")) != "n")
+            display_usage();
+
+    // Process command-line arguments.
+    if (args.exists("nkeys"))
+        num_keys = args.get_int("nkeys");
+    if (args.exists("nbytes"))
+        num_bytes = args.get_int("nbytes");
+
+    Random::seed(current_time());
+
+    // Hash quality: the fewer probes, the better. A perfectly uniform hash
+    // needs about 1 + load/2 probes per key on average.
+
+    char const* const kinds[] = { "sequential", "route", "short", "random" };
+    for (unsigned i = 0; i < sizeof(kinds)/sizeof(kinds[0]); i++) {
+        vector<string> keys = generate_keys(kinds[i]);
+        report_quality<Hash_lookup2>("lookup2", kinds[i], keys);
+        report_quality<Hash_string>("Hash_string", kinds[i], keys);
+        report_quality<Hash_string_ignore_case>("ignore_case", kinds[i],
+                                                keys);
+    }
+
+    // Hash throughput.
+
+    int const lengths[] = { 8, 16, 32, 64, 256, 4096 };
+    for (unsigned i = 0; i < sizeof(lengths)/sizeof(lengths[0]); i++) {
+        report_speed<Hash_lookup2>("lookup2", lengths[i]);
+        report_speed<Hash_string>("Hash_string", lengths[i]);
+        report_speed<Hash_string_ignore_case>("ignore_case", lengths[i]);
+    }
+
+    printf("main: OK\n");
+    return 0;
+}
+catch (Exception& e) {
+    fprintf(stderr, "main: FATAL: %s\n", e.to_string().c_str());
+    return 1;
+}
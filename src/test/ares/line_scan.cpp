@@ -0,0 +1,187 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/buffer.hpp"
+#include "ares/cmdline_arg_parser.hpp"
+#include "ares/line_reader.hpp"
+#include "ares/line_scan.hpp"
+#include "ares/platform.hpp"
+#include "ares/random.hpp"
+#include "ares/string_util.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+int num_bytes = 64*1024*1024;       // size of the scanned text
+int line_length = 4096;             // average line length
+int num_passes = 10;                // number of scans per measurement
+
+// Print usage instructions to stdout, then exit the program.
+void display_usage()
+{
+    printf("\n"
+           "line_scan: Measure the throughput of newline scanning.\n"
+           "\n"
+           "Scans a large buffer of random text for line ends, once with\n"
+           "each implementation of find_newline that this processor\n"
+           "supports, then reads the same text with Line_reader::get_line\n"
+           "and Line_reader::get_line_view. Keywords are NOT case\n"
+           "sensitive:\n"
+           "\n"
+           "    Format: line_scan KEYWORD=value (KEYWORD=value ...)\n"
+           "    Example: line_scan NBYTES=16777216 LINE_LENGTH=80\n"
+           "\n"
+           "Keyword         Description (Default)\n"
+           "------------------------------------------------------------\n"
+           "HELP            if 'Y', displays this message and exits (N)\n"
+           "NBYTES          size of the text to scan (64MB)\n"
+           "LINE_LENGTH     average line length, in bytes (4096)\n"
+           "NPASSES         number of scans per measurement (10)\n"
+           "\n");
+    exit(0);
+}
+
+// Returns n bytes of printable text broken into CRLF-terminated lines whose
+// lengths average avg_length.
+vector<Byte> generate_text(int n, int avg_length)
+{
+    vector<Byte> v(n);
+    int next_newline = Random::next_int(2*avg_length) + 1;
+    for (int i = 0; i < n; i++) {
+        if (i == next_newline && i + 1 < n) {
+            v[i++] = '\r';
+            v[i] = '\n';
+            next_newline = i + Random::next_int(2*avg_length) + 1;
+        }
+        else {
+            v[i] = Byte(' ' + Random::next_int(95));
+        }
+    }
+    return v;
+}
+
+// Prints a throughput measurement.
+void report(char const* what, Int64 bytes, Int64 millis)
+{
+    double mb_per_sec = millis == 0 ? 0 : bytes/1048576.0/(millis/1000.0);
+    printf("%-28s %8d ms %10.1f MB/s\n", what, int(millis), mb_per_sec);
+}
+}
+
+int main(int argc, char** argv) try
+{
+    Cmdline_arg_parser args(argc, argv);
+
+    // Display help message if requested.
+    if (args.exists("help"))
+        if (boost::to_lower_copy(args.get_string("help")) != "n")
+            display_usage();
+
+    // Process command-line arguments.
+    if (args.exists("nbytes"))
+        num_bytes = args.get_int("nbytes");
+    if (args.exists("line_length"))
+        line_length = args.get_int("line_length");
+    if (args.exists("npasses"))
+        num_passes = args.get_int("npasses");
+
+    printf("main: scanning %d bytes in lines of about %d bytes, %d times\n",
+           num_bytes, line_length, num_passes);
+    printf("main: find_newline is using %s\n", to_string(line_scan_isa()));
+
+    Random::seed(current_time());
+    vector<Byte> text = generate_text(num_bytes, line_length);
+    Byte const* const begin = &text[0];
+    Byte const* const end = begin + text.size();
+    Int64 const total_bytes = Int64(num_bytes)*num_passes;
+
+    // Scan the text with each supported implementation. Every one of them
+    // must find the same number of line ends.
+
+    Line_scan_isa const isas[] =
+            { LINE_SCAN_GENERIC, LINE_SCAN_SSE2, LINE_SCAN_AVX2 };
+    int expected_count = -1;
+
+    for (unsigned i = 0; i < sizeof(isas)/sizeof(isas[0]); i++) {
+        if (!is_line_scan_isa_supported(isas[i])) {
+            printf("%-28s (not supported)\n",
+                   format("find_newline/%s", to_string(isas[i])).c_str());
+            continue;
+        }
+
+        int count = 0;
+        Int64 start = current_time_millis();
+        for (int pass = 0; pass < num_passes; pass++) {
+            for (Byte const* p = begin; ; p++) {
+                p = find_newline(p, end, isas[i]);
+                if (p == end)
+                    break;
+                count++;
+            }
+        }
+        report(format("find_newline/%s", to_string(isas[i])).c_str(),
+               total_bytes, current_time_millis() - start);
+
+        if (expected_count < 0)
+            expected_count = count;
+        else if (count != expected_count) {
+            printf("main: FATAL: found %d line ends, expected %d\n",
+                   count/num_passes, expected_count/num_passes);
+            return 1;
+        }
+    }
+
+    // Read the text line by line, copying each line into a string, then
+    // without copying.
+
+    Buffer buffer;
+    string line;
+    int lines_copied = 0;
+    int lines_viewed = 0;
+
+    Int64 start = current_time_millis();
+    for (int pass = 0; pass < num_passes; pass++) {
+        buffer.assign(begin, num_bytes);
+        Line_reader reader(buffer);
+        while (reader.get_line(line))
+            lines_copied++;
+    }
+    report("Line_reader::get_line", total_bytes,
+           current_time_millis() - start);
+
+    start = current_time_millis();
+    for (int pass = 0; pass < num_passes; pass++) {
+        buffer.assign(begin, num_bytes);
+        Line_reader reader(buffer);
+        char const* p;
+        int length;
+        while (reader.get_line_view(p, length))
+            lines_viewed++;
+    }
+    report("Line_reader::get_line_view", total_bytes,
+           current_time_millis() - start);
+
+    if (lines_copied != lines_viewed) {
+        printf("main: FATAL: get_line read %d lines, get_line_view %d\n",
+               lines_copied/num_passes, lines_viewed/num_passes);
+        return 1;
+    }
+
+    printf("main: OK: %d line ends per pass\n", lines_viewed/num_passes);
+    return 0;
+}
+catch (Exception& e) {
+    fprintf(stderr, "main: FATAL: %s\n", e.to_string().c_str());
+    return 1;
+}
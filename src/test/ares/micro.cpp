@@ -0,0 +1,922 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/bin_util.hpp"
+#include "ares/buffer.hpp"
+#include "ares/cmdline_arg_parser.hpp"
+#include "ares/fixed_allocator.hpp"
+#include "ares/hashtable.hpp"
+#include "ares/message_reader.hpp"
+#include "ares/message_writer.hpp"
+#include "ares/metrics.hpp"
+#include "ares/platform.hpp"
+#include "ares/random.hpp"
+#include "ares/shared_queue.hpp"
+#include "ares/sink.hpp"
+#include "ares/string_util.hpp"
+#include "ares/sync_queue.hpp"
+#include "ares/thread.hpp"
+#include "ares/utility.hpp"
+#include <algorithm>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+int num_reps = 10;                  // measured repetitions per benchmark
+int num_warmups = 2;                // unmeasured repetitions per benchmark
+int rep_millis = 50;                // target duration of one repetition
+int num_ops = 0;                    // operations per repetition, if fixed
+int num_threads = 4;                // producers or consumers, for N cases
+string filter;                      // runs only benchmarks whose names
+                                    // contain this string
+bool json = false;                  // prints one JSON object if true
+volatile Uint32 value_sink;         // keeps results from being optimized away
+
+// Print usage instructions to stdout, then exit the program.
+void display_usage()
+{
+    printf("\n"
+           "micro: Measure the speed of the library's core primitives.\n"
+           "\n"
+           "Runs a benchmark of each of the queues, the fixed allocator,\n"
+           "buffers, the hashtable, the message reader and the binary\n"
+           "codecs, in isolation. Each benchmark is calibrated to run for\n"
+           "about REPMILLIS milliseconds, warmed up, then repeated; the\n"
+           "minimum, median, mean and standard deviation of the time per\n"
+           "operation are reported. Keywords are NOT case sensitive:\n"
+           "\n"
+           "    Format: micro KEYWORD=value (KEYWORD=value ...)\n"
+           "    Example: micro FILTER=queue REPS=20 JSON=Y\n"
+           "\n"
+           "Keyword         Description (Default)\n"
+           "------------------------------------------------------------\n"
+           "HELP            if 'Y', displays this message and exits (N)\n"
+           "FILTER          runs only benchmarks whose names contain it\n"
+           "LIST            if 'Y', lists the benchmarks and exits (N)\n"
+           "REPS            measured repetitions per benchmark (10)\n"
+           "WARMUP          unmeasured repetitions per benchmark (2)\n"
+           "REPMILLIS       target duration of a repetition (50)\n"
+           "OPS             operations per repetition; if given, no\n"
+           "                calibration is done (0)\n"
+           "THREADS         producers or consumers in the N cases (4)\n"
+           "JSON            if 'Y', prints one JSON object (N)\n"
+           "\n");
+    exit(0);
+}
+
+// A benchmark of one primitive.
+class Benchmark : boost::noncopyable {
+  public:
+    explicit Benchmark(string const& name) : m_name(name) {}
+
+    virtual ~Benchmark() {}
+
+    string const& name() const { return m_name; }
+
+    // Returns the number of operations that run performs together; the
+    // number passed to run is always a multiple of it.
+    virtual int batch_size() const { return 1; }
+
+    // Performs ops operations and returns the time they took, in
+    // microseconds. Any setup the benchmark does is not timed.
+    virtual Int64 run(int ops) = 0;
+
+  private:
+    string m_name;
+};
+
+// Adapts Shared_queue to Queue_benchmark. Consumers block in dequeue.
+struct Shared_queue_policy {
+    typedef Shared_queue<int> Queue;
+
+    static void put(Queue& q, int item) { q.enqueue(item); }
+
+    static void get(Queue& q, vector<int>& items)
+    {
+        items.resize(1);
+        while (!q.dequeue(items[0], 100))
+            ;
+    }
+};
+
+// Adapts Sync_queue to Queue_benchmark. Sync_queue cannot wait, so
+// consumers poll with dequeue_all, yielding while the queue is empty.
+struct Sync_queue_policy {
+    typedef Sync_queue<int> Queue;
+
+    static void put(Queue& q, int item) { q.enqueue(item); }
+
+    static void get(Queue& q, vector<int>& items)
+    {
+        while (q.dequeue_all(items) == 0)
+            sched_yield();
+    }
+};
+
+// Passes ops items from producer threads to consumer threads through a
+// queue. Each operation is one item enqueued and dequeued. The time
+// includes starting the threads, which is negligible at the calibrated
+// number of operations.
+template <class POLICY>
+class Queue_benchmark : public Benchmark {
+  public:
+    Queue_benchmark(string const& name, int num_producers,
+                    int num_consumers)
+            : Benchmark(name)
+            , m_num_producers(num_producers)
+            , m_num_consumers(num_consumers)
+    {}
+
+    int batch_size() const { return m_num_producers; }
+
+    Int64 run(int ops)
+    {
+        State state(ops/m_num_producers, m_num_producers, m_num_consumers);
+        vector<Thread::Runnable*> runnables;
+        for (int i = 0; i < m_num_producers; i++)
+            runnables.push_back(new Producer(state, i));
+        for (int i = 0; i < m_num_consumers; i++)
+            runnables.push_back(new Consumer(state, m_num_producers + i));
+        vector<Thread*> threads;
+        for (int i = 0; i < int(runnables.size()); i++)
+            threads.push_back(new Thread(runnables[i]));
+
+        Int64 const start = monotonic_micros();
+        for (int i = 0; i < int(threads.size()); i++)
+            threads[i]->start();
+
+        // Each thread records when it finished, so the waiting here does
+        // not count.
+        while (state.m_done.value() < Int64(threads.size()))
+            milli_sleep(1);
+        for (int i = 0; i < int(threads.size()); i++)
+            threads[i]->wait_for_exit(0);
+        Int64 const finish = *max_element(state.m_finished.begin(),
+                                          state.m_finished.end());
+
+        for_each(threads.begin(), threads.end(), delete_fun<Thread>);
+        for_each(runnables.begin(), runnables.end(),
+                 delete_fun<Thread::Runnable>);
+        if (state.m_consumed.value() != ops)
+            throw Internal_error("s", "queue lost items");
+        return finish - start;
+    }
+
+  private:
+    enum { STOP = -1 };             // tells a consumer to finish
+
+    struct State {
+        typename POLICY::Queue m_queue;
+        int const m_items_per_producer;
+        int const m_num_producers;
+        int const m_num_consumers;
+        int m_num_producers_done;
+        vector<Int64> m_finished;   // when each thread finished
+        Counter m_consumed;         // items dequeued, excluding STOP
+        Counter m_done;             // threads finished
+
+        State(int items_per_producer, int num_producers, int num_consumers)
+                : m_items_per_producer(items_per_producer)
+                , m_num_producers(num_producers)
+                , m_num_consumers(num_consumers)
+                , m_num_producers_done(0)
+                , m_finished(num_producers + num_consumers)
+        {}
+    };
+
+    class Producer : public Thread::Runnable {
+      public:
+        Producer(State& state, int index)
+                : m_state(state)
+                , m_index(index)
+        {}
+
+        void run()
+        {
+            for (int i = 0; i < m_state.m_items_per_producer; i++)
+                POLICY::put(m_state.m_queue, i);
+
+            // The last producer to finish stops the consumers. Every item
+            // has been enqueued by then, so each STOP follows all of them.
+            if (__sync_add_and_fetch(&m_state.m_num_producers_done, 1) ==
+                m_state.m_num_producers)
+            {
+                for (int i = 0; i < m_state.m_num_consumers; i++)
+                    POLICY::put(m_state.m_queue, STOP);
+            }
+            m_state.m_finished[m_index] = monotonic_micros();
+            m_state.m_done.add();
+        }
+
+      private:
+        State& m_state;
+        int const m_index;
+    };
+
+    class Consumer : public Thread::Runnable {
+      public:
+        Consumer(State& state, int index)
+                : m_state(state)
+                , m_index(index)
+        {}
+
+        void run()
+        {
+            vector<int> items;
+            Int64 count = 0;
+            Uint32 sum = 0;
+            for (;;) {
+                POLICY::get(m_state.m_queue, items);
+                int stops = 0;
+                for (int i = 0; i < int(items.size()); i++) {
+                    if (items[i] == STOP) {
+                        ++stops;
+                    }
+                    else {
+                        sum += items[i];
+                        ++count;
+                    }
+                }
+                if (stops > 0) {
+                    // Puts back the STOPs meant for other consumers.
+                    for (int i = 1; i < stops; i++)
+                        POLICY::put(m_state.m_queue, STOP);
+                    break;
+                }
+            }
+            value_sink = sum;
+            m_state.m_consumed.add(count);
+            m_state.m_finished[m_index] = monotonic_micros();
+            m_state.m_done.add();
+        }
+
+      private:
+        State& m_state;
+        int const m_index;
+    };
+
+    int const m_num_producers;
+    int const m_num_consumers;
+};
+
+// Allocates and frees blocks of BLOCK_SIZE bytes, either with a
+// Fixed_allocator or with malloc. Each operation is one allocation and one
+// free; blocks are freed in batches of the given size, in the order they
+// were allocated.
+class Allocator_benchmark : public Benchmark {
+  public:
+    enum { BLOCK_SIZE = 64 };
+
+    Allocator_benchmark(string const& name, bool use_malloc, int batch)
+            : Benchmark(name)
+            , m_use_malloc(use_malloc)
+            , m_batch(batch)
+    {}
+
+    int batch_size() const { return m_batch; }
+
+    Int64 run(int ops)
+    {
+        Fixed_allocator allocator(BLOCK_SIZE);
+        vector<void*> blocks(m_batch);
+        Int64 const start = monotonic_micros();
+        for (int n = 0; n < ops; n += m_batch) {
+            if (m_use_malloc) {
+                for (int i = 0; i < m_batch; i++)
+                    *static_cast<char*>(blocks[i] = malloc(BLOCK_SIZE)) = i;
+                for (int i = 0; i < m_batch; i++)
+                    ::free(blocks[i]);
+            }
+            else {
+                for (int i = 0; i < m_batch; i++)
+                    *static_cast<char*>(blocks[i] = allocator.allocate()) = i;
+                for (int i = 0; i < m_batch; i++)
+                    allocator.free(blocks[i]);
+            }
+        }
+        return monotonic_micros() - start;
+    }
+
+  private:
+    bool const m_use_malloc;
+    int const m_batch;
+};
+
+// Exercises a Buffer in the patterns the library uses it in. Each operation
+// writes CHUNK_SIZE bytes to the buffer.
+class Buffer_benchmark : public Benchmark {
+  public:
+    enum Pattern {
+        PUT_CONSUME,        // put a chunk, then consume it
+        STREAM,             // put a chunk, then consume whole records, as a
+                            // reader does; partial records are compacted
+        DIRECT,             // write a chunk at end() and advance, as a
+                            // socket read does, then consume it
+        GROW,               // append chunks, doubling the capacity when it
+                            // is full, as a sink does
+    };
+
+    enum {
+        CHUNK_SIZE = 100,
+        RECORD_SIZE = 64,
+        CAPACITY = 64*1024,
+        GROW_BATCH = 1024,  // chunks appended before the buffer is reset
+    };
+
+    Buffer_benchmark(string const& name, Pattern pattern)
+            : Benchmark(name)
+            , m_pattern(pattern)
+    {
+        for (int i = 0; i < CHUNK_SIZE; i++)
+            m_chunk[i] = Byte(i);
+    }
+
+    int batch_size() const { return m_pattern == GROW ? GROW_BATCH : 1; }
+
+    Int64 run(int ops)
+    {
+        Buffer b(m_pattern == GROW ? 1 : int(CAPACITY));
+        Int64 const start = monotonic_micros();
+        switch (m_pattern) {
+          case PUT_CONSUME:
+            for (int i = 0; i < ops; i++) {
+                b.put(m_chunk, CHUNK_SIZE);
+                b.consume(CHUNK_SIZE);
+            }
+            break;
+
+          case STREAM:
+            for (int i = 0; i < ops; i++) {
+                b.put(m_chunk, CHUNK_SIZE);
+                while (b.size() >= RECORD_SIZE)
+                    b.consume(RECORD_SIZE);
+            }
+            break;
+
+          case DIRECT:
+            for (int i = 0; i < ops; i++) {
+                memcpy(b.end(), m_chunk, CHUNK_SIZE);
+                b.advance(CHUNK_SIZE);
+                b.consume(b.size());
+            }
+            break;
+
+          case GROW:
+            for (int i = 0; i < ops; i++) {
+                if (b.free() < CHUNK_SIZE)
+                    b.set_capacity(2*b.capacity() + CHUNK_SIZE);
+                b.put(m_chunk, CHUNK_SIZE);
+                if ((i + 1) % GROW_BATCH == 0) {
+                    b.clear();
+                    b.set_capacity(1);
+                }
+            }
+            break;
+        }
+        Int64 const elapsed = monotonic_micros() - start;
+        value_sink = b.size();
+        return elapsed;
+    }
+
+  private:
+    Pattern const m_pattern;
+    Byte m_chunk[CHUNK_SIZE];
+};
+
+// Inserts, finds or erases integer keys in a Hashtable of up to TABLE_SIZE
+// elements. Each operation is one insertion, lookup or erasure. Keys are
+// scattered, so that consecutive operations touch unrelated slots.
+class Hashtable_benchmark : public Benchmark {
+  public:
+    enum Operation { INSERT, FIND, ERASE };
+
+    enum { TABLE_SIZE = 64*1024 };
+
+    typedef Hashtable<Uint32, Uint32> Table;
+
+    Hashtable_benchmark(string const& name, Operation operation)
+            : Benchmark(name)
+            , m_operation(operation)
+            , m_keys(TABLE_SIZE)
+    {
+        for (int i = 0; i < TABLE_SIZE; i++)
+            m_keys[i] = Uint32(i)*2654435761U;
+    }
+
+    int batch_size() const { return TABLE_SIZE; }
+
+    Int64 run(int ops)
+    {
+        // Only the operation being measured is timed; filling and emptying
+        // the tables around it is not.
+        Int64 elapsed = 0;
+        Uint32 sum = 0;
+        Table found;
+        if (m_operation == FIND)
+            fill(found);
+
+        for (int n = 0; n < ops; n += TABLE_SIZE) {
+            Table t;
+            if (m_operation == ERASE)
+                fill(t);
+
+            Int64 const start = monotonic_micros();
+            switch (m_operation) {
+              case INSERT:
+                for (int i = 0; i < TABLE_SIZE; i++)
+                    t.insert(m_keys[i], i);
+                break;
+
+              case FIND:
+                for (int i = 0; i < TABLE_SIZE; i++)
+                    sum += found.find(m_keys[i])->second;
+                break;
+
+              case ERASE:
+                for (int i = 0; i < TABLE_SIZE; i++)
+                    sum += t.erase(m_keys[i]);
+                break;
+            }
+            elapsed += monotonic_micros() - start;
+            sum += t.size();
+        }
+        value_sink = sum;
+        return elapsed;
+    }
+
+  private:
+    void fill(Table& t) const
+    {
+        for (int i = 0; i < TABLE_SIZE; i++)
+            t.insert(m_keys[i], i);
+    }
+
+    Operation const m_operation;
+    vector<Uint32> m_keys;
+};
+
+// Collects everything sent to it in a buffer.
+class Buffer_sink : public Sink {
+  public:
+    void send(Buffer const& b)
+    {
+        m_buffer.set_min_capacity(m_buffer.size() + b.size());
+        m_buffer.put(b);
+    }
+
+    Buffer& buffer() { return m_buffer; }
+
+  private:
+    Buffer m_buffer;
+};
+
+// Counts the messages sent to it.
+class Counting_sink : public Sink {
+  public:
+    Counting_sink() : m_count(0) {}
+
+    void send(Buffer const&) { ++m_count; }
+
+    int count() const { return m_count; }
+
+  private:
+    int m_count;
+};
+
+// Parses messages of one size with a Message_reader. Each operation is one
+// message. Messages are parsed from a copy of a stream written once by a
+// Message_writer; making the copy is timed, since a socket read makes one
+// too.
+class Reader_benchmark : public Benchmark {
+  public:
+    enum { STREAM_SIZE = 256*1024 };
+
+    Reader_benchmark(string const& name, int message_size, int packet_size,
+                     Message_framing framing)
+            : Benchmark(name)
+            , m_message_size(message_size)
+            , m_packet_size(packet_size)
+            , m_framing(framing)
+            , m_batch(max(1, int(STREAM_SIZE)/message_size))
+    {}
+
+    int batch_size() const { return m_batch; }
+
+    Int64 run(int ops)
+    {
+        Buffer_sink stream;
+        Message_writer writer(stream);
+        writer.set_max_packet_size(m_packet_size);
+        writer.set_framing(m_framing);
+        vector<Byte> data(m_message_size);
+        for (int i = 0; i < m_message_size; i++)
+            data[i] = Byte(i);
+        for (int i = 0; i < m_batch; i++) {
+            writer.begin_message();
+            writer.put_bytes(&data[0], m_message_size);
+            writer.end_message();
+        }
+
+        Counting_sink messages;
+        Message_reader reader(messages);
+        reader.set_max_packet_size(m_packet_size);
+        reader.set_max_message_size(m_message_size + 1024);
+        Buffer input(stream.buffer().size());
+
+        Int64 const start = monotonic_micros();
+        for (int n = 0; n < ops; n += m_batch) {
+            input.assign(stream.buffer().begin(), stream.buffer().size());
+            reader.read_messages(input);
+        }
+        Int64 const elapsed = monotonic_micros() - start;
+        if (messages.count() != ops)
+            throw Internal_error("s", "reader lost messages");
+        return elapsed;
+    }
+
+  private:
+    int const m_message_size;
+    int const m_packet_size;
+    Message_framing const m_framing;
+    int const m_batch;
+};
+
+// Encodes or decodes integers with the bin_util functions. Each operation
+// is one value. The values have a mix of magnitudes, so that the variable
+// length encodings are not all one length.
+class Codec_benchmark : public Benchmark {
+  public:
+    enum Codec {
+        PACK_UINT32,
+        UNPACK_UINT32,
+        PACK_UINT64,
+        UNPACK_UINT64,
+        ENCODE_VARINT32,
+        DECODE_VARINT32,
+        COMPRESS_UINT32,
+        DECOMPRESS_UINT32,
+        COMPRESS_UINT32_ARRAY,
+        DECOMPRESS_UINT32_ARRAY,
+    };
+
+    enum { NUM_VALUES = 4096 };
+
+    Codec_benchmark(string const& name, Codec codec)
+            : Benchmark(name)
+            , m_codec(codec)
+            , m_values(NUM_VALUES)
+            , m_buf(8*NUM_VALUES)
+    {
+        for (int i = 0; i < NUM_VALUES; i++)
+            m_values[i] = Uint32(Random::next_int(0x10000)) <<
+                          Random::next_int(17);
+    }
+
+    int batch_size() const { return NUM_VALUES; }
+
+    Int64 run(int ops)
+    {
+        // Fills the buffer for the decoders.
+        int size = 0;
+        switch (m_codec) {
+          case UNPACK_UINT32:
+            for (int i = 0; i < NUM_VALUES; i++)
+                pack_uint32(&m_buf[4*i], m_values[i]);
+            break;
+
+          case UNPACK_UINT64:
+            for (int i = 0; i < NUM_VALUES; i++)
+                pack_uint64(&m_buf[8*i], Uint64(m_values[i]) << 16);
+            break;
+
+          case DECODE_VARINT32:
+            for (int i = 0; i < NUM_VALUES; i++)
+                size += encode_varint32(&m_buf[size], m_values[i]);
+            break;
+
+          case DECOMPRESS_UINT32:
+            for (int i = 0; i < NUM_VALUES; i++)
+                size += compress_uint32(&m_buf[size], m_values[i]);
+            break;
+
+          case DECOMPRESS_UINT32_ARRAY:
+            size = compress_uint32_array(&m_buf[0], &m_values[0],
+                                         NUM_VALUES);
+            break;
+
+          default:
+            break;
+        }
+
+        Byte* const buf = &m_buf[0];
+        Uint32 const* const values = &m_values[0];
+        vector<Uint32> decoded(NUM_VALUES);
+        Uint32 sum = 0;
+        Int64 const start = monotonic_micros();
+        for (int n = 0; n < ops; n += NUM_VALUES) {
+            Byte* p = buf;
+            switch (m_codec) {
+              case PACK_UINT32:
+                for (int i = 0; i < NUM_VALUES; i++, p += 4)
+                    pack_uint32(p, values[i]);
+                break;
+
+              case UNPACK_UINT32:
+                for (int i = 0; i < NUM_VALUES; i++, p += 4)
+                    sum += unpack_uint32(p);
+                break;
+
+              case PACK_UINT64:
+                for (int i = 0; i < NUM_VALUES; i++, p += 8)
+                    pack_uint64(p, Uint64(values[i]) << 16);
+                break;
+
+              case UNPACK_UINT64:
+                for (int i = 0; i < NUM_VALUES; i++, p += 8)
+                    sum += Uint32(unpack_uint64(p) >> 16);
+                break;
+
+              case ENCODE_VARINT32:
+                for (int i = 0; i < NUM_VALUES; i++)
+                    p += encode_varint32(p, values[i]);
+                break;
+
+              case DECODE_VARINT32:
+                for (int i = 0; i < NUM_VALUES; i++)
+                    p += decode_varint32(p, buf + size - p, decoded[i]);
+                break;
+
+              case COMPRESS_UINT32:
+                for (int i = 0; i < NUM_VALUES; i++)
+                    p += compress_uint32(p, values[i]);
+                break;
+
+              case DECOMPRESS_UINT32:
+                for (int i = 0; i < NUM_VALUES; i++)
+                    p += decompress_uint32(p, decoded[i]);
+                break;
+
+              case COMPRESS_UINT32_ARRAY:
+                p += compress_uint32_array(p, values, NUM_VALUES);
+                break;
+
+              case DECOMPRESS_UINT32_ARRAY:
+                p += decompress_uint32_array(p, size, &decoded[0],
+                                             NUM_VALUES);
+                break;
+            }
+            sum += decoded[0] + Uint32(p - buf);
+        }
+        Int64 const elapsed = monotonic_micros() - start;
+        value_sink = sum;
+
+        if (size > 0 && decoded != m_values)
+            throw Internal_error("s", "decoded values do not match");
+        return elapsed;
+    }
+
+  private:
+    Codec const m_codec;
+    vector<Uint32> m_values;
+    vector<Byte> m_buf;
+};
+
+// The measurements of one benchmark.
+struct Result {
+    string m_name;
+    int m_ops;                      // operations per repetition
+    vector<double> m_nanos;         // time per operation, per repetition
+    double m_min;
+    double m_median;
+    double m_mean;
+    double m_stddev;                // sample standard deviation
+    double m_max;
+};
+
+// Returns n rounded up to a multiple of m.
+int round_up(double n, int m)
+{
+    double const rounded = ceil(n/m)*m;
+    return rounded < m ? m : rounded > 1e9 ? int(1e9/m)*m : int(rounded);
+}
+
+// Returns the number of operations one repetition of b should perform: the
+// number that takes about rep_millis milliseconds, found by running b with
+// increasing numbers of operations. The runs also warm b up.
+int calibrate(Benchmark& b)
+{
+    int const batch = b.batch_size();
+    if (num_ops > 0)
+        return round_up(num_ops, batch);
+
+    Int64 const target = Int64(rep_millis)*1000;
+    int ops = batch;
+    for (;;) {
+        Int64 const micros = b.run(ops);
+        if (micros >= target/8 || ops >= 1e9/8)
+            return round_up(double(ops)*target/max(micros, Int64(1)), batch);
+        ops *= 8;
+    }
+}
+
+// Runs b, and returns its measurements.
+Result measure(Benchmark& b)
+{
+    Result r;
+    r.m_name = b.name();
+    r.m_ops = calibrate(b);
+    for (int i = 0; i < num_warmups; i++)
+        b.run(r.m_ops);
+    for (int i = 0; i < num_reps; i++)
+        r.m_nanos.push_back(1000.0*b.run(r.m_ops)/r.m_ops);
+
+    vector<double> sorted(r.m_nanos);
+    sort(sorted.begin(), sorted.end());
+    int const n = sorted.size();
+    r.m_min = sorted.front();
+    r.m_max = sorted.back();
+    r.m_median = n % 2 ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2])/2;
+    r.m_mean = 0;
+    for (int i = 0; i < n; i++)
+        r.m_mean += sorted[i];
+    r.m_mean /= n;
+    double squares = 0;
+    for (int i = 0; i < n; i++)
+        squares += (sorted[i] - r.m_mean)*(sorted[i] - r.m_mean);
+    r.m_stddev = n > 1 ? sqrt(squares/(n - 1)) : 0;
+    return r;
+}
+
+// Creates every benchmark, in the order they are run.
+void create_benchmarks(vector<Benchmark*>& v)
+{
+    int const n = num_threads;
+    v.push_back(new Queue_benchmark<Shared_queue_policy>(
+        "shared_queue/1p1c", 1, 1));
+    v.push_back(new Queue_benchmark<Shared_queue_policy>(
+        format("shared_queue/%dp1c", n), n, 1));
+    v.push_back(new Queue_benchmark<Shared_queue_policy>(
+        format("shared_queue/%dp%dc", n, n), n, n));
+    v.push_back(new Queue_benchmark<Sync_queue_policy>(
+        "sync_queue/1p1c", 1, 1));
+    v.push_back(new Queue_benchmark<Sync_queue_policy>(
+        format("sync_queue/%dp1c", n), n, 1));
+    v.push_back(new Queue_benchmark<Sync_queue_policy>(
+        format("sync_queue/%dp%dc", n, n), n, n));
+
+    v.push_back(new Allocator_benchmark("fixed_allocator/1", false, 1));
+    v.push_back(new Allocator_benchmark("fixed_allocator/1024", false, 1024));
+    v.push_back(new Allocator_benchmark("malloc/1", true, 1));
+    v.push_back(new Allocator_benchmark("malloc/1024", true, 1024));
+
+    v.push_back(new Buffer_benchmark("buffer/put_consume",
+                                     Buffer_benchmark::PUT_CONSUME));
+    v.push_back(new Buffer_benchmark("buffer/stream",
+                                     Buffer_benchmark::STREAM));
+    v.push_back(new Buffer_benchmark("buffer/direct",
+                                     Buffer_benchmark::DIRECT));
+    v.push_back(new Buffer_benchmark("buffer/grow", Buffer_benchmark::GROW));
+
+    v.push_back(new Hashtable_benchmark("hashtable/insert",
+                                        Hashtable_benchmark::INSERT));
+    v.push_back(new Hashtable_benchmark("hashtable/find",
+                                        Hashtable_benchmark::FIND));
+    v.push_back(new Hashtable_benchmark("hashtable/erase",
+                                        Hashtable_benchmark::ERASE));
+
+    // Messages that fill one packet each, then messages chained across
+    // default-sized packets, then the same in single frames.
+    int const packet_sizes[] = { 64, 512, 4096, 65536 };
+    for (unsigned i = 0; i < sizeof(packet_sizes)/sizeof(packet_sizes[0]);
+         i++)
+    {
+        int const size = packet_sizes[i];
+        v.push_back(new Reader_benchmark(
+            format("message_reader/%d/%d", size, size),
+            size - 7, size, FRAMING_CHAINED));
+    }
+    v.push_back(new Reader_benchmark("message_reader/65536/4096", 65536,
+                                     4096, FRAMING_CHAINED));
+    v.push_back(new Reader_benchmark("message_reader/65536/single", 65536,
+                                     4096, FRAMING_SINGLE));
+
+    struct {
+        char const* m_name;
+        Codec_benchmark::Codec m_codec;
+    } const codecs[] = {
+        { "bin_util/pack_uint32", Codec_benchmark::PACK_UINT32 },
+        { "bin_util/unpack_uint32", Codec_benchmark::UNPACK_UINT32 },
+        { "bin_util/pack_uint64", Codec_benchmark::PACK_UINT64 },
+        { "bin_util/unpack_uint64", Codec_benchmark::UNPACK_UINT64 },
+        { "bin_util/encode_varint32", Codec_benchmark::ENCODE_VARINT32 },
+        { "bin_util/decode_varint32", Codec_benchmark::DECODE_VARINT32 },
+        { "bin_util/compress_uint32", Codec_benchmark::COMPRESS_UINT32 },
+        { "bin_util/decompress_uint32",
+          Codec_benchmark::DECOMPRESS_UINT32 },
+        { "bin_util/compress_uint32_array",
+          Codec_benchmark::COMPRESS_UINT32_ARRAY },
+        { "bin_util/decompress_uint32_array",
+          Codec_benchmark::DECOMPRESS_UINT32_ARRAY },
+    };
+    for (unsigned i = 0; i < sizeof(codecs)/sizeof(codecs[0]); i++)
+        v.push_back(new Codec_benchmark(codecs[i].m_name, codecs[i].m_codec));
+}
+
+// Prints a result as a line of a table.
+void print_text(Result const& r)
+{
+    printf("%-34s %10d %9.2f %9.2f %9.2f %8.2f\n", r.m_name.c_str(),
+           r.m_ops, r.m_min, r.m_median, r.m_mean, r.m_stddev);
+    fflush(stdout);
+}
+
+// Prints the results as one JSON object.
+void print_json(vector<Result> const& results)
+{
+    printf("{\"reps\":%d,\"warmup\":%d,\"rep_millis\":%d,\"results\":[",
+           num_reps, num_warmups, rep_millis);
+    for (int i = 0; i < int(results.size()); i++) {
+        Result const& r = results[i];
+        printf("%s{\"name\":\"%s\",\"ops\":%d,\"min_ns\":%.3f,"
+               "\"median_ns\":%.3f,\"mean_ns\":%.3f,\"stddev_ns\":%.3f,"
+               "\"max_ns\":%.3f,\"ns\":[", i ? "," : "", r.m_name.c_str(),
+               r.m_ops, r.m_min, r.m_median, r.m_mean, r.m_stddev, r.m_max);
+        for (int j = 0; j < int(r.m_nanos.size()); j++)
+            printf("%s%.3f", j ? "," : "", r.m_nanos[j]);
+        printf("]}");
+    }
+    printf("]}\n");
+}
+}
+
+int main(int argc, char** argv) try
+{
+    Cmdline_arg_parser args(argc, argv);
+
+    // Display help message if requested.
+    if (args.exists("help"))
+        if (boost::to_lower_copy(args.get_string("help")) != "n")
+            display_usage();
+
+    // Process command-line arguments.
+    if (args.exists("filter"))
+        filter = args.get_string("filter");
+    if (args.exists("reps"))
+        num_reps = max(1, args.get_int("reps"));
+    if (args.exists("warmup"))
+        num_warmups = max(0, args.get_int("warmup"));
+    if (args.exists("repmillis"))
+        rep_millis = max(1, args.get_int("repmillis"));
+    if (args.exists("ops"))
+        num_ops = args.get_int("ops");
+    if (args.exists("threads"))
+        num_threads = max(1, args.get_int("threads"));
+    json = args.exists("json") &&
+           boost::to_lower_copy(args.get_string("json")) != "n";
+    bool const list = args.exists("list") &&
+                      boost::to_lower_copy(args.get_string("list")) != "n";
+
+    Random::seed(current_time());
+
+    vector<Benchmark*> benchmarks;
+    create_benchmarks(benchmarks);
+
+    if (!json && !list)
+        printf("%-34s %10s %9s %9s %9s %8s\n", "benchmark (ns/op)", "ops",
+               "min", "median", "mean", "stddev");
+    vector<Result> results;
+    for (int i = 0; i < int(benchmarks.size()); i++) {
+        Benchmark& b = *benchmarks[i];
+        if (b.name().find(filter) == string::npos)
+            continue;
+        if (list) {
+            printf("%s\n", b.name().c_str());
+            continue;
+        }
+        results.push_back(measure(b));
+        if (!json)
+            print_text(results.back());
+    }
+    if (json)
+        print_json(results);
+
+    for_each(benchmarks.begin(), benchmarks.end(), delete_fun<Benchmark>);
+    return 0;
+}
+catch (Exception& e) {
+    fprintf(stderr, "main: FATAL: %s\n", e.to_string().c_str());
+    return 1;
+}
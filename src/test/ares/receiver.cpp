@@ -7,11 +7,13 @@
 // DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
 
 #include "ares/buffer.hpp"
+#include "ares/cmdline_arg_parser.hpp"
 #include "ares/net_tk.hpp"
 #include "ares/random.hpp"
 #include "ares/socket.hpp"
 #include "ares/socket_acceptor.hpp"
 #include "ares/receiver.hpp"
+#include "ares/string_util.hpp"
 #include "ares/thread.hpp"
 #include <assert.h>
 
@@ -60,6 +62,8 @@ class Test_server : public Server_interface {
     void enqueue_command(Command*) {}
     void enqueue_delayed_command(Command*, int) {}
     void dispatch(Session, Buffer*) {}
+    void dispatch(Session, Gather_list const&) {}
+    bool is_output_idle(Session) { return true; }
     job::Scheduler& scheduler() { return m_scheduler; }
     void shutdown() {}
     Date started() const { return Date(); }
@@ -122,6 +126,14 @@ class Listener : public Thread::Runnable {
 
 int main(int argc, char** argv) try
 {
+    // IO_URING=Y reads through io_uring; SHARED_BUFFERS=Y makes the sessions
+    // share input buffers.
+    Cmdline_arg_parser args(argc, argv);
+    bool use_io_uring = args.exists("io_uring")
+        && boost::to_lower_copy(args.get_string("io_uring")) != "n";
+    bool use_shared_buffers = args.exists("shared_buffers")
+        && boost::to_lower_copy(args.get_string("shared_buffers")) != "n";
+
     Random::seed(current_time());
 
     //
@@ -144,8 +156,12 @@ int main(int argc, char** argv) try
     //
     Test_server server;
     Receiver receiver(server);
+    receiver.use_io_uring(use_io_uring);
+    receiver.use_shared_input_buffers(use_shared_buffers);
     printf("main: starting independent receiver thread\n");
     receiver.startup();
+    if (receiver.is_using_io_uring())
+        printf("main: receiver is using io_uring\n");
     printf("main: creating listener thread\n");
     Thread(new Listener(server, receiver)).start();
     printf("main: sleeping for 200 ms\n");
@@ -226,6 +242,20 @@ int main(int argc, char** argv) try
             }
         }
         if (success) {
+            Receiver_statistics stats = receiver.statistics();
+            printf("receiver: reads: %d\n", int(stats.reads()));
+            printf("receiver: bytes_per_read: %d\n", stats.bytes_per_read());
+            printf("receiver: reads_per_event: %.2f\n",
+                   stats.reads_per_event());
+            printf("receiver: buffer_grows: %d\n",
+                   int(stats.buffer_grows()));
+            printf("receiver: buffer_shrinks: %d\n",
+                   int(stats.buffer_shrinks()));
+            printf("receiver: attached_buffers_snap: %d\n",
+                   stats.attached_buffers_snap());
+            printf("receiver: pooled_buffers_snap: %d\n",
+                   stats.pooled_buffers_snap());
+
             receiver.shutdown();
             for_each(sockets.begin(), sockets.end(), delete_fun<Socket>);
             printf("main: OK: data sent and data received match\n");
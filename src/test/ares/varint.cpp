@@ -0,0 +1,152 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "ares/bin_util.hpp"
+#include "ares/cmdline_arg_parser.hpp"
+#include "ares/platform.hpp"
+#include "ares/random.hpp"
+#include "ares/string_util.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+int num_values = 1000000;           // integers per array
+int num_passes = 100;               // number of decodes per measurement
+volatile Uint32 value_sink;         // keeps decoding from being optimized away
+
+// Print usage instructions to stdout, then exit the program.
+void display_usage()
+{
+    printf("\n"
+           "varint: Measure the size and speed of integer array encodings.\n"
+           "\n"
+           "Encodes arrays of random integers of several magnitudes with\n"
+           "compress_uint32, one value at a time, and with\n"
+           "compress_uint32_array, then reports the encoded sizes and the\n"
+           "decoding throughput of each. Keywords are NOT case sensitive:\n"
+           "\n"
+           "    Format: varint KEYWORD=value (KEYWORD=value ...)\n"
+           "    Example: varint NVALUES=100000 NPASSES=1000\n"
+           "\n"
+           "Keyword         Description (Default)\n"
+           "------------------------------------------------------------\n"
+           "HELP            if 'Y', displays this message and exits (N)\n"
+           "NVALUES         number of integers per array (1000000)\n"
+           "NPASSES         number of decodes per measurement (100)\n"
+           "\n");
+    exit(0);
+}
+
+// Prints a decoding measurement.
+void report(char const* what, int bytes, Int64 millis)
+{
+    Int64 total = Int64(num_values)*num_passes;
+    double mvalues_per_sec = millis == 0 ? 0 : total/1e6/(millis/1000.0);
+    printf("  %-32s %9d bytes %6.2f bytes/value %8.1f Mvalues/s\n", what,
+           bytes, 1.0*bytes/num_values, mvalues_per_sec);
+}
+
+// Encodes and decodes num_values integers below max_value.
+bool measure(Uint32 max_value)
+{
+    vector<Uint32> values(num_values);
+    for (int i = 0; i < num_values; i++)
+        values[i] = (Uint32(Random::next_int(0x10000)) << 16 |
+                     Uint32(Random::next_int(0x10000))) % max_value;
+
+    vector<Uint32> decoded(num_values);
+    vector<Byte> buf(5*num_values);
+    Uint32 sum = 0;
+    printf("values below %u:\n", max_value);
+
+    // One at a time.
+    int size = 0;
+    for (int i = 0; i < num_values; i++)
+        size += compress_uint32(&buf[size], values[i]);
+
+    Int64 start = current_time_millis();
+    for (int pass = 0; pass < num_passes; pass++) {
+        Byte const* p = &buf[0];
+        for (int i = 0; i < num_values; i++)
+            p += decompress_uint32(p, decoded[i]);
+        sum += decoded[pass % num_values];
+    }
+    report("decompress_uint32", size, current_time_millis() - start);
+    if (decoded != values)
+        return false;
+
+    // As an array, with each decoder.
+    size = compress_uint32_array(&buf[0], &values[0], num_values);
+    for (int simd = 0; simd < 2; simd++) {
+        if (simd && !is_uint32_array_simd_supported()) {
+            printf("  %-32s (not supported)\n", "decompress_uint32_array");
+            break;
+        }
+
+        decoded.assign(num_values, 0);
+        start = current_time_millis();
+        for (int pass = 0; pass < num_passes; pass++) {
+            int n = simd
+                    ? decompress_uint32_array(&buf[0], size, &decoded[0],
+                                              num_values)
+                    : decompress_uint32_array_generic(&buf[0], size,
+                                                      &decoded[0],
+                                                      num_values);
+            if (n != size)
+                return false;
+            sum += decoded[pass % num_values];
+        }
+        report(simd ? "decompress_uint32_array"
+                    : "decompress_uint32_array_generic", size,
+               current_time_millis() - start);
+        if (decoded != values)
+            return false;
+    }
+
+    value_sink = sum;
+    return true;
+}
+}
+
+int main(int argc, char** argv) try
+{
+    Cmdline_arg_parser args(argc, argv);
+
+    // Display help message if requested.
+    if (args.exists("help"))
+        if (boost::to_lower_copy(args.get_string("help")) != "n")
+            display_usage();
+
+    // Process command-line arguments.
+    if (args.exists("nvalues"))
+        num_values = args.get_int("nvalues");
+    if (args.exists("npasses"))
+        num_passes = args.get_int("npasses");
+
+    Random::seed(current_time());
+
+    Uint32 const max_values[] = { 200, 60000, 16000000, 0xFFFFFFFF };
+    for (unsigned i = 0; i < sizeof(max_values)/sizeof(max_values[0]); i++) {
+        if (!measure(max_values[i])) {
+            printf("main: FATAL: decoded values do not match\n");
+            return 1;
+        }
+    }
+
+    printf("main: OK\n");
+    return 0;
+}
+catch (Exception& e) {
+    fprintf(stderr, "main: FATAL: %s\n", e.to_string().c_str());
+    return 1;
+}
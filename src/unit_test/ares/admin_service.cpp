@@ -0,0 +1,251 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/admin_service.hpp"
+#include "ares/http/error.hpp"
+#include "ares/http/http.hpp"
+#include "ares/server.hpp"
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+Server_statistics make_statistics()
+{
+    Server_statistics stats;
+    stats.m_elapsed_sec = 60;
+    stats.m_sessions_snap = 3;
+    stats.m_queued_updates_snap = 0;
+    stats.m_events = 100;
+    stats.m_reads = 90;
+    stats.m_bytes_read = Int64(5) << 32;
+    stats.m_buffer_grows = 1;
+    stats.m_buffer_shrinks = 2;
+    stats.m_output_sessions_snap = 1;
+    stats.m_queued_dispatches_snap = 4;
+    stats.m_output_buffers_snap = 5;
+    stats.m_output_bytes_snap = 6;
+    stats.m_writes = 7;
+    stats.m_zero_writes = 8;
+    stats.m_bytes_sent = 9;
+    stats.m_buffers_added = 10;
+    stats.m_buffers_sent = 11;
+    stats.m_blocked_sends = 12;
+    stats.m_dropped_buffers = 13;
+    stats.m_disconnects = 14;
+    stats.m_commands_executed.push_back(15);
+    stats.m_commands_executed.push_back(16);
+    return stats;
+}
+
+bool contains(string const& s, string const& part)
+{
+    return s.find(part) != string::npos;
+}
+}
+
+class Admin_service_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_prometheus()
+    {
+        string s = statistics_to_prometheus(make_statistics());
+        CPPUNIT_ASSERT(contains(s, "# TYPE ares_uptime_seconds gauge\n"
+                                   "ares_uptime_seconds 60\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_receiver_read_bytes_total "
+                                   "21474836480\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_dispatcher_disconnects_total "
+                                   "14\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_commands_executed_total"
+                                   "{processor=\"1\"} 16\n"));
+        CPPUNIT_ASSERT(contains(s, "# TYPE ares_receiver_input_latency_"
+                                   "seconds summary\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_queue_latency_seconds"
+                                   "{quantile=\"0.99\"} 0.000000\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_queue_latency_seconds_"
+                                   "count 0\n"));
+        CPPUNIT_ASSERT_EQUAL('\n', s[s.size() - 1]);
+    }
+
+    void test_json()
+    {
+        string s = statistics_to_json(make_statistics());
+        CPPUNIT_ASSERT(contains(s, "\"elapsed_sec\": 60,"));
+        CPPUNIT_ASSERT(contains(s, "\"bytes_read\": 21474836480,"));
+        CPPUNIT_ASSERT(contains(s, "\"commands_executed\": [15, 16],"));
+        CPPUNIT_ASSERT(contains(s, "\"flush_latency\": {\"count\": 0,"));
+        CPPUNIT_ASSERT_EQUAL(string("{\n"), s.substr(0, 2));
+        CPPUNIT_ASSERT_EQUAL(string("\n}\n"), s.substr(s.size() - 3));
+    }
+
+    void test_commands()
+    {
+        Server_statistics stats;
+        stats.m_commands.resize(1);
+        stats.m_commands[0].m_name = "Login_command";
+        string s = statistics_to_prometheus(stats);
+        CPPUNIT_ASSERT(contains(s, "\nares_command_execution_latency_"
+                                   "seconds{command=\"Login_command\","
+                                   "quantile=\"0.5\"} 0.000000\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_command_queue_latency_seconds_"
+                                   "sum{command=\"Login_command\"} "
+                                   "0.000000\n"));
+        s = statistics_to_json(stats);
+        CPPUNIT_ASSERT(contains(s, "\"name\": \"Login_command\",\n"));
+    }
+
+    void test_placement()
+    {
+        Server_statistics stats;
+        stats.m_placement.resize(1);
+        stats.m_placement[0].m_name = "rcvr";
+        stats.m_placement[0].m_cpus = parse_cpu_list("0-3,8");
+        stats.m_placement[0].m_nodes.insert(0);
+        string const s = statistics_to_json(stats);
+        CPPUNIT_ASSERT(contains(s, "\"cpus\": \"0-3,8\",\n"));
+        CPPUNIT_ASSERT(contains(s, "\"nodes\": [0]\n"));
+    }
+
+    void test_scaling()
+    {
+        Server_statistics stats;
+        stats.m_busy_micros = 2500000;
+        stats.m_processor_grows = 3;
+        string s = statistics_to_prometheus(stats);
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_busy_seconds_total "
+                                   "2.500000\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_scaling_grows_total "
+                                   "3\n"));
+        s = statistics_to_json(stats);
+        CPPUNIT_ASSERT(contains(s, "\"grows\": 3,"));
+    }
+
+    void test_priorities()
+    {
+        Server_statistics stats;
+        stats.m_queued_by_priority_snap.push_back(0);
+        stats.m_queued_by_priority_snap.push_back(1);
+        stats.m_queued_by_priority_snap.push_back(2);
+        stats.m_commands_dropped = 3;
+        string s = statistics_to_prometheus(stats);
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_queued_commands_by_"
+                                   "priority{priority=\"low\"} 2\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_processor_commands_dropped_total "
+                                   "3\n"));
+        s = statistics_to_json(stats);
+        CPPUNIT_ASSERT(contains(s, "\"queued_by_priority\": {\n"
+                                   "      \"high\": 0,\n"
+                                   "      \"normal\": 1,\n"
+                                   "      \"low\": 2\n"
+                                   "    },"));
+        CPPUNIT_ASSERT(contains(s, "\"commands_dropped\": 3,"));
+    }
+
+    void test_admission()
+    {
+        Server_statistics stats;
+        stats.m_overloaded_snap = true;
+        stats.m_rejected_connections = 3;
+        string s = statistics_to_prometheus(stats);
+        CPPUNIT_ASSERT(contains(s, "\nares_listener_overloaded 1\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_listener_rejected_connections_"
+                                   "total 3\n"));
+        s = statistics_to_json(stats);
+        CPPUNIT_ASSERT(contains(s, "\"listeners\": {\n"
+                                   "    \"overloaded\": true,\n"
+                                   "    \"admission_closures\": 0,\n"
+                                   "    \"rejected_connections\": 3\n"
+                                   "  },"));
+    }
+
+    void test_receiver_buffers()
+    {
+        Server_statistics stats;
+        stats.m_attached_buffers_snap = 3;
+        stats.m_pooled_buffers_snap = 4;
+        string s = statistics_to_prometheus(stats);
+        CPPUNIT_ASSERT(contains(s, "\nares_receiver_attached_buffers 3\n"));
+        CPPUNIT_ASSERT(contains(s, "\nares_receiver_pooled_buffers 4\n"));
+        s = statistics_to_json(stats);
+        CPPUNIT_ASSERT(contains(s, "\"attached_buffers\": 3,"));
+        CPPUNIT_ASSERT(contains(s, "\"pooled_buffers\": 4,"));
+        s = stats.to_string();
+        CPPUNIT_ASSERT(contains(s, "rcvr.attached_buffers_snap"));
+    }
+
+    void test_jobs()
+    {
+        CPPUNIT_ASSERT_EQUAL(string("[]\n"),
+                             jobs_to_json(vector<job::Job_info>()));
+
+        vector<job::Job_info> jobs(2);
+        jobs[0].m_id = 1;
+        jobs[0].m_next_date = Date(2007, 1, 2, 3, 4, 5);
+        jobs[0].m_num_failures = 2;
+        jobs[0].m_last_failure = "said \"no\"\n";
+        jobs[1].m_id = 2;
+        jobs[1].m_is_running = true;
+
+        string s = jobs_to_json(jobs);
+        CPPUNIT_ASSERT(contains(s, "\"id\": 1,"));
+        CPPUNIT_ASSERT(contains(s, "\"next_date\": "
+                                   "\"2007-01-02 03:04:05\","));
+        CPPUNIT_ASSERT(contains(s, "\"failures\": 2,"));
+        CPPUNIT_ASSERT(contains(s, "\"last_failure\": "
+                                   "\"said \\\"no\\\"\\u000a\""));
+
+        // Only the ID of a running job is reported.
+        string const running = s.substr(s.find("\"id\": 2"));
+        CPPUNIT_ASSERT(contains(running, "\"running\": true\n"));
+        CPPUNIT_ASSERT(!contains(running, "next_date"));
+    }
+
+    void test_render()
+    {
+        Server server;
+        Admin_strategy admin(server);
+        string content_type;
+
+        string s = admin.render("/metrics", content_type);
+        CPPUNIT_ASSERT(contains(content_type, "text/plain"));
+        CPPUNIT_ASSERT(contains(s, "ares_receiver_sessions 0\n"));
+
+        s = admin.render("/sessions", content_type);
+        CPPUNIT_ASSERT_EQUAL(string("application/json"), content_type);
+        CPPUNIT_ASSERT_EQUAL(string("[]\n"), s);
+
+        try {
+            admin.render("/", content_type);
+            CPPUNIT_ASSERT(false);
+        }
+        catch (http::Client_error& e) {
+            CPPUNIT_ASSERT_EQUAL(int(http::Codes::NOT_FOUND), e.code());
+        }
+    }
+
+    CPPUNIT_TEST_SUITE(Admin_service_tests);
+    CPPUNIT_TEST(test_prometheus);
+    CPPUNIT_TEST(test_json);
+    CPPUNIT_TEST(test_commands);
+    CPPUNIT_TEST(test_placement);
+    CPPUNIT_TEST(test_scaling);
+    CPPUNIT_TEST(test_priorities);
+    CPPUNIT_TEST(test_admission);
+    CPPUNIT_TEST(test_receiver_buffers);
+    CPPUNIT_TEST(test_jobs);
+    CPPUNIT_TEST(test_render);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Admin_service_tests);
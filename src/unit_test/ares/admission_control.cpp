@@ -0,0 +1,209 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/admin_service.hpp"
+#include "ares/admission_control.hpp"
+#include "ares/command.hpp"
+#include "ares/listener_strategy.hpp"
+#include "ares/platform.hpp"
+#include "ares/server.hpp"
+#include "ares/service.hpp"
+#include "ares/socket.hpp"
+#include <memory>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+Server_load make_load(int queued_commands, Int64 pending_output,
+                      int sessions)
+{
+    Server_load load;
+    load.m_queued_commands = queued_commands;
+    load.m_pending_output = pending_output;
+    load.m_sessions = sessions;
+    return load;
+}
+
+// Counts the connections it is given, and closes them.
+class Counting_strategy : public Listener_strategy {
+  public:
+    Counting_strategy() : m_connections(0) {}
+
+    void handle_connection(Server_interface&, Socket* socket)
+    {
+        delete socket;
+        m_connections++;
+    }
+
+    int volatile m_connections;
+};
+
+class Null_command : public Command {
+  public:
+    void execute(Server_interface&, int) {}
+};
+
+// Connects to the port, sends request, and returns what the server sends
+// before closing the connection (or before a few seconds have passed).
+string read_until_closed(string const& port, string const& request = "")
+{
+    auto_ptr<Socket> socket(connect_tcp("127.0.0.1", port));
+    if (!request.empty()) {
+        socket->write_all(reinterpret_cast<Byte const*>(request.data()),
+                          request.size());
+    }
+    socket->set_blocking(false);
+    string s;
+    for (int i = 0; i < 300; i++) {
+        Byte b[64];
+        int const n = socket->read(b, sizeof(b));
+        if (n < 0)
+            break;
+        if (n == 0)
+            milli_sleep(10);
+        s.append(reinterpret_cast<char const*>(b), n);
+    }
+    return s;
+}
+}
+
+class Admission_control_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_hysteresis()
+    {
+        Admission_limits limits;
+        limits.m_max_queued_commands = 100;
+        limits.m_max_pending_output = 1000;
+        limits.m_resume_fraction = 0.5;
+        Admission_control control(limits);
+        CPPUNIT_ASSERT(!control.is_overloaded());
+
+        // Sessions are not limited.
+        CPPUNIT_ASSERT(control.admit(make_load(99, 999, 1000000)));
+
+        // Reaching any limit closes admission, which stays closed until
+        // every signal has fallen to half of its limit.
+        CPPUNIT_ASSERT(!control.admit(make_load(100, 0, 0)));
+        CPPUNIT_ASSERT(control.is_overloaded());
+        CPPUNIT_ASSERT(!control.admit(make_load(99, 0, 0)));
+        CPPUNIT_ASSERT(!control.admit(make_load(50, 501, 0)));
+        CPPUNIT_ASSERT(control.admit(make_load(50, 500, 0)));
+        CPPUNIT_ASSERT(!control.is_overloaded());
+        CPPUNIT_ASSERT(control.admit(make_load(99, 999, 0)));
+        CPPUNIT_ASSERT(!control.admit(make_load(0, 1000, 0)));
+    }
+
+    void test_limits()
+    {
+        // Without limits, everything is admitted.
+        Admission_control control((Admission_limits()));
+        CPPUNIT_ASSERT(control.admit(make_load(1000000, Int64(1) << 40,
+                                               1000000)));
+
+        Admission_limits limits;
+        limits.m_max_sessions = 10;
+        limits.m_resume_fraction = 2;
+        Admission_control other(limits);
+        CPPUNIT_ASSERT_EQUAL(1.0, other.limits().m_resume_fraction);
+        CPPUNIT_ASSERT(!other.admit(make_load(0, 0, 10)));
+        CPPUNIT_ASSERT(other.admit(make_load(0, 0, 9)));
+    }
+
+    void test_server()
+    {
+        string const port = "27471";
+        Counting_strategy* strategy = new Counting_strategy;
+
+        Admission_limits limits;
+        limits.m_max_queued_commands = 3;
+        limits.m_policy = ADMISSION_REJECT;
+        limits.m_reject_message = "busy\r\n";
+
+        Server server;
+        server.add_service(new Service("admission", "127.0.0.1", port,
+                                       strategy));
+        server.set_admission_limits(limits);
+        server.startup();
+
+        // A backlog of commands closes admission, and new connections are
+        // rejected.
+        server.set_num_processors(0);
+        for (int i = 0; i < 3; i++)
+            server.enqueue_command(new Null_command);
+        for (int i = 0; i < 300 && !server.totals().m_overloaded_snap; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT(server.totals().m_overloaded_snap);
+        CPPUNIT_ASSERT_EQUAL(string("busy\r\n"), read_until_closed(port));
+        CPPUNIT_ASSERT_EQUAL(0, int(strategy->m_connections));
+
+        // Once the backlog is gone, connections are admitted again.
+        server.set_num_processors(1);
+        for (int i = 0; i < 300 && server.totals().m_overloaded_snap; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT(!server.totals().m_overloaded_snap);
+        delete connect_tcp("127.0.0.1", port);
+        for (int i = 0; i < 300 && strategy->m_connections == 0; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT_EQUAL(1, int(strategy->m_connections));
+
+        Server_statistics const stats = server.totals();
+        CPPUNIT_ASSERT_EQUAL(Int64(1), stats.m_admission_closures);
+        CPPUNIT_ASSERT_EQUAL(Int64(1), stats.m_rejected_connections);
+
+        server.shutdown();
+    }
+
+    void test_admin_service()
+    {
+        string const port = "27472";
+        string const admin_port = "27473";
+
+        Admission_limits limits;
+        limits.m_max_queued_commands = 1;
+
+        Server server;
+        server.add_service(new Service("admission", "127.0.0.1", port,
+                                       new Counting_strategy));
+        server.add_service(new Service("admin", "127.0.0.1", admin_port,
+                                       new Admin_strategy(server)));
+        server.set_admission_limits(limits);
+        server.startup();
+
+        // While the server is overloaded, the admin service still answers.
+        server.set_num_processors(0);
+        server.enqueue_command(new Null_command);
+        for (int i = 0; i < 300 && !server.totals().m_overloaded_snap; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT(server.totals().m_overloaded_snap);
+        string const s = read_until_closed(admin_port,
+                                           "GET /metrics HTTP/1.0\r\n\r\n");
+        CPPUNIT_ASSERT_EQUAL(string("HTTP/1."), s.substr(0, 7));
+        CPPUNIT_ASSERT(s.find("\nares_listener_overloaded 1\n")
+                       != string::npos);
+
+        server.set_num_processors(1);
+        server.shutdown();
+    }
+
+    CPPUNIT_TEST_SUITE(Admission_control_tests);
+    CPPUNIT_TEST(test_hysteresis);
+    CPPUNIT_TEST(test_limits);
+    CPPUNIT_TEST(test_server);
+    CPPUNIT_TEST(test_admin_service);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Admission_control_tests);
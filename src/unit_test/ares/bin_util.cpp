@@ -9,6 +9,11 @@
 #include "cppunit/TestFixture.h"
 #include "cppunit/extensions/HelperMacros.h"
 #include "ares/bin_util.hpp"
+#include "ares/buffer.hpp"
+#include "ares/data_reader.hpp"
+#include "ares/data_writer.hpp"
+#include <cstring>
+#include <vector>
 
 using namespace std;
 using namespace ares;
@@ -296,6 +301,239 @@ class Bin_util_tests : public CppUnit::TestFixture {
         }
     }
 
+    void test_pack_int64()
+    {
+        const Int64 test_values[] = {
+            -9223372036854775807LL - 1,
+            -4294967296LL,
+            -1,
+            0,
+            1,
+            4294967295LL,
+            81985529216486895LL,
+            9223372036854775807LL,
+        };
+        const int test_bytes[][8] = {
+            { 128,   0,   0,   0,   0,   0,   0,   0 },
+            { 255, 255, 255, 255,   0,   0,   0,   0 },
+            { 255, 255, 255, 255, 255, 255, 255, 255 },
+            {   0,   0,   0,   0,   0,   0,   0,   0 },
+            {   0,   0,   0,   0,   0,   0,   0,   1 },
+            {   0,   0,   0,   0, 255, 255, 255, 255 },
+            {   1,  35,  69, 103, 137, 171, 205, 239 },
+            { 127, 255, 255, 255, 255, 255, 255, 255 },
+        };
+
+        for (int i = 0; i < nelems(test_values); i++) {
+            Byte buf[9] = {0,0,0,0,0,0,0,0,0};
+            pack_int64(buf+1, test_values[i]);     // unaligned
+            for (int j = 0; j < 8; j++)
+                CPPUNIT_ASSERT_EQUAL(test_bytes[i][j], int(buf[j+1]));
+            CPPUNIT_ASSERT_EQUAL(test_values[i], unpack_int64(buf+1));
+            CPPUNIT_ASSERT_EQUAL(Uint64(test_values[i]),
+                                 unpack_uint64(buf+1));
+        }
+    }
+
+    void test_pack_double()
+    {
+        const double test_values[] = {
+            0.0, -0.0, 1.0, -2.5, 3.141592653589793, 1e-300, 1e300,
+        };
+
+        Byte buf[8];
+        pack_double(buf, 1.0);      // 0x3FF0000000000000
+        CPPUNIT_ASSERT_EQUAL(0x3F, int(buf[0]));
+        CPPUNIT_ASSERT_EQUAL(0xF0, int(buf[1]));
+        for (int j = 2; j < 8; j++)
+            CPPUNIT_ASSERT_EQUAL(0, int(buf[j]));
+
+        for (int i = 0; i < nelems(test_values); i++) {
+            pack_double(buf, test_values[i]);
+            double d = unpack_double(buf);
+            CPPUNIT_ASSERT(memcmp(&d, &test_values[i], sizeof(d)) == 0);
+        }
+    }
+
+    void test_int32_array()
+    {
+        vector<Int32> values;
+        for (int i = 0; i < 1000; i++)
+            values.push_back(Int32(0x9E3779B9U*i));
+
+        vector<Byte> buf(4*values.size() + 1);
+        pack_int32_array(&buf[1], &values[0], values.size());
+        for (unsigned i = 0; i < values.size(); i++)
+            CPPUNIT_ASSERT_EQUAL(values[i], unpack_int32(&buf[1 + 4*i]));
+
+        vector<Int32> result(values.size());
+        unpack_int32_array(&buf[1], &result[0], result.size());
+        CPPUNIT_ASSERT(result == values);
+
+        // Through Data_writer and Data_reader, with the other new types.
+        Buffer buffer(6000);
+        Data_writer writer(buffer);
+        CPPUNIT_ASSERT(writer.put_int64(-81985529216486895LL));
+        CPPUNIT_ASSERT(writer.put_double(-2.5));
+        CPPUNIT_ASSERT(writer.put_int32_array(values));
+        CPPUNIT_ASSERT(writer.put_int32_array(vector<Int32>()));
+        CPPUNIT_ASSERT(!writer.put_int32_array(values));   // no room
+
+        Data_reader reader(buffer);
+        CPPUNIT_ASSERT_EQUAL(Int64(-81985529216486895LL), reader.get_int64());
+        CPPUNIT_ASSERT_EQUAL(-2.5, reader.get_double());
+        CPPUNIT_ASSERT(reader.get_int32_array(result));
+        CPPUNIT_ASSERT(result == values);
+        CPPUNIT_ASSERT(reader.get_int32_array(result));
+        CPPUNIT_ASSERT(result.empty());
+        CPPUNIT_ASSERT(reader);
+        CPPUNIT_ASSERT_EQUAL(0, buffer.size());
+
+        // A count that the buffer cannot hold is an error.
+        Data_writer(buffer).put_int32(2);
+        Data_writer(buffer).put_int32(7);
+        Data_reader short_reader(buffer);
+        CPPUNIT_ASSERT(!short_reader.get_int32_array(result));
+        CPPUNIT_ASSERT_EQUAL(8, buffer.size());
+    }
+
+    void test_varint32()
+    {
+        const Uint32 test_values[][2] = {
+            {          0, 1 },
+            {          1, 1 },
+            {        127, 1 },
+            {        128, 2 },
+            {      16383, 2 },
+            {      16384, 3 },
+            {    2097151, 3 },
+            {    2097152, 4 },
+            {  268435455, 4 },
+            {  268435456, 5 },
+            { 4294967295U, 5 },
+        };
+
+        for (int i = 0; i < nelems(test_values); i++) {
+            Byte buf[] = {0,0,0,0,0};
+            int n = encode_varint32(buf, test_values[i][0]);
+            CPPUNIT_ASSERT_EQUAL(int(test_values[i][1]), n);
+            Uint32 value;
+            for (int j = 0; j < n; j++)
+                CPPUNIT_ASSERT_EQUAL(0, decode_varint32(buf, j, value));
+            CPPUNIT_ASSERT_EQUAL(n, decode_varint32(buf, 5, value));
+            CPPUNIT_ASSERT_EQUAL(test_values[i][0], value);
+        }
+
+        // 300 is the traditional example.
+        Byte buf[5];
+        CPPUNIT_ASSERT_EQUAL(2, encode_varint32(buf, 300));
+        CPPUNIT_ASSERT_EQUAL(0xAC, int(buf[0]));
+        CPPUNIT_ASSERT_EQUAL(0x02, int(buf[1]));
+
+        // Encodings that are too long, or that overflow, are invalid.
+        Uint32 value;
+        Byte const too_long[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+        CPPUNIT_ASSERT_EQUAL(-1, decode_varint32(too_long, 6, value));
+        Byte const overflow[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x1F };
+        CPPUNIT_ASSERT_EQUAL(-1, decode_varint32(overflow, 5, value));
+    }
+
+    void test_compress_uint32_array()
+    {
+        const Uint32 values[] = { 1, 256, 65536, 16777216, 0, 4294967295U };
+        const int bytes[] = {
+            0xE4, 1, 0, 1, 0, 0, 1, 0, 0, 0, 1,    // tag 11 10 01 00
+            0x0C, 0, 0xFF, 0xFF, 0xFF, 0xFF,        // tag 11 00
+        };
+
+        Byte buf[32];
+        int n = compress_uint32_array(buf, values, nelems(values));
+        CPPUNIT_ASSERT_EQUAL(nelems(bytes), n);
+        CPPUNIT_ASSERT_EQUAL(n,
+                compressed_uint32_array_size(values, nelems(values)));
+        CPPUNIT_ASSERT(n <= max_compressed_uint32_array_size(nelems(values)));
+        for (int i = 0; i < n; i++)
+            CPPUNIT_ASSERT_EQUAL(bytes[i], int(buf[i]));
+    }
+
+    void test_decompress_uint32_array()
+    {
+        // Every count from 0 to 64, with values of every length, decoded by
+        // both decoders from a buffer that is exactly the right size (so
+        // that the vector decoder must stop short of the end).
+        for (int count = 0; count <= 64; count++) {
+            vector<Uint32> values(count);
+            for (int i = 0; i < count; i++)
+                values[i] = Uint32(0x9E3779B9U*(i + 1)) >> (8*(i % 4));
+
+            vector<Byte> buf(max_compressed_uint32_array_size(count) + 1);
+            int size = compress_uint32_array(&buf[0],
+                    count ? &values[0] : 0, count);
+            buf.resize(size + 1);
+
+            for (int pass = 0; pass < 2; pass++) {
+                vector<Uint32> decoded(count + 1, 12345);
+                int n = pass == 0
+                        ? decompress_uint32_array_generic(&buf[0], size,
+                                                          &decoded[0], count)
+                        : decompress_uint32_array(&buf[0], size,
+                                                  &decoded[0], count);
+                CPPUNIT_ASSERT_EQUAL(count ? size : 0, n);
+                for (int i = 0; i < count; i++)
+                    CPPUNIT_ASSERT_EQUAL(values[i], decoded[i]);
+                CPPUNIT_ASSERT_EQUAL(Uint32(12345), decoded[count]);
+
+                // Truncated input is never decoded.
+                if (count > 0) {
+                    n = pass == 0
+                        ? decompress_uint32_array_generic(&buf[0], size-1,
+                                                          &decoded[0], count)
+                        : decompress_uint32_array(&buf[0], size-1,
+                                                  &decoded[0], count);
+                    CPPUNIT_ASSERT_EQUAL(0, n);
+                }
+            }
+        }
+    }
+
+    void test_packed_array()
+    {
+        vector<Uint32> ids;
+        for (int i = 0; i < 1000; i++)
+            ids.push_back(i*i);
+
+        Buffer buffer(8192);
+        Data_writer writer(buffer);
+        CPPUNIT_ASSERT(writer.put_varint(300));
+        CPPUNIT_ASSERT(writer.put_uint32_array(ids));
+        CPPUNIT_ASSERT(writer.put_uint32_array(vector<Uint32>()));
+        CPPUNIT_ASSERT(writer.put_int8(7));
+        CPPUNIT_ASSERT(buffer.size() < 3000);
+
+        Data_reader reader(buffer);
+        vector<Uint32> result;
+        CPPUNIT_ASSERT_EQUAL(Uint32(300), reader.get_varint());
+        CPPUNIT_ASSERT(reader.get_uint32_array(result));
+        CPPUNIT_ASSERT(result == ids);
+        CPPUNIT_ASSERT(reader.get_uint32_array(result));
+        CPPUNIT_ASSERT(result.empty());
+        CPPUNIT_ASSERT_EQUAL(Int8(7), reader.get_int8());
+        CPPUNIT_ASSERT(reader);
+        CPPUNIT_ASSERT_EQUAL(0, buffer.size());
+
+        // An array longer than max_count is an error.
+        Data_writer(buffer).put_uint32_array(ids);
+        Data_reader limited(buffer);
+        CPPUNIT_ASSERT(!limited.get_uint32_array(result, 999));
+        CPPUNIT_ASSERT(!limited);
+
+        // So is a count that the buffer cannot possibly hold.
+        buffer.clear();
+        Data_writer(buffer).put_varint(1000000);
+        Data_reader corrupt(buffer);
+        CPPUNIT_ASSERT(!corrupt.get_uint32_array(result));
+    }
+
     CPPUNIT_TEST_SUITE(Bin_util_tests);
     CPPUNIT_TEST(test_unpack_int16);
     CPPUNIT_TEST(test_unpack_uint16);
@@ -306,6 +544,13 @@ class Bin_util_tests : public CppUnit::TestFixture {
     CPPUNIT_TEST(test_compress_uint32);
     CPPUNIT_TEST(test_decompress_uint32_0);
     CPPUNIT_TEST(test_decompress_uint32_1);
+    CPPUNIT_TEST(test_pack_int64);
+    CPPUNIT_TEST(test_pack_double);
+    CPPUNIT_TEST(test_int32_array);
+    CPPUNIT_TEST(test_varint32);
+    CPPUNIT_TEST(test_compress_uint32_array);
+    CPPUNIT_TEST(test_decompress_uint32_array);
+    CPPUNIT_TEST(test_packed_array);
     CPPUNIT_TEST_SUITE_END();
 };
 
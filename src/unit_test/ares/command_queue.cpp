@@ -0,0 +1,191 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/command.hpp"
+#include "ares/command_queue.hpp"
+#include "ares/platform.hpp"
+#include "ares/server.hpp"
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+// A command that records whether it was executed or discarded.
+class Test_command : public Command {
+  public:
+    Test_command(int id, Priority p, int* executed = 0, int* discarded = 0)
+            : m_id(id), m_executed(executed), m_discarded(discarded)
+    {
+        set_priority(p);
+    }
+
+    void execute(Server_interface&, int)
+    {
+        if (m_executed)
+            ++*m_executed;
+    }
+
+    void discard(Server_interface&, int)
+    {
+        if (m_discarded)
+            ++*m_discarded;
+    }
+
+    int const m_id;
+
+  private:
+    int* m_executed;
+    int* m_discarded;
+};
+
+// Dequeues a command from queue, and returns its id, or -1 if the queue is
+// empty.
+int dequeue_id(Command_queue& queue)
+{
+    Command* c;
+    if (!queue.dequeue(c))
+        return -1;
+    int const id = static_cast<Test_command*>(c)->m_id;
+    delete c;
+    return id;
+}
+}
+
+class Command_queue_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_priority()
+    {
+        Command_queue queue(0);
+        CPPUNIT_ASSERT(queue.is_empty());
+        CPPUNIT_ASSERT_EQUAL(-1, dequeue_id(queue));
+
+        queue.enqueue(new Test_command(1, Command::LOW_PRIORITY));
+        queue.enqueue(new Test_command(2, Command::NORMAL_PRIORITY));
+        queue.enqueue(new Test_command(3, Command::LOW_PRIORITY));
+        queue.enqueue(new Test_command(4, Command::HIGH_PRIORITY));
+        queue.enqueue(new Test_command(5, Command::NORMAL_PRIORITY));
+        CPPUNIT_ASSERT_EQUAL(5, queue.size());
+        CPPUNIT_ASSERT_EQUAL(1, queue.size(Command::HIGH_PRIORITY));
+        CPPUNIT_ASSERT_EQUAL(2, queue.size(Command::NORMAL_PRIORITY));
+        CPPUNIT_ASSERT_EQUAL(2, queue.size(Command::LOW_PRIORITY));
+
+        // Higher priorities first, and each priority in FIFO order.
+        CPPUNIT_ASSERT_EQUAL(4, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(2, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(5, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(1, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(3, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(-1, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(Int64(0), queue.aged());
+
+        // Without aging, an old command waits for newer ones.
+        queue.enqueue(new Test_command(6, Command::LOW_PRIORITY));
+        milli_sleep(5);
+        queue.enqueue(new Test_command(7, Command::NORMAL_PRIORITY));
+        CPPUNIT_ASSERT_EQUAL(7, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(6, dequeue_id(queue));
+    }
+
+    void test_aging()
+    {
+        Command_queue queue(20);
+        CPPUNIT_ASSERT_EQUAL(20, queue.aging());
+
+        // A command that has waited for the aging time goes ahead of
+        // newer, higher priority ones, oldest first.
+        queue.enqueue(new Test_command(1, Command::LOW_PRIORITY));
+        queue.enqueue(new Test_command(2, Command::NORMAL_PRIORITY));
+        milli_sleep(30);
+        queue.enqueue(new Test_command(3, Command::HIGH_PRIORITY));
+        CPPUNIT_ASSERT_EQUAL(1, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(2, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(3, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(Int64(2), queue.aged());
+
+        // A command that hasn't aged waits.
+        queue.enqueue(new Test_command(4, Command::LOW_PRIORITY));
+        queue.enqueue(new Test_command(5, Command::HIGH_PRIORITY));
+        CPPUNIT_ASSERT_EQUAL(5, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(4, dequeue_id(queue));
+        CPPUNIT_ASSERT_EQUAL(Int64(2), queue.aged());
+
+        queue.set_aging(-1);
+        CPPUNIT_ASSERT_EQUAL(0, queue.aging());
+    }
+
+    void test_wait()
+    {
+        Command_queue queue;
+        Command* c;
+        Int64 const started = monotonic_micros();
+        CPPUNIT_ASSERT(!queue.dequeue(c, 20));
+        CPPUNIT_ASSERT(monotonic_micros() - started >= 15000);
+    }
+
+    void test_deadline()
+    {
+        int executed = 0;
+        int discarded = 0;
+        Server server;
+        server.set_num_processors(1);
+        server.startup();
+
+        // Expired commands are executed by default, and flagged.
+        Command* c = new Test_command(1, Command::NORMAL_PRIORITY,
+                                      &executed, &discarded);
+        c->set_deadline(monotonic_micros() - 1);
+        server.enqueue_command(c);
+        c = new Test_command(2, Command::NORMAL_PRIORITY,
+                             &executed, &discarded);
+        c->set_deadline_after(60000);
+        server.enqueue_command(c);
+        for (int i = 0; i < 500 && executed < 2; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT_EQUAL(2, executed);
+
+        // If the server drops them, they are discarded instead.
+        server.drop_expired_commands(true);
+        c = new Test_command(3, Command::NORMAL_PRIORITY,
+                             &executed, &discarded);
+        c->set_deadline(monotonic_micros() - 1);
+        server.enqueue_command(c);
+        for (int i = 0; i < 500 && discarded < 1; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT_EQUAL(2, executed);
+        CPPUNIT_ASSERT_EQUAL(1, discarded);
+        CPPUNIT_ASSERT_EQUAL(Int64(2),
+                             server.totals().total_commands_executed());
+
+        // The counts outlive the processor that made them.
+        server.set_num_processors(0);
+        server.set_num_processors(1);
+        Server_statistics const stats = server.totals();
+        CPPUNIT_ASSERT_EQUAL(Int64(2), stats.m_commands_expired);
+        CPPUNIT_ASSERT_EQUAL(Int64(1), stats.m_commands_dropped);
+        CPPUNIT_ASSERT_EQUAL(int(Command::NUM_PRIORITIES),
+                             int(stats.m_queued_by_priority_snap.size()));
+
+        server.shutdown();
+    }
+
+    CPPUNIT_TEST_SUITE(Command_queue_tests);
+    CPPUNIT_TEST(test_priority);
+    CPPUNIT_TEST(test_aging);
+    CPPUNIT_TEST(test_wait);
+    CPPUNIT_TEST(test_deadline);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Command_queue_tests);
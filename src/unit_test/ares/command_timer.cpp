@@ -0,0 +1,119 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/command_timer.hpp"
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+struct Fast_command : public Command {
+    void execute(Server_interface&, int) {}
+};
+
+struct Slow_command : public Command {
+    void execute(Server_interface&, int) {}
+};
+
+// A command that reports under the same name as Fast_command.
+struct Renamed_command : public Command {
+    void execute(Server_interface&, int) {}
+    string name() const { return Fast_command().name(); }
+};
+}
+
+class Command_timer_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_name()
+    {
+        CPPUNIT_ASSERT_EQUAL(string("(anonymous namespace)::Slow_command"),
+                             Slow_command().name());
+        Add_session_command add(Session(0));
+        CPPUNIT_ASSERT_EQUAL(string("ares::Add_session_command"),
+                             add.name());
+    }
+
+    void test_totals()
+    {
+        Command_timer timer;
+        Command_timer::Cache cache;
+        Command_timer::Cache other_cache;
+        Fast_command fast;
+        Slow_command slow;
+        Renamed_command renamed;
+
+        for (int i = 0; i < 100; i++) {
+            timer.record(fast, 5, 10, cache);
+            timer.record(slow, 7, 10000, other_cache);
+        }
+        timer.record(fast, -1, 20, other_cache);
+        timer.record(renamed, 3, 30, cache);
+
+        vector<Command_statistics> v;
+        timer.totals(v);
+        CPPUNIT_ASSERT_EQUAL(2, int(v.size()));
+        CPPUNIT_ASSERT_EQUAL(slow.name(), v[0].m_name);
+        CPPUNIT_ASSERT_EQUAL(Int64(100), v[0].m_queue_latency.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(100), v[0].m_execution_latency.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(700), v[0].m_queue_latency.sum());
+
+        // Unknown queue latencies are not counted, and types that share a
+        // name are counted together.
+        CPPUNIT_ASSERT_EQUAL(fast.name(), v[1].m_name);
+        CPPUNIT_ASSERT_EQUAL(Int64(101), v[1].m_queue_latency.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(102), v[1].m_execution_latency.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(1050),
+                             v[1].m_execution_latency.sum());
+    }
+
+    void test_statistics()
+    {
+        Command_timer timer;
+        Command_timer::Cache cache;
+        Fast_command fast;
+        Slow_command slow;
+
+        timer.record(fast, 1, 10, cache);
+        timer.record(slow, 1, 1000, cache);
+        vector<Command_statistics> v;
+        timer.statistics(v);
+        CPPUNIT_ASSERT_EQUAL(2, int(v.size()));
+
+        // Types not executed since the previous call are omitted.
+        timer.record(fast, 1, 20, cache);
+        timer.record(fast, 1, 30, cache);
+        timer.statistics(v);
+        CPPUNIT_ASSERT_EQUAL(1, int(v.size()));
+        CPPUNIT_ASSERT_EQUAL(fast.name(), v[0].m_name);
+        CPPUNIT_ASSERT_EQUAL(Int64(2), v[0].m_execution_latency.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(50), v[0].m_execution_latency.sum());
+
+        timer.statistics(v);
+        CPPUNIT_ASSERT(v.empty());
+
+        // Totals are unaffected.
+        timer.totals(v);
+        CPPUNIT_ASSERT_EQUAL(2, int(v.size()));
+        CPPUNIT_ASSERT_EQUAL(Int64(3), v[1].m_execution_latency.count());
+    }
+
+    CPPUNIT_TEST_SUITE(Command_timer_tests);
+    CPPUNIT_TEST(test_name);
+    CPPUNIT_TEST(test_totals);
+    CPPUNIT_TEST(test_statistics);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Command_timer_tests);
@@ -0,0 +1,152 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/buffer.hpp"
+#include "ares/data_reader.hpp"
+#include "ares/message_reader.hpp"
+#include "ares/message_writer.hpp"
+#include "ares/platform.hpp"
+#include "ares/server.hpp"
+#include "ares/sink.hpp"
+#include "ares/socket.hpp"
+#include "ares/socket_acceptor.hpp"
+#include <memory>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+int const COPIED_BYTES = 20000;     // bytes of each message that are copied
+int const SHARED_BYTES = 20000;     // and that are referred to
+
+// A session that only sends.
+class Output_session : public Session_rep {
+  public:
+    Output_session(Server_interface& server, Socket* socket)
+            : Session_rep(server, socket)
+    {}
+
+  private:
+    bool do_handle_input(Buffer&) { return true; }
+};
+
+// Checks the messages it receives, which must be numbered in increasing
+// order (with gaps where messages were dropped) and hold the expected
+// bytes. A message numbered -1 ends the test.
+class Checking_sink : public Sink {
+  public:
+    Checking_sink() : m_last(-1), m_received(0), m_ended(false) {}
+
+    void send(Buffer const& b)
+    {
+        Buffer message(b);
+        Data_reader reader(message);
+        int const n = reader.get_int32();
+        if (n == -1) {
+            m_ended = true;
+            return;
+        }
+        CPPUNIT_ASSERT(n > m_last);
+        CPPUNIT_ASSERT_EQUAL(COPIED_BYTES, int(reader.get_int32()));
+        CPPUNIT_ASSERT(message.size() >= COPIED_BYTES);
+        for (int i = 0; i < COPIED_BYTES; i++)
+            CPPUNIT_ASSERT_EQUAL(int(Byte(n)), int(message.begin()[i]));
+        message.consume(COPIED_BYTES);
+        CPPUNIT_ASSERT_EQUAL(SHARED_BYTES, int(reader.get_int32()));
+        CPPUNIT_ASSERT_EQUAL(SHARED_BYTES, message.size());
+        for (int i = 0; i < SHARED_BYTES; i++)
+            CPPUNIT_ASSERT_EQUAL(0x5a, int(message.begin()[i]));
+        m_last = n;
+        m_received++;
+    }
+
+    int m_last;
+    int m_received;
+    bool m_ended;
+};
+}
+
+class Dispatcher_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_drop_oldest()
+    {
+        int const NUM_MESSAGES = 400;
+        string const port = "27474";
+
+        Socket_acceptor acceptor;
+        acceptor.bind("127.0.0.1", port);
+        auto_ptr<Socket> client(connect_tcp("127.0.0.1", port));
+        vector<Socket*> accepted;
+        for (int i = 0; i < 100 && accepted.empty(); i++)
+            acceptor.wait_for_connection(10, accepted);
+        CPPUNIT_ASSERT_EQUAL(1, int(accepted.size()));
+
+        Server server;
+        server.set_output_limits(0, 0, 256*1024, OUTPUT_DROP_OLDEST);
+        server.startup();
+
+        // Send messages that each span several of the writer's chunks, and
+        // ranges of a shared buffer, to a client that isn't reading, so
+        // that many are dropped.
+        vector<Byte> copied(SHARED_BYTES, 0x5a);
+        Shared_buffer shared(new Buffer(&copied[0], SHARED_BYTES));
+        copied.resize(COPIED_BYTES);
+        {
+            accepted[0]->set_blocking(false);
+            Session session(new Output_session(server, accepted[0]));
+            session->use_slave_process_for_output(true);
+            Message_writer writer(*session);
+            for (int n = 0; n < NUM_MESSAGES; n++) {
+                fill(copied.begin(), copied.end(), Byte(n));
+                writer.begin_message();
+                writer.put_int32(n);
+                writer.put_bytes(&copied[0], COPIED_BYTES);
+                writer.put_bytes_ref(shared);
+                writer.end_message();
+            }
+            writer.begin_message();
+            writer.put_int32(-1);
+            writer.end_message();
+        }
+
+        // The client receives whole messages, in order.
+        Checking_sink sink;
+        Message_reader reader(sink);
+        Buffer input(64*1024);
+        client->set_blocking(false);
+        for (int i = 0; i < 1000 && !sink.m_ended; ) {
+            if (input.free() == 0)
+                input.set_capacity(2*input.capacity());
+            if (client->read(input) <= 0) {
+                milli_sleep(10);
+                i++;
+            }
+            reader.read_messages(input);
+        }
+        CPPUNIT_ASSERT(sink.m_ended);
+        CPPUNIT_ASSERT(sink.m_received > 0);
+        CPPUNIT_ASSERT(sink.m_received < NUM_MESSAGES);
+        CPPUNIT_ASSERT(server.totals().m_dropped_buffers > 0);
+
+        server.shutdown();
+    }
+
+    CPPUNIT_TEST_SUITE(Dispatcher_tests);
+    CPPUNIT_TEST(test_drop_oldest);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Dispatcher_tests);
@@ -0,0 +1,117 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/io_uring.hpp"
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+Uint64 const RECV = 1;
+Uint64 const SEND = 2;
+Uint64 const CANCEL = 3;
+
+// Waits up to a second for the ring's next completion.
+bool wait_for_completion(Io_uring& ring, Io_uring::Completion& c)
+{
+    for (int i = 0; i < 100; i++) {
+        if (ring.next_completion(c))
+            return true;
+        ring.submit_and_wait(10);
+    }
+    return false;
+}
+}
+
+class Io_uring_tests : public CppUnit::TestFixture {
+  public:
+    void setUp()
+    {
+        CPPUNIT_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds));
+    }
+
+    void tearDown()
+    {
+        close(m_fds[0]);
+        close(m_fds[1]);
+    }
+
+    void test_recv_and_send()
+    {
+        // (the engine is optional; without it, there is nothing to test)
+        if (!Io_uring::is_supported())
+            return;
+
+        Io_uring ring(8);
+        ring.provide_buffers(4, 64);
+        ring.recv_multishot(m_fds[0], RECV);
+        ring.send(m_fds[1], reinterpret_cast<Byte const*>("hello"), 5, SEND);
+
+        // The send completes, and the receive delivers its data in a
+        // provided buffer and stays active.
+        bool sent = false;
+        bool received = false;
+        Io_uring::Completion c;
+        while (!(sent && received) && wait_for_completion(ring, c)) {
+            if (c.m_user_data == SEND) {
+                CPPUNIT_ASSERT_EQUAL(5, c.m_result);
+                sent = true;
+            }
+            else {
+                CPPUNIT_ASSERT_EQUAL(RECV, c.m_user_data);
+                CPPUNIT_ASSERT_EQUAL(5, c.m_result);
+                CPPUNIT_ASSERT(c.has_more());
+                int const id = c.buffer_id();
+                CPPUNIT_ASSERT(id >= 0 && id < 4);
+                CPPUNIT_ASSERT(memcmp(ring.provided_buffer(id), "hello", 5)
+                               == 0);
+                ring.recycle_buffer(id);
+                received = true;
+            }
+        }
+        CPPUNIT_ASSERT(sent && received);
+
+        // The receive goes on until it is canceled.
+        CPPUNIT_ASSERT_EQUAL(ssize_t(2), write(m_fds[1], "hi", 2));
+        CPPUNIT_ASSERT(wait_for_completion(ring, c));
+        CPPUNIT_ASSERT_EQUAL(RECV, c.m_user_data);
+        CPPUNIT_ASSERT_EQUAL(2, c.m_result);
+        ring.recycle_buffer(c.buffer_id());
+
+        ring.cancel(RECV, CANCEL);
+        bool canceled = false;
+        bool ended = false;
+        while (!(canceled && ended) && wait_for_completion(ring, c)) {
+            if (c.m_user_data == CANCEL) {
+                CPPUNIT_ASSERT_EQUAL(1, c.m_result);
+                canceled = true;
+            }
+            else {
+                CPPUNIT_ASSERT_EQUAL(RECV, c.m_user_data);
+                CPPUNIT_ASSERT(!c.has_more());
+                ended = true;
+            }
+        }
+        CPPUNIT_ASSERT(canceled && ended);
+    }
+
+    CPPUNIT_TEST_SUITE(Io_uring_tests);
+    CPPUNIT_TEST(test_recv_and_send);
+    CPPUNIT_TEST_SUITE_END();
+
+  private:
+    int m_fds[2];
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Io_uring_tests);
@@ -0,0 +1,99 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/buffer.hpp"
+#include "ares/line_reader.hpp"
+#include "ares/line_scan.hpp"
+#include <string>
+
+using namespace std;
+using namespace ares;
+
+class Line_reader_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_find_newline()
+    {
+        // Place a newline at every position of a text long enough to cover
+        // the vector loops and the tail, using every supported scanner.
+
+        Line_scan_isa const isas[] =
+                { LINE_SCAN_GENERIC, LINE_SCAN_SSE2, LINE_SCAN_AVX2 };
+
+        for (unsigned i = 0; i < sizeof(isas)/sizeof(isas[0]); i++) {
+            if (!is_line_scan_isa_supported(isas[i]))
+                continue;
+
+            for (int pos = 0; pos <= 100; pos++) {
+                string s(100, 'x');
+                if (pos < 100)
+                    s[pos] = (pos % 2) ? '\r' : '\n';
+
+                Byte const* begin = (Byte const*) s.data();
+                Byte const* end = begin + s.size();
+                CPPUNIT_ASSERT(find_newline(begin, end, isas[i]) ==
+                               begin + pos);
+                CPPUNIT_ASSERT(find_newline(begin, end) == begin + pos);
+            }
+        }
+    }
+
+    void test_get_line()
+    {
+        Buffer b(string("one\r\ntwo\nthree\rfour"));
+        Line_reader reader(b);
+        string s;
+
+        CPPUNIT_ASSERT(reader.get_line(s));
+        CPPUNIT_ASSERT_EQUAL(string("one\r\n"), s);
+        CPPUNIT_ASSERT(reader.get_line(s));
+        CPPUNIT_ASSERT_EQUAL(string("two\n"), s);
+        CPPUNIT_ASSERT(reader.get_line(s));
+        CPPUNIT_ASSERT_EQUAL(string("three\r"), s);
+        CPPUNIT_ASSERT(!reader.get_line(s));
+        CPPUNIT_ASSERT_EQUAL(4, b.size());
+    }
+
+    void test_get_line_view()
+    {
+        Buffer b(string("one\r\ntwo\nthree"));
+        char const* line;
+        int length;
+
+        {
+            Line_reader reader(b);
+            reader.set_discard_newline(true);
+
+            CPPUNIT_ASSERT(reader.get_line_view(line, length));
+            CPPUNIT_ASSERT_EQUAL(string("one"), string(line, length));
+            CPPUNIT_ASSERT_EQUAL(14, b.size());     // (not yet consumed)
+
+            CPPUNIT_ASSERT(reader.get_line_view(line, length));
+            CPPUNIT_ASSERT_EQUAL(string("two"), string(line, length));
+            CPPUNIT_ASSERT_EQUAL(9, b.size());
+        }
+        CPPUNIT_ASSERT_EQUAL(5, b.size());          // consumed by destructor
+
+        Line_reader reader(b);
+        CPPUNIT_ASSERT(!reader.get_line_view(line, length));
+        CPPUNIT_ASSERT_EQUAL(5, b.size());
+    }
+
+    CPPUNIT_TEST_SUITE(Line_reader_tests);
+    CPPUNIT_TEST(test_find_newline);
+    CPPUNIT_TEST(test_get_line);
+    CPPUNIT_TEST(test_get_line_view);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Line_reader_tests);
@@ -0,0 +1,138 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/lz_codec.hpp"
+#include "ares/random.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+// Compresses and decompresses count bytes, checking that they survive, and
+// returns the compressed size.
+int round_trip(Lz_codec& codec, Byte const* data, int count)
+{
+    vector<Byte> packed(Lz_codec::max_compressed_size(count));
+    int size = codec.compress(data, count, &packed[0], packed.size());
+    CPPUNIT_ASSERT(size > 0);
+
+    vector<Byte> unpacked(count + 1);
+    CPPUNIT_ASSERT_EQUAL(count, Lz_codec::decompress(&packed[0], size,
+                                                     &unpacked[0], count));
+    CPPUNIT_ASSERT(memcmp(data, &unpacked[0], count) == 0);
+    return size;
+}
+
+int round_trip(Lz_codec& codec, string const& s)
+{
+    return round_trip(codec, (Byte const*) s.data(), s.size());
+}
+}
+
+class Lz_codec_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_small()
+    {
+        // Too short to hold a match; stored as literals.
+        Lz_codec codec;
+        for (int n = 0; n <= 12; n++)
+            CPPUNIT_ASSERT_EQUAL(1 + n, round_trip(codec, string(n, 'a')));
+    }
+
+    void test_repetitive()
+    {
+        Lz_codec codec;
+        string s;
+        for (int i = 0; i < 2000; i++)
+            s += "GET /api/v1/items HTTP/1.1\r\n";
+        CPPUNIT_ASSERT(round_trip(codec, s) < int(s.size())/50);
+
+        // Matches that overlap their own output.
+        CPPUNIT_ASSERT(round_trip(codec, string(100000, 'x')) < 500);
+    }
+
+    void test_random()
+    {
+        // Random data do not compress, but still fit in max_compressed_size;
+        // mixed data compress in part.
+        Lz_codec codec;
+        vector<Byte> data(100000);
+        for (unsigned i = 0; i < data.size(); i++)
+            data[i] = Byte(Random::next_int(256));
+        round_trip(codec, &data[0], data.size());
+
+        for (unsigned i = 0; i < data.size(); i++) {
+            if ((i/1000) % 2 == 0)
+                data[i] = Byte(i % 7);
+        }
+        int size = round_trip(codec, &data[0], data.size());
+        CPPUNIT_ASSERT(size < int(data.size())*3/4);
+    }
+
+    void test_capacity()
+    {
+        // compress fails, without overrunning, if the output does not fit.
+        Lz_codec codec;
+        vector<Byte> data(1000);
+        for (unsigned i = 0; i < data.size(); i++)
+            data[i] = Byte(Random::next_int(256));
+        vector<Byte> packed(1001, 0xEE);
+        CPPUNIT_ASSERT_EQUAL(0, codec.compress(&data[0], data.size(),
+                                               &packed[0], 1000));
+        CPPUNIT_ASSERT_EQUAL(0xEE, int(packed[1000]));
+    }
+
+    void test_corrupt()
+    {
+        // Damaged blocks are rejected without writing outside the output.
+        Lz_codec codec;
+        string s;
+        for (int i = 0; i < 200; i++)
+            s += "abcdefgh";
+        vector<Byte> packed(Lz_codec::max_compressed_size(s.size()));
+        int size = codec.compress((Byte const*) s.data(), s.size(),
+                                  &packed[0], packed.size());
+        CPPUNIT_ASSERT(size > 0);
+
+        vector<Byte> out(s.size() + 16, 0xEE);
+        int n = s.size();
+        CPPUNIT_ASSERT_EQUAL(-1, Lz_codec::decompress(&packed[0], size - 1,
+                                                      &out[0], n));
+        CPPUNIT_ASSERT_EQUAL(-1, Lz_codec::decompress(&packed[0], size,
+                                                      &out[0], n - 1));
+        CPPUNIT_ASSERT_EQUAL(-1, Lz_codec::decompress(&packed[0], size,
+                                                      &out[0], n + 1));
+        for (int i = 0; i < 1000; i++) {
+            vector<Byte> damaged(packed.begin(), packed.begin() + size);
+            damaged[Random::next_int(size)] = Byte(Random::next_int(256));
+            Lz_codec::decompress(&damaged[0], size, &out[0], n);
+        }
+        for (int i = n; i < int(out.size()); i++)
+            CPPUNIT_ASSERT_EQUAL(0xEE, int(out[i]));
+    }
+
+    CPPUNIT_TEST_SUITE(Lz_codec_tests);
+    CPPUNIT_TEST(test_small);
+    CPPUNIT_TEST(test_repetitive);
+    CPPUNIT_TEST(test_random);
+    CPPUNIT_TEST(test_capacity);
+    CPPUNIT_TEST(test_corrupt);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Lz_codec_tests);
@@ -563,6 +563,192 @@ class Message_reader_tests : public CppUnit::TestFixture {
         CPPUNIT_ASSERT_EQUAL(string(n32, 'C'), string(buf,buf+n32));
     }
 
+    void test_single_frames()
+    {
+        // Single frames and chained messages, in any mix.
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        for (int i = 0; i < 4; i++) {
+            writer.set_framing(i % 2 ? FRAMING_SINGLE : FRAMING_CHAINED);
+            writer.begin_message();
+            writer.put_int32(i);
+            writer.put_string(string(10000, 'X'));
+            writer.end_message();
+        }
+
+        m_queue_sink.reset();
+        Message_reader reader(m_queue_sink);
+        CPPUNIT_ASSERT(!reader.peer_uses_single_frames());
+        reader.set_max_packet_size(writer.max_packet_size());
+        CPPUNIT_ASSERT_EQUAL(4, reader.read_messages(m_sink.buffer()));
+        CPPUNIT_ASSERT(reader.peer_uses_single_frames());
+
+        for (int i = 0; i < 4; i++) {
+            Buffer msg = m_queue_sink.dequeue();
+            Data_reader data_reader(msg);
+            CPPUNIT_ASSERT_EQUAL(i, data_reader.get_int32());
+            CPPUNIT_ASSERT_EQUAL(string(10000, 'X'),
+                                 data_reader.get_string());
+            CPPUNIT_ASSERT_EQUAL(0, msg.size());
+        }
+    }
+
+    void test_partial_single_frame()
+    {
+        // A frame larger than the input buffer, which arrives a little at a
+        // time, followed by a small one.
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        writer.set_framing(FRAMING_SINGLE);
+        writer.begin_message();
+        writer.put_string(string(100000, 'X'));
+        writer.end_message();
+        writer.begin_message();
+        writer.put_int32(42);
+        writer.end_message();
+
+        m_queue_sink.reset();
+        Message_reader reader(m_queue_sink);
+        Buffer& stream = m_sink.buffer();
+        Buffer input(1000);
+        int n = 0;
+        while (stream.size() > 0) {
+            int count = min(input.free(), min(stream.size(), 333));
+            input.put(stream.begin(), count);
+            stream.consume(count);
+            n += reader.read_messages(input);
+        }
+        CPPUNIT_ASSERT_EQUAL(2, n);
+        CPPUNIT_ASSERT_EQUAL(0, input.size());
+
+        Buffer msg = m_queue_sink.dequeue();
+        Data_reader data_reader(msg);
+        CPPUNIT_ASSERT_EQUAL(string(100000, 'X'), data_reader.get_string());
+        msg = m_queue_sink.dequeue();
+        CPPUNIT_ASSERT_EQUAL(42, Data_reader(msg).get_int32());
+    }
+
+    void test_single_frame_overflow()
+    {
+        // An oversized frame is discarded, even if it has not all arrived.
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        writer.set_framing(FRAMING_SINGLE);
+        writer.begin_message();
+        writer.put_string(string(1000, 'X'));
+        writer.end_message();
+
+        m_queue_sink.reset();
+        Message_reader reader(m_queue_sink);
+        reader.set_max_message_size(1000);
+        Buffer input(m_sink.buffer().begin(), 500);
+        m_sink.buffer().consume(500);
+        try {
+            reader.read_messages(input);
+            CPPUNIT_ASSERT(false);
+        }
+        catch (Message_size_exceeded_error&) {
+            // OK
+        }
+
+        writer.begin_message();
+        writer.put_int32(42);
+        writer.end_message();
+        CPPUNIT_ASSERT_EQUAL(1, reader.read_messages(m_sink.buffer()));
+        Buffer msg = m_queue_sink.dequeue();
+        CPPUNIT_ASSERT_EQUAL(42, Data_reader(msg).get_int32());
+    }
+
+    void test_long_chain()
+    {
+        // More packets than a 16-bit sequence number can count.
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        writer.set_max_packet_size(MIN_PACKET_SIZE);
+        writer.begin_message();
+        writer.put_string(string(70000, 'X'));
+        writer.end_message();
+
+        m_queue_sink.reset();
+        Message_reader reader(m_queue_sink);
+        CPPUNIT_ASSERT_EQUAL(1, reader.read_messages(m_sink.buffer()));
+        Buffer msg = m_queue_sink.dequeue();
+        CPPUNIT_ASSERT_EQUAL(70004, msg.size());
+    }
+
+    void test_compressed_messages()
+    {
+        // A compressed message is delivered decompressed, and one whose
+        // decompressed size is too large is discarded.
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        writer.set_compression_threshold(100);
+        writer.begin_message();
+        writer.put_string(string(100000, 'X'));
+        writer.end_message();
+        writer.begin_message();
+        writer.put_int32(42);
+        writer.end_message();
+        CPPUNIT_ASSERT(m_sink.buffer().size() < 1000);
+
+        m_queue_sink.reset();
+        Message_reader reader(m_queue_sink);
+        CPPUNIT_ASSERT(!reader.peer_uses_compression());
+        CPPUNIT_ASSERT_EQUAL(2, reader.read_messages(m_sink.buffer()));
+        CPPUNIT_ASSERT(reader.peer_uses_compression());
+        Buffer msg = m_queue_sink.dequeue();
+        CPPUNIT_ASSERT_EQUAL(string(100000, 'X'),
+                             Data_reader(msg).get_string());
+        msg = m_queue_sink.dequeue();
+        CPPUNIT_ASSERT_EQUAL(42, Data_reader(msg).get_int32());
+
+        writer.set_framing(FRAMING_SINGLE);
+        writer.begin_message();
+        writer.put_string(string(100000, 'X'));
+        writer.end_message();
+        reader.set_max_message_size(100000);
+        try {
+            reader.read_messages(m_sink.buffer());
+            CPPUNIT_ASSERT(false);
+        }
+        catch (Message_size_exceeded_error&) {
+            // OK
+        }
+        CPPUNIT_ASSERT_EQUAL(0, m_sink.buffer().size());
+    }
+
+    void test_corrupt_message()
+    {
+        // A compressed message that cannot be decompressed is discarded,
+        // and the next one is read normally.
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        writer.set_compression_threshold(100);
+        writer.begin_message();
+        writer.put_string(string(10000, 'X'));
+        writer.end_message();
+        Buffer& input = m_sink.buffer();
+        CPPUNIT_ASSERT_EQUAL(2, int(input.begin()[6]));   // (compressed)
+        input.begin()[10] ^= 1;         // (the original size)
+
+        writer.begin_message();
+        writer.put_int32(42);
+        writer.end_message();
+
+        m_queue_sink.reset();
+        Message_reader reader(m_queue_sink);
+        try {
+            reader.read_messages(input);
+            CPPUNIT_ASSERT(false);
+        }
+        catch (Message_corrupt_error&) {
+            // OK
+        }
+        CPPUNIT_ASSERT_EQUAL(1, reader.read_messages(input));
+        Buffer msg = m_queue_sink.dequeue();
+        CPPUNIT_ASSERT_EQUAL(42, Data_reader(msg).get_int32());
+    }
+
     CPPUNIT_TEST_SUITE(Message_reader_tests);
     CPPUNIT_TEST(test_empty_message);
     CPPUNIT_TEST(test_one_byte_message);
@@ -576,6 +762,12 @@ class Message_reader_tests : public CppUnit::TestFixture {
     CPPUNIT_TEST(test_overflow_1_with_min_packet_size);
     CPPUNIT_TEST(test_overflow_2);
     CPPUNIT_TEST(test_overflow_2_with_min_packet_size);
+    CPPUNIT_TEST(test_single_frames);
+    CPPUNIT_TEST(test_partial_single_frame);
+    CPPUNIT_TEST(test_single_frame_overflow);
+    CPPUNIT_TEST(test_long_chain);
+    CPPUNIT_TEST(test_compressed_messages);
+    CPPUNIT_TEST(test_corrupt_message);
     CPPUNIT_TEST_SUITE_END();
 
   private:
@@ -0,0 +1,252 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/bin_util.hpp"
+#include "ares/data_writer.hpp"
+#include "ares/message_reader.hpp"
+#include "ares/message_schema.hpp"
+#include "ares/message_writer.hpp"
+#include "unit_test/ares/test_sink.h"
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+// Version 1 of a message.
+struct Login_v1 {
+    enum { VERSION = 1 };
+
+    Int32 user_id;
+    string name;
+    vector<Uint32> group_ids;
+
+    template<class Visitor>
+    void visit_fields(Visitor& v)
+    {
+        v.field(user_id);
+        v.field(name);
+        v.field(group_ids);
+    }
+};
+
+// Version 2 of the same message, with every kind of field.
+struct Login_v2 {
+    enum { VERSION = 2 };
+
+    Int32 user_id;
+    string name;
+    vector<Uint32> group_ids;
+    Int8 flags;
+    Int16 port;
+    Int64 session_id;
+    bool is_admin;
+    Uint32 sequence;
+    double score;
+    vector<Int32> offsets;
+    Optional<string> locale;
+    Optional<Int32> timeout;
+
+    template<class Visitor>
+    void visit_fields(Visitor& v)
+    {
+        v.field(user_id);
+        v.field(name);
+        v.field(group_ids);
+        v.field(flags, 2);
+        v.field(port, 2);
+        v.field(session_id, 2);
+        v.field(is_admin, 2);
+        v.field(sequence, 2);
+        v.field(score, 2);
+        v.field(offsets, 2);
+        v.field(locale, 2);
+        v.field(timeout, 2);
+    }
+};
+
+Login_v2 make_login()
+{
+    Login_v2 m;
+    m.user_id = 1234;
+    m.name = "cowgill";
+    for (int i = 0; i < 100; i++)
+        m.group_ids.push_back(i*i);
+    m.flags = -3;
+    m.port = 8080;
+    m.session_id = -81985529216486895LL;
+    m.is_admin = true;
+    m.sequence = 300;
+    m.score = 2.5;
+    m.offsets.push_back(-1);
+    m.offsets.push_back(65536);
+    m.locale.set("en_US");
+    return m;
+}
+
+void assert_equal(Login_v2 const& a, Login_v2 const& b)
+{
+    CPPUNIT_ASSERT_EQUAL(a.user_id, b.user_id);
+    CPPUNIT_ASSERT_EQUAL(a.name, b.name);
+    CPPUNIT_ASSERT(a.group_ids == b.group_ids);
+    CPPUNIT_ASSERT_EQUAL(a.flags, b.flags);
+    CPPUNIT_ASSERT_EQUAL(a.port, b.port);
+    CPPUNIT_ASSERT_EQUAL(a.session_id, b.session_id);
+    CPPUNIT_ASSERT_EQUAL(a.is_admin, b.is_admin);
+    CPPUNIT_ASSERT_EQUAL(a.sequence, b.sequence);
+    CPPUNIT_ASSERT_EQUAL(a.score, b.score);
+    CPPUNIT_ASSERT(a.offsets == b.offsets);
+    CPPUNIT_ASSERT_EQUAL(a.locale.present(), b.locale.present());
+    CPPUNIT_ASSERT_EQUAL(a.locale.get(), b.locale.get());
+    CPPUNIT_ASSERT_EQUAL(a.timeout.present(), b.timeout.present());
+}
+}
+
+class Message_schema_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_data_writer()
+    {
+        Login_v2 in = make_login();
+        Buffer buffer(4096);
+        Data_writer writer(buffer);
+        write_message(writer, in);
+        writer.put_int32(42);           // the next thing in the buffer
+        CPPUNIT_ASSERT(writer);
+
+        // The header holds the version and the length of the fields.
+        Data_reader peeker(buffer);
+        int size;
+        Byte const* p = peeker.peek(size);
+        Uint32 version, length;
+        int used = decode_varint32(p, size, version);
+        used += decode_varint32(p + used, size - used, length);
+        CPPUNIT_ASSERT_EQUAL(Uint32(2), version);
+        CPPUNIT_ASSERT_EQUAL(size, used + int(length) + 4);
+
+        // The first fields are encoded as Data_writer encodes them.
+        CPPUNIT_ASSERT_EQUAL(in.user_id, unpack_int32(p + used));
+        CPPUNIT_ASSERT_EQUAL(int(in.name.size()),
+                             unpack_int32(p + used + 4));
+
+        Data_reader reader(buffer);
+        Login_v2 out;
+        CPPUNIT_ASSERT(read_message(reader, out));
+        assert_equal(in, out);
+        CPPUNIT_ASSERT_EQUAL(42, reader.get_int32());
+        CPPUNIT_ASSERT_EQUAL(0, buffer.size());
+    }
+
+    void test_message_writer()
+    {
+        // Written in small packets, reassembled by a Message_reader.
+        Login_v2 in = make_login();
+        Test_sink packets;
+        Message_writer writer(packets);
+        writer.set_max_packet_size(64);
+        writer.begin_message();
+        write_message(writer, in);
+        writer.end_message();
+
+        Test_sink messages;
+        Message_reader message_reader(messages);
+        int n = message_reader.read_messages(packets.buffer());
+        CPPUNIT_ASSERT_EQUAL(1, n);
+
+        Data_reader reader(messages.buffer());
+        Login_v2 out;
+        CPPUNIT_ASSERT(read_message(reader, out));
+        assert_equal(in, out);
+        CPPUNIT_ASSERT_EQUAL(0, messages.buffer().size());
+    }
+
+    void test_versions()
+    {
+        Login_v2 in = make_login();
+        Buffer buffer(4096);
+        Data_writer writer(buffer);
+
+        // An old reader skips the fields it does not know.
+        write_message(writer, in);
+        writer.put_int32(42);
+        Data_reader reader(buffer);
+        Login_v1 old;
+        CPPUNIT_ASSERT(read_message(reader, old));
+        CPPUNIT_ASSERT_EQUAL(in.user_id, old.user_id);
+        CPPUNIT_ASSERT_EQUAL(in.name, old.name);
+        CPPUNIT_ASSERT(in.group_ids == old.group_ids);
+        CPPUNIT_ASSERT_EQUAL(42, reader.get_int32());
+
+        // A new reader resets the fields an old writer did not know.
+        write_message(writer, old);
+        Login_v2 out = make_login();
+        CPPUNIT_ASSERT(read_message(reader, out));
+        CPPUNIT_ASSERT_EQUAL(in.user_id, out.user_id);
+        CPPUNIT_ASSERT_EQUAL(in.name, out.name);
+        CPPUNIT_ASSERT_EQUAL(Int64(0), out.session_id);
+        CPPUNIT_ASSERT(out.offsets.empty());
+        CPPUNIT_ASSERT(!out.locale.present());
+
+        // So does a new writer asked to write an old version.
+        write_message(writer, in, 1);
+        out = make_login();
+        CPPUNIT_ASSERT(read_message(reader, out));
+        CPPUNIT_ASSERT_EQUAL(Int16(0), out.port);
+        CPPUNIT_ASSERT(!out.locale.present());
+        CPPUNIT_ASSERT(reader);
+        CPPUNIT_ASSERT_EQUAL(0, buffer.size());
+    }
+
+    void test_errors()
+    {
+        Login_v2 in = make_login();
+        Buffer message(4096);
+        Data_writer writer(message);
+        write_message(writer, in);
+
+        // Incomplete messages are not read, and not removed.
+        for (int n = 0; n < message.size(); n++) {
+            Buffer buffer(message.begin(), n);
+            Data_reader reader(buffer);
+            Login_v2 out;
+            CPPUNIT_ASSERT(!read_message(reader, out));
+            CPPUNIT_ASSERT(!reader);
+            CPPUNIT_ASSERT_EQUAL(n, buffer.size());
+        }
+
+        // Neither are messages whose fields overrun their length.
+        Buffer buffer(4096);
+        Data_writer corrupt(buffer);
+        corrupt.put_varint(1);
+        corrupt.put_varint(6);
+        corrupt.put_int32(1234);
+        corrupt.put_int32(1000);        // length of name
+        corrupt.put_string("cowgill");
+        int size = buffer.size();
+
+        Data_reader reader(buffer);
+        Login_v1 out;
+        CPPUNIT_ASSERT(!read_message(reader, out));
+        CPPUNIT_ASSERT(!reader);
+        CPPUNIT_ASSERT_EQUAL(size, buffer.size());
+    }
+
+    CPPUNIT_TEST_SUITE(Message_schema_tests);
+    CPPUNIT_TEST(test_data_writer);
+    CPPUNIT_TEST(test_message_writer);
+    CPPUNIT_TEST(test_versions);
+    CPPUNIT_TEST(test_errors);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Message_schema_tests);
@@ -9,7 +9,10 @@
 #include "cppunit/TestFixture.h"
 #include "cppunit/extensions/HelperMacros.h"
 #include "ares/data_reader.hpp"
+#include "ares/gather_list.hpp"
+#include "ares/message_reader.hpp"
 #include "ares/message_writer.hpp"
+#include "ares/random.hpp"
 #include "unit_test/ares/test_sink.h"
 
 using namespace std;
@@ -20,6 +23,33 @@ namespace
 // (for readability)
 const int MIN_PACKET_SIZE = Message_writer::MIN_PACKET_SIZE;
 const int MAX_PACKET_SIZE = Message_writer::MAX_PACKET_SIZE;
+
+// A sink that keeps the last gather list sent to it.
+class Gather_sink : public Sink {
+  public:
+    Gather_sink() : m_num_buffers(0) {}
+    void send(Buffer const&) { m_num_buffers++; }
+    void send(Gather_list const& list) { m_list = list; }
+    Gather_list& list() { return m_list; }
+    int num_buffers() const { return m_num_buffers; }
+
+  private:
+    Gather_list m_list;
+    int m_num_buffers;      // buffers sent instead of gather lists
+};
+
+// Reassembles the message in a gather list.
+Buffer reassemble(Gather_list const& list)
+{
+    Buffer packets(list.size());
+    list.copy_to(packets);
+
+    Test_sink messages;
+    Message_reader reader(messages);
+    CPPUNIT_ASSERT_EQUAL(1, reader.read_messages(packets));
+    CPPUNIT_ASSERT_EQUAL(0, packets.size());
+    return messages.buffer();
+}
 }
 
 class Message_writer_tests : public CppUnit::TestFixture {
@@ -268,6 +298,161 @@ class Message_writer_tests : public CppUnit::TestFixture {
         CPPUNIT_ASSERT_EQUAL(30, n32);
     }
 
+    void test_single_frame()
+    {
+        m_sink.reset();
+        Message_writer writer(m_sink);
+        writer.set_max_packet_size(MIN_PACKET_SIZE);   // (not applicable)
+        writer.set_framing(FRAMING_SINGLE);
+        writer.begin_message();
+        writer.put_string(string(100, 'X'));
+        writer.end_message();
+
+        // No seq_num or is_chained; the size has the high bit set.
+        Data_reader reader(m_sink.buffer());
+        Uint32 size = reader.get_int32();
+        string s = reader.get_string();
+
+        CPPUNIT_ASSERT(reader);
+        CPPUNIT_ASSERT_EQUAL(0x80000000U | 104, size);
+        CPPUNIT_ASSERT_EQUAL(string(100, 'X'), s);
+        CPPUNIT_ASSERT_EQUAL(0, m_sink.buffer().size());
+    }
+
+    void test_bytes_ref()
+    {
+        Shared_buffer data(new Buffer(string(3000, 'Y')));
+        Gather_sink sink;
+        Message_writer writer(sink);
+        writer.set_max_packet_size(1000);
+
+        writer.begin_message();
+        writer.put_int8(7);
+        writer.put_bytes_ref(data);
+        writer.end_message();
+
+        // 3005 bytes of data, in four packets; the 3000 bytes are shared,
+        // not copied.
+        Gather_list& list = sink.list();
+        CPPUNIT_ASSERT_EQUAL(3005 + 4*7, list.size());
+        int shared = 0;
+        for (int i = 0; i < list.num_segments(); i++) {
+            if (list.segment(i).m_buffer == data)
+                shared += list.segment(i).m_count;
+        }
+        CPPUNIT_ASSERT_EQUAL(3000, shared);
+        CPPUNIT_ASSERT_EQUAL(0, sink.num_buffers());
+
+        Buffer message = reassemble(list);
+        Data_reader reader(message);
+        CPPUNIT_ASSERT_EQUAL(7, int(reader.get_int8()));
+        CPPUNIT_ASSERT_EQUAL(string(3000, 'Y'), reader.get_string());
+        CPPUNIT_ASSERT(reader);
+        CPPUNIT_ASSERT_EQUAL(0, message.size());
+
+        list.clear();
+        CPPUNIT_ASSERT_EQUAL(1, data->ref_count());
+    }
+
+    void test_large_message()
+    {
+        // Larger than several chunks, with packet headers falling at
+        // assorted places in them; sent twice, so that the second message
+        // reuses the chunks of the first.
+        Gather_sink sink;
+        Message_writer writer(sink);
+        writer.set_max_packet_size(1001);
+
+        for (int pass = 0; pass < 2; pass++) {
+            writer.begin_message();
+            for (int i = 0; i < 20000; i++)
+                writer.put_int32(i);
+            writer.put_string(string(50000, 'Z'));
+            writer.end_message();
+
+            Buffer message = reassemble(sink.list());
+            Data_reader reader(message);
+            for (int i = 0; i < 20000; i++)
+                CPPUNIT_ASSERT_EQUAL(i, reader.get_int32());
+            CPPUNIT_ASSERT_EQUAL(string(50000, 'Z'), reader.get_string());
+            CPPUNIT_ASSERT(reader);
+            sink.list().clear();
+        }
+    }
+
+    void test_compression()
+    {
+        // In either format, a message at the threshold is compressed, and
+        // the reader restores it.
+        Message_framing const framings[] = { FRAMING_CHAINED, FRAMING_SINGLE };
+        string text;
+        for (int i = 0; i < 1000; i++)
+            text += "a message that compresses well; ";
+
+        for (int i = 0; i < 2; i++) {
+            Gather_sink sink;
+            Message_writer writer(sink);
+            writer.set_max_packet_size(1000);
+            writer.set_framing(framings[i]);
+            writer.set_compression_threshold(text.size() + 4);
+
+            writer.begin_message();
+            writer.put_string(text);
+            writer.end_message();
+            CPPUNIT_ASSERT(sink.list().size() < int(text.size())/10);
+
+            Buffer message = reassemble(sink.list());
+            CPPUNIT_ASSERT_EQUAL(text, Data_reader(message).get_string());
+
+            // A message below the threshold is sent as it is.
+            writer.begin_message();
+            writer.put_string(text.substr(1));
+            writer.end_message();
+            CPPUNIT_ASSERT(sink.list().size() > int(text.size()));
+        }
+    }
+
+    void test_incompressible()
+    {
+        // Data that do not shrink are sent uncompressed, and the writer's
+        // chunks are still recycled.
+        Gather_sink sink;
+        Message_writer writer(sink);
+        writer.set_compression_threshold(1);
+        string noise(5000, ' ');
+        for (unsigned i = 0; i < noise.size(); i++)
+            noise[i] = char(Random::next_int(256));
+
+        for (int pass = 0; pass < 2; pass++) {
+            writer.begin_message();
+            writer.put_string(noise);
+            writer.end_message();
+
+            Gather_list& list = sink.list();
+            CPPUNIT_ASSERT_EQUAL(5004 + 2*7, list.size());
+            Buffer message = reassemble(list);
+            CPPUNIT_ASSERT_EQUAL(noise, Data_reader(message).get_string());
+            list.clear();
+        }
+    }
+
+    void test_tiny_message()
+    {
+        // A message too small to compress is sent as it is, whatever the
+        // threshold.
+        Gather_sink sink;
+        Message_writer writer(sink);
+        writer.set_compression_threshold(1);
+        writer.begin_message();
+        writer.put_int8(50);
+        writer.end_message();
+
+        Gather_list& list = sink.list();
+        CPPUNIT_ASSERT_EQUAL(1 + 7, list.size());
+        Buffer message = reassemble(list);
+        CPPUNIT_ASSERT_EQUAL(50, int(Data_reader(message).get_int8()));
+    }
+
     CPPUNIT_TEST_SUITE(Message_writer_tests);
     CPPUNIT_TEST(test_capacity);
     CPPUNIT_TEST(test_empty_message);
@@ -276,6 +461,12 @@ class Message_writer_tests : public CppUnit::TestFixture {
     CPPUNIT_TEST(test_chained_message);
     CPPUNIT_TEST(test_chained_message_1);
     CPPUNIT_TEST(test_multiple_messages);
+    CPPUNIT_TEST(test_single_frame);
+    CPPUNIT_TEST(test_bytes_ref);
+    CPPUNIT_TEST(test_large_message);
+    CPPUNIT_TEST(test_compression);
+    CPPUNIT_TEST(test_incompressible);
+    CPPUNIT_TEST(test_tiny_message);
     CPPUNIT_TEST_SUITE_END();
 
   private:
@@ -0,0 +1,177 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/metrics.hpp"
+#include "ares/platform.hpp"
+#include "ares/thread.hpp"
+#include <vector>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+// Adds to a counter and records in a histogram many times, then counts
+// itself as finished.
+struct Adder : public Thread::Runnable {
+    Adder(Counter& counter, Histogram& histogram, Counter& finished)
+            : m_counter(counter)
+            , m_histogram(histogram)
+            , m_finished(finished)
+    {}
+
+    void run()
+    {
+        for (int i = 0; i < 100000; i++) {
+            m_counter.add(3);
+            m_histogram.record(i % 100);
+        }
+        m_finished.add();
+    }
+
+    Counter& m_counter;
+    Histogram& m_histogram;
+    Counter& m_finished;
+};
+}
+
+class Metrics_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_counter()
+    {
+        Counter c;
+        CPPUNIT_ASSERT_EQUAL(Int64(0), c.value());
+        c.add();
+        c.add(41);
+        CPPUNIT_ASSERT_EQUAL(Int64(42), c.value());
+
+        // Counters do not overflow at 2^31.
+        c.add(Int64(3) << 32);
+        CPPUNIT_ASSERT_EQUAL((Int64(3) << 32) + 42, c.value());
+    }
+
+    void test_threads()
+    {
+        int const NUM_THREADS = 6;
+        Counter counter;
+        Histogram histogram;
+        Counter finished;
+
+        Adder adder(counter, histogram, finished);
+        vector<Thread*> threads;
+        for (int i = 0; i < NUM_THREADS; i++) {
+            threads.push_back(new Thread(&adder));
+            threads.back()->start();
+        }
+        while (finished.value() < NUM_THREADS)
+            milli_sleep(10);
+        for (int i = 0; i < NUM_THREADS; i++)
+            delete threads[i];
+
+        CPPUNIT_ASSERT_EQUAL(Int64(NUM_THREADS)*300000, counter.value());
+        Histogram_snapshot s = histogram.snapshot();
+        CPPUNIT_ASSERT_EQUAL(Int64(NUM_THREADS)*100000, s.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(NUM_THREADS)*1000*4950, s.sum());
+    }
+
+    void test_buckets()
+    {
+        // Small values are exact.
+        for (int n = 0; n < Histogram::EXACT_LIMIT; n++) {
+            CPPUNIT_ASSERT_EQUAL(n, Histogram::bucket(n));
+            CPPUNIT_ASSERT_EQUAL(Int64(n), Histogram::bucket_limit(n));
+        }
+
+        // Larger values fall in buckets whose limit is within about 3% of
+        // them, and buckets are contiguous.
+        for (Int64 n = Histogram::EXACT_LIMIT; n < (Int64(1) << 40);
+             n += 1 + n/7)
+        {
+            int const b = Histogram::bucket(n);
+            Int64 const limit = Histogram::bucket_limit(b);
+            CPPUNIT_ASSERT(limit >= n);
+            CPPUNIT_ASSERT(limit - n <= n/32);
+            CPPUNIT_ASSERT_EQUAL(b, Histogram::bucket(limit));
+            CPPUNIT_ASSERT_EQUAL(b + 1, Histogram::bucket(limit + 1));
+        }
+
+        // Enormous and negative values are clamped.
+        CPPUNIT_ASSERT_EQUAL(int(Histogram::NUM_BUCKETS) - 1,
+                             Histogram::bucket(Int64(1) << 40));
+        CPPUNIT_ASSERT_EQUAL(int(Histogram::NUM_BUCKETS) - 1,
+                             Histogram::bucket(Int64(1) << 62));
+        CPPUNIT_ASSERT_EQUAL(0, Histogram::bucket(-5));
+    }
+
+    void test_percentiles()
+    {
+        Histogram h;
+        Histogram_snapshot empty = h.snapshot();
+        CPPUNIT_ASSERT_EQUAL(Int64(0), empty.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(0), empty.percentile(50));
+        CPPUNIT_ASSERT_EQUAL(0.0, empty.mean());
+
+        for (int i = 1; i <= 1000; i++)
+            h.record(i);
+        Histogram_snapshot s = h.snapshot();
+        CPPUNIT_ASSERT_EQUAL(Int64(1000), s.count());
+        CPPUNIT_ASSERT_EQUAL(500.5, s.mean());
+        CPPUNIT_ASSERT_EQUAL(Int64(1), s.percentile(0));
+        CPPUNIT_ASSERT_EQUAL(Int64(10), s.percentile(1));
+        assert_near(500, s.percentile(50));
+        assert_near(990, s.percentile(99));
+        assert_near(1000, s.max());
+        CPPUNIT_ASSERT(s.max() >= 1000);
+    }
+
+    void test_intervals()
+    {
+        Histogram h;
+        h.record(10);
+        h.record(20);
+        Histogram_snapshot before = h.snapshot();
+
+        h.record(5000);
+        h.record(7000);
+        Histogram_snapshot after = h.snapshot();
+        Histogram_snapshot window = after;
+        window -= before;
+        CPPUNIT_ASSERT_EQUAL(Int64(2), window.count());
+        CPPUNIT_ASSERT_EQUAL(Int64(12000), window.sum());
+        assert_near(5000, window.percentile(50));
+        assert_near(7000, window.max());
+
+        window += before;
+        CPPUNIT_ASSERT_EQUAL(after.count(), window.count());
+        CPPUNIT_ASSERT_EQUAL(after.sum(), window.sum());
+        CPPUNIT_ASSERT_EQUAL(Int64(10), window.percentile(0));
+    }
+
+    CPPUNIT_TEST_SUITE(Metrics_tests);
+    CPPUNIT_TEST(test_counter);
+    CPPUNIT_TEST(test_threads);
+    CPPUNIT_TEST(test_buckets);
+    CPPUNIT_TEST(test_percentiles);
+    CPPUNIT_TEST(test_intervals);
+    CPPUNIT_TEST_SUITE_END();
+
+  private:
+    // Asserts that a reported value is within a bucket's width of n.
+    static void assert_near(Int64 n, Int64 reported)
+    {
+        CPPUNIT_ASSERT(reported >= n && reported - n <= n/32 + 1);
+    }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Metrics_tests);
@@ -0,0 +1,170 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/command.hpp"
+#include "ares/platform.hpp"
+#include "ares/processor_scaler.hpp"
+#include "ares/server.hpp"
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+Processor_scaling make_scaling()
+{
+    Processor_scaling scaling;
+    scaling.m_min_processors = 2;
+    scaling.m_max_processors = 10;
+    scaling.m_grow_queue_depth = 4;
+    scaling.m_grow_utilization = 0.9;
+    scaling.m_shrink_utilization = 0.3;
+    scaling.m_grow_samples = 2;
+    scaling.m_shrink_samples = 3;
+    return scaling;
+}
+
+// A command that keeps a processor busy for a while.
+class Sleep_command : public Command {
+  public:
+    void execute(Server_interface&, int) { milli_sleep(20); }
+};
+}
+
+class Processor_scaler_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_limits()
+    {
+        Processor_scaling scaling;
+        scaling.m_min_processors = 0;
+        scaling.m_max_processors = -5;
+        Processor_scaler scaler(scaling);
+        CPPUNIT_ASSERT_EQUAL(1, scaler.scaling().m_min_processors);
+        CPPUNIT_ASSERT_EQUAL(1, scaler.scaling().m_max_processors);
+
+        // A pool outside the limits is corrected at once.
+        Processor_scaler other(make_scaling());
+        CPPUNIT_ASSERT_EQUAL(2, other.sample(0, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(10, other.sample(12, 100, 1));
+    }
+
+    void test_grow()
+    {
+        Processor_scaler scaler(make_scaling());
+
+        // Growth takes two overloaded samples in a row, and doubles the
+        // pool up to the maximum.
+        CPPUNIT_ASSERT_EQUAL(2, scaler.sample(2, 8, 0.5));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(2, 8, 0.5));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 1, 0.95));
+        CPPUNIT_ASSERT_EQUAL(8, scaler.sample(4, 1, 0.95));
+        CPPUNIT_ASSERT_EQUAL(8, scaler.sample(8, 100, 1));
+        CPPUNIT_ASSERT_EQUAL(10, scaler.sample(8, 100, 1));
+        CPPUNIT_ASSERT_EQUAL(10, scaler.sample(10, 100, 1));
+        CPPUNIT_ASSERT_EQUAL(10, scaler.sample(10, 100, 1));
+
+        // An ordinary sample breaks the run.
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 16, 0.5));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 15, 0.5));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 16, 0.5));
+        CPPUNIT_ASSERT_EQUAL(8, scaler.sample(4, 16, 0.5));
+
+        // Busy processors with nothing waiting are not overloaded.
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 0, 1));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 0, 1));
+    }
+
+    void test_shrink()
+    {
+        Processor_scaler scaler(make_scaling());
+
+        // Shrinking takes three underloaded samples in a row, and removes
+        // one processor at a time down to the minimum.
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 0, 0.1));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(4, 0, 0.3));
+        CPPUNIT_ASSERT_EQUAL(3, scaler.sample(4, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(3, scaler.sample(3, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(3, scaler.sample(3, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(2, scaler.sample(3, 0, 0));
+        for (int i = 0; i < 10; i++)
+            CPPUNIT_ASSERT_EQUAL(2, scaler.sample(2, 0, 0));
+
+        // A waiting command or a moderate load breaks the run.
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 1, 0));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0.5));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(5, scaler.sample(5, 0, 0));
+        CPPUNIT_ASSERT_EQUAL(4, scaler.sample(5, 0, 0));
+    }
+
+    void test_server()
+    {
+        Processor_scaling scaling;
+        scaling.m_min_processors = 1;
+        scaling.m_max_processors = 4;
+        scaling.m_sample_millis = 10;
+        scaling.m_grow_samples = 1;
+        scaling.m_shrink_samples = 3;
+
+        Server server;
+        server.set_processor_scaling(scaling);
+        server.startup();
+        CPPUNIT_ASSERT_EQUAL(1, server.num_processors());
+
+        // A backlog of commands grows the pool to the maximum.
+        for (int i = 0; i < 200; i++)
+            server.enqueue_command(new Sleep_command);
+        for (int i = 0; i < 200 && server.num_processors() < 4; i++)
+            milli_sleep(10);
+        CPPUNIT_ASSERT_EQUAL(4, server.num_processors());
+        for (int i = 0; i < 500 && server.totals().m_queued_commands_snap > 0;
+             i++)
+        {
+            milli_sleep(10);
+        }
+        Int64 const busy = server.totals().m_busy_micros;
+
+        // Once the backlog is gone, the pool shrinks to the minimum, one
+        // processor at a time. (Each change is counted after it is made.)
+        for (int i = 0; i < 500 && server.totals().m_processor_shrinks < 3;
+             i++)
+        {
+            milli_sleep(10);
+        }
+        CPPUNIT_ASSERT_EQUAL(1, server.num_processors());
+
+        Server_statistics const stats = server.totals();
+        CPPUNIT_ASSERT(stats.m_processor_grows >= 2);
+        CPPUNIT_ASSERT_EQUAL(Int64(3), stats.m_processor_shrinks);
+        CPPUNIT_ASSERT(stats.m_busy_micros > 0);
+
+        // The time spent by the removed processors is still counted.
+        CPPUNIT_ASSERT(stats.m_busy_micros >= busy);
+
+        server.shutdown();
+    }
+
+    CPPUNIT_TEST_SUITE(Processor_scaler_tests);
+    CPPUNIT_TEST(test_limits);
+    CPPUNIT_TEST(test_grow);
+    CPPUNIT_TEST(test_shrink);
+    CPPUNIT_TEST(test_server);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Processor_scaler_tests);
@@ -18,7 +18,80 @@ class String_util_tests : public CppUnit::TestFixture {
     void setUp() {}
     void tearDown() {}
 
+    void test_hash_bytes()
+    {
+        // Every prefix of a string, and every string differing from it in
+        // one byte, should hash differently; the same bytes at a different
+        // address should hash the same.
+
+        string s;
+        for (int i = 0; i < 200; i++)
+            s += char('a' + i % 26);
+
+        for (int n = 0; n <= int(s.size()); n++) {
+            string t = s.substr(0, n);
+            Uint64 h = hash_bytes(t.data(), n);
+            CPPUNIT_ASSERT(h == hash_bytes(s.data(), n));
+            CPPUNIT_ASSERT(h != hash_bytes(s.data(), n + 1));
+            for (int i = 0; i < n; i++) {
+                string u = t;
+                u[i] ^= 1;
+                CPPUNIT_ASSERT(h != hash_bytes(u.data(), n));
+            }
+        }
+    }
+
+    void test_hash_seed()
+    {
+        string s = "session-12345";
+        CPPUNIT_ASSERT(hash_bytes(s.data(), s.size(), 1) !=
+                       hash_bytes(s.data(), s.size(), 2));
+        CPPUNIT_ASSERT(Hash_string(7)(s) == hash_bytes(s.data(), s.size(), 7));
+    }
+
+    void test_hash_ignore_case()
+    {
+        // Strings that differ only in case must hash the same, whatever
+        // their length; other strings should not.
+
+        string lower, upper;
+        for (int i = 0; i < 100; i++) {
+            lower += char('a' + i % 26);
+            upper += char('A' + i % 26);
+        }
+
+        Hash_string_ignore_case hash;
+        Equal_string_ignore_case equal;
+        for (int n = 0; n <= 100; n++) {
+            string a = lower.substr(0, n), b = upper.substr(0, n);
+            CPPUNIT_ASSERT(equal(a, b));
+            CPPUNIT_ASSERT_EQUAL(hash(a), hash(b));
+            CPPUNIT_ASSERT(Hash_string()(a) == hash(a));
+
+            // '@' and '[' lie just outside 'A'-'Z'; '`' and '{', 'a'-'z'.
+            if (n > 0) {
+                string c = a;
+                c[n - 1] = '@';
+                string d = a;
+                d[n - 1] = '`';
+                CPPUNIT_ASSERT(hash(c) != hash(d));
+                c[n - 1] = '[';
+                d[n - 1] = '{';
+                CPPUNIT_ASSERT(hash(c) != hash(d));
+                CPPUNIT_ASSERT(!equal(c, d));
+            }
+        }
+
+        // Only ASCII letters are folded, and every byte is compared.
+        CPPUNIT_ASSERT(!equal("\xc9t\xe9", "\xe9t\xe9"));
+        CPPUNIT_ASSERT(equal(string("ab\0cd", 5), string("AB\0CD", 5)));
+        CPPUNIT_ASSERT(!equal(string("ab\0cd", 5), string("ab\0ce", 5)));
+    }
+
     CPPUNIT_TEST_SUITE(String_util_tests);
+    CPPUNIT_TEST(test_hash_bytes);
+    CPPUNIT_TEST(test_hash_seed);
+    CPPUNIT_TEST(test_hash_ignore_case);
     CPPUNIT_TEST_SUITE_END();
 };
 
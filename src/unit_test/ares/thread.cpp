@@ -0,0 +1,135 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/platform.hpp"
+#include "ares/thread.hpp"
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+// Records the cpu it runs on, then waits to be told to exit.
+class Cpu_recorder : public Thread::Runnable {
+  public:
+    Cpu_recorder() : m_cpu(-2), m_stopped(false) {}
+
+    void run()
+    {
+        m_cpu = current_cpu();
+        while (!m_stopped)
+            milli_sleep(1);
+    }
+
+    int volatile m_cpu;
+    bool volatile m_stopped;
+};
+
+Cpu_set cpus(int first, int last)
+{
+    Cpu_set s;
+    for (int cpu = first; cpu <= last; cpu++)
+        s.insert(cpu);
+    return s;
+}
+}
+
+class Thread_tests : public CppUnit::TestFixture {
+  public:
+    void setUp() {}
+
+    void tearDown() {}
+
+    void test_parse_cpu_list()
+    {
+        CPPUNIT_ASSERT(parse_cpu_list("").empty());
+        CPPUNIT_ASSERT(parse_cpu_list("  ").empty());
+        CPPUNIT_ASSERT(parse_cpu_list("3") == cpus(3, 3));
+        CPPUNIT_ASSERT(parse_cpu_list("0-3") == cpus(0, 3));
+
+        Cpu_set expected = cpus(0, 3);
+        expected.insert(8);
+        expected.insert(10);
+        expected.insert(11);
+        CPPUNIT_ASSERT(parse_cpu_list("0-3,8,10-11") == expected);
+        CPPUNIT_ASSERT(parse_cpu_list(" 10-11, 8 ,2-3,0-1 ") == expected);
+
+        char const* const bad[] = { ",", "1,", "-1", "3-1", "1-", "a",
+                                    "1 2", "1;2", "99999999999" };
+        for (int i = 0; i < int(sizeof(bad)/sizeof(bad[0])); i++) {
+            try {
+                parse_cpu_list(bad[i]);
+                CPPUNIT_ASSERT(false);
+            }
+            catch (Invalid_cpu_list_error&) {}
+        }
+    }
+
+    void test_format_cpu_list()
+    {
+        CPPUNIT_ASSERT_EQUAL(string(""), format_cpu_list(Cpu_set()));
+        CPPUNIT_ASSERT_EQUAL(string("5"), format_cpu_list(cpus(5, 5)));
+        CPPUNIT_ASSERT_EQUAL(string("0-3,8,10-11"),
+                             format_cpu_list(parse_cpu_list("10,11,8,0-3")));
+    }
+
+    void test_affinity()
+    {
+        Cpu_recorder recorder;
+        Thread thread(&recorder);
+
+        // Binds the thread to the first cpu this process may use.
+        thread.set_affinity(cpus(0, CPU_SETSIZE - 1));
+        thread.start();
+        while (recorder.m_cpu == -2)
+            milli_sleep(1);
+        Cpu_set const allowed = thread.current_affinity();
+        CPPUNIT_ASSERT(!allowed.empty());
+
+        Cpu_set const first = cpus(*allowed.begin(), *allowed.begin());
+        thread.set_affinity(first);
+        CPPUNIT_ASSERT(thread.affinity() == first);
+        CPPUNIT_ASSERT(thread.current_affinity() == first);
+
+        thread.set_affinity(Cpu_set());
+        CPPUNIT_ASSERT(thread.affinity().empty());
+        CPPUNIT_ASSERT(thread.current_affinity() == allowed);
+
+        recorder.m_stopped = true;
+        thread.wait_for_exit(0);
+        CPPUNIT_ASSERT(thread.current_affinity().empty());
+
+        // A thread bound before it starts runs only on its cpus.
+        recorder.m_cpu = -2;
+        recorder.m_stopped = false;
+        thread.set_affinity(first);
+        thread.start();
+        while (recorder.m_cpu == -2)
+            milli_sleep(1);
+        CPPUNIT_ASSERT(recorder.m_cpu == -1
+                       || recorder.m_cpu == *first.begin());
+        recorder.m_stopped = true;
+        thread.wait_for_exit(0);
+
+        try {
+            thread.set_affinity(cpus(CPU_SETSIZE, CPU_SETSIZE));
+            CPPUNIT_ASSERT(false);
+        }
+        catch (Invalid_cpu_list_error&) {}
+    }
+
+    CPPUNIT_TEST_SUITE(Thread_tests);
+    CPPUNIT_TEST(test_parse_cpu_list);
+    CPPUNIT_TEST(test_format_cpu_list);
+    CPPUNIT_TEST(test_affinity);
+    CPPUNIT_TEST_SUITE_END();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Thread_tests);
@@ -0,0 +1,220 @@
+// Copyright (C) 2002-2007 Daniel Cowgill
+//
+// Usage of the works is permitted provided that this instrument is retained
+// with the works, so that any entity that uses the works is notified of this
+// instrument.
+//
+// DISCLAIMER: THE WORKS ARE WITHOUT WARRANTY.
+
+#include "cppunit/TestFixture.h"
+#include "cppunit/extensions/HelperMacros.h"
+#include "ares/buffer.hpp"
+#include "ares/platform.hpp"
+#include "ares/server.hpp"
+#include "ares/traffic_capture.hpp"
+#include "ares/traffic_replay.hpp"
+#include <deque>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ares;
+
+namespace
+{
+Byte const* bytes(char const* s)
+{
+    return reinterpret_cast<Byte const*>(s);
+}
+
+// A session that echoes its input, and remembers it.
+class Recording_session : public Session_rep {
+  public:
+    Recording_session(Server_interface& server, Socket* socket,
+                      string& received, bool& shut_down)
+            : Session_rep(server, socket)
+            , m_received(received)
+            , m_shut_down(shut_down)
+    {}
+
+  private:
+    bool do_handle_input(Buffer& input)
+    {
+        m_received.append(reinterpret_cast<char const*>(input.begin()),
+                          input.size());
+        send(input);
+        input.consume(input.size());
+        return m_received.find("quit") == string::npos;
+    }
+
+    void do_handle_shutdown() { m_shut_down = true; }
+
+    string& m_received;
+    bool& m_shut_down;
+};
+
+class Recording_factory : public Traffic_replay::Session_factory {
+  public:
+    Session_rep* create(Server_interface& server, Socket* socket,
+                        string const& description)
+    {
+        m_descriptions.push_back(description);
+        m_received.push_back("");
+        m_shut_down.push_back(false);
+        return new Recording_session(server, socket, m_received.back(),
+                                     m_shut_down.back());
+    }
+
+    // (deques, so that references to their elements stay valid)
+    deque<string> m_descriptions;
+    deque<string> m_received;
+    deque<bool> m_shut_down;
+};
+}
+
+class Traffic_capture_tests : public CppUnit::TestFixture {
+  public:
+    void setUp()
+    {
+        m_path = "/tmp/traffic_capture_test." + system_process_id();
+    }
+
+    void tearDown()
+    {
+        unlink(m_path.c_str());
+    }
+
+    void test_round_trip()
+    {
+        vector<Byte> large(100000);
+        for (int i = 0; i < int(large.size()); i++)
+            large[i] = Byte(i*7);
+
+        Int64 const started = current_time_millis();
+        {
+            Traffic_capture capture(m_path);
+            capture.record_open(7, "7@10.0.0.1:4000");
+            capture.record_input(7, bytes("hello"), 5);
+            capture.record_open(300, "300@10.0.0.2:4001");
+            capture.record_input(300, &large[0], large.size());
+            capture.record_close(7);
+            CPPUNIT_ASSERT(capture.bytes_written() > 100000);
+        }
+
+        Traffic_reader reader(m_path);
+        CPPUNIT_ASSERT(reader.started() >= started);
+        CPPUNIT_ASSERT(reader.started() <= current_time_millis());
+
+        Traffic_record r;
+        CPPUNIT_ASSERT(reader.next(r));
+        CPPUNIT_ASSERT_EQUAL(TRAFFIC_OPEN, r.m_type);
+        CPPUNIT_ASSERT_EQUAL(7, r.m_session_id);
+        CPPUNIT_ASSERT_EQUAL(string("7@10.0.0.1:4000"), r.m_description);
+        Int64 time = r.m_time;
+
+        CPPUNIT_ASSERT(reader.next(r));
+        CPPUNIT_ASSERT_EQUAL(TRAFFIC_INPUT, r.m_type);
+        CPPUNIT_ASSERT_EQUAL(7, r.m_session_id);
+        CPPUNIT_ASSERT(r.m_data == vector<Byte>(bytes("hello"),
+                                                bytes("hello") + 5));
+        CPPUNIT_ASSERT(r.m_time >= time);
+        time = r.m_time;
+
+        CPPUNIT_ASSERT(reader.next(r));
+        CPPUNIT_ASSERT_EQUAL(TRAFFIC_OPEN, r.m_type);
+        CPPUNIT_ASSERT_EQUAL(300, r.m_session_id);
+        CPPUNIT_ASSERT(reader.next(r));
+        CPPUNIT_ASSERT_EQUAL(TRAFFIC_INPUT, r.m_type);
+        CPPUNIT_ASSERT(r.m_data == large);
+
+        CPPUNIT_ASSERT(reader.next(r));
+        CPPUNIT_ASSERT_EQUAL(TRAFFIC_CLOSE, r.m_type);
+        CPPUNIT_ASSERT_EQUAL(7, r.m_session_id);
+        CPPUNIT_ASSERT(r.m_time >= time);
+
+        CPPUNIT_ASSERT(!reader.next(r));
+    }
+
+    void test_corrupt()
+    {
+        Int64 size = 0;
+        {
+            Traffic_capture capture(m_path);
+            capture.record_open(1, "1@10.0.0.1:4000");
+            capture.record_input(1, bytes("hello"), 5);
+            size = capture.bytes_written();
+        }
+
+        // A record cut short.
+        CPPUNIT_ASSERT_EQUAL(0, truncate(m_path.c_str(), size - 2));
+        Traffic_reader reader(m_path);
+        Traffic_record r;
+        CPPUNIT_ASSERT(reader.next(r));
+        try {
+            reader.next(r);
+            CPPUNIT_ASSERT(false);
+        }
+        catch (Traffic_capture_corrupt_error&) {}
+
+        // Not a capture file at all.
+        FILE* fp = fopen(m_path.c_str(), "wb");
+        fputs("GET / HTTP/1.0\r\n\r\n", fp);
+        fclose(fp);
+        try {
+            Traffic_reader other(m_path);
+            CPPUNIT_ASSERT(false);
+        }
+        catch (Traffic_capture_corrupt_error&) {}
+    }
+
+    void test_replay()
+    {
+        {
+            Traffic_capture capture(m_path);
+            capture.record_open(1, "1@10.0.0.1:4000");
+            capture.record_input(1, bytes("ab"), 2);
+            capture.record_open(2, "2@10.0.0.2:4001");
+            capture.record_input(2, bytes("xyz"), 3);
+            capture.record_input(1, bytes("cd"), 2);
+            capture.record_close(1);
+            capture.record_open(3, "3@10.0.0.3:4002");
+            capture.record_input(3, bytes("quit"), 4);
+            capture.record_input(3, bytes("ignored"), 7);
+            capture.record_input(4, bytes("unknown"), 7);
+        }
+
+        Server server;
+        Recording_factory factory;
+        Traffic_replay replay(server, factory);
+        Traffic_replay_statistics stats = replay.run(m_path);
+
+        CPPUNIT_ASSERT_EQUAL(3, stats.m_sessions);
+        CPPUNIT_ASSERT_EQUAL(Int64(4), stats.m_inputs);
+        CPPUNIT_ASSERT_EQUAL(Int64(11), stats.m_bytes_replayed);
+        CPPUNIT_ASSERT_EQUAL(Int64(11), stats.m_bytes_sent);
+        CPPUNIT_ASSERT_EQUAL(Int64(4), stats.m_input_latency.count());
+
+        CPPUNIT_ASSERT_EQUAL(3, int(factory.m_descriptions.size()));
+        CPPUNIT_ASSERT_EQUAL(string("2@10.0.0.2:4001"),
+                             factory.m_descriptions[1]);
+        CPPUNIT_ASSERT_EQUAL(string("abcd"), factory.m_received[0]);
+        CPPUNIT_ASSERT_EQUAL(string("xyz"), factory.m_received[1]);
+        CPPUNIT_ASSERT_EQUAL(string("quit"), factory.m_received[2]);
+
+        // Every session is shut down: by its close record, by returning
+        // false from handle_input, or at the end of the replay.
+        for (int i = 0; i < 3; i++)
+            CPPUNIT_ASSERT(factory.m_shut_down[i]);
+    }
+
+    CPPUNIT_TEST_SUITE(Traffic_capture_tests);
+    CPPUNIT_TEST(test_round_trip);
+    CPPUNIT_TEST(test_corrupt);
+    CPPUNIT_TEST(test_replay);
+    CPPUNIT_TEST_SUITE_END();
+
+  private:
+    string m_path;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Traffic_capture_tests);